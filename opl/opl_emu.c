@@ -11,7 +11,10 @@
 // MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
 // GNU General Public License for more details.
 
+#include <SDL3/SDL.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "doomtype.h"
 #include "opl.h"
@@ -68,6 +71,29 @@ static opl_timer_t timer2 = { 3125, 0, 0, 0 };
 
 static int mixing_channels;
 
+// [Woof!] Every chip renders a whole slice between two callbacks into its
+// own buffer before the buffers are mixed. A chip only depends on its own
+// registers within a slice, so with several chips the slices of all but
+// the first are rendered by chip threads while the caller renders chip 0.
+
+#define OPL_MIN_THREADED_SAMPLES 64
+
+static Bit16s *chip_buffers[OPL_MAX_CHIPS];
+static unsigned int chip_buffer_samples;
+static boolean chip_rendered[OPL_MAX_CHIPS];
+
+static SDL_Thread *chip_threads[OPL_MAX_CHIPS];
+static int chip_generations[OPL_MAX_CHIPS];
+static int num_chip_threads;
+
+static SDL_Mutex *render_lock;
+static SDL_Condition *render_wake;
+static SDL_Condition *render_done;
+static boolean render_quit;
+static int render_generation;
+static int render_pending;
+static unsigned int render_samples;
+
 // Advance time by the specified number of samples, invoking any
 // callback functions as appropriate.
 
@@ -137,12 +163,224 @@ static void ResyncChip (int chip)
 }
 
 
+// Generate a slice of samples from a chip. Returns false if the chip was
+// idle for all of it, in which case the buffer is left untouched.
+
+static boolean RenderChip(int c, unsigned int nsamples)
+{
+    opl3_chip *chip = &opl_chips[c];
+    Bit16s *cursor = chip_buffers[c];
+    boolean rendered = false;
+
+    for (unsigned int s = 0; s < nsamples; ++s)
+    {
+        // Keyed-on chips never time out
+        if (opl_chip_keys[c])
+            opl_chip_timeouts[c] = 0;
+
+        // Run the chip if it's active or if it has pending register writes
+        if (opl_chip_timeouts[c] < OPL_CHIP_TIMEOUT || (chip->writebuf[chip->writebuf_cur].reg & 0x200))
+        {
+            if (!rendered)
+            {
+                memset(chip_buffers[c], 0, s * 2 * sizeof(Bit16s));
+                rendered = true;
+            }
+
+            OPL3_Generate(chip, cursor);
+
+            // Reset chip timeout if it breaks the silence threshold
+            if (MAX(abs(cursor[0]), abs(cursor[1])) > OPL_SILENCE_THRESHOLD)
+                opl_chip_timeouts[c] = 0;
+            else
+                opl_chip_timeouts[c]++;
+        }
+        else if (rendered)
+        {
+            cursor[0] = cursor[1] = 0;
+        }
+
+        cursor += 2;
+    }
+
+    return rendered;
+}
+
+static int ChipThread(void *arg)
+{
+    const int c = (int)(intptr_t)arg;
+
+    // the music thread waits for this one, see PlayerThread()
+    SDL_SetCurrentThreadPriority(SDL_THREAD_PRIORITY_TIME_CRITICAL);
+
+    SDL_LockMutex(render_lock);
+
+    while (true)
+    {
+        while (!render_quit && chip_generations[c] == render_generation)
+        {
+            SDL_WaitCondition(render_wake, render_lock);
+        }
+
+        if (render_quit)
+        {
+            break;
+        }
+
+        chip_generations[c] = render_generation;
+        SDL_UnlockMutex(render_lock);
+
+        chip_rendered[c] = RenderChip(c, render_samples);
+
+        SDL_LockMutex(render_lock);
+        if (--render_pending == 0)
+        {
+            SDL_SignalCondition(render_done);
+        }
+    }
+
+    SDL_UnlockMutex(render_lock);
+
+    return 0;
+}
+
+static void ShutdownChipThreads(void)
+{
+    if (!render_lock)
+    {
+        return;
+    }
+
+    SDL_LockMutex(render_lock);
+    render_quit = true;
+    SDL_BroadcastCondition(render_wake);
+    SDL_UnlockMutex(render_lock);
+
+    for (int i = 0; i < num_chip_threads; ++i)
+    {
+        SDL_WaitThread(chip_threads[i], NULL);
+    }
+
+    SDL_DestroyCondition(render_done);
+    SDL_DestroyCondition(render_wake);
+    SDL_DestroyMutex(render_lock);
+    render_done = render_wake = NULL;
+    render_lock = NULL;
+
+    num_chip_threads = 0;
+}
+
+// One thread for each chip after the first. Without them all chips are
+// rendered by the caller.
+
+static void InitChipThreads(void)
+{
+    num_chip_threads = 0;
+    render_quit = false;
+
+    if (num_opl_chips <= 1 || SDL_GetNumLogicalCPUCores() <= 1)
+    {
+        return;
+    }
+
+    render_lock = SDL_CreateMutex();
+    render_wake = SDL_CreateCondition();
+    render_done = SDL_CreateCondition();
+
+    if (!render_lock || !render_wake || !render_done)
+    {
+        SDL_DestroyCondition(render_done);
+        SDL_DestroyCondition(render_wake);
+        SDL_DestroyMutex(render_lock);
+        render_done = render_wake = NULL;
+        render_lock = NULL;
+        return;
+    }
+
+    for (int c = 1; c < num_opl_chips; ++c)
+    {
+        chip_generations[c] = render_generation;
+        chip_threads[num_chip_threads] =
+            SDL_CreateThread(ChipThread, "woof opl chip", (void *)(intptr_t)c);
+
+        if (!chip_threads[num_chip_threads])
+        {
+            break;
+        }
+
+        num_chip_threads++;
+    }
+
+    // Every chip needs its thread, otherwise the caller renders them all
+    if (num_chip_threads < num_opl_chips - 1)
+    {
+        ShutdownChipThreads();
+    }
+}
+
+static void RenderChips(unsigned int nsamples)
+{
+    const boolean threaded = num_chip_threads > 0
+                             && nsamples >= OPL_MIN_THREADED_SAMPLES;
+
+    // Check for chip activations before we generate the slice. Keys only
+    // change in callbacks, so a chip can't be activated in the middle of it.
+    for (int c = 0; c < num_opl_chips; ++c)
+    {
+        // Reset chip timeout if any channels are active
+        if (opl_chip_keys[c])
+        {
+            // Resync is necessary if the chip was idle
+            if (opl_chip_timeouts[c] >= OPL_CHIP_TIMEOUT)
+                ResyncChip(c);
+            opl_chip_timeouts[c] = 0;
+        }
+    }
+
+    if (threaded)
+    {
+        SDL_LockMutex(render_lock);
+        render_samples = nsamples;
+        render_pending = num_chip_threads;
+        render_generation++;
+        SDL_BroadcastCondition(render_wake);
+        SDL_UnlockMutex(render_lock);
+
+        chip_rendered[0] = RenderChip(0, nsamples);
+
+        SDL_LockMutex(render_lock);
+        while (render_pending)
+        {
+            SDL_WaitCondition(render_done, render_lock);
+        }
+        SDL_UnlockMutex(render_lock);
+    }
+    else
+    {
+        for (int c = 0; c < num_opl_chips; ++c)
+        {
+            chip_rendered[c] = RenderChip(c, nsamples);
+        }
+    }
+}
+
 // Callback function to fill a new sound buffer:
 
 int OPL_FillBuffer(byte *buffer, int buffer_samples)
 {
     unsigned int filled;
 
+    if (buffer_samples > chip_buffer_samples)
+    {
+        chip_buffer_samples = buffer_samples;
+
+        for (int c = 0; c < OPL_MAX_CHIPS; ++c)
+        {
+            chip_buffers[c] = realloc(chip_buffers[c],
+                                      chip_buffer_samples * 2 * sizeof(Bit16s));
+        }
+    }
+
     // Repeatedly call the OPL emulator update function until the buffer is
     // full.
     filled = 0;
@@ -174,48 +412,30 @@ int OPL_FillBuffer(byte *buffer, int buffer_samples)
         }
 
         // Add emulator output to buffer.
-        Bit16s *cursor = (Bit16s *)(buffer + filled * 4);
-        for (int s = 0; s < nsamples; ++s)
+        if (nsamples > 0)
         {
-            // Check for chip activations before we generate the sample
+            Bit16s *cursor = (Bit16s *)(buffer + filled * 4);
+            int chips[OPL_MAX_CHIPS];
+            int num_chips = 0;
+
+            RenderChips(nsamples);
+
             for (int c = 0; c < num_opl_chips; ++c)
             {
-                // Reset chip timeout if any channels are active
-                if (opl_chip_keys[c])
-                {
-                    // Resync is necessary if the chip was idle
-                    if (opl_chip_timeouts[c] >= OPL_CHIP_TIMEOUT)
-                        ResyncChip(c);
-                    opl_chip_timeouts[c] = 0;
-                }
+                if (chip_rendered[c])
+                    chips[num_chips++] = c;
             }
 
-            // Generate a sample from each chip and mix them
-            Bit32s mix[2] = {0, 0};
-            for (int c = 0; c < num_opl_chips; ++c)
+            // Mix the chips that weren't idle
+            for (int s = 0; s < nsamples * 2; ++s)
             {
-                // Run the chip if it's active or if it has pending register writes
-                if (opl_chip_timeouts[c] < OPL_CHIP_TIMEOUT || (opl_chips[c].writebuf[opl_chips[c].writebuf_cur].reg & 0x200))
-                {
-                    Bit16s sample[2];
-                    OPL3_Generate(&opl_chips[c], sample);
-                    mix[0] += sample[0];
-                    mix[1] += sample[1];
-
-                    // Reset chip timeout if it breaks the silence threshold
-                    if (MAX(abs(sample[0]), abs(sample[1])) > OPL_SILENCE_THRESHOLD)
-                        opl_chip_timeouts[c] = 0;
-                    else
-                        opl_chip_timeouts[c]++;
-                }
+                Bit32s mix = 0;
+                for (int i = 0; i < num_chips; ++i)
+                    mix += chip_buffers[chips[i]][s];
+                cursor[s] = CLAMP(mix, -32768, 32767);
             }
-
-            cursor[0] = CLAMP(mix[0], -32768, 32767);
-            cursor[1] = CLAMP(mix[1], -32768, 32767);
-            cursor += 2;
         }
 
-        //OPL3_GenerateStream(&opl_chip, (Bit16s *)(buffer + filled * 4), nsamples);
         filled += nsamples;
 
         // Invoke callbacks for this point in time.
@@ -228,6 +448,8 @@ int OPL_FillBuffer(byte *buffer, int buffer_samples)
 
 static void OPL_EMU_Shutdown(void)
 {
+    ShutdownChipThreads();
+
     OPL_Queue_Destroy(callback_queue);
 
 /*
@@ -266,6 +488,8 @@ static int OPL_EMU_Init(unsigned int port_base, int num_chips)
         opl_chip_timeouts[c] = OPL_CHIP_TIMEOUT;
     }
 
+    InitChipThreads();
+
     return 1;
 }
 
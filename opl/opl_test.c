@@ -0,0 +1,132 @@
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 2
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Golden output test of the OPL emulator. Plays a pseudo-random
+//     stream of register writes through the chips, in buffers of varying
+//     size, and compares a checksum of the samples with the one of the
+//     emulator before it rendered in blocks and in parallel.
+//
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "opl.h"
+#include "opl_internal.h"
+
+#define NUM_BUFFERS 300
+#define MAX_SAMPLES 4096
+
+int num_opl_chips;
+
+static unsigned int seed = 1;
+
+static unsigned int Random(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+// Writes some registers, now and then keys off every voice, and sets the
+// next callback, sometimes within the same sample.
+
+static void WriteRegisters(void *unused)
+{
+    for (int i = 0; i < 20; ++i)
+    {
+        int chip = Random() % num_opl_chips;
+        int reg = Random() % 0x100;
+        opl_port_t port;
+
+        if (Random() % 4 == 0)
+        {
+            reg = OPL_REGS_FREQ_2 + Random() % 9;
+        }
+
+        port = (Random() & 1) ? OPL_REGISTER_PORT : OPL_REGISTER_PORT_OPL3;
+
+        opl_emu_driver.write_port_func(chip, port, reg);
+        opl_emu_driver.write_port_func(chip, OPL_DATA_PORT, Random() & 0xff);
+    }
+
+    if (Random() % 50 == 0)
+    {
+        for (int c = 0; c < num_opl_chips; ++c)
+        {
+            for (int i = 0; i < 9; ++i)
+            {
+                opl_emu_driver.write_port_func(c, OPL_REGISTER_PORT,
+                                               OPL_REGS_FREQ_2 + i);
+                opl_emu_driver.write_port_func(c, OPL_DATA_PORT, 0);
+            }
+        }
+    }
+
+    opl_emu_driver.set_callback_func(Random() % 20000, WriteRegisters, NULL);
+}
+
+// FNV-1a
+
+static uint64_t Checksum(uint64_t hash, const unsigned char *data, int size)
+{
+    for (int i = 0; i < size; ++i)
+    {
+        hash = (hash ^ data[i]) * 0x100000001b3;
+    }
+
+    return hash;
+}
+
+int main(int argc, char **argv)
+{
+    static unsigned char buffer[MAX_SAMPLES * 4];
+    uint64_t hash = 0xcbf29ce484222325;
+    uint64_t expected;
+
+    if (argc != 3)
+    {
+        fprintf(stderr, "Usage: %s <chips> <checksum>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    num_opl_chips = atoi(argv[1]);
+    expected = strtoull(argv[2], NULL, 16);
+
+    if (!opl_emu_driver.init_func(0, num_opl_chips))
+    {
+        fprintf(stderr, "Could not initialize the OPL emulator\n");
+        return EXIT_FAILURE;
+    }
+
+    opl_emu_driver.set_callback_func(0, WriteRegisters, NULL);
+
+    for (int i = 0; i < NUM_BUFFERS; ++i)
+    {
+        int samples = 512 + Random() % (MAX_SAMPLES - 512);
+
+        OPL_FillBuffer(buffer, samples);
+        hash = Checksum(hash, buffer, samples * 4);
+    }
+
+    opl_emu_driver.shutdown_func();
+
+    printf("%d chip(s): %016" PRIx64 "\n", num_opl_chips, hash);
+
+    if (hash != expected)
+    {
+        fprintf(stderr, "Checksum mismatch, expected %016" PRIx64 "\n",
+                expected);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -1775,11 +1775,6 @@ static void AM_drawGrid(int color)
 //
 static int AM_DoorColor(int type)
 {
-  if (map_keyed_door == MAP_KEYED_DOOR_OFF)
-  {
-    return -1;
-  }
-
   if (GenLockedBase <= type && type< GenDoorBase)
   {
     type -= GenLockedBase;
@@ -1833,208 +1828,404 @@ typedef struct
 
 static am_line_t *lines_1S = NULL;
 
-static void AM_drawWalls(void)
+// [Woof!] Cached lines of the level. Every line keeps its map coordinates
+// and the part of its classification that only depends on its special,
+// which is updated when the special changes. The lines are indexed by a
+// grid of blocks, so that only the lines in the visible part of the map
+// are transformed and drawn.
+
+typedef struct
 {
-  int i;
-  static mline_t l;
+  mline_t l;          // map coordinates, before AM_transformPoint()
+  short special;      // special the classification is for
+  signed char door;   // AM_DoorColor()
+  boolean exit, tele;
+} am_cacheline_t;
+
+#define AM_MINBLOCKSHIFT (7 + MAPBITS) // 128 units
+#define AM_MAXBLOCKS 256               // per axis
+
+static am_cacheline_t *am_lines; // PU_LEVEL, NULL until first drawn
+static int am_blockshift;
+static int64_t am_orgx, am_orgy;
+static int am_blockwidth, am_blockheight;
+static int *am_blockstart;       // start of each block in am_blocklines
+static int *am_blocklines;
+static uint32_t *am_visible;     // bit set of the lines to draw
+
+static void AM_classifyLine(const line_t *line, am_cacheline_t *cl)
+{
+  const int special = line->special;
 
-  const boolean keyed_door_flash = (map_keyed_door == MAP_KEYED_DOOR_FLASH) && (leveltime & 16);
+  cl->special = special;
+  cl->door = AM_DoorColor(special);
+
+  //jff 4/23/98 add exit lines to automap
+  cl->exit = (special==11 || special==52 || special==197 ||
+              special==51 || special==124 || special==198);
+
+  // jff 1/10/98 add color change for all teleporter types
+  cl->tele = (special == 39 || special == 97 /* ||
+              special == 125 || special == 126 */ );
+}
+
+static void AM_blockRange(const mline_t *l, int *bx1, int *by1, int *bx2,
+                          int *by2)
+{
+  *bx1 = (int)((MIN(l->a.x, l->b.x) - am_orgx) >> am_blockshift);
+  *bx2 = (int)((MAX(l->a.x, l->b.x) - am_orgx) >> am_blockshift);
+  *by1 = (int)((MIN(l->a.y, l->b.y) - am_orgy) >> am_blockshift);
+  *by2 = (int)((MAX(l->a.y, l->b.y) - am_orgy) >> am_blockshift);
+}
+
+static void AM_cacheLines(void)
+{
+  int64_t minx = 0, miny = 0, maxx = 0, maxy = 0;
+  int i, b, numblocks;
+
+  Z_Malloc(numlines * sizeof(*am_lines), PU_LEVEL, (void **)&am_lines);
+
+  for (i = 0; i < numlines; i++)
+  {
+    am_cacheline_t *cl = &am_lines[i];
+
+    cl->l.a.x = lines[i].v1->x >> FRACTOMAPBITS;
+    cl->l.a.y = lines[i].v1->y >> FRACTOMAPBITS;
+    cl->l.b.x = lines[i].v2->x >> FRACTOMAPBITS;
+    cl->l.b.y = lines[i].v2->y >> FRACTOMAPBITS;
+
+    AM_classifyLine(&lines[i], cl);
+
+    if (!i)
+    {
+      minx = maxx = cl->l.a.x;
+      miny = maxy = cl->l.a.y;
+    }
+    minx = MIN(minx, MIN(cl->l.a.x, cl->l.b.x));
+    maxx = MAX(maxx, MAX(cl->l.a.x, cl->l.b.x));
+    miny = MIN(miny, MIN(cl->l.a.y, cl->l.b.y));
+    maxy = MAX(maxy, MAX(cl->l.a.y, cl->l.b.y));
+  }
+
+  am_orgx = minx;
+  am_orgy = miny;
+
+  for (am_blockshift = AM_MINBLOCKSHIFT;
+       ((maxx - minx) >> am_blockshift) >= AM_MAXBLOCKS ||
+       ((maxy - miny) >> am_blockshift) >= AM_MAXBLOCKS;
+       am_blockshift++)
+    ;
+
+  am_blockwidth = (int)((maxx - minx) >> am_blockshift) + 1;
+  am_blockheight = (int)((maxy - miny) >> am_blockshift) + 1;
+  numblocks = am_blockwidth * am_blockheight;
+
+  // count the lines of each block, then fill them in
+  am_blockstart = Z_Realloc(am_blockstart, (numblocks + 1) * sizeof(int),
+                            PU_STATIC, NULL);
+  memset(am_blockstart, 0, (numblocks + 1) * sizeof(int));
+
+  for (i = 0; i < numlines; i++)
+  {
+    int x, y, bx1, by1, bx2, by2;
+
+    AM_blockRange(&am_lines[i].l, &bx1, &by1, &bx2, &by2);
+
+    for (y = by1; y <= by2; y++)
+      for (x = bx1; x <= bx2; x++)
+        am_blockstart[y * am_blockwidth + x + 1]++;
+  }
+
+  for (b = 0; b < numblocks; b++)
+    am_blockstart[b + 1] += am_blockstart[b];
+
+  am_blocklines = Z_Realloc(am_blocklines,
+                            MAX(am_blockstart[numblocks], 1) * sizeof(int),
+                            PU_STATIC, NULL);
+
+  for (i = 0; i < numlines; i++)
+  {
+    int x, y, bx1, by1, bx2, by2;
+
+    AM_blockRange(&am_lines[i].l, &bx1, &by1, &bx2, &by2);
+
+    for (y = by1; y <= by2; y++)
+      for (x = bx1; x <= bx2; x++)
+        am_blocklines[am_blockstart[y * am_blockwidth + x]++] = i;
+  }
 
-  // draw the unclipped visible portions of all lines
-  for (i=0;i<numlines;i++)
+  // the starts have moved to the ends of their blocks
+  for (b = numblocks; b > 0; b--)
+    am_blockstart[b] = am_blockstart[b - 1];
+  am_blockstart[0] = 0;
+
+  am_visible = Z_Realloc(am_visible,
+                         MAX((numlines + 31) / 32, 1) * sizeof(uint32_t),
+                         PU_STATIC, NULL);
+}
+
+// Marks the lines of the blocks the visible window may overlap.
+
+static void AM_markVisibleLines(void)
+{
+  int64_t x1 = m_x, y1 = m_y, x2 = m_x2, y2 = m_y2;
+  int x, y;
+
+  memset(am_visible, 0, ((numlines + 31) / 32) * sizeof(uint32_t));
+
+  // the lines are transformed around the window center, cover all
+  // rotations and the aspect ratio correction
+  if (automaprotate || ADJUST_ASPECT_RATIO)
+  {
+    const int64_t r = m_w + m_h;
+
+    x1 = mapcenter.x - r;
+    x2 = mapcenter.x + r;
+    y1 = mapcenter.y - r;
+    y2 = mapcenter.y + r;
+  }
+
+  x1 = (MAX(x1, am_orgx) - am_orgx) >> am_blockshift;
+  y1 = (MAX(y1, am_orgy) - am_orgy) >> am_blockshift;
+  x2 = (x2 - am_orgx) >> am_blockshift;
+  y2 = (y2 - am_orgy) >> am_blockshift;
+
+  x2 = MIN(x2, am_blockwidth - 1);
+  y2 = MIN(y2, am_blockheight - 1);
+
+  for (y = (int)y1; y <= y2; y++)
+  {
+    for (x = (int)x1; x <= x2; x++)
+    {
+      const int b = y * am_blockwidth + x;
+      int j;
+
+      for (j = am_blockstart[b]; j < am_blockstart[b + 1]; j++)
+      {
+        const int i = am_blocklines[j];
+        am_visible[i >> 5] |= 1u << (i & 31);
+      }
+    }
+  }
+}
+
+static void AM_drawWall(const line_t *line, const am_cacheline_t *cl,
+                        mline_t *l, boolean keyed_door_flash)
+{
+  // if line has been seen or IDDT has been used
+  if (ddt_cheating || (line->flags & ML_MAPPED))
   {
-    l.a.x = lines[i].v1->x >> FRACTOMAPBITS;
-    l.a.y = lines[i].v1->y >> FRACTOMAPBITS;
-    l.b.x = lines[i].v2->x >> FRACTOMAPBITS;
-    l.b.y = lines[i].v2->y >> FRACTOMAPBITS;
-    AM_transformPoint(&l.a);
-    AM_transformPoint(&l.b);
-    // if line has been seen or IDDT has been used
-    if (ddt_cheating || (lines[i].flags & ML_MAPPED))
-    {
-      if ((lines[i].flags & ML_DONTDRAW) && !ddt_cheating)
-        continue;
+    if ((line->flags & ML_DONTDRAW) && !ddt_cheating)
+      return;
+    {
+      /* cph - show keyed doors and lines */
+      const int amd = map_keyed_door == MAP_KEYED_DOOR_OFF ? -1 : cl->door;
+      if ((cur_mapcolor_bdor || cur_mapcolor_ydor || cur_mapcolor_rdor) &&
+          !(line->flags & ML_SECRET) &&    /* non-secret */
+          (amd != -1)
+      )
       {
-        /* cph - show keyed doors and lines */
-        const int amd = AM_DoorColor(lines[i].special);
-        if ((cur_mapcolor_bdor || cur_mapcolor_ydor || cur_mapcolor_rdor) &&
-            !(lines[i].flags & ML_SECRET) &&    /* non-secret */
-            (amd != -1)
+          if (keyed_door_flash)
+          {
+             AM_drawMline(l, cur_mapcolor_grid);
+          }
+          else switch (amd) // closed keyed door
+          {
+            case 1:
+              /*bluekey*/
+              AM_drawMline(l,
+                cur_mapcolor_bdor? cur_mapcolor_bdor : cur_mapcolor_cchg);
+              break;
+            case 2:
+              /*yellowkey*/
+              AM_drawMline(l,
+                cur_mapcolor_ydor? cur_mapcolor_ydor : cur_mapcolor_cchg);
+              break;
+            case 0:
+              /*redkey*/
+              AM_drawMline(l,
+                cur_mapcolor_rdor? cur_mapcolor_rdor : cur_mapcolor_cchg);
+              break;
+            case 3:
+              /*any or all*/
+              AM_drawMline(l,
+                cur_mapcolor_clsd? cur_mapcolor_clsd : cur_mapcolor_cchg);
+              break;
+          }
+          return;
+      }
+    }
+    if //jff 4/23/98 add exit lines to automap
+    (
+      cur_mapcolor_exit && cl->exit
+    )
+    {
+      AM_drawMline(l, keyed_door_flash ? cur_mapcolor_grid : cur_mapcolor_exit); // exit line
+      return;
+    }
+
+    if (!line->backsector)
+    {
+      if (cur_mapcolor_exit && P_IsDeathExit(line->frontsector))
+      {
+        array_push(lines_1S, ((am_line_t){*l, keyed_door_flash ? cur_mapcolor_grid : cur_mapcolor_exit}));
+      }
+      // jff 1/10/98 add new color for 1S secret sector boundary
+      else if (cur_mapcolor_secr && //jff 4/3/98 0 is disable
+          (
+           !map_secret_after &&
+           P_IsSecret(line->frontsector)
+          )
         )
-        {
-            if (keyed_door_flash)
-            {
-               AM_drawMline(&l, cur_mapcolor_grid);
-            }
-            else switch (amd) // closed keyed door
-            {
-              case 1:
-                /*bluekey*/
-                AM_drawMline(&l,
-                  cur_mapcolor_bdor? cur_mapcolor_bdor : cur_mapcolor_cchg);
-                break;
-              case 2:
-                /*yellowkey*/
-                AM_drawMline(&l,
-                  cur_mapcolor_ydor? cur_mapcolor_ydor : cur_mapcolor_cchg);
-                break;
-              case 0:
-                /*redkey*/
-                AM_drawMline(&l,
-                  cur_mapcolor_rdor? cur_mapcolor_rdor : cur_mapcolor_cchg);
-                break;
-              case 3:
-                /*any or all*/
-                AM_drawMline(&l,
-                  cur_mapcolor_clsd? cur_mapcolor_clsd : cur_mapcolor_cchg);
-                break;
-            }
-            continue;
-        }
+      {
+        // line bounding secret sector
+        array_push(lines_1S, ((am_line_t){*l, cur_mapcolor_secr}));
       }
-      if //jff 4/23/98 add exit lines to automap
-      (
-        cur_mapcolor_exit &&
-        (
-          lines[i].special==11 ||
-          lines[i].special==52 ||
-          lines[i].special==197 ||
-          lines[i].special==51  ||
-          lines[i].special==124 ||
-          lines[i].special==198
+      else if (cur_mapcolor_revsecr &&
+          (
+           P_WasSecret(line->frontsector) &&
+           !P_IsSecret(line->frontsector)
+          )
         )
+      {
+        // line bounding revealed secret sector
+        array_push(lines_1S, ((am_line_t){*l, cur_mapcolor_revsecr}));
+      }
+      else                               //jff 2/16/98 fixed bug
+      {
+        // special was cleared
+        array_push(lines_1S, ((am_line_t){*l, cur_mapcolor_wall}));
+      }
+    }
+    else
+    {
+      // jff 1/10/98 add color change for all teleporter types
+      if
+      (
+          cur_mapcolor_tele && !(line->flags & ML_SECRET) && cl->tele
       )
+      { // teleporters
+        AM_drawMline(l, cur_mapcolor_tele);
+      }
+      else if (line->flags & ML_SECRET)    // secret door
       {
-        AM_drawMline(&l, keyed_door_flash ? cur_mapcolor_grid : cur_mapcolor_exit); // exit line
-        continue;
+        AM_drawMline(l, cur_mapcolor_wall);      // wall color
       }
-
-      if (!lines[i].backsector)
+      else if
+      (
+          cur_mapcolor_clsd &&
+          !(line->flags & ML_SECRET) &&    // non-secret closed door
+          ((line->backsector->floorheight==line->backsector->ceilingheight) ||
+          (line->frontsector->floorheight==line->frontsector->ceilingheight))
+      )
       {
-        if (cur_mapcolor_exit && P_IsDeathExit(lines[i].frontsector))
-        {
-          array_push(lines_1S, ((am_line_t){l, keyed_door_flash ? cur_mapcolor_grid : cur_mapcolor_exit}));
-        }
-        // jff 1/10/98 add new color for 1S secret sector boundary
-        else if (cur_mapcolor_secr && //jff 4/3/98 0 is disable
-            (
-             !map_secret_after &&
-             P_IsSecret(lines[i].frontsector)
-            )
+        AM_drawMline(l, cur_mapcolor_clsd);      // non-secret closed door
+      } //jff 1/6/98 show secret sector 2S lines
+      else if (cur_mapcolor_exit &&
+          (P_IsDeathExit(line->frontsector) ||
+           P_IsDeathExit(line->backsector))
+      )
+      {
+        AM_drawMline(l, keyed_door_flash ? cur_mapcolor_grid : cur_mapcolor_exit);
+      }
+      else if
+      (
+          cur_mapcolor_secr && //jff 2/16/98 fixed bug
+          (                    // special was cleared after getting it
+            !map_secret_after &&
+             (
+              P_IsSecret(line->frontsector) ||
+              P_IsSecret(line->backsector)
+             )
           )
-        {
-          // line bounding secret sector
-          array_push(lines_1S, ((am_line_t){l, cur_mapcolor_secr}));
-        }
-        else if (cur_mapcolor_revsecr &&
-            (
-             P_WasSecret(lines[i].frontsector) &&
-             !P_IsSecret(lines[i].frontsector)
-            )
+      )
+      {
+        AM_drawMline(l, cur_mapcolor_secr); // line bounding secret sector
+      } //jff 1/6/98 end secret sector line change
+      else if
+      (
+          cur_mapcolor_revsecr &&
+          (
+            (P_WasSecret(line->frontsector)
+             && !P_IsSecret(line->frontsector)) ||
+            (P_WasSecret(line->backsector)
+             && !P_IsSecret(line->backsector))
           )
-        {
-          // line bounding revealed secret sector
-          array_push(lines_1S, ((am_line_t){l, cur_mapcolor_revsecr}));
-        }
-        else                               //jff 2/16/98 fixed bug
-        {
-          // special was cleared
-          array_push(lines_1S, ((am_line_t){l, cur_mapcolor_wall}));
-        }
+      )
+      {
+        AM_drawMline(l, cur_mapcolor_revsecr); // line bounding revealed secret sector
       }
-      else
+      else if (line->backsector->floorheight !=
+                line->frontsector->floorheight)
       {
-        // jff 1/10/98 add color change for all teleporter types
-        if
-        (
-            cur_mapcolor_tele && !(lines[i].flags & ML_SECRET) &&
-            (lines[i].special == 39 || lines[i].special == 97 /* ||
-            lines[i].special == 125 || lines[i].special == 126 */ )
-        )
-        { // teleporters
-          AM_drawMline(&l, cur_mapcolor_tele);
-        }
-        else if (lines[i].flags & ML_SECRET)    // secret door
-        {
-          AM_drawMline(&l, cur_mapcolor_wall);      // wall color
-        }
-        else if
-        (
-            cur_mapcolor_clsd &&
-            !(lines[i].flags & ML_SECRET) &&    // non-secret closed door
-            ((lines[i].backsector->floorheight==lines[i].backsector->ceilingheight) ||
-            (lines[i].frontsector->floorheight==lines[i].frontsector->ceilingheight))
-        )
-        {
-          AM_drawMline(&l, cur_mapcolor_clsd);      // non-secret closed door
-        } //jff 1/6/98 show secret sector 2S lines
-        else if (cur_mapcolor_exit &&
-            (P_IsDeathExit(lines[i].frontsector) ||
-             P_IsDeathExit(lines[i].backsector))
-        )
-        {
-          AM_drawMline(&l, keyed_door_flash ? cur_mapcolor_grid : cur_mapcolor_exit);
-        }
-        else if
-        (
-            cur_mapcolor_secr && //jff 2/16/98 fixed bug
-            (                    // special was cleared after getting it
-              !map_secret_after &&
-               (
-                P_IsSecret(lines[i].frontsector) ||
-                P_IsSecret(lines[i].backsector)
-               )
-            )
-        )
-        {
-          AM_drawMline(&l, cur_mapcolor_secr); // line bounding secret sector
-        } //jff 1/6/98 end secret sector line change
-        else if
-        (
-            cur_mapcolor_revsecr &&
-            (
-              (P_WasSecret(lines[i].frontsector)
-               && !P_IsSecret(lines[i].frontsector)) ||
-              (P_WasSecret(lines[i].backsector)
-               && !P_IsSecret(lines[i].backsector))
-            )
-        )
-        {
-          AM_drawMline(&l, cur_mapcolor_revsecr); // line bounding revealed secret sector
-        }
-        else if (lines[i].backsector->floorheight !=
-                  lines[i].frontsector->floorheight)
-        {
-          AM_drawMline(&l, cur_mapcolor_fchg); // floor level change
-        }
-        else if (lines[i].backsector->ceilingheight !=
-                  lines[i].frontsector->ceilingheight)
-        {
-          AM_drawMline(&l, cur_mapcolor_cchg); // ceiling level change
-        }
-        else if (cur_mapcolor_flat && ddt_cheating)
-        { 
-          AM_drawMline(&l, cur_mapcolor_flat); //2S lines that appear only in IDDT
-        }
+        AM_drawMline(l, cur_mapcolor_fchg); // floor level change
+      }
+      else if (line->backsector->ceilingheight !=
+                line->frontsector->ceilingheight)
+      {
+        AM_drawMline(l, cur_mapcolor_cchg); // ceiling level change
+      }
+      else if (cur_mapcolor_flat && ddt_cheating)
+      { 
+        AM_drawMline(l, cur_mapcolor_flat); //2S lines that appear only in IDDT
       }
-    } // now draw the lines only visible because the player has computermap
-    else if (plr->powers[pw_allmap]) // computermap visible lines
+    }
+  } // now draw the lines only visible because the player has computermap
+  else if (plr->powers[pw_allmap]) // computermap visible lines
+  {
+    if (!(line->flags & ML_DONTDRAW)) // invisible flag lines do not show
     {
-      if (!(lines[i].flags & ML_DONTDRAW)) // invisible flag lines do not show
+      if
+      (
+        cur_mapcolor_flat
+        ||
+        !line->backsector
+        ||
+        line->backsector->floorheight
+        != line->frontsector->floorheight
+        ||
+        line->backsector->ceilingheight
+        != line->frontsector->ceilingheight
+      )
+        AM_drawMline(l, cur_mapcolor_unsn);
+    }
+  }
+}
+
+static void AM_drawWalls(void)
+{
+  int w;
+
+  const boolean keyed_door_flash = (map_keyed_door == MAP_KEYED_DOOR_FLASH) && (leveltime & 16);
+
+  if (!am_lines)
+  {
+    AM_cacheLines();
+  }
+
+  AM_markVisibleLines();
+
+  // draw the unclipped visible portions of the lines, in their order
+  for (w = 0; w < (numlines + 31) / 32; w++)
+  {
+    uint32_t bits = am_visible[w];
+    int i;
+
+    for (i = w * 32; bits; i++, bits >>= 1)
+    {
+      if (bits & 1)
       {
-        if
-        (
-          cur_mapcolor_flat
-          ||
-          !lines[i].backsector
-          ||
-          lines[i].backsector->floorheight
-          != lines[i].frontsector->floorheight
-          ||
-          lines[i].backsector->ceilingheight
-          != lines[i].frontsector->ceilingheight
-        )
-          AM_drawMline(&l, cur_mapcolor_unsn);
+        am_cacheline_t *cl = &am_lines[i];
+        mline_t l = cl->l;
+
+        if (cl->special != lines[i].special)
+        {
+          AM_classifyLine(&lines[i], cl);
+        }
+
+        AM_transformPoint(&l.a);
+        AM_transformPoint(&l.b);
+        AM_drawWall(&lines[i], cl, &l, keyed_door_flash);
       }
     }
   }
@@ -0,0 +1,601 @@
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 2
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      -demobatch: play a list of demos in parallel worker processes.
+//
+//      The WADs are loaded once, then a worker is forked for every demo.
+//      It plays the demo like -timedemo -nodraw -noblit in a directory of
+//      its own, and the main process compares its -statdump or -levelstat
+//      output with the expected one. A demo without an expected output is
+//      only played to its end and reported as unchecked.
+//
+//      Every line of the list is
+//
+//          <demo> [statdump|levelstat <expected output>]
+//
+//      Empty lines and lines starting with '#' are skipped.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+  #include <errno.h>
+  #include <sys/types.h>
+  #include <sys/wait.h>
+  #include <unistd.h>
+#endif
+
+#include "d_demobatch.h"
+#include "doomstat.h"
+#include "doomtype.h"
+#include "i_exit.h"
+#include "i_printf.h"
+#include "i_system.h"
+#include "i_thread.h"
+#include "i_timer.h"
+#include "m_argv.h"
+#include "m_array.h"
+#include "m_config.h"
+#include "m_io.h"
+#include "m_misc.h"
+
+#include "yyjson.h"
+
+#ifndef _WIN32
+
+typedef enum
+{
+    CHECK_NONE,
+    CHECK_STATDUMP,
+    CHECK_LEVELSTAT,
+} check_t;
+
+static const char *check_names[] = {"none", "statdump", "levelstat"};
+static const char *check_files[] = {NULL, "statdump.txt", "levelstat.txt"};
+
+typedef enum
+{
+    RESULT_OK,
+    RESULT_UNCHECKED, // played to its end, but nothing to compare with
+    RESULT_DESYNC,    // output differs from the expected one
+    RESULT_ERROR,     // the worker failed
+} result_t;
+
+static const char *result_names[] = {"ok", "unchecked", "desync", "error"};
+
+typedef struct
+{
+    char *demo;
+    check_t check;
+    char *expected;
+
+    char *dir;
+    pid_t pid;
+    uint64_t start, time;
+    int status;
+
+    result_t result;
+    int diffline;   // first line that differs, 0 if none
+    char *expectedline, *actualline;
+} job_t;
+
+static job_t *jobs;
+
+static char *TrimLine(char *line)
+{
+    char *end;
+
+    while (*line == ' ' || *line == '\t')
+    {
+        line++;
+    }
+
+    end = line + strlen(line);
+    while (end > line && strchr(" \t\r\n", end[-1]))
+    {
+        *--end = '\0';
+    }
+
+    return line;
+}
+
+static void ReadList(const char *filename)
+{
+    char buffer[1024];
+    FILE *file;
+    int linenum = 0;
+
+    if (!(file = M_fopen(filename, "r")))
+    {
+        I_Error("Could not open demo list %s", filename);
+    }
+
+    while (fgets(buffer, sizeof(buffer), file))
+    {
+        char *line = TrimLine(buffer), *demo, *check, *expected;
+        char *path;
+        job_t job = {0};
+
+        linenum++;
+
+        if (!*line || *line == '#')
+        {
+            continue;
+        }
+
+        demo = strtok(line, " \t");
+        check = strtok(NULL, " \t");
+        expected = strtok(NULL, " \t");
+
+        // workers run in a directory of their own
+        if (!(path = realpath(demo, NULL)))
+        {
+            I_Error("%s:%d: demo %s not found", filename, linenum, demo);
+        }
+        job.demo = path;
+
+        if (check)
+        {
+            if (!strcasecmp(check, "statdump"))
+            {
+                job.check = CHECK_STATDUMP;
+            }
+            else if (!strcasecmp(check, "levelstat"))
+            {
+                job.check = CHECK_LEVELSTAT;
+            }
+            else
+            {
+                I_Error("%s:%d: unknown check %s", filename, linenum, check);
+            }
+
+            if (!expected)
+            {
+                I_Error("%s:%d: missing expected output", filename, linenum);
+            }
+            job.expected = M_StringDuplicate(expected);
+        }
+
+        array_push(jobs, job);
+    }
+
+    fclose(file);
+
+    if (!array_size(jobs))
+    {
+        I_Error("Demo list %s is empty", filename);
+    }
+}
+
+// Sets up a worker to play its demo when D_DoomMain() carries on.
+
+static void StartWorker(job_t *job)
+{
+    const char **argv = malloc((myargc + 8) * sizeof(*argv));
+    int argc = myargc;
+
+    memcpy(argv, myargv, myargc * sizeof(*argv));
+    argv[argc++] = "-timedemo";
+    argv[argc++] = job->demo;
+    argv[argc++] = "-nogui";
+    if (job->check == CHECK_STATDUMP)
+    {
+        argv[argc++] = "-statdump";
+        argv[argc++] = check_files[CHECK_STATDUMP];
+    }
+    else if (job->check == CHECK_LEVELSTAT)
+    {
+        argv[argc++] = "-levelstat";
+    }
+
+    myargv = (char **)argv;
+    myargc = argc;
+
+    // -nosound and the like have already been parsed
+    nodrawers = true;
+    noblit = true;
+    nosfxparm = true;
+    nomusicparm = true;
+    setenv("SDL_VIDEO_DRIVER", "dummy", false);
+
+    // don't overwrite the config of the main process
+    M_DisableSaveDefaults();
+
+    if (chdir(job->dir) != 0)
+    {
+        I_Error("Could not enter %s", job->dir);
+    }
+
+    if (freopen("output.txt", "w", stdout))
+    {
+        dup2(fileno(stdout), STDERR_FILENO);
+    }
+}
+
+// Compares the output of a worker with the expected one, ignoring
+// whitespace like "diff -w".
+
+static void StripSpace(char *s)
+{
+    char *d = s;
+
+    for (; *s; s++)
+    {
+        if (!strchr(" \t\r\n", *s))
+        {
+            *d++ = *s;
+        }
+    }
+    *d = '\0';
+}
+
+static void CompareOutput(job_t *job)
+{
+    char expectedbuf[1024], actualbuf[1024];
+    char *path;
+    FILE *expected, *actual;
+    int linenum = 0;
+
+    path = M_StringJoin(job->dir, DIR_SEPARATOR_S, check_files[job->check]);
+    actual = M_fopen(path, "r");
+    free(path);
+    expected = M_fopen(job->expected, "r");
+
+    if (!expected)
+    {
+        I_Printf(VB_ERROR, "Could not open %s", job->expected);
+    }
+
+    if (!expected || !actual)
+    {
+        job->result = RESULT_DESYNC;
+        job->diffline = 1;
+    }
+
+    while (expected && actual)
+    {
+        char *e = fgets(expectedbuf, sizeof(expectedbuf), expected);
+        char *a = fgets(actualbuf, sizeof(actualbuf), actual);
+        char *rawe, *rawa;
+
+        if (!e && !a)
+        {
+            break;
+        }
+
+        linenum++;
+        rawe = M_StringDuplicate(e ? TrimLine(e) : "");
+        rawa = M_StringDuplicate(a ? TrimLine(a) : "");
+
+        if (e)
+        {
+            StripSpace(e);
+        }
+        if (a)
+        {
+            StripSpace(a);
+        }
+
+        if (!e || !a || strcmp(e, a))
+        {
+            job->result = RESULT_DESYNC;
+            job->diffline = linenum;
+            job->expectedline = rawe;
+            job->actualline = rawa;
+            break;
+        }
+
+        free(rawe);
+        free(rawa);
+    }
+
+    if (expected)
+    {
+        fclose(expected);
+    }
+    if (actual)
+    {
+        fclose(actual);
+    }
+}
+
+static void FinishJob(job_t *job)
+{
+    if (!WIFEXITED(job->status) || WEXITSTATUS(job->status) != 0)
+    {
+        job->result = RESULT_ERROR;
+    }
+    else if (job->check != CHECK_NONE)
+    {
+        CompareOutput(job);
+    }
+    else
+    {
+        job->result = RESULT_UNCHECKED;
+    }
+
+    // keep the output of failed demos around
+    if (job->result == RESULT_OK || job->result == RESULT_UNCHECKED)
+    {
+        char *path;
+
+        path = M_StringJoin(job->dir, DIR_SEPARATOR_S, "output.txt");
+        M_remove(path);
+        free(path);
+
+        if (job->check != CHECK_NONE)
+        {
+            path = M_StringJoin(job->dir, DIR_SEPARATOR_S,
+                                check_files[job->check]);
+            M_remove(path);
+            free(path);
+        }
+
+        M_rmdir(job->dir);
+    }
+
+    I_Printf(VB_INFO, "%s: %s (%.1f s)", M_BaseName(job->demo),
+             result_names[job->result], job->time / 1000000000.0);
+}
+
+static yyjson_mut_doc *CreateReport(uint64_t time, int failed,
+                                    int unchecked)
+{
+    yyjson_mut_doc *doc = yyjson_mut_doc_new(NULL);
+    yyjson_mut_val *root, *results;
+
+    root = yyjson_mut_obj(doc);
+    yyjson_mut_doc_set_root(doc, root);
+    yyjson_mut_obj_add_int(doc, root, "demos", array_size(jobs));
+    yyjson_mut_obj_add_int(doc, root, "failed", failed);
+    yyjson_mut_obj_add_int(doc, root, "unchecked", unchecked);
+    yyjson_mut_obj_add_real(doc, root, "seconds", time / 1000000000.0);
+    results = yyjson_mut_obj_add_arr(doc, root, "results");
+
+    for (int i = 0; i < array_size(jobs); i++)
+    {
+        const job_t *job = &jobs[i];
+        yyjson_mut_val *result = yyjson_mut_arr_add_obj(doc, results);
+
+        yyjson_mut_obj_add_str(doc, result, "demo", job->demo);
+        yyjson_mut_obj_add_str(doc, result, "result",
+                               result_names[job->result]);
+        yyjson_mut_obj_add_str(doc, result, "check", check_names[job->check]);
+        yyjson_mut_obj_add_real(doc, result, "seconds",
+                                job->time / 1000000000.0);
+
+        if (WIFEXITED(job->status))
+        {
+            yyjson_mut_obj_add_int(doc, result, "exit_code",
+                                   WEXITSTATUS(job->status));
+        }
+        else
+        {
+            yyjson_mut_obj_add_int(doc, result, "signal",
+                                   WTERMSIG(job->status));
+        }
+
+        if (job->diffline)
+        {
+            yyjson_mut_val *diff = yyjson_mut_obj_add_obj(doc, result, "diff");
+
+            yyjson_mut_obj_add_int(doc, diff, "line", job->diffline);
+            if (job->expectedline)
+            {
+                yyjson_mut_obj_add_str(doc, diff, "expected",
+                                       job->expectedline);
+                yyjson_mut_obj_add_str(doc, diff, "actual", job->actualline);
+            }
+            else
+            {
+                yyjson_mut_obj_add_null(doc, diff, "expected");
+                yyjson_mut_obj_add_null(doc, diff, "actual");
+            }
+        }
+        else
+        {
+            yyjson_mut_obj_add_null(doc, result, "diff");
+        }
+
+        if (job->result == RESULT_DESYNC || job->result == RESULT_ERROR)
+        {
+            yyjson_mut_obj_add_str(doc, result, "output", job->dir);
+        }
+        else
+        {
+            yyjson_mut_obj_add_null(doc, result, "output");
+        }
+    }
+
+    return doc;
+}
+
+static int WriteReport(const char *filename, uint64_t time)
+{
+    yyjson_mut_doc *doc;
+    FILE *file;
+    boolean success;
+    int failed = 0, unchecked = 0;
+    int i;
+
+    for (i = 0; i < array_size(jobs); i++)
+    {
+        failed += jobs[i].result == RESULT_DESYNC
+                  || jobs[i].result == RESULT_ERROR;
+        unchecked += jobs[i].result == RESULT_UNCHECKED;
+    }
+
+    if (!strcmp(filename, "-"))
+    {
+        file = stdout;
+    }
+    else if (!(file = M_fopen(filename, "w")))
+    {
+        I_Error("Could not write %s", filename);
+    }
+
+    doc = CreateReport(time, failed, unchecked);
+    success = yyjson_mut_write_fp(file, doc, YYJSON_WRITE_PRETTY, NULL, NULL);
+    yyjson_mut_doc_free(doc);
+
+    if (file != stdout)
+    {
+        success &= fclose(file) == 0;
+    }
+
+    if (!success)
+    {
+        I_Error("Could not write %s", filename);
+    }
+
+    if (unchecked)
+    {
+        I_Printf(VB_WARNING,
+                 "D_DemoBatch: %d demos have no expected output to check",
+                 unchecked);
+    }
+
+    return failed;
+}
+
+static void RunBatch(int maxjobs, const char *report)
+{
+    const uint64_t start = I_GetTimeNS();
+    int next = 0, running = 0;
+    int i;
+
+    I_Printf(VB_INFO, "D_DemoBatch: %d demos, %d jobs", array_size(jobs),
+             maxjobs);
+
+    while (next < array_size(jobs) || running)
+    {
+        pid_t pid;
+        int status;
+
+        if (next < array_size(jobs) && running < maxjobs)
+        {
+            job_t *job = &jobs[next++];
+            char name[64];
+
+            M_snprintf(name, sizeof(name), "woof-demobatch-%d-%d",
+                       (int)getpid(), next);
+            job->dir = M_TempFile(name);
+            M_MakeDirectory(job->dir);
+
+            fflush(stdout);
+            fflush(stderr);
+
+            job->start = I_GetTimeNS();
+            pid = fork();
+
+            if (pid < 0)
+            {
+                I_Error("Could not fork a demo worker: %s", strerror(errno));
+            }
+            else if (pid == 0)
+            {
+                StartWorker(job);
+                return;
+            }
+
+            job->pid = pid;
+            running++;
+            continue;
+        }
+
+        pid = waitpid(-1, &status, 0);
+
+        if (pid < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            I_Error("Could not wait for demo workers: %s", strerror(errno));
+        }
+
+        for (i = 0; i < array_size(jobs); i++)
+        {
+            if (jobs[i].pid == pid)
+            {
+                jobs[i].time = I_GetTimeNS() - jobs[i].start;
+                jobs[i].status = status;
+                FinishJob(&jobs[i]);
+                running--;
+                break;
+            }
+        }
+    }
+
+    I_SafeExit(WriteReport(report, I_GetTimeNS() - start) ? 1 : 0);
+}
+
+#endif
+
+void D_DemoBatch(void)
+{
+    int p;
+    int maxjobs;
+    const char *report;
+
+    //!
+    // @arg <list>
+    // @category demo
+    //
+    // Play every demo of the list in parallel worker processes, without
+    // loading the WADs again for each of them, and write a report of their
+    // results (see -demobatchreport). Every line of the list is a demo,
+    // optionally followed by "statdump" or "levelstat" and the file its
+    // output is expected to match. Demos without one are reported as
+    // unchecked. Not available on Windows.
+    //
+
+    p = M_CheckParmWithArgs("-demobatch", 1);
+
+    if (!p)
+    {
+        return;
+    }
+
+#ifdef _WIN32
+    I_Error("-demobatch is not supported on Windows");
+#else
+    ReadList(myargv[p + 1]);
+
+    //!
+    // @arg <n>
+    // @category demo
+    //
+    // Number of demos that -demobatch plays at once. The default is the
+    // number of CPU cores.
+    //
+
+    p = M_CheckParmWithArgs("-demobatchjobs", 1);
+    maxjobs = p ? M_ParmArgToInt(p) : I_GetNumCPUs();
+    maxjobs = MAX(maxjobs, 1);
+
+    //!
+    // @arg <file>
+    // @category demo
+    //
+    // Write the -demobatch report to the given JSON file, or to standard
+    // output if it is "-". The default is "demobatch.json".
+    //
+
+    p = M_CheckParmWithArgs("-demobatchreport", 1);
+    report = p ? myargv[p + 1] : "demobatch.json";
+
+    RunBatch(maxjobs, report);
+#endif
+}
@@ -0,0 +1,24 @@
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 2
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      -demobatch: play a list of demos in parallel worker processes.
+//
+
+#ifndef __D_DEMOBATCH__
+#define __D_DEMOBATCH__
+
+// Forks a worker process for every demo of the -demobatch list. Returns in
+// the workers, which go on to play their demo; the main process waits for
+// all of them, writes the report and exits.
+void D_DemoBatch(void);
+
+#endif
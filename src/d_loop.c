@@ -30,6 +30,7 @@
 #include "i_video.h"
 #include "m_argv.h"
 #include "m_fixed.h"
+#include "m_trace.h"
 #include "net_client.h"
 #include "net_gui.h"
 #include "net_io.h"
@@ -139,8 +140,10 @@ static boolean BuildNewTic(void)
 
     gameticdiv = gametic / ticdup;
 
+    M_TraceBegin(TRACE_INPUT);
     I_StartTic();
     D_ProcessEvents();
+    M_TraceEnd(TRACE_INPUT);
 
     // Always run the menu
 
@@ -888,5 +891,7 @@ void TryRunTics(void)
     }
 
     // killough 3/16/98: change consoleplayer to displayplayer
+    M_TraceBegin(TRACE_SOUND);
     S_UpdateSounds(players[displayplayer].mo); // move positional sounds
+    M_TraceEnd(TRACE_SOUND);
 }
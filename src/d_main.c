@@ -31,6 +31,7 @@
 
 #include "am_map.h"
 #include "config.h"
+#include "d_demobatch.h"
 #include "d_demoloop.h"
 #include "d_event.h"
 #include "d_iwad.h"
@@ -61,12 +62,14 @@
 #include "info.h"
 #include "m_argv.h"
 #include "m_array.h"
+#include "m_bench.h"
 #include "m_config.h"
 #include "m_input.h"
 #include "m_io.h"
 #include "mn_menu.h"
 #include "m_misc.h"
 #include "m_swap.h"
+#include "m_trace.h"
 #include "net_client.h"
 #include "net_dedicated.h"
 #include "deh_misc.h" // deh_max_health_bonus
@@ -350,7 +353,11 @@ void D_Display (void)
     }
 
   if (gamestate == GS_LEVEL && gametic)
+  {
+    M_BenchStart(BENCH_HUD);
     ST_Drawer();
+    M_BenchStop(BENCH_HUD);
+  }
 
   if (wi_overlay)
     WI_drawOverlayStats();
@@ -380,7 +387,9 @@ void D_Display (void)
   // normal update
   if (!wipe)
     {
+      M_BenchStart(BENCH_BLIT);
       I_FinishUpdate ();              // page flip or blit buffer
+      M_BenchStop(BENCH_BLIT);
       return;
     }
 
@@ -388,6 +397,7 @@ void D_Display (void)
   wipe_EndScreen(0, 0, video.width, video.height);
 
   wipestart = I_GetTime () - 1;
+  screenwiping = true;
 
   do
     {
@@ -403,6 +413,8 @@ void D_Display (void)
       I_FinishUpdate();             // page flip or blit buffer
     }
   while (!done);
+
+  screenwiping = false;
 }
 
 //
@@ -2203,6 +2215,9 @@ void D_DoomMain(void)
   I_Printf(VB_INFO, "P_Init: Init Playloop state.");
   P_Init();
 
+  // Fork the -demobatch workers before any SDL subsystem is up.
+  D_DemoBatch();
+
   I_Printf(VB_INFO, "I_Init: Setting up machine state.");
   I_SetMetadata(PROJECT_NAME, PROJECT_VERSION, PROJECT_APPID);
   I_InitTimer();
@@ -2373,6 +2388,23 @@ void D_DoomMain(void)
       singledemo = true; // quit after one demo
   }
 
+  //!
+  // @arg <demo>
+  // @category demo
+  //
+  // Same as -timedemo, but also time the game tics and every rendering
+  // phase of each frame, and write a report at exit (see -benchreport).
+  //
+
+  else if ((p = M_CheckParm("-benchmark")) && ++p < myargc)
+  {
+      singletics = true;
+      timingdemo = true; // show stats after quit
+      G_DeferedPlayDemo(myargv[p]);
+      singledemo = true; // quit after one demo
+      M_InitBenchmark(myargv[p]);
+  }
+
   //!
   // @arg <demo>
   // @category demo
@@ -2452,11 +2484,16 @@ void D_DoomMain(void)
       // frame syncronous IO operations
       I_StartFrame ();
 
+      M_TraceBegin(TRACE_TICS);
       TryRunTics (); // will run at least one tic
+      M_TraceEnd(TRACE_TICS);
 
       // Update display, next frame, with current state.
       if (screenvisible)
         D_Display();
+
+      M_BenchFrame();
+      M_TraceFrame();
     }
 }
 
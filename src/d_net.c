@@ -27,6 +27,7 @@
 #include "g_game.h"
 #include "i_printf.h"
 #include "m_argv.h"
+#include "m_bench.h"
 #include "m_misc.h"
 #include "net_defs.h"
 #include "p_mobj.h"
@@ -88,7 +89,9 @@ void RunTic(ticcmd_t *cmds, boolean *ingame)
     if (advancedemo)
         D_DoAdvanceDemo ();
 
+    M_BenchStart(BENCH_TIC);
     G_Ticker ();
+    M_BenchStop(BENCH_TIC);
 }
 
 // Load game settings from the specified structure and
@@ -137,6 +137,14 @@ inline static float clampf(float x, float min, float max)
   #define NORETURN
 #endif
 
+// Variables with a separate instance in each thread.
+
+#if defined(_MSC_VER)
+  #define THREAD_LOCAL __declspec(thread)
+#else
+  #define THREAD_LOCAL _Thread_local
+#endif
+
 // The packed attribute forces structures to be packed into the minimum
 // space necessary.  If this is not done, the compiler may align structure
 // fields differently to optimize memory access, inflating the overall
@@ -61,6 +61,7 @@
 #include "info.h"
 #include "m_argv.h"
 #include "m_array.h"
+#include "m_bench.h"
 #include "m_config.h"
 #include "m_input.h"
 #include "m_io.h"
@@ -4824,9 +4825,15 @@ boolean G_CheckDemoStatus(void)
       int endtime = I_GetTime_RealTime();
       // killough -- added fps information and made it work for longer demos:
       unsigned realtics = endtime-starttime;
-      I_MessageBox("Timed %u gametics in %u realtics = %-.1f frames per second",
-                   (unsigned)gametic, realtics,
-                   (unsigned)gametic * (double)TICRATE / realtics);
+      // -benchmark is meant to run unattended
+      if (benchmark)
+        I_Printf(VB_ALWAYS, "Timed %u gametics in %u realtics = %-.1f frames per second",
+                 (unsigned)gametic, realtics,
+                 (unsigned)gametic * (double)TICRATE / realtics);
+      else
+        I_MessageBox("Timed %u gametics in %u realtics = %-.1f frames per second",
+                     (unsigned)gametic, realtics,
+                     (unsigned)gametic * (double)TICRATE / realtics);
       I_SafeExit(0);
     }
 
@@ -5083,6 +5090,8 @@ void G_BindCompVariables(void)
              "Fix blockmap bug (improves hit detection)");
   M_BindBool("checksight12", &checksight12, NULL, false, ss_comp, wad_no,
              "Fast blockmap-based line-of-sight calculation");
+  M_BindBool("sight_cache", &sight_cache, NULL, true, ss_none, wad_no,
+             "Cache line-of-sight results (doesn't affect demo sync)");
 
 #define BIND_COMP(id, v, help) \
   M_BindNum(#id, &default_comp[(id)], &comp[(id)], (v), 0, 1, ss_none, wad_yes, help)
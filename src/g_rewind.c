@@ -15,7 +15,9 @@
 #include "doomstat.h"
 #include "doomtype.h"
 #include "g_game.h"
+#include "i_thread.h"
 #include "i_timer.h"
+#include "m_array.h"
 #include "m_config.h"
 #include "p_dirty.h"
 #include "p_keyframe.h"
@@ -31,92 +33,138 @@ static boolean rewind_auto;
 static boolean disable_rewind;
 static int interval_tics;
 
-typedef struct elem_s
+// Keyframes are kept oldest first. Every FULL_INTERVAL-th one is a full
+// snapshot and the ones in between are deltas against it. Beyond the last
+// RECENT_KEYFRAMES, the history is thinned out to the full snapshots, so at
+// the default interval there is one keyframe per second for the last minute
+// and one per ten seconds before that.
+
+#define FULL_INTERVAL    10
+#define RECENT_KEYFRAMES 60
+
+typedef struct
 {
     keyframe_t *keyframe;
-    struct elem_s *next;
-    struct elem_s *prev;
+    boolean full;
 } elem_t;
 
+static elem_t *keyframes;
+
+// Keyframes are packed and delta compressed on the job thread, so that the
+// game thread only pays for copying the state.
+
 typedef struct
 {
-    elem_t* top;
-    elem_t* tail;
-    int count;
-} queue_t;
+    keyframe_t *keyframe;
+    const keyframe_t *base;
+} finish_t;
+
+static finish_t finish;
+static thread_job_t *finish_job;
+
+static void FinishKeyframe(void *data, int index)
+{
+    finish_t *args = data;
+    P_FinishKeyframe(args->keyframe, args->base);
+}
 
-static queue_t queue;
+static void WaitFinish(void)
+{
+    I_WaitJob(finish_job);
+    finish_job = NULL;
+}
 
 static boolean IsEmpty(void)
 {
-    return queue.top == NULL;
+    return array_size(keyframes) == 0;
 }
 
-// Add an element to the top of the queue
-static void Push(keyframe_t *keyframe)
+// Index of the newest full snapshot.
+static int LastFull(void)
 {
-    // Remove oldest element if queue is full
-    if (queue.count == rewind_depth)
+    for (int i = array_size(keyframes) - 1; i >= 0; --i)
     {
-        elem_t *oldtail = queue.tail;
-        if (oldtail)
+        if (keyframes[i].full)
         {
-            queue.tail = oldtail->prev;
-            if (queue.tail)
-            {
-                queue.tail->next = NULL;
-            }
-            else
-            {
-                // Queue becomes empty after removal
-                queue.top = NULL;
-            }
-            P_FreeKeyframe(oldtail->keyframe);
-            free(oldtail);
-            --queue.count;
+            return i;
         }
     }
+    return -1;
+}
 
-    elem_t *newelem = calloc(1, sizeof(*newelem));    
-    newelem->keyframe = keyframe;
-    
-    if (IsEmpty())
+static void Delete(int index, int count)
+{
+    for (int i = index; i < index + count; ++i)
     {
-        queue.top = newelem;
-        queue.tail = newelem;
+        P_FreeKeyframe(keyframes[i].keyframe);
     }
-    else
+    array_delete_n(keyframes, index, count);
+}
+
+static void Thin(void)
+{
+    for (int i = array_size(keyframes) - RECENT_KEYFRAMES - 1; i >= 0; --i)
     {
-        newelem->next = queue.top;
-        queue.top->prev = newelem;
-        queue.top = newelem;
+        if (!keyframes[i].full)
+        {
+            Delete(i, 1);
+        }
     }
-    ++queue.count;
 }
 
-// Remove and return element from top of queue
-static keyframe_t *Pop(void)
+// Add a keyframe to the top of the queue
+static void Push(elem_t elem)
 {
-    if (IsEmpty())
+    array_push(keyframes, elem);
+
+    Thin();
+
+    // Remove the oldest snapshot along with its deltas if the queue is full
+    while (array_size(keyframes) > rewind_depth)
     {
-        return NULL;
+        int count = 1;
+        while (count < array_size(keyframes) && !keyframes[count].full)
+        {
+            ++count;
+        }
+        Delete(0, count);
     }
-    
-    elem_t* temp = queue.top;
-    keyframe_t *keyframe = temp->keyframe;
-    queue.top = temp->next;
-    if (queue.top)
+}
+
+static void SaveKeyframe(int tic)
+{
+    // normally finished long ago, one interval has passed since
+    WaitFinish();
+
+    elem_t elem = {P_SaveKeyframe(tic), true};
+    const int base = LastFull();
+
+    finish.keyframe = elem.keyframe;
+    finish.base = NULL;
+
+    if (base >= 0 && array_size(keyframes) - base < FULL_INTERVAL)
     {
-        queue.top->prev = NULL;
+        finish.base = keyframes[base].keyframe;
+        elem.full = false;
     }
-    else
+
+    // neither Thin() nor the eviction of the oldest snapshot can free the
+    // base, it is the newest full one and has fewer deltas than
+    // rewind_depth
+    Push(elem);
+
+    finish_job = I_StartJob(FinishKeyframe, &finish);
+}
+
+// Remove and return the keyframe from top of queue
+static keyframe_t *Pop(void)
+{
+    if (IsEmpty())
     {
-        queue.tail = NULL;
+        return NULL;
     }
-    free(temp);
-    --queue.count;
 
-    return keyframe;
+    return array_pop(keyframes).keyframe;
 }
 
 void G_SaveAutoKeyframe(void)
@@ -133,8 +181,8 @@ void G_SaveAutoKeyframe(void)
     if (!disable_rewind && current_tic % interval_tics == 0)
     {
         int time = I_GetTimeMS();
-        
-        Push(P_SaveKeyframe(current_tic));
+
+        SaveKeyframe(current_tic);
 
         if (rewind_timeout)
         {
@@ -156,16 +204,18 @@ void G_LoadAutoKeyframe(void)
         return;
     }
 
+    WaitFinish();
+
     int current_tic = gametic - true_basetic;
 
     // Search for the closest keyframe by interval.
-    elem_t* elem = queue.top;
-    while (elem)
+    int index = array_size(keyframes) - 1;
+    while (index >= 0)
     {
-        int tic = elem->keyframe->tic;
+        int tic = keyframes[index].keyframe->tic;
         if (tic > 0 && current_tic - tic < interval_tics)
         {
-            elem = elem->next;
+            --index;
         }
         else
         {
@@ -173,14 +223,14 @@ void G_LoadAutoKeyframe(void)
         }
     }
 
-    if (!elem)
+    if (index < 0)
     {
         // No suitable keyframe found (all are too recent).
         return;
     }
 
     // Delete from queue skipped keyframes.
-    while (queue.top != elem)
+    while (array_size(keyframes) - 1 > index)
     {
         keyframe_t* skipped = Pop();
         if (skipped)
@@ -202,7 +252,7 @@ void G_LoadAutoKeyframe(void)
 
         if (IsEmpty()) // Don't delete the first keyframe.
         {
-            Push(keyframe);
+            Push((elem_t){keyframe, true});
         }
         else
         {
@@ -220,15 +270,9 @@ void G_LoadAutoKeyframe(void)
 
 static void FreeKeyframeQueue(void)
 {
-    elem_t* current = queue.top;
-    while (current)
-    {
-        elem_t* temp = current;
-        current = current->next;
-        P_FreeKeyframe(temp->keyframe);
-        free(temp);
-    }
-    memset(&queue, 0, sizeof(queue));
+    WaitFinish();
+    Delete(0, array_size(keyframes));
+    array_free(keyframes);
 }
 
 void G_ResetRewind(boolean force)
@@ -247,7 +291,7 @@ void G_BindRewindVariables(void)
 {
     BIND_NUM(rewind_interval, 1000, 100, 10000,
         "Rewind interval in miliseconds");
-    BIND_NUM(rewind_depth, 60, 10, 1000,
+    BIND_NUM(rewind_depth, 120, 10, 1000,
         "Number of rewind key frames to be stored");
     BIND_NUM(rewind_timeout, 10, 0, 25,
         "Time to store a key frame [ms]; if exceeded, storing "
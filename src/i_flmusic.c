@@ -61,6 +61,7 @@ static int fl_note_cut;
 static fluid_synth_t *synth = NULL;
 static fluid_settings_t *settings = NULL;
 static fluid_player_t *player = NULL;
+static boolean song_looping;
 
 static const char **soundfonts = NULL;
 static int interp_method;
@@ -257,6 +258,21 @@ static void I_FL_Log_Debug(int level, const char *message, void *data)
     I_Printf(VB_DEBUG, "FluidSynth: \"%s\"", message);
 }
 
+// Everything the rendered songs depend on.
+
+static char cache_key[1024];
+
+static void MakeCacheKey(const char *soundfont, int length)
+{
+    M_snprintf(cache_key, sizeof(cache_key),
+               "FluidSynth %s %s %d %d %d %d %d %d %d %d %d %d %d %d %d %d",
+               fluid_version_str(), soundfont, length, fl_polyphony,
+               interp_method, fl_reverb, fl_chorus, fl_reverb_damp,
+               fl_reverb_level, fl_reverb_roomsize, fl_reverb_width,
+               fl_chorus_depth, fl_chorus_level, fl_chorus_nr,
+               fl_chorus_speed, fl_note_cut);
+}
+
 static boolean I_FL_InitStream(int device)
 {
     int sf_id;
@@ -351,6 +367,16 @@ static boolean I_FL_InitStream(int device)
     I_Printf(VB_INFO, "FluidSynth Init: Using '%s'.",
              lumpnum >= 0 ? "SNDFONT lump" : soundfonts[device]);
 
+    if (lumpnum >= 0)
+    {
+        MakeCacheKey(M_BaseName(W_WadNameForLump(lumpnum)),
+                     W_LumpLength(lumpnum));
+    }
+    else
+    {
+        MakeCacheKey(soundfonts[device], M_FileLength(soundfonts[device]));
+    }
+
     return true;
 }
 
@@ -421,19 +447,48 @@ static boolean I_FL_OpenStream(void *data, ALsizei size, ALenum *format,
     return true;
 }
 
+// [Woof!] FluidSynth's own block size
+#define END_BLOCK_SAMPLES 64
+
 static int I_FL_FillStream(void *buffer, int buffer_samples)
 {
-    int result;
+    int result = FLUID_OK;
+    int filled = 0;
 
-    result = fluid_synth_write_float(synth, buffer_samples, buffer, 0, 2,
-                                     buffer, 1, 2);
+    // A song that doesn't loop ends when its last notes have faded out.
+    if (fluid_player_get_status(player) == FLUID_PLAYER_DONE
+        && fluid_synth_get_active_voice_count(synth) == 0)
+    {
+        return 0;
+    }
+
+    if (song_looping || fluid_player_get_status(player) == FLUID_PLAYER_DONE)
+    {
+        result = fluid_synth_write_float(synth, buffer_samples, buffer, 0, 2,
+                                         buffer, 1, 2);
+        filled = buffer_samples;
+    }
+    else
+    {
+        // The fill that reaches the end of the song's events is a short
+        // one, the decay of its last notes follows.
+        while (filled < buffer_samples && result == FLUID_OK
+               && fluid_player_get_status(player) != FLUID_PLAYER_DONE)
+        {
+            const int len = MIN(END_BLOCK_SAMPLES, buffer_samples - filled);
+
+            result = fluid_synth_write_float(synth, len, buffer, 2 * filled,
+                                             2, buffer, 2 * filled + 1, 2);
+            filled += len;
+        }
+    }
 
     if (result != FLUID_OK)
     {
         I_Printf(VB_ERROR, "FluidSynth: Error generating audio");
     }
 
-    return buffer_samples;
+    return filled;
 }
 
 static void I_FL_PlayStream(boolean looping)
@@ -444,6 +499,7 @@ static void I_FL_PlayStream(boolean looping)
     }
 
     fluid_synth_set_interp_method(synth, -1, interp_method);
+    song_looping = looping;
     fluid_player_set_loop(player, looping ? -1 : 1);
     fluid_player_play(player);
 }
@@ -502,6 +558,11 @@ static const char **I_FL_DeviceList(void)
     return devices;
 }
 
+static const char *I_FL_CacheKey(void)
+{
+    return synth ? cache_key : NULL;
+}
+
 static void I_FL_BindVariables(void)
 {
     M_BindStr("soundfont_dirs", &soundfont_dirs, "", wad_no,
@@ -551,4 +612,5 @@ stream_module_t stream_fl_module =
     I_FL_DeviceList,
     I_FL_BindVariables,
     I_FL_MusicFormat,
+    I_FL_CacheKey,
 };
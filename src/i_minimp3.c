@@ -117,4 +117,5 @@ stream_module_t stream_mp3_module =
     I_MP3_DeviceList,
     I_MP3_BindVariables,
     I_MP3_MusicFormat,
+    NULL,
 };
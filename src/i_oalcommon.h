@@ -37,6 +37,7 @@ typedef struct oal_system_s
     ALCdevice *device;
     ALCcontext *context;
     ALuint *sources;
+    int num_sources;
     boolean SOFT_source_spatialize;
     boolean EXT_EFX;
     boolean EXT_SOURCE_RADIUS;
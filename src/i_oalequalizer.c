@@ -104,7 +104,7 @@ static void RestoreCustomPreset(void)
 
 static void StopEffects(void)
 {
-    for (int i = 0; i < MAX_CHANNELS; i++)
+    for (int i = 0; i < oal->num_sources; i++)
     {
         alSourceStop(oal->sources[i]);
     }
@@ -114,7 +114,7 @@ static void UnloadEffects(void)
 {
     if (alIsAuxiliaryEffectSlot(uiEffectSlot))
     {
-        for (int i = 0; i < MAX_CHANNELS; i++)
+        for (int i = 0; i < oal->num_sources; i++)
         {
             alSourcei(oal->sources[i], AL_DIRECT_FILTER, AL_FILTER_NULL);
             alSource3i(oal->sources[i], AL_AUXILIARY_SEND_FILTER,
@@ -255,7 +255,7 @@ void I_OAL_SetEqualizer(void)
 
     alAuxiliaryEffectSloti(uiEffectSlot, AL_EFFECTSLOT_EFFECT, uiEffect);
 
-    for (int i = 0; i < MAX_CHANNELS; i++)
+    for (int i = 0; i < oal->num_sources; i++)
     {
         // Mute the dry path.
         alFilterf(uiFilter, AL_LOWPASS_GAIN, 0.0f);
@@ -22,13 +22,20 @@
 
 #include <stdlib.h>
 
+#include "d_iwad.h"
 #include "doomtype.h"
 #include "i_oalcommon.h"
 #include "i_oalstream.h"
 #include "i_printf.h"
+#include "i_sndfile.h"
 #include "i_sound.h"
+#include "i_system.h"
+#include "i_timer.h"
 #include "m_array.h"
 #include "m_config.h"
+#include "m_io.h"
+#include "m_misc.h"
+#include "md5.h"
 
 // Define the number of buffers and buffer size (in milliseconds) to use. 4
 // buffers with 4096 samples each gives a nice per-chunk size, and lets the
@@ -36,6 +43,12 @@
 #define NUM_BUFFERS    4
 #define BUFFER_SAMPLES 4096
 
+// [Woof!] The queue grows by a buffer on every underrun, up to this many.
+#define MAX_BUFFERS    12
+
+// Longest sleep of the player thread while the source is not playing.
+#define MAX_SLEEP_MS   100
+
 static stream_module_t *all_modules[] =
 {
 #if defined (HAVE_FLUIDSYNTH)
@@ -68,14 +81,59 @@ static stream_module_t *midi_modules[] =
 
 static stream_module_t *active_module;
 
+// [Woof!] With midi_cache, the songs of the MIDI modules are rendered once
+// to FLAC files in <prefdir>/music, named after the MD5 checksum of the
+// lump and the synth settings, and streamed by the sndfile module from
+// then on. The synths only loop whole songs, and so does the stream.
+//
+// A song that isn't cached yet plays live, and the frames of its first pass
+// are encoded by a thread of their own as they are played. The recording
+// stops at the end of the song's events, without the decay of its last
+// notes, so that the stream loops where the synths do. The file is kept
+// only if the song was played to its end. The oldest files are removed when
+// the directory grows past MUSIC_CACHE_SIZE.
+
+#define MAX_RENDER_SECONDS (30 * 60)
+
+#define MUSIC_CACHE_SIZE   (512 * 1024 * 1024)
+
+static boolean midi_cache;
+
+// MIDI module the playing song was rendered with
+static stream_module_t *cached_module;
+
+static byte *cache_data;
+static size_t cache_length;
+
+// The module whose settings apply to the playing song.
+
+static stream_module_t *SongModule(void)
+{
+    return cached_module ? cached_module : active_module;
+}
+
 typedef struct
 {
     // These are the buffers and source to play out through OpenAL with
-    ALuint buffers[NUM_BUFFERS];
+    ALuint buffers[MAX_BUFFERS];
     ALuint source;
 
+    // The buffers in use and the ones of them that are not queued
+    int num_buffers;
+    ALuint free_buffers[MAX_BUFFERS];
+    int num_free;
+
+    // Holds the next buffer, rendered one buffer ahead of need
     byte *data;
+    uint32_t ahead_frames;
     boolean looping;
+    boolean ended;
+    boolean started;
+
+    // Counters, reported when the song stops
+    int underruns;
+    int fills;
+    uint64_t fill_time, max_fill_time;
 
     ALfloat gain;
     ALfloat auto_gain;
@@ -90,8 +148,32 @@ typedef struct
 
 static stream_player_t player;
 
+typedef struct
+{
+    SDL_Thread *thread;
+    SDL_Mutex *lock;
+    SDL_Condition *wake;
+    char *filename;
+
+    // Frames played but not written yet
+    byte *data;
+    size_t size, alloc;
+
+    boolean finished; // the first pass has been played, write the rest
+    boolean aborted;  // stopped before its end, discard the file
+    boolean closed;   // the file is complete, the frames are not needed
+
+    // The song, to open again when it loops
+    void *song_data;
+    int song_len;
+} recorder_t;
+
+static recorder_t recorder;
+
 static SDL_Thread *player_thread_handle;
 static SDL_AtomicInt player_thread_running;
+static SDL_Mutex *player_lock;
+static SDL_Condition *player_wake;
 
 static boolean music_initialized;
 
@@ -223,6 +305,231 @@ static void AutoGain(uint32_t frames)
     alSourcef(player.source, AL_GAIN, player.gain * player.auto_gain);
 }
 
+// Hands the frames just rendered over to the recorder thread.
+
+static void RecordFrames(const byte *data, uint32_t frames)
+{
+    const size_t size = frames * player.frame_size;
+
+    SDL_LockMutex(recorder.lock);
+    if (!recorder.finished && !recorder.closed)
+    {
+        if (recorder.size + size > recorder.alloc)
+        {
+            recorder.alloc = MAX(recorder.alloc * 2, recorder.size + size);
+            recorder.data = I_Realloc(recorder.data, recorder.alloc);
+        }
+        memcpy(recorder.data + recorder.size, data, size);
+        recorder.size += size;
+        SDL_SignalCondition(recorder.wake);
+    }
+    SDL_UnlockMutex(recorder.lock);
+}
+
+// Returns true if the stream ended the first pass of a recording.
+
+static boolean FinishRecording(void)
+{
+    boolean result = false;
+
+    if (!recorder.thread)
+    {
+        return false;
+    }
+
+    SDL_LockMutex(recorder.lock);
+    if (!recorder.finished)
+    {
+        recorder.finished = true;
+        SDL_SignalCondition(recorder.wake);
+        result = true;
+    }
+    SDL_UnlockMutex(recorder.lock);
+
+    return result;
+}
+
+// Waits for the frames the player renders, and returns fewer than asked for
+// only at the end of the first pass.
+
+static int RecordFill(void *data, int frames)
+{
+    size_t size = frames * player.frame_size;
+
+    SDL_LockMutex(recorder.lock);
+    while (recorder.size < size && !recorder.finished && !recorder.aborted)
+    {
+        SDL_WaitCondition(recorder.wake, recorder.lock);
+    }
+
+    size = recorder.aborted ? 0 : MIN(size, recorder.size);
+    if (size > 0)
+    {
+        memcpy(data, recorder.data, size);
+        recorder.size -= size;
+        memmove(recorder.data, recorder.data + size, recorder.size);
+    }
+    SDL_UnlockMutex(recorder.lock);
+
+    return size / player.frame_size;
+}
+
+static int RecorderThread(void *unused)
+{
+    char *tempfile = M_StringJoin(recorder.filename, ".tmp");
+    boolean ok, aborted;
+
+    ok = I_SND_WriteFile(tempfile, player.format, player.freq, RecordFill,
+                         MAX_RENDER_SECONDS * player.freq);
+
+    SDL_LockMutex(recorder.lock);
+    recorder.closed = true;
+    aborted = recorder.aborted;
+    SDL_UnlockMutex(recorder.lock);
+
+    ok &= !aborted;
+
+    // other instances never see a partially written file
+    if (ok)
+    {
+        M_remove(recorder.filename);
+        ok = !M_rename(tempfile, recorder.filename);
+    }
+
+    if (ok)
+    {
+        I_Printf(VB_DEBUG, "RecorderThread: Wrote %s", recorder.filename);
+    }
+    else
+    {
+        if (!aborted)
+        {
+            I_Printf(VB_WARNING, "RecorderThread: Could not write %s",
+                     recorder.filename);
+        }
+        M_remove(tempfile);
+    }
+
+    free(tempfile);
+
+    return 0;
+}
+
+static void StartRecording(const char *filename, void *data, int len)
+{
+    recorder.lock = SDL_CreateMutex();
+    recorder.wake = SDL_CreateCondition();
+    recorder.filename = M_StringDuplicate(filename);
+    recorder.song_data = data;
+    recorder.song_len = len;
+
+    recorder.thread = SDL_CreateThread(RecorderThread, NULL, NULL);
+
+    if (!recorder.thread)
+    {
+        I_Printf(VB_WARNING, "StartRecording: %s", SDL_GetError());
+        SDL_DestroyCondition(recorder.wake);
+        SDL_DestroyMutex(recorder.lock);
+        free(recorder.filename);
+        memset(&recorder, 0, sizeof(recorder));
+    }
+}
+
+// Discards the file unless the first pass has been played to its end.
+
+static void StopRecording(void)
+{
+    if (!recorder.thread)
+    {
+        return;
+    }
+
+    SDL_LockMutex(recorder.lock);
+    recorder.aborted = !recorder.finished;
+    SDL_SignalCondition(recorder.wake);
+    SDL_UnlockMutex(recorder.lock);
+
+    SDL_WaitThread(recorder.thread, NULL);
+
+    SDL_DestroyCondition(recorder.wake);
+    SDL_DestroyMutex(recorder.lock);
+    free(recorder.filename);
+    free(recorder.data);
+    memset(&recorder, 0, sizeof(recorder));
+}
+
+// Renders the next buffer into player.data, unless it already holds one.
+// Returns false at the end of the stream.
+
+static boolean RenderAhead(void)
+{
+    uint64_t time;
+
+    if (player.ahead_frames || player.ended)
+    {
+        return player.ahead_frames > 0;
+    }
+
+    time = I_GetTimeNS();
+    player.ahead_frames =
+        active_module->I_FillStream(player.data, BUFFER_SAMPLES);
+
+    if (recorder.thread && player.ahead_frames > 0)
+    {
+        RecordFrames(player.data, player.ahead_frames);
+    }
+
+    // The first pass is recorded without looping, up to the end of the
+    // song's events. Loop from there, as the module does when it loops.
+    if (player.ahead_frames < BUFFER_SAMPLES && FinishRecording()
+        && player.looping)
+    {
+        active_module->I_CloseStream();
+        active_module->I_OpenStream(recorder.song_data, recorder.song_len,
+                                    &player.format, &player.freq,
+                                    &player.frame_size);
+        active_module->I_PlayStream(true);
+        player.ahead_frames += active_module->I_FillStream(
+            player.data + player.ahead_frames * player.frame_size,
+            BUFFER_SAMPLES - player.ahead_frames);
+    }
+    time = I_GetTimeNS() - time;
+
+    player.fills++;
+    player.fill_time += time;
+    player.max_fill_time = MAX(player.max_fill_time, time);
+
+    if (player.ahead_frames > 0)
+    {
+        AutoGain(player.ahead_frames);
+    }
+    else
+    {
+        player.ended = true;
+    }
+
+    return player.ahead_frames > 0;
+}
+
+// Fills and queues the free buffers, then renders the next one.
+
+static boolean QueueBuffers(void)
+{
+    while (player.num_free > 0 && RenderAhead())
+    {
+        ALuint bufid = player.free_buffers[--player.num_free];
+
+        alBufferData(bufid, player.format, player.data,
+                     player.ahead_frames * player.frame_size, player.freq);
+        alSourceQueueBuffers(player.source, 1, &bufid);
+        player.ahead_frames = 0;
+    }
+
+    RenderAhead();
+
+    return alGetError() == AL_NO_ERROR;
+}
+
 static boolean UpdatePlayer(void)
 {
     ALint processed, state;
@@ -236,36 +543,34 @@ static boolean UpdatePlayer(void)
         return false;
     }
 
-    // Unqueue and handle each processed buffer
+    // Unqueue the processed buffers
     while (processed > 0)
     {
-        uint32_t frames;
         ALuint bufid;
-        ALsizei size;
 
         alSourceUnqueueBuffers(player.source, 1, &bufid);
+        player.free_buffers[player.num_free++] = bufid;
         processed--;
+    }
 
-        // Read the next chunk of data, refill the buffer, and queue it back on
-        // the source.
-        frames = active_module->I_FillStream(player.data, BUFFER_SAMPLES);
+    // The source ran out of data before the stream did, queue more of it
+    if (state != AL_PLAYING && state != AL_PAUSED && player.started
+        && !player.ended)
+    {
+        player.underruns++;
 
-        if (frames > 0)
+        if (player.num_buffers < MAX_BUFFERS)
         {
-            AutoGain(frames);
+            player.free_buffers[player.num_free++] =
+                player.buffers[player.num_buffers++];
         }
+    }
 
-        if (frames > 0)
-        {
-            size = frames * player.frame_size;
-            alBufferData(bufid, player.format, player.data, size, player.freq);
-            alSourceQueueBuffers(player.source, 1, &bufid);
-        }
-        if (alGetError() != AL_NO_ERROR)
-        {
-            I_Printf(VB_ERROR, "UpdatePlayer: Error buffering data");
-            return false;
-        }
+    // Refill the buffers and queue them back on the source
+    if (!QueueBuffers())
+    {
+        I_Printf(VB_ERROR, "UpdatePlayer: Error buffering data");
+        return false;
     }
 
     // Make sure the source hasn't underrun
@@ -286,58 +591,75 @@ static boolean UpdatePlayer(void)
             I_Printf(VB_ERROR, "UpdatePlayer: Error restarting playback");
             return false;
         }
+
+        player.started = true;
     }
 
     return true;
 }
 
-static boolean StartPlayer(void)
+// Milliseconds until the buffer being played has been processed.
+
+static int TimeToNextBuffer(void)
 {
-    int i;
+    ALint state, offset;
+
+    alGetSourcei(player.source, AL_SOURCE_STATE, &state);
+    alGetSourcei(player.source, AL_SAMPLE_OFFSET, &offset);
+
+    if (alGetError() != AL_NO_ERROR || state != AL_PLAYING)
+    {
+        return MAX_SLEEP_MS;
+    }
+
+    // the offset is from the start of the oldest queued buffer
+    return MAX(BUFFER_SAMPLES - offset, 0) * 1000 / player.freq;
+}
 
+static boolean StartPlayer(void)
+{
     player.data = malloc(BUFFER_SAMPLES * player.frame_size);
+    player.ahead_frames = 0;
+    player.ended = false;
+    player.started = false;
+
+    player.underruns = 0;
+    player.fills = 0;
+    player.fill_time = player.max_fill_time = 0;
 
     // Rewind the source position and clear the buffer queue.
     alSourceRewind(player.source);
     alSourcei(player.source, AL_BUFFER, 0);
 
-    active_module->I_PlayStream(player.looping);
+    active_module->I_PlayStream(player.looping && !recorder.thread);
 
-    // Fill the buffer queue
-    for (i = 0; i < NUM_BUFFERS; i++)
+    player.num_buffers = NUM_BUFFERS;
+    player.num_free = 0;
+    for (int i = NUM_BUFFERS - 1; i >= 0; i--)
     {
-        uint32_t frames;
-        ALsizei size;
-
-        // Get some data to give it to the buffer
-        frames = active_module->I_FillStream(player.data, BUFFER_SAMPLES);
-
-        if (frames < 1)
-        {
-            break;
-        }
-
-        if (frames > 0)
-        {
-            AutoGain(frames);
-        }
-
-        size = frames * player.frame_size;
-
-        alBufferData(player.buffers[i], player.format, player.data, size,
-                     player.freq);
+        player.free_buffers[player.num_free++] = player.buffers[i];
     }
-    if (alGetError() != AL_NO_ERROR)
+
+    // Fill the buffer queue
+    if (!QueueBuffers())
     {
         I_Printf(VB_ERROR, "StartPlayer: Error buffering for playback.");
         return false;
     }
 
-    alSourceQueueBuffers(player.source, i, player.buffers);
-
     return true;
 }
 
+static void WakePlayer(void)
+{
+    SDL_LockMutex(player_lock);
+    SDL_SignalCondition(player_wake);
+    SDL_UnlockMutex(player_lock);
+}
+
+// Sleeps until the next buffer is due instead of polling the source, and
+// is woken early when the song is stopped or resumed.
+
 static int PlayerThread(void *unused)
 {
     SDL_SetCurrentThreadPriority(SDL_THREAD_PRIORITY_TIME_CRITICAL);
@@ -349,9 +671,16 @@ static int PlayerThread(void *unused)
         if (!UpdatePlayer())
         {
             SDL_SetAtomicInt(&player_thread_running, 0);
+            break;
         }
 
-        SDL_Delay(1);
+        SDL_LockMutex(player_lock);
+        if (SDL_GetAtomicInt(&player_thread_running))
+        {
+            SDL_WaitConditionTimeout(player_wake, player_lock,
+                                     MAX(TimeToNextBuffer(), 1));
+        }
+        SDL_UnlockMutex(player_lock);
     }
 
     return 0;
@@ -364,9 +693,12 @@ boolean I_OAL_InitStream(void)
         return false;
     }
 
-    alGenBuffers(NUM_BUFFERS, player.buffers);
+    alGenBuffers(MAX_BUFFERS, player.buffers);
     alGenSources(1, &player.source);
 
+    player_lock = SDL_CreateMutex();
+    player_wake = SDL_CreateCondition();
+
     alSourcef(player.source, AL_MAX_GAIN, 10.0f);
 
     // Set parameters so mono sources play out the front-center speaker and
@@ -410,12 +742,17 @@ void I_OAL_ShutdownStream(void)
     }
 
     alDeleteSources(1, &player.source);
-    alDeleteBuffers(NUM_BUFFERS, player.buffers);
+    alDeleteBuffers(MAX_BUFFERS, player.buffers);
     if (alGetError() != AL_NO_ERROR)
     {
         I_Printf(VB_ERROR, "I_OAL_ShutdownStream: Failed to delete object IDs.");
     }
 
+    SDL_DestroyCondition(player_wake);
+    SDL_DestroyMutex(player_lock);
+    player_wake = NULL;
+    player_lock = NULL;
+
     memset(&player, 0, sizeof(stream_player_t));
 
     music_initialized = false;
@@ -458,12 +795,12 @@ static void I_OAL_SetMusicVolume(int volume)
 
     if (!auto_gain)
     {
-        if (active_module == &stream_opl_module)
+        if (SongModule() == &stream_opl_module)
         {
             player.gain *= (ALfloat)DB_TO_GAIN(opl_gain);
         }
     #if defined(HAVE_FLUIDSYNTH)
-        else if (active_module == &stream_fl_module)
+        else if (SongModule() == &stream_fl_module)
         {
             player.gain *= (ALfloat)DB_TO_GAIN(fl_gain);
         }
@@ -491,6 +828,7 @@ static void I_OAL_ResumeSong(void *handle)
     }
 
     alSourcePlay(player.source);
+    WakePlayer();
 }
 
 static void I_OAL_PlaySong(void *handle, boolean looping)
@@ -523,12 +861,22 @@ static void I_OAL_StopSong(void *handle)
     alSourceStop(player.source);
 
     SDL_SetAtomicInt(&player_thread_running, 0);
+    WakePlayer();
     SDL_WaitThread(player_thread_handle, NULL);
 
+    StopRecording();
+
     if (alGetError() != AL_NO_ERROR)
     {
         I_Printf(VB_ERROR, "I_OAL_StopSong: Error stopping playback.");
     }
+
+    I_Printf(VB_DEBUG,
+             "I_OAL_StopSong: %d buffers, %d underruns, "
+             "fill time %.2f ms average, %.2f ms max",
+             player.num_buffers, player.underruns,
+             player.fill_time / 1000000.0 / MAX(player.fills, 1),
+             player.max_fill_time / 1000000.0);
 }
 
 static void I_OAL_UnRegisterSong(void *handle)
@@ -538,11 +886,20 @@ static void I_OAL_UnRegisterSong(void *handle)
         return;
     }
 
+    StopRecording();
+
     if (active_module)
     {
         active_module->I_CloseStream();
     }
 
+    if (cache_data)
+    {
+        M_UnmapFile(cache_data, cache_length);
+        cache_data = NULL;
+    }
+    cached_module = NULL;
+
     ShutdownAutoGain();
 
     if (player.data)
@@ -568,6 +925,93 @@ static void I_OAL_ShutdownMusic(void)
     }
 }
 
+static char *CacheFileName(void *data, int len, const char *key)
+{
+    struct MD5Context md5;
+    byte digest[16];
+    char digest_string[33];
+    char *dir, *filename;
+
+    MD5Init(&md5);
+    MD5Update(&md5, data, len);
+    MD5Update(&md5, (const byte *)key, strlen(key));
+    MD5Final(digest, &md5);
+
+    M_DigestToString(digest, digest_string, sizeof(digest));
+
+    dir = M_StringJoin(D_DoomPrefDir(), DIR_SEPARATOR_S, "music");
+    M_MakeDirectory(dir);
+    M_TrimCacheDir(dir, "*.flac", MUSIC_CACHE_SIZE);
+
+    filename = M_StringJoin(dir, DIR_SEPARATOR_S, digest_string, ".flac");
+    free(dir);
+
+    return filename;
+}
+
+static boolean OpenCachedSong(const char *filename)
+{
+    cache_data = M_MapFile(filename, &cache_length);
+
+    if (cache_data
+        && stream_snd_module.I_OpenStream(cache_data, cache_length,
+                                          &player.format, &player.freq,
+                                          &player.frame_size))
+    {
+        return true;
+    }
+
+    if (cache_data)
+    {
+        M_UnmapFile(cache_data, cache_length);
+        cache_data = NULL;
+    }
+
+    return false;
+}
+
+// Replaces the song just opened by the MIDI module with its rendering, or
+// records one while the module plays the song. Returns false if the module
+// plays the song.
+
+static boolean OpenCache(stream_module_t *module, void *data, int len)
+{
+    const char *key = module->I_CacheKey ? module->I_CacheKey() : NULL;
+    char *filename;
+    boolean ok;
+
+    if (!midi_cache || !key)
+    {
+        return false;
+    }
+
+    filename = CacheFileName(data, len, key);
+
+    if (!M_FileExistsNotDir(filename))
+    {
+        StartRecording(filename, data, len);
+        free(filename);
+        return false;
+    }
+
+    module->I_CloseStream();
+    ok = OpenCachedSong(filename);
+    free(filename);
+
+    if (ok)
+    {
+        active_module = &stream_snd_module;
+        cached_module = module;
+        return true;
+    }
+
+    // the module plays the song after all
+    module->I_CloseStream();
+    module->I_OpenStream(data, len, &player.format, &player.freq,
+                         &player.frame_size);
+    return false;
+}
+
 // Prebuffers some audio from the file, and starts playing the source.
 
 static void *I_OAL_RegisterSong(void *data, int len)
@@ -583,6 +1027,7 @@ static void *I_OAL_RegisterSong(void *data, int len)
                                             &player.freq, &player.frame_size))
         {
             active_module = all_modules[i];
+            OpenCache(active_module, data, len);
             InitAutoGain();
             return (void *)1;
         }
@@ -616,12 +1061,12 @@ static const char **I_OAL_DeviceList(void)
 static midiplayertype_t I_OAL_MidiPlayerType(void)
 {
 #if defined (HAVE_FLUIDSYNTH)
-    if (active_module == &stream_fl_module)
+    if (SongModule() == &stream_fl_module)
     {
         return midiplayer_fluidsynth;
     }
 #endif
-    if (active_module == &stream_opl_module)
+    if (SongModule() == &stream_opl_module)
     {
         return midiplayer_opl;
     }
@@ -631,6 +1076,8 @@ static midiplayertype_t I_OAL_MidiPlayerType(void)
 static void I_OAL_BindVariables(void)
 {
     BIND_BOOL_MUSIC(auto_gain, true, "Auto Gain");
+    BIND_BOOL(midi_cache, false,
+        "Render MIDI music once and stream it from a cache on disk");
 #if defined (HAVE_FLUIDSYNTH)
     BIND_NUM_MUSIC(fl_gain, 0, -20, 20, "[FluidSynth] Gain [dB]");
 #endif
@@ -645,7 +1092,7 @@ static const char *I_OAL_MusicFormat(void)
 {
     if (active_module)
     {
-        return active_module->I_MusicFormat();
+        return SongModule()->I_MusicFormat();
     }
     return "None";
 }
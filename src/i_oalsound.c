@@ -16,6 +16,7 @@
 //      System interface for OpenAL sound.
 //
 
+#include <SDL3/SDL.h>
 #include "al.h"
 #include "alc.h"
 #include "alext.h"
@@ -23,6 +24,7 @@
 
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "i_oalcommon.h"
 #include "i_oalequalizer.h"
@@ -50,6 +52,9 @@
 
 #define VOL_TO_GAIN(x)          ((ALfloat)(x) / 127)
 
+// Decoded sounds uploaded to buffers per I_OAL_ProcessUpdates().
+#define UPLOAD_BATCH            8
+
 static int snd_resampler;
 static boolean snd_hrtf;
 static int snd_absorption;
@@ -72,6 +77,8 @@ void I_OAL_DeferUpdates(void)
     alDeferUpdatesSOFT();
 }
 
+static void UploadSounds(int count);
+
 void I_OAL_ProcessUpdates(void)
 {
     if (!oal)
@@ -79,6 +86,8 @@ void I_OAL_ProcessUpdates(void)
         return;
     }
 
+    UploadSounds(UPLOAD_BATCH);
+
     alProcessUpdatesSOFT();
 }
 
@@ -114,6 +123,9 @@ static void InitDeferred(void)
         FUNCTION_CAST(LPALPROCESSUPDATESSOFT, &wrap_ProcessUpdatesSOFT);
 }
 
+static void DrainDecoder(void);
+static void ShutdownDecoder(void);
+
 void I_OAL_ShutdownModule(void)
 {
     int i;
@@ -123,7 +135,9 @@ void I_OAL_ShutdownModule(void)
         return;
     }
 
-    for (i = 0; i < MAX_CHANNELS; ++i)
+    DrainDecoder();
+
+    for (i = 0; i < oal->num_sources; ++i)
     {
         alSourcei(oal->sources[i], AL_BUFFER, 0);
     }
@@ -146,11 +160,12 @@ void I_OAL_ShutdownSound(void)
 {
     I_OAL_ShutdownEqualizer();
 
-    for (int i = 0; i < MAX_CHANNELS; ++i)
+    for (int i = 0; i < I_OAL_NumSources(); ++i)
     {
         I_OAL_StopSound(i);
     }
     I_OAL_ShutdownModule();
+    ShutdownDecoder();
 
     if (!oal)
     {
@@ -159,7 +174,7 @@ void I_OAL_ShutdownSound(void)
 
     if (oal->sources)
     {
-        alDeleteSources(MAX_CHANNELS, oal->sources);
+        alDeleteSources(oal->num_sources, oal->sources);
         free(oal->sources);
     }
 
@@ -221,7 +236,7 @@ void I_OAL_SetResampler(void)
         snd_resampler = def_resampler;
     }
 
-    for (i = 0; i < MAX_CHANNELS; i++)
+    for (i = 0; i < oal->num_sources; i++)
     {
         alSourcei(oal->sources[i], AL_SOURCE_RESAMPLER_SOFT, snd_resampler);
     }
@@ -360,7 +375,7 @@ static void ResetParams(void)
     int i;
 
     // Source parameters.
-    for (i = 0; i < MAX_CHANNELS; i++)
+    for (i = 0; i < oal->num_sources; i++)
     {
         I_OAL_ResetSource2D(i);
         alSource3i(oal->sources[i], AL_DIRECTION, 0, 0, 0);
@@ -368,7 +383,7 @@ static void ResetParams(void)
     // Spatialization is required even for 2D panning emulation.
     if (oal->SOFT_source_spatialize)
     {
-        for (i = 0; i < MAX_CHANNELS; i++)
+        for (i = 0; i < oal->num_sources; i++)
         {
             alSourcei(oal->sources[i], AL_SOURCE_SPATIALIZE_SOFT, AL_TRUE);
         }
@@ -435,6 +450,10 @@ static void GetAttribs(ALCint **attribs)
         array_push(*attribs, snd_limiter ? ALC_TRUE : ALC_FALSE);
     }
 
+    // Ask for a source per channel, the default may be fewer.
+    array_push(*attribs, ALC_MONO_SOURCES);
+    array_push(*attribs, MAX_CHANNELS);
+
     // Attribute list must be zero terminated.
     array_push(*attribs, 0);
 }
@@ -451,6 +470,11 @@ void I_OAL_BindSoundVariables(void)
         "[OpenAL 3D] Doppler effect (0 = Off; 10 = Max)");
 }
 
+int I_OAL_NumSources(void)
+{
+    return oal ? oal->num_sources : 0;
+}
+
 boolean I_OAL_InitSound(int snd_module)
 {
     ALCint *attribs = NULL;
@@ -483,15 +507,30 @@ boolean I_OAL_InitSound(int snd_module)
     }
     PrintDeviceInfo(oal->device);
 
+    // [Woof!] Not every device can supply MAX_CHANNELS sources, so they are
+    // created one by one until it runs out.
     oal->sources = malloc(sizeof(*oal->sources) * MAX_CHANNELS);
     alGetError();
-    alGenSources(MAX_CHANNELS, oal->sources);
-    if (!oal->sources || alGetError() != AL_NO_ERROR)
+    while (oal->sources && oal->num_sources < MAX_CHANNELS)
+    {
+        alGenSources(1, &oal->sources[oal->num_sources]);
+        if (alGetError() != AL_NO_ERROR)
+        {
+            break;
+        }
+        oal->num_sources++;
+    }
+    if (!oal->num_sources)
     {
         I_Printf(VB_ERROR, "I_OAL_InitSound: Error creating sources.");
         I_OAL_ShutdownSound();
         return false;
     }
+    if (oal->num_sources < MAX_CHANNELS)
+    {
+        I_Printf(VB_WARNING, " Only %d sound sources available.",
+                 oal->num_sources);
+    }
 
     oal->SOFT_source_spatialize =
         (alIsExtensionPresent("AL_SOFT_source_spatialize") == AL_TRUE);
@@ -617,16 +656,428 @@ static void FadeInOutMono8(byte *data, ALsizei size, ALsizei freq)
     }
 }
 
+static boolean UploadSound(sfxinfo_t *sfx, ALenum format,
+                           const byte *sampledata, ALsizei size, ALsizei freq)
+{
+    ALuint buffer;
+
+    alGetError();
+    alGenBuffers(1, &buffer);
+    if (alGetError() != AL_NO_ERROR)
+    {
+        I_Printf(VB_ERROR, "I_OAL_CacheSound: Error creating buffers.");
+        return false;
+    }
+    alBufferData(buffer, format, sampledata, size, freq);
+    if (alGetError() != AL_NO_ERROR)
+    {
+        I_Printf(VB_ERROR, "I_OAL_CacheSound: Error buffering data.");
+        return false;
+    }
+
+    sfx->buffer = buffer;
+    sfx->cached = true;
+
+    if (sfx->ambient)
+    {
+        sfx->length = GetSoundLength(sfx->buffer);
+
+        if ((uint64_t)(sfx->length * FRACUNIT) > INT_MAX)
+        {
+            // Ignore ambient sounds that are somehow over 32767.99998474
+            // seconds long.
+            sfx->length = 0.0f; 
+        }
+    }
+
+    I_CacheRumble(sfx, format, sampledata, size, freq);
+
+    return true;
+}
+
+//
+// Background decoding
+//
+// [Woof!] Sounds that are not in the DMX format are decoded by libsndfile
+// on a thread of their own, which can take long for big WAV, OGG or FLAC
+// replacements. Only the main thread reads lumps and uploads the decoded
+// sounds to buffers, a batch at a time. A sound is not played until it has
+// been decoded, instead of stalling the game.
+//
+
+typedef struct decode_s
+{
+    sfxinfo_t *sfx;
+    byte *lumpdata; // copy of the lump, freed by the decoder
+    int lumplen;
+    boolean looping;
+
+    byte *wavdata;
+    ALsizei size, freq;
+    ALenum format;
+    boolean ok;
+
+    struct decode_s *next;
+} decode_t;
+
+static SDL_Thread *decoder_thread;
+static SDL_Mutex *decoder_lock;
+static SDL_Condition *decoder_wake;
+static SDL_Condition *decoder_done;
+static boolean decoder_quit;
+static boolean decoder_failed; // decode on the main thread
+
+static decode_t *pending_head, *pending_tail; // not decoded yet
+static decode_t *decoded_head, *decoded_tail; // not uploaded yet
+static decode_t *decoding;
+
+static void DecodeSound(decode_t *decode)
+{
+    decode->size = decode->lumplen;
+    decode->ok = I_SND_LoadFile(decode->lumpdata, &decode->format,
+                                &decode->wavdata, &decode->size,
+                                &decode->freq, decode->looping);
+    free(decode->lumpdata);
+    decode->lumpdata = NULL;
+}
+
+static void AppendDecode(decode_t **head, decode_t **tail, decode_t *decode)
+{
+    decode->next = NULL;
+    if (*tail)
+    {
+        (*tail)->next = decode;
+    }
+    else
+    {
+        *head = decode;
+    }
+    *tail = decode;
+}
+
+// Unlinks the decode of sfx, or the first one if sfx is NULL.
+
+static decode_t *RemoveDecode(decode_t **head, decode_t **tail,
+                              const sfxinfo_t *sfx)
+{
+    decode_t *prev = NULL, *decode;
+
+    for (decode = *head; decode; prev = decode, decode = decode->next)
+    {
+        if (!sfx || decode->sfx == sfx)
+        {
+            if (prev)
+            {
+                prev->next = decode->next;
+            }
+            else
+            {
+                *head = decode->next;
+            }
+            if (*tail == decode)
+            {
+                *tail = prev;
+            }
+            decode->next = NULL;
+            break;
+        }
+    }
+
+    return decode;
+}
+
+static int DecoderThread(void *arg)
+{
+    SDL_LockMutex(decoder_lock);
+
+    while (true)
+    {
+        while (!decoder_quit && !pending_head)
+        {
+            SDL_WaitCondition(decoder_wake, decoder_lock);
+        }
+
+        if (decoder_quit)
+        {
+            break;
+        }
+
+        decoding = RemoveDecode(&pending_head, &pending_tail, NULL);
+        SDL_UnlockMutex(decoder_lock);
+
+        DecodeSound(decoding);
+
+        SDL_LockMutex(decoder_lock);
+        AppendDecode(&decoded_head, &decoded_tail, decoding);
+        decoding = NULL;
+        SDL_BroadcastCondition(decoder_done);
+    }
+
+    SDL_UnlockMutex(decoder_lock);
+
+    return 0;
+}
+
+static boolean InitDecoder(void)
+{
+    if (decoder_thread || decoder_failed)
+    {
+        return !decoder_failed;
+    }
+
+    decoder_lock = SDL_CreateMutex();
+    decoder_wake = SDL_CreateCondition();
+    decoder_done = SDL_CreateCondition();
+    decoder_quit = false;
+
+    if (decoder_lock && decoder_wake && decoder_done)
+    {
+        decoder_thread =
+            SDL_CreateThread(DecoderThread, "woof sound decoder", NULL);
+    }
+
+    if (!decoder_thread)
+    {
+        I_Printf(VB_WARNING,
+                 "I_OAL_CacheSound: Failed to create decoder thread: %s",
+                 SDL_GetError());
+        ShutdownDecoder();
+        decoder_failed = true;
+        return false;
+    }
+
+    return true;
+}
+
+// Waits for the sound being decoded and drops all others.
+
+static void DrainDecoder(void)
+{
+    decode_t *decode;
+
+    if (!decoder_thread)
+    {
+        return;
+    }
+
+    SDL_LockMutex(decoder_lock);
+
+    while (decoding)
+    {
+        SDL_WaitCondition(decoder_done, decoder_lock);
+    }
+
+    while ((decode = RemoveDecode(&pending_head, &pending_tail, NULL))
+           || (decode = RemoveDecode(&decoded_head, &decoded_tail, NULL)))
+    {
+        decode->sfx->decoding = false;
+        free(decode->lumpdata);
+        free(decode->wavdata);
+        free(decode);
+    }
+
+    SDL_UnlockMutex(decoder_lock);
+}
+
+static void ShutdownDecoder(void)
+{
+    if (decoder_thread)
+    {
+        DrainDecoder();
+
+        SDL_LockMutex(decoder_lock);
+        decoder_quit = true;
+        SDL_SignalCondition(decoder_wake);
+        SDL_UnlockMutex(decoder_lock);
+
+        SDL_WaitThread(decoder_thread, NULL);
+        decoder_thread = NULL;
+    }
+
+    if (decoder_done)
+    {
+        SDL_DestroyCondition(decoder_done);
+        decoder_done = NULL;
+    }
+    if (decoder_wake)
+    {
+        SDL_DestroyCondition(decoder_wake);
+        decoder_wake = NULL;
+    }
+    if (decoder_lock)
+    {
+        SDL_DestroyMutex(decoder_lock);
+        decoder_lock = NULL;
+    }
+}
+
+static void FinishDecode(decode_t *decode)
+{
+    sfxinfo_t *sfx = decode->sfx;
+
+    sfx->decoding = false;
+
+    if (!decode->ok)
+    {
+        I_Printf(VB_WARNING, " I_OAL_CacheSound: %s",
+                 lumpinfo[sfx->lumpnum].name);
+    }
+
+    if (!decode->ok
+        || !UploadSound(sfx, decode->format, decode->wavdata, decode->size,
+                        decode->freq))
+    {
+        sfx->lumpnum = -2; // [FG] don't try again
+    }
+
+    free(decode->wavdata);
+    free(decode);
+}
+
+static void QueueSound(sfxinfo_t *sfx, const byte *lumpdata, int lumplen)
+{
+    decode_t *decode = calloc(1, sizeof(*decode));
+
+    decode->sfx = sfx;
+    decode->lumpdata = malloc(lumplen);
+    decode->lumplen = lumplen;
+    decode->looping = sfx->looping;
+    memcpy(decode->lumpdata, lumpdata, lumplen);
+
+    sfx->decoding = true;
+
+    // the ambient sounds need their length when they are spawned
+    if (sfx->ambient || !InitDecoder())
+    {
+        DecodeSound(decode);
+        FinishDecode(decode);
+        return;
+    }
+
+    SDL_LockMutex(decoder_lock);
+    AppendDecode(&pending_head, &pending_tail, decode);
+    SDL_SignalCondition(decoder_wake);
+    SDL_UnlockMutex(decoder_lock);
+}
+
+// Uploads the sound if it has been decoded.
+
+static boolean FinishSound(sfxinfo_t *sfx)
+{
+    decode_t *decode;
+
+    SDL_LockMutex(decoder_lock);
+    decode = RemoveDecode(&decoded_head, &decoded_tail, sfx);
+    SDL_UnlockMutex(decoder_lock);
+
+    if (decode)
+    {
+        FinishDecode(decode);
+    }
+
+    return sfx->cached;
+}
+
+static void UploadSounds(int count)
+{
+    decode_t *decode;
+
+    if (!decoder_thread)
+    {
+        return;
+    }
+
+    while (count--)
+    {
+        SDL_LockMutex(decoder_lock);
+        decode = RemoveDecode(&decoded_head, &decoded_tail, NULL);
+        SDL_UnlockMutex(decoder_lock);
+
+        if (!decode)
+        {
+            break;
+        }
+
+        FinishDecode(decode);
+    }
+}
+
+void I_OAL_PreloadSounds(sfxinfo_t **sfx, int count)
+{
+    decode_t *first_head = NULL, *first_tail = NULL;
+    decode_t *decode;
+    int i;
+
+    if (!oal)
+    {
+        return;
+    }
+
+    for (i = 0; i < count; ++i)
+    {
+        I_OAL_CacheSound(sfx[i]);
+    }
+
+    if (!decoder_thread)
+    {
+        return;
+    }
+
+    SDL_LockMutex(decoder_lock);
+
+    // decode these before the others
+    for (i = 0; i < count; ++i)
+    {
+        if ((decode = RemoveDecode(&pending_head, &pending_tail, sfx[i])))
+        {
+            AppendDecode(&first_head, &first_tail, decode);
+        }
+    }
+    if (first_head)
+    {
+        first_tail->next = pending_head;
+        pending_head = first_head;
+        if (!pending_tail)
+        {
+            pending_tail = first_tail;
+        }
+    }
+
+    for (i = 0; i < count; ++i)
+    {
+        if (!sfx[i]->decoding)
+        {
+            continue;
+        }
+
+        while (!(decode = RemoveDecode(&decoded_head, &decoded_tail, sfx[i])))
+        {
+            SDL_WaitCondition(decoder_done, decoder_lock);
+        }
+
+        SDL_UnlockMutex(decoder_lock);
+        FinishDecode(decode);
+        SDL_LockMutex(decoder_lock);
+    }
+
+    SDL_UnlockMutex(decoder_lock);
+}
+
 boolean I_OAL_CacheSound(sfxinfo_t *sfx)
 {
     int lumpnum;
-    byte *lumpdata = NULL, *wavdata = NULL;
+    byte *lumpdata = NULL;
 
     if (!oal)
     {
         return false;
     }
 
+    if (sfx->decoding)
+    {
+        return FinishSound(sfx);
+    }
+
     lumpnum = I_GetSfxLumpNum(sfx);
 
     if (lumpnum < 0)
@@ -641,8 +1092,6 @@ boolean I_OAL_CacheSound(sfxinfo_t *sfx)
         int lumplen;
 
         ALsizei size, freq;
-        ALenum format;
-        ALuint buffer;
 
         // haleyjd: this should always be called (if lump is already loaded,
         // W_CacheLumpNum handles that for us).
@@ -680,53 +1129,14 @@ boolean I_OAL_CacheSound(sfxinfo_t *sfx)
             }
 
             // All Doom sounds are 8-bit
-            format = AL_FORMAT_MONO8;
+            UploadSound(sfx, AL_FORMAT_MONO8, sampledata, size, freq);
         }
         else
         {
-            size = lumplen;
-
-            if (!I_SND_LoadFile(lumpdata, &format, &wavdata, &size, &freq,
-                                sfx->looping))
-            {
-                I_Printf(VB_WARNING, " I_OAL_CacheSound: %s",
-                         lumpinfo[lumpnum].name);
-                break;
-            }
-
-            sampledata = wavdata;
-        }
-
-        alGetError();
-        alGenBuffers(1, &buffer);
-        if (alGetError() != AL_NO_ERROR)
-        {
-            I_Printf(VB_ERROR, "I_OAL_CacheSound: Error creating buffers.");
-            break;
-        }
-        alBufferData(buffer, format, sampledata, size, freq);
-        if (alGetError() != AL_NO_ERROR)
-        {
-            I_Printf(VB_ERROR, "I_OAL_CacheSound: Error buffering data.");
-            break;
+            QueueSound(sfx, lumpdata, lumplen);
         }
 
-        sfx->buffer = buffer;
-        sfx->cached = true;
-
-        if (sfx->ambient)
-        {
-            sfx->length = GetSoundLength(sfx->buffer);
-
-            if ((uint64_t)(sfx->length * FRACUNIT) > INT_MAX)
-            {
-                // Ignore ambient sounds that are somehow over 32767.99998474
-                // seconds long.
-                sfx->length = 0.0f; 
-            }
-        }
-
-        I_CacheRumble(sfx, format, sampledata, size, freq);
+        break;
     }
 
     // don't need original lump data any more
@@ -734,14 +1144,13 @@ boolean I_OAL_CacheSound(sfxinfo_t *sfx)
     {
         Z_Free(lumpdata);
     }
-    if (wavdata)
-    {
-        free(wavdata);
-    }
 
     if (sfx->cached == false)
     {
-        sfx->lumpnum = -2; // [FG] don't try again
+        if (!sfx->decoding)
+        {
+            sfx->lumpnum = -2; // [FG] don't try again
+        }
         return false;
     }
 
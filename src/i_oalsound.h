@@ -52,6 +52,9 @@ void I_OAL_UpdateListenerParams(const ALfloat *position,
 
 const char **I_OAL_GetResamplerStrings(void);
 
+// Number of sources, which may be less than MAX_CHANNELS.
+int I_OAL_NumSources(void);
+
 boolean I_OAL_InitSound(int snd_module);
 
 boolean I_OAL_ReinitSound(int snd_module);
@@ -60,6 +63,8 @@ boolean I_OAL_AllowReinitSound(void);
 
 boolean I_OAL_CacheSound(struct sfxinfo_s *sfx);
 
+void I_OAL_PreloadSounds(struct sfxinfo_s **sfx, int count);
+
 float I_OAL_GetOffset(int channel);
 
 boolean I_OAL_StartSound(int channel, struct sfxinfo_s *sfx,
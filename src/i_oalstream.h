@@ -27,6 +27,9 @@ typedef struct
     boolean (*I_InitStream)(int device);
     boolean (*I_OpenStream)(void *data, ALsizei size, ALenum *format,
                             ALsizei *freq, ALsizei *frame_size);
+    // Returns fewer frames than asked for when a song that doesn't loop
+    // reaches the end of its events. The fills after that, if any, are the
+    // decay of its last notes.
     int (*I_FillStream)(void *data, int frames);
     void (*I_PlayStream)(boolean looping);
     void (*I_CloseStream)(void);
@@ -34,6 +37,9 @@ typedef struct
     const char **(*I_DeviceList)(void);
     void (*BindVariables)(void);
     const char *(*I_MusicFormat)(void);
+    // Identifies the synth and its settings for the music cache, NULL if
+    // the songs of the module are not rendered to it.
+    const char *(*I_CacheKey)(void);
 } stream_module_t;
 
 extern stream_module_t stream_opl_module;
@@ -28,6 +28,7 @@
 #include "m_array.h"
 #include "m_config.h"
 #include "m_io.h"
+#include "m_misc.h"
 #include "m_swap.h"
 #include "memio.h"
 #include "midifile.h"
@@ -1457,6 +1458,20 @@ static void StartTrack(midi_file_t *file, unsigned int track_num)
     ScheduleTrack(track);
 }
 
+// Everything the rendered songs depend on.
+
+static char cache_key[128];
+
+static void MakeCacheKey(const char *lumpname)
+{
+    const int lumpnum = W_GetNumForName(lumpname);
+
+    M_snprintf(cache_key, sizeof(cache_key), "OPL %s %s %d %d %d %d",
+               lumpname, M_BaseName(W_WadNameForLump(lumpnum)),
+               W_LumpLength(lumpnum), num_opl_chips, opl_opl3mode,
+               opl_stereo_correct);
+}
+
 static boolean I_OPL_InitStream(int device)
 {
     char *dmxoption;
@@ -1506,6 +1521,8 @@ static boolean I_OPL_InitStream(int device)
         return false;
     }
 
+    MakeCacheKey(device ? "DMXOPL" : "GENMIDI");
+
     InitVoices();
 
     tracks = NULL;
@@ -1618,9 +1635,28 @@ static void I_OPL_PlayStream(boolean looping)
     }
 }
 
+// [Woof!] Blocks of about the 5 ms a looping song waits to restart
+#define END_BLOCK_SAMPLES 256
+
 static int I_OPL_FillStream(void *buffer, int buffer_samples)
 {
-    return OPL_FillBuffer(buffer, buffer_samples);
+    byte *data = buffer;
+    int filled = 0;
+
+    if (song_looping)
+    {
+        return OPL_FillBuffer(data, buffer_samples);
+    }
+
+    // A song that doesn't loop ends with its last track, in a short fill.
+    while (filled < buffer_samples && running_tracks > 0)
+    {
+        filled += OPL_FillBuffer(data + filled * 2 * sizeof(short),
+                                 MIN(END_BLOCK_SAMPLES,
+                                     buffer_samples - filled));
+    }
+
+    return filled;
 }
 
 static void I_OPL_CloseStream(void)
@@ -1695,6 +1731,11 @@ static const char *I_OPL_MusicFormat(void)
     return music_format;
 }
 
+static const char *I_OPL_CacheKey(void)
+{
+    return music_initialized ? cache_key : NULL;
+}
+
 static void I_OPL_BindVariables(void)
 {
     BIND_NUM_MUSIC(num_opl_chips, 1, 1, OPL_MAX_CHIPS,
@@ -1714,4 +1755,5 @@ stream_module_t stream_opl_module =
     I_OPL_DeviceList,
     I_OPL_BindVariables,
     I_OPL_MusicFormat,
+    I_OPL_CacheKey,
 };
@@ -513,6 +513,7 @@ const sound_module_t sound_pcs_module =
     I_PCS_ReinitSound,
     I_OAL_AllowReinitSound,
     I_PCS_CacheSound,
+    NULL,
     I_PCS_AdjustSoundParams,
     I_PCS_UpdateSoundParams,
     NULL,
@@ -31,6 +31,7 @@
 #include "config.h"
 #include "i_oalstream.h"
 #include "i_printf.h"
+#include "m_io.h"
 #include "m_swap.h"
 #include "memio.h"
 
@@ -294,7 +295,8 @@ static sf_count_t sfx_mix_mono_read_float(SNDFILE *file, float *data,
         return sf_readf_float(file, data, datalen);
     }
 
-    static float multi_data[2048];
+    // [Woof!] not static, sounds are decoded on more than one thread
+    float multi_data[2048];
     int k, ch, frames_read;
     sf_count_t dataout = 0;
 
@@ -340,7 +342,7 @@ static sf_count_t sfx_mix_mono_read_short(SNDFILE *file, short *data,
         return sf_readf_short(file, data, datalen);
     }
 
-    static short multi_data[2048];
+    short multi_data[2048];
     int k, ch, frames_read;
     sf_count_t dataout = 0;
 
@@ -638,6 +640,145 @@ boolean I_SND_LoadFile(void *data, ALenum *format, byte **wavdata,
     return true;
 }
 
+static sf_count_t sfvio_file_get_filelen(void *user_data)
+{
+    FILE *file = user_data;
+    long pos;
+    sf_count_t len;
+
+    pos = ftell(file);
+    fseek(file, 0, SEEK_END);
+    len = ftell(file);
+    fseek(file, pos, SEEK_SET);
+
+    return len;
+}
+
+static sf_count_t sfvio_file_seek(sf_count_t offset, int whence,
+                                  void *user_data)
+{
+    FILE *file = user_data;
+
+    fseek(file, offset, whence);
+
+    return ftell(file);
+}
+
+static sf_count_t sfvio_file_read(void *ptr, sf_count_t count,
+                                  void *user_data)
+{
+    return fread(ptr, 1, count, (FILE *)user_data);
+}
+
+static sf_count_t sfvio_file_write(const void *ptr, sf_count_t count,
+                                   void *user_data)
+{
+    return fwrite(ptr, 1, count, (FILE *)user_data);
+}
+
+static sf_count_t sfvio_file_tell(void *user_data)
+{
+    return ftell((FILE *)user_data);
+}
+
+static SF_VIRTUAL_IO sfvio_file =
+{
+    sfvio_file_get_filelen,
+    sfvio_file_seek,
+    sfvio_file_read,
+    sfvio_file_write,
+    sfvio_file_tell
+};
+
+#define WRITE_FRAMES 4096
+
+boolean I_SND_WriteFile(const char *filename, ALenum format, ALsizei freq,
+                        int (*fill)(void *data, int frames), int max_frames)
+{
+    SF_INFO sfinfo = {0};
+    SNDFILE *sndfile;
+    sample_format_t sample_format;
+    void *data;
+    int frames, total = 0;
+    boolean done = false;
+    boolean ok = true;
+    FILE *file;
+
+    switch (format)
+    {
+        case AL_FORMAT_MONO16:
+        case AL_FORMAT_STEREO16:
+            sample_format = Int16;
+            sfinfo.format = SF_FORMAT_FLAC | SF_FORMAT_PCM_16;
+            break;
+        case AL_FORMAT_MONO_FLOAT32:
+        case AL_FORMAT_STEREO_FLOAT32:
+            // read back as float, see OpenFile()
+            sample_format = Float;
+            sfinfo.format = SF_FORMAT_FLAC | SF_FORMAT_PCM_24;
+            break;
+        default:
+            return false;
+    }
+
+    sfinfo.samplerate = freq;
+    sfinfo.channels = (format == AL_FORMAT_MONO16
+                       || format == AL_FORMAT_MONO_FLOAT32) ? 1 : 2;
+
+    file = M_fopen(filename, "w+b");
+
+    if (!file)
+    {
+        return false;
+    }
+
+    sndfile = sf_open_virtual(&sfvio_file, SFM_WRITE, &sfinfo, file);
+
+    if (!sndfile)
+    {
+        I_Printf(VB_DEBUG, "SndFile: %s", sf_strerror(NULL));
+        fclose(file);
+        return false;
+    }
+
+    sf_command(sndfile, SFC_SET_CLIPPING, NULL, SF_TRUE);
+
+    data = malloc(WRITE_FRAMES * sfinfo.channels
+                  * (sample_format == Int16 ? sizeof(short) : sizeof(float)));
+
+    while (ok && !done && total < max_frames)
+    {
+        const int count = MIN(WRITE_FRAMES, max_frames - total);
+
+        frames = fill(data, count);
+
+        if (frames <= 0)
+        {
+            break;
+        }
+
+        done = frames < count;
+
+        if (sample_format == Int16)
+        {
+            ok = sf_writef_short(sndfile, data, frames) == frames;
+        }
+        else
+        {
+            ok = sf_writef_float(sndfile, data, frames) == frames;
+        }
+
+        total += frames;
+    }
+
+    free(data);
+
+    ok &= sf_close(sndfile) == 0;
+    ok &= fclose(file) == 0;
+
+    return ok && total > 0;
+}
+
 static boolean I_SND_InitStream(int device)
 {
     return true;
@@ -775,4 +916,5 @@ stream_module_t stream_snd_module =
     I_SND_DeviceList,
     I_SND_BindVariables,
     I_SND_MusicFormat,
+    NULL,
 };
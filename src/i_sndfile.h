@@ -28,4 +28,9 @@
 boolean I_SND_LoadFile(void *data, ALenum *format, byte **wavdata,
                        ALsizei *size, ALsizei *freq, boolean looping);
 
+// Writes the frames of fill() to a FLAC file, until it returns fewer frames
+// than asked for or max_frames have been written.
+boolean I_SND_WriteFile(const char *filename, ALenum format, ALsizei freq,
+                        int (*fill)(void *data, int frames), int max_frames);
+
 #endif
@@ -26,6 +26,7 @@
 #include "doomstat.h"
 #include "doomtype.h"
 #include "i_exit.h"
+#include "i_oalsound.h"
 #include "i_oalstream.h"
 #include "i_printf.h"
 #include "i_rumble.h"
@@ -274,6 +275,13 @@ int I_GetSfxLumpNum(sfxinfo_t *sfx)
 // rewritten by Lee Killough, based on Chi's rough initial
 // version.
 
+// [Woof!] The sound module may have fewer channels than MAX_CHANNELS.
+
+int I_SoundChannels(void)
+{
+    return snd_init ? I_OAL_NumSources() : MAX_CHANNELS;
+}
+
 //
 // I_StartSound
 //
@@ -291,7 +299,8 @@ int I_StartSound(sfxinfo_t *sfx, const sfxparams_t *params)
     }
 
     // haleyjd 06/03/06: look for an unused hardware channel
-    for (channel = 0; channel < MAX_CHANNELS; channel++)
+    const int num_channels = I_SoundChannels();
+    for (channel = 0; channel < num_channels; channel++)
     {
         if (channelinfo[channel].enabled == false)
         {
@@ -301,7 +310,7 @@ int I_StartSound(sfxinfo_t *sfx, const sfxparams_t *params)
 
     // all used? don't play the sound. It's preferable to miss a sound
     // than it is to cut off one already playing, which sounds weird.
-    if (channel == MAX_CHANNELS)
+    if (channel == num_channels)
     {
         return -1;
     }
@@ -495,6 +504,16 @@ static void CacheSounds(void)
     }
 }
 
+void I_PreloadSounds(sfxinfo_t **sfx, int count)
+{
+    if (!snd_init || nosfxparm || !sound_module->PreloadSounds)
+    {
+        return;
+    }
+
+    sound_module->PreloadSounds(sfx, count);
+}
+
 //
 // I_InitSound
 //
@@ -795,7 +814,7 @@ void I_BindSoundVariables(void)
     BIND_BOOL_SFX(pitched_sounds, false,
         "Variable pitch for sound effects");
     BIND_BOOL_SFX(full_sounds, false, "Play sounds in full length (prevent cutoffs)");
-    BIND_NUM_SFX(snd_channels, MAX_CHANNELS, 1, MAX_CHANNELS,
+    BIND_NUM_SFX(snd_channels, 32, 1, MAX_CHANNELS,
         "Number of sound channels");
     BIND_BOOL_SFX(snd_limiter, false, "Use sound output limiter");
     BIND_NUM(snd_channels_per_sfx, 5, 0, MAX_CHANNELS,
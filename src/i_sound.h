@@ -45,7 +45,7 @@
 
 // Adjustable by menu.
 // [FG] moved here from i_sound.c
-#define MAX_CHANNELS    32
+#define MAX_CHANNELS    128
 // [FG] moved here from s_sound.c
 #define NORM_PITCH      127
 #define NORM_PRIORITY   64
@@ -79,6 +79,7 @@ typedef struct sound_module_s
     boolean (*ReinitSound)(void);
     boolean (*AllowReinitSound)(void);
     boolean (*CacheSound)(struct sfxinfo_s *sfx);
+    void (*PreloadSounds)(struct sfxinfo_s **sfx, int count);
     boolean (*AdjustSoundParams)(const struct mobj_s *listener,
                                  const struct mobj_s *source,
                                  struct sfxparams_s *params);
@@ -120,6 +121,12 @@ void I_SetSoundModule(void);
 // Initialize channels?
 void I_SetChannels(void);
 
+// Number of sounds the sound module can play at once.
+int I_SoundChannels(void);
+
+// Caches the sounds, waiting for the ones decoded in the background.
+void I_PreloadSounds(struct sfxinfo_s **sfx, int count);
+
 // Get raw data lump index for sound descriptor.
 int I_GetSfxLumpNum(struct sfxinfo_s *sfxinfo);
 
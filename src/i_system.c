@@ -259,6 +259,26 @@ void I_SetMetadata(const char *appname, const char *appversion,
     SDL_SetAppMetadata(appname, appversion, appidentifier);
 }
 
+int I_GetCPUFeatures(void)
+{
+    int features = 0;
+
+    if (SDL_HasSSE41())
+    {
+        features |= CPU_SSE41;
+    }
+    if (SDL_HasAVX2())
+    {
+        features |= CPU_AVX2;
+    }
+    if (SDL_HasNEON())
+    {
+        features |= CPU_NEON;
+    }
+
+    return features;
+}
+
 //----------------------------------------------------------------------------
 //
 // $Log: i_system.c,v $
@@ -92,6 +92,16 @@ const char *I_GetPlatform(void);
 void I_SetMetadata(const char *appname, const char *appversion,
                    const char *appidentifier);
 
+typedef enum
+{
+    CPU_SSE41 = 0x01,
+    CPU_AVX2 = 0x02,
+    CPU_NEON = 0x04,
+} cpufeature_t;
+
+// SIMD instruction sets the CPU supports.
+int I_GetCPUFeatures(void);
+
 #endif
 
 //----------------------------------------------------------------------------
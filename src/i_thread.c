@@ -0,0 +1,446 @@
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 2
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Worker thread pool, background jobs and locking primitives.
+//
+
+#include <SDL3/SDL.h>
+#include <stdlib.h>
+
+#include "doomtype.h"
+#include "i_exit.h"
+#include "i_printf.h"
+#include "i_system.h"
+#include "i_thread.h"
+
+#define MAX_WORKERS 63
+
+thread_mutex_t *I_CreateMutex(void)
+{
+    SDL_Mutex *mutex = SDL_CreateMutex();
+
+    if (!mutex)
+    {
+        I_Error("Failed to create mutex: %s", SDL_GetError());
+    }
+
+    return (thread_mutex_t *)mutex;
+}
+
+void I_DestroyMutex(thread_mutex_t *mutex)
+{
+    SDL_DestroyMutex((SDL_Mutex *)mutex);
+}
+
+void I_LockMutex(thread_mutex_t *mutex)
+{
+    SDL_LockMutex((SDL_Mutex *)mutex);
+}
+
+void I_UnlockMutex(thread_mutex_t *mutex)
+{
+    SDL_UnlockMutex((SDL_Mutex *)mutex);
+}
+
+void I_MemoryBarrier(void)
+{
+    SDL_MemoryBarrierRelease();
+}
+
+int I_GetNumCPUs(void)
+{
+    return MAX(SDL_GetNumLogicalCPUCores(), 1);
+}
+
+typedef struct
+{
+    SDL_Thread *thread;
+    int generation;
+} worker_t;
+
+static worker_t workers[MAX_WORKERS];
+static int numworkers = -1;
+
+static SDL_Mutex *pool_lock;
+static SDL_Condition *pool_wake;
+static SDL_Condition *pool_done;
+static boolean pool_quit;
+
+// Current batch of tasks. A new batch bumps the generation, which is what
+// the workers wait for.
+static int pool_generation;
+static int pool_pending;
+static thread_task_t pool_task;
+static void *pool_data;
+static int pool_count;
+static SDL_AtomicInt pool_next;
+
+static void RunPendingTasks(void)
+{
+    int index;
+
+    while ((index = SDL_AddAtomicInt(&pool_next, 1)) < pool_count)
+    {
+        pool_task(pool_data, index);
+    }
+}
+
+static int WorkerThread(void *arg)
+{
+    worker_t *worker = arg;
+
+    SDL_LockMutex(pool_lock);
+
+    while (true)
+    {
+        while (!pool_quit && worker->generation == pool_generation)
+        {
+            SDL_WaitCondition(pool_wake, pool_lock);
+        }
+
+        if (pool_quit)
+        {
+            break;
+        }
+
+        worker->generation = pool_generation;
+        SDL_UnlockMutex(pool_lock);
+
+        RunPendingTasks();
+
+        SDL_LockMutex(pool_lock);
+        if (--pool_pending == 0)
+        {
+            SDL_SignalCondition(pool_done);
+        }
+    }
+
+    SDL_UnlockMutex(pool_lock);
+
+    return 0;
+}
+
+static void ShutdownThreads(void)
+{
+    if (numworkers <= 0)
+    {
+        return;
+    }
+
+    SDL_LockMutex(pool_lock);
+    pool_quit = true;
+    SDL_BroadcastCondition(pool_wake);
+    SDL_UnlockMutex(pool_lock);
+
+    for (int i = 0; i < numworkers; i++)
+    {
+        SDL_WaitThread(workers[i].thread, NULL);
+    }
+
+    SDL_DestroyCondition(pool_done);
+    SDL_DestroyCondition(pool_wake);
+    SDL_DestroyMutex(pool_lock);
+
+    numworkers = 0;
+}
+
+static void InitThreads(void)
+{
+    const int count = MIN(I_GetNumCPUs() - 1, MAX_WORKERS);
+
+    numworkers = 0;
+
+    if (count <= 0)
+    {
+        return;
+    }
+
+    pool_lock = SDL_CreateMutex();
+    pool_wake = SDL_CreateCondition();
+    pool_done = SDL_CreateCondition();
+
+    if (!pool_lock || !pool_wake || !pool_done)
+    {
+        I_Error("Failed to create thread pool: %s", SDL_GetError());
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        workers[i].generation = pool_generation;
+        workers[i].thread = SDL_CreateThread(WorkerThread, "woof worker",
+                                             &workers[i]);
+        if (!workers[i].thread)
+        {
+            I_Printf(VB_WARNING, "Failed to create worker thread: %s",
+                     SDL_GetError());
+            break;
+        }
+        numworkers++;
+    }
+
+    I_Printf(VB_DEBUG, "Thread pool: %d workers", numworkers);
+
+    I_AtExit(ShutdownThreads, true);
+}
+
+int I_GetNumThreads(void)
+{
+    if (numworkers < 0)
+    {
+        InitThreads();
+    }
+
+    return numworkers + 1;
+}
+
+void I_RunTasks(thread_task_t task, void *data, int count)
+{
+    if (I_GetNumThreads() == 1 || count <= 1)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            task(data, i);
+        }
+        return;
+    }
+
+    SDL_LockMutex(pool_lock);
+    pool_task = task;
+    pool_data = data;
+    pool_count = count;
+    SDL_SetAtomicInt(&pool_next, 0);
+    pool_pending = numworkers;
+    pool_generation++;
+    SDL_BroadcastCondition(pool_wake);
+    SDL_UnlockMutex(pool_lock);
+
+    RunPendingTasks();
+
+    SDL_LockMutex(pool_lock);
+    while (pool_pending)
+    {
+        SDL_WaitCondition(pool_done, pool_lock);
+    }
+    SDL_UnlockMutex(pool_lock);
+}
+
+struct thread_job_s
+{
+    thread_task_t task;
+    void *data;
+    thread_queue_t *queue;
+    boolean done;
+    struct thread_job_s *next;
+};
+
+#define MAX_JOB_QUEUES 4
+
+struct thread_queue_s
+{
+    const char *name;
+
+    // -1 before the first job, 0 if jobs run synchronously.
+    int state;
+    SDL_Thread *thread;
+
+    SDL_Mutex *lock;
+    SDL_Condition *wake;
+    SDL_Condition *done;
+    boolean quit;
+
+    thread_job_t *head, *tail;
+};
+
+static thread_queue_t queues[MAX_JOB_QUEUES] = {{"woof jobs", -1}};
+static int numqueues = 1;
+
+static int JobThread(void *arg)
+{
+    thread_queue_t *queue = arg;
+
+    SDL_LockMutex(queue->lock);
+
+    while (true)
+    {
+        thread_job_t *job;
+
+        while (!queue->quit && !queue->head)
+        {
+            SDL_WaitCondition(queue->wake, queue->lock);
+        }
+
+        // the queue is drained before quitting
+        if (!queue->head)
+        {
+            break;
+        }
+
+        job = queue->head;
+        queue->head = job->next;
+        if (!queue->head)
+        {
+            queue->tail = NULL;
+        }
+        SDL_UnlockMutex(queue->lock);
+
+        job->task(job->data, 0);
+
+        SDL_LockMutex(queue->lock);
+        job->done = true;
+        SDL_BroadcastCondition(queue->done);
+    }
+
+    SDL_UnlockMutex(queue->lock);
+
+    return 0;
+}
+
+static void ShutdownJobThreads(void)
+{
+    for (int i = 0; i < numqueues; i++)
+    {
+        thread_queue_t *queue = &queues[i];
+
+        if (queue->state <= 0)
+        {
+            continue;
+        }
+
+        SDL_LockMutex(queue->lock);
+        queue->quit = true;
+        SDL_SignalCondition(queue->wake);
+        SDL_UnlockMutex(queue->lock);
+
+        SDL_WaitThread(queue->thread, NULL);
+
+        SDL_DestroyCondition(queue->done);
+        SDL_DestroyCondition(queue->wake);
+        SDL_DestroyMutex(queue->lock);
+
+        queue->state = 0;
+    }
+}
+
+static void InitJobThread(thread_queue_t *queue)
+{
+    static boolean atexit_added;
+
+    queue->state = 0;
+
+    queue->lock = SDL_CreateMutex();
+    queue->wake = SDL_CreateCondition();
+    queue->done = SDL_CreateCondition();
+
+    if (!queue->lock || !queue->wake || !queue->done)
+    {
+        I_Error("Failed to create job thread: %s", SDL_GetError());
+    }
+
+    queue->thread = SDL_CreateThread(JobThread, queue->name, queue);
+
+    if (!queue->thread)
+    {
+        I_Printf(VB_WARNING, "Failed to create job thread: %s",
+                 SDL_GetError());
+        return;
+    }
+
+    queue->state = 1;
+
+    if (!atexit_added)
+    {
+        I_AtExit(ShutdownJobThreads, true);
+        atexit_added = true;
+    }
+}
+
+thread_queue_t *I_CreateJobQueue(const char *name)
+{
+    thread_queue_t *queue;
+
+    if (numqueues == MAX_JOB_QUEUES)
+    {
+        I_Error("Too many job queues");
+    }
+
+    queue = &queues[numqueues++];
+    queue->name = name;
+    queue->state = -1;
+
+    return queue;
+}
+
+thread_job_t *I_StartQueueJob(thread_queue_t *queue, thread_task_t task,
+                              void *data)
+{
+    thread_job_t *job = calloc(1, sizeof(*job));
+
+    job->task = task;
+    job->data = data;
+    job->queue = queue;
+
+    if (queue->state < 0)
+    {
+        InitJobThread(queue);
+    }
+
+    if (queue->state == 0)
+    {
+        task(data, 0);
+        job->done = true;
+        return job;
+    }
+
+    SDL_LockMutex(queue->lock);
+    if (queue->tail)
+    {
+        queue->tail->next = job;
+    }
+    else
+    {
+        queue->head = job;
+    }
+    queue->tail = job;
+    SDL_SignalCondition(queue->wake);
+    SDL_UnlockMutex(queue->lock);
+
+    return job;
+}
+
+thread_job_t *I_StartJob(thread_task_t task, void *data)
+{
+    return I_StartQueueJob(&queues[0], task, data);
+}
+
+void I_WaitJob(thread_job_t *job)
+{
+    thread_queue_t *queue;
+
+    if (!job)
+    {
+        return;
+    }
+
+    queue = job->queue;
+
+    if (queue->state > 0)
+    {
+        SDL_LockMutex(queue->lock);
+        while (!job->done)
+        {
+            SDL_WaitCondition(queue->done, queue->lock);
+        }
+        SDL_UnlockMutex(queue->lock);
+    }
+
+    free(job);
+}
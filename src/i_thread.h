@@ -0,0 +1,65 @@
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 2
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Worker thread pool, background jobs and locking primitives.
+//
+
+#ifndef __I_THREAD__
+#define __I_THREAD__
+
+#include "doomtype.h"
+
+typedef struct thread_mutex_s thread_mutex_t;
+
+thread_mutex_t *I_CreateMutex(void);
+void I_DestroyMutex(thread_mutex_t *mutex);
+void I_LockMutex(thread_mutex_t *mutex);
+void I_UnlockMutex(thread_mutex_t *mutex);
+
+// Makes the writes before it visible to other threads before the writes
+// after it, so that data can be published by storing a pointer to it.
+void I_MemoryBarrier(void);
+
+// Number of logical CPU cores, at least 1.
+int I_GetNumCPUs(void);
+
+// Number of threads that run tasks, including the calling thread.
+int I_GetNumThreads(void);
+
+typedef void (*thread_task_t)(void *data, int index);
+
+// Calls task(data, index) for every index in [0, count) on the worker pool
+// and the calling thread, and returns when all of them have finished. Tasks
+// must not call I_RunTasks() themselves.
+void I_RunTasks(thread_task_t task, void *data, int count);
+
+typedef struct thread_job_s thread_job_t;
+
+// Queues task(data, 0) to run on a background thread, in the order the jobs
+// were started, without waiting for it. Every job must be passed to
+// I_WaitJob() eventually.
+thread_job_t *I_StartJob(thread_task_t task, void *data);
+
+typedef struct thread_queue_s thread_queue_t;
+
+// Creates a queue with a background thread of its own, for jobs that must
+// not wait behind the ones of I_StartJob().
+thread_queue_t *I_CreateJobQueue(const char *name);
+
+// Like I_StartJob(), on the given queue.
+thread_job_t *I_StartQueueJob(thread_queue_t *queue, thread_task_t task,
+                              void *data);
+
+// Returns when the job has finished and frees it. NULL is ignored.
+void I_WaitJob(thread_job_t *job);
+
+#endif
@@ -61,6 +61,13 @@ uint64_t I_GetTimeUS(void)
     return ((counter - basecounter) * 1000000ull) / basefreq;
 }
 
+// Nanoseconds since SDL was initialized, for profiling.
+
+uint64_t I_GetTimeNS(void)
+{
+    return SDL_GetTicksNS();
+}
+
 int time_scale = 100;
 
 static uint64_t GetPerfCounter_Scaled(void)
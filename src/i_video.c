@@ -41,6 +41,7 @@
 #include "i_input.h"
 #include "i_printf.h"
 #include "i_system.h"
+#include "i_thread.h"
 #include "i_timer.h"
 #include "i_video.h"
 #include "m_argv.h"
@@ -48,7 +49,10 @@
 #include "m_fixed.h"
 #include "m_io.h"
 #include "m_misc.h"
+#include "m_trace.h"
+#include "md5.h"
 #include "mn_menu.h"
+#include "p_tick.h"
 #include "r_draw.h"
 #include "r_main.h"
 #include "r_plane.h"
@@ -86,6 +90,7 @@ boolean setrefreshneeded;
 boolean toggle_fullscreen;
 
 static boolean use_vsync; // killough 2/8/98: controls whether vsync is called
+static boolean async_present;
 boolean correct_aspect_ratio;
 static int fpslimit; // when uncapped, limit framerate to this value
 static boolean fullscreen;
@@ -142,6 +147,10 @@ static boolean grabmouse = true, default_grabmouse;
 // when the screen isnt visible, don't render the screen
 boolean screenvisible = true;
 
+// [Woof!] Set while D_Display() draws a wipe, whose frames follow the wall
+// clock.
+boolean screenwiping;
+
 static boolean drs_skip_frame;
 
 void *I_GetSDLWindow(void)
@@ -664,6 +673,19 @@ void I_StartFrame(void)
     ;
 }
 
+static void CopyFrame(pixel_t *dst, int dst_pitch)
+{
+    int h = rect.h;
+    int src_pitch = video.width;
+    pixel_t *src = I_VideoBuffer;
+    while (h--)
+    {
+        memcpy(dst, src, src_pitch);
+        dst += dst_pitch;
+        src += src_pitch;
+    }
+}
+
 static void UpdateRender(void)
 {
     // When using SDL_LockTexture, the pixels made available for editing may not
@@ -672,16 +694,45 @@ static void UpdateRender(void)
     void *pixels;
     int dst_pitch;
     SDL_LockTexture(texture, &rect, &pixels, &dst_pitch);
-    int h = rect.h;
-    int src_pitch = video.width;
-    pixel_t *dst = pixels;
-    pixel_t *src = I_VideoBuffer;
-    while (h--)
+    CopyFrame(pixels, dst_pitch);
+    SDL_UnlockTexture(texture);
+
+    SDL_RenderClear(renderer);
+    SDL_RenderTexture(renderer, texture, &frect, NULL);
+}
+
+// [Woof!] With async_present and the framerate limiter on, the frame is
+// copied into the locked texture on a thread of its own while the main
+// thread waits for the limiter. The SDL render API may only be used from
+// the main thread, so the texture is locked, unlocked, drawn and presented
+// there. Nothing may touch the video buffer or the renderer in between.
+
+static thread_queue_t *upload_queue;
+static thread_job_t *upload_job;
+static void *upload_pixels;
+static int upload_pitch;
+
+static void UploadFrame(void *data, int index)
+{
+    CopyFrame(upload_pixels, upload_pitch);
+}
+
+static void StartUpload(void)
+{
+    // not behind the rewind keyframes on the shared job thread
+    if (!upload_queue)
     {
-        memcpy(dst, src, src_pitch);
-        dst += dst_pitch;        
-        src += src_pitch;
+        upload_queue = I_CreateJobQueue("woof upload");
     }
+
+    SDL_LockTexture(texture, &rect, &upload_pixels, &upload_pitch);
+    upload_job = I_StartQueueJob(upload_queue, UploadFrame, NULL);
+}
+
+static void FinishUpload(void)
+{
+    I_WaitJob(upload_job);
+    upload_job = NULL;
     SDL_UnlockTexture(texture);
 
     SDL_RenderClear(renderer);
@@ -689,33 +740,165 @@ static void UpdateRender(void)
 }
 
 static uint64_t frametime_start, frametime_withoutpresent;
+// [Woof!] time of the present after the limiter, see I_FinishUpdate()
+static uint64_t frametime_present;
 
 static void ResetResolution(int height);
 static void ResetLogicalSize(void);
 
-#define DRS_FRAME_HISTORY 60
+// Predictive dynamic resolution. The time of a frame is modelled as
+//
+//   time = pixels * (a + b * load) + c * thinkers
+//
+// where load is the number of segs, visplanes, vissprites and voxels the
+// renderer drew, and thinkers the number of awake thinkers in the last tic.
+// The coefficients are fitted to the recent frames by exponentially weighted
+// least squares. The resolution is then chosen so that the predicted time of
+// the next frame, with a rising load extrapolated, fits the budget. Waking
+// monsters raise the thinker count before they are drawn, which lowers the
+// resolution before the spike lands.
+
+#define DRS_STEP         (SCREENHEIGHT / 8)
+#define DRS_MAX_UPSCALE  (4 * DRS_STEP)
+#define DRS_MAX_COOLDOWN 60
+#define DRS_MIN_FRAMES   10
+#define DRS_FORGET       0.97 // weight of the previous frames per frame
+#define DRS_RIDGE        1.0e-4
+#define DRS_DOWNSCALE    1.0  // downscale if prediction > budget * this
+#define DRS_UPSCALE      0.8  // upscale if prediction < budget * this
+#define DRS_UPSCALE_GOAL 0.9  // and aim for budget * this
+
+#define DRS_NUM_COEFS    3
 
 typedef struct
 {
-    double history[DRS_FRAME_HISTORY];
-    int history_index;
-    int history_frames;
+    double sum_xx[DRS_NUM_COEFS][DRS_NUM_COEFS];
+    double sum_xt[DRS_NUM_COEFS];
+    double coefs[DRS_NUM_COEFS];
+    int frames;
+    double last_load, last_thinkers;
     int cooldown_counter;
     int cooldown_frames;
+    drs_stats_t stats;
 } drs_t;
 
 static drs_t drs;
 
 void I_ResetDRS(void)
 {
-    memset(drs.history, 0, sizeof(drs.history));
-    drs.history_index = 0;
-    drs.history_frames = MIN(DRS_FRAME_HISTORY, (int)(targetrefresh / 2.0f));
+    drs.last_load = drs.last_thinkers = 0.0;
     drs.cooldown_counter = 0;
-    drs.cooldown_frames = drs.history_frames;
+    drs.cooldown_frames = MIN(DRS_MAX_COOLDOWN, (int)(targetrefresh / 2.0f));
     drs_skip_frame = true;
 }
 
+drs_stats_t I_GetDRSStats(void)
+{
+    return drs.stats;
+}
+
+// Adds a frame to the weighted sums and solves the normal equations for the
+// coefficients by Gaussian elimination. Returns false if they can't be
+// trusted yet.
+
+static boolean FitCostModel(const double x[DRS_NUM_COEFS], double time)
+{
+    double m[DRS_NUM_COEFS][DRS_NUM_COEFS + 1];
+
+    for (int i = 0; i < DRS_NUM_COEFS; ++i)
+    {
+        for (int j = 0; j < DRS_NUM_COEFS; ++j)
+        {
+            drs.sum_xx[i][j] = drs.sum_xx[i][j] * DRS_FORGET + x[i] * x[j];
+        }
+        drs.sum_xt[i] = drs.sum_xt[i] * DRS_FORGET + x[i] * time;
+    }
+
+    if (++drs.frames < DRS_MIN_FRAMES)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < DRS_NUM_COEFS; ++i)
+    {
+        for (int j = 0; j < DRS_NUM_COEFS; ++j)
+        {
+            m[i][j] = drs.sum_xx[i][j] + (i == j ? DRS_RIDGE : 0.0);
+        }
+        m[i][DRS_NUM_COEFS] = drs.sum_xt[i];
+    }
+
+    for (int i = 0; i < DRS_NUM_COEFS; ++i)
+    {
+        int pivot = i;
+
+        for (int j = i + 1; j < DRS_NUM_COEFS; ++j)
+        {
+            if (fabs(m[j][i]) > fabs(m[pivot][i]))
+            {
+                pivot = j;
+            }
+        }
+
+        if (fabs(m[pivot][i]) < DRS_RIDGE)
+        {
+            return false;
+        }
+
+        for (int k = 0; k <= DRS_NUM_COEFS; ++k)
+        {
+            double temp = m[i][k];
+            m[i][k] = m[pivot][k];
+            m[pivot][k] = temp;
+        }
+
+        for (int j = 0; j < DRS_NUM_COEFS; ++j)
+        {
+            if (j != i)
+            {
+                const double f = m[j][i] / m[i][i];
+
+                for (int k = i; k <= DRS_NUM_COEFS; ++k)
+                {
+                    m[j][k] -= f * m[i][k];
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < DRS_NUM_COEFS; ++i)
+    {
+        // costs are never negative
+        drs.coefs[i] = MAX(0.0, m[i][DRS_NUM_COEFS] / m[i][i]);
+    }
+
+    return drs.coefs[0] > 0.0 || drs.coefs[1] > 0.0;
+}
+
+// Largest height whose predicted frame time fits the budget.
+
+static int FitHeight(double budget, double load, double thinkers)
+{
+    const double per_pixel = drs.coefs[0] + drs.coefs[1] * load;
+    const double render_budget = budget - drs.coefs[2] * thinkers;
+
+    if (per_pixel <= 0.0)
+    {
+        return current_video_height;
+    }
+
+    if (render_budget <= 0.0)
+    {
+        return DRS_MIN_HEIGHT;
+    }
+
+    // megapixels, width is proportional to height
+    const double pixels = render_budget / per_pixel;
+    const double aspect = (double)video.width / video.height;
+
+    return (int)sqrt(pixels * 1000000.0 / aspect);
+}
+
 void I_DynamicResolution(void)
 {
     if (!dynamic_resolution || current_video_height <= DRS_MIN_HEIGHT
@@ -731,61 +914,60 @@ void I_DynamicResolution(void)
         return;
     }
 
-    if (drs.cooldown_counter > 0)
-    {
-        --drs.cooldown_counter;
-        return;
-    }
+    // milliseconds, 1.25 of them for SDL render present
+    const double budget = 1000.0 / targetrefresh - 1.25;
+    const double time = frametime_withoutpresent / 1000.0;
+
+    // megapixels and thousands, to keep the sums well conditioned
+    const double pixels = video.width * video.height / 1000000.0;
+    const double load = (rendered_segs + rendered_visplanes
+                         + rendered_vissprites + rendered_voxels)
+                        / 1000.0;
+    const double thinkers = awake_thinkers / 1000.0;
 
-    // 1.25 milliseconds for SDL render present
-    double target = (1.0 / targetrefresh) - 0.00125;
-    double actual = frametime_withoutpresent / 1000000.0;
+    const double x[DRS_NUM_COEFS] = {pixels, pixels * load, thinkers};
 
-    drs.history[drs.history_index] = actual;
-    drs.history_index = (drs.history_index + 1) % drs.history_frames;
-    double total = 0;
-    for (int i = 0; i < drs.history_frames; ++i)
+    if (!FitCostModel(x, time))
     {
-        total += drs.history[i];
+        // until the model is fitted, assume the time is all pixels
+        drs.coefs[0] = time / pixels;
+        drs.coefs[1] = drs.coefs[2] = 0.0;
     }
-    const double avg_frame_time = total / drs.history_frames;
-    const double performance_ratio = avg_frame_time / target;
 
-    static boolean needs_upscale;
+    // extrapolate a rising load one frame ahead
+    const double next_load = load + MAX(0.0, load - drs.last_load);
+    const double next_thinkers =
+        thinkers + MAX(0.0, thinkers - drs.last_thinkers);
 
-    #define DRS_STEP         (SCREENHEIGHT / 2)
-    #define DRS_DOWNSCALE_T1 1.08
-    #define DRS_DOWNSCALE_T2 1.2   // 20% over target -> 2x step
-    #define DRS_DOWNSCALE_T3 1.5   // 50% over target -> 3x step
-    #define DRS_UPSCALE_T1   0.6
-    #define DRS_UPSCALE_T2   0.4
+    drs.last_load = load;
+    drs.last_thinkers = thinkers;
 
-    int oldheight = video.height;
-    int newheight = 0;
-    int step_multipler = 1;
+    const double predicted = pixels * (drs.coefs[0] + drs.coefs[1] * next_load)
+                             + drs.coefs[2] * next_thinkers;
+
+    drs.stats.scale = (double)video.height / current_video_height;
+    drs.stats.predicted = predicted;
+    drs.stats.budget = budget;
 
-    if (performance_ratio > DRS_DOWNSCALE_T1)
+    if (drs.cooldown_counter > 0)
     {
-        if (performance_ratio > DRS_DOWNSCALE_T3)
-        {
-            step_multipler = 3;
-        }
-        else if (performance_ratio > DRS_DOWNSCALE_T2)
-        {
-            step_multipler = 2;
-        }
+        --drs.cooldown_counter;
+    }
+
+    int oldheight = video.height;
+    int newheight;
 
-        newheight = MAX(DRS_MIN_HEIGHT, oldheight - DRS_STEP * step_multipler);
+    if (predicted > budget * DRS_DOWNSCALE)
+    {
+        newheight = FitHeight(budget * DRS_DOWNSCALE, next_load, next_thinkers);
+        newheight = MIN(newheight, oldheight - DRS_STEP);
     }
-    else if (performance_ratio < DRS_UPSCALE_T1 && needs_upscale)
+    else if (predicted < budget * DRS_UPSCALE && !drs.cooldown_counter
+             && oldheight < current_video_height)
     {
-        if (performance_ratio < DRS_UPSCALE_T2)
-        {
-            step_multipler = 2;
-        }
-
         newheight =
-            MIN(current_video_height, oldheight + DRS_STEP * step_multipler);
+            FitHeight(budget * DRS_UPSCALE_GOAL, next_load, next_thinkers);
+        newheight = CLAMP(newheight, oldheight, oldheight + DRS_MAX_UPSCALE);
     }
     else
     {
@@ -794,8 +976,11 @@ void I_DynamicResolution(void)
 
     if (newheight < current_video_height)
     {
-        int mul = (newheight + (DRS_STEP - 1)) / DRS_STEP;
-        newheight = mul * DRS_STEP;
+        newheight = MAX(DRS_MIN_HEIGHT, newheight / DRS_STEP * DRS_STEP);
+    }
+    else
+    {
+        newheight = current_video_height;
     }
 
     if (newheight == oldheight)
@@ -803,17 +988,19 @@ void I_DynamicResolution(void)
         return;
     }
 
-    needs_upscale = newheight < current_video_height;
-
+    // don't upscale again until the new resolution has been measured
     drs.cooldown_counter = drs.cooldown_frames;
 
+    const int voxel_steps =
+        MAX(1, abs(newheight - oldheight) / (SCREENHEIGHT / 2));
+
     if (newheight < oldheight)
     {
-        VX_DecreaseMaxDist(step_multipler);
+        VX_DecreaseMaxDist(voxel_steps);
     }
     else
     {
-        VX_IncreaseMaxDist(step_multipler);
+        VX_IncreaseMaxDist(voxel_steps);
     }
 
     ResetResolution(newheight);
@@ -825,8 +1012,104 @@ static unsigned int disk_to_draw, disk_to_restore;
 
 static void I_ResetTargetRefresh(void);
 
+// [Woof!] -framehash
+
+static const char *framehash_file;
+static struct MD5Context framehash_md5;
+static int framehash_tic = -1;
+
+// Only the first frame of a tic is hashed, so that the number of frames
+// drawn in between doesn't matter. Wipes are left out, see screenwiping.
+
+static void UpdateFrameHash(void)
+{
+    if (screenwiping || gametic == framehash_tic)
+    {
+        return;
+    }
+
+    framehash_tic = gametic;
+    MD5Update(&framehash_md5, I_VideoBuffer, video.width * video.height);
+}
+
+static void WriteFrameHash(void)
+{
+    byte digest[16];
+    char digest_string[33];
+    FILE *file;
+
+    MD5Final(digest, &framehash_md5);
+    M_DigestToString(digest, digest_string, sizeof(digest));
+
+    file = M_fopen(framehash_file, "w");
+
+    if (!file)
+    {
+        I_Printf(VB_WARNING, "WriteFrameHash: Could not write %s",
+                 framehash_file);
+        return;
+    }
+
+    fprintf(file, "%s\n", digest_string);
+    fclose(file);
+}
+
+static void InitFrameHash(void)
+{
+    //!
+    // @arg <file>
+    // @category video
+    //
+    // Write the MD5 checksum of the frames drawn, one per tic, to <file> at
+    // exit. Used by demotest to check that -plaindrawers and the threaded
+    // renderer draw the same frames.
+    //
+
+    int p = M_CheckParmWithArgs("-framehash", 1);
+
+    if (p)
+    {
+        framehash_file = myargv[p + 1];
+        MD5Init(&framehash_md5);
+        I_AtExit(WriteFrameHash, false);
+    }
+}
+
+static void LimitFrameRate(void)
+{
+    uint64_t target_time = (uint64_t)(1000000.0f / targetrefresh);
+
+    M_TraceBegin(TRACE_SLEEP);
+
+    while (true)
+    {
+        uint64_t current_time = I_GetTimeUS();
+        int64_t elapsed_time = current_time - frametime_start;
+
+        if (elapsed_time >= target_time)
+        {
+            frametime_start = current_time;
+            break;
+        }
+
+        int64_t remaining_time = target_time - elapsed_time;
+
+        if (remaining_time > 1000ull)
+        {
+            I_SleepUS(500ull);
+        }
+    }
+
+    M_TraceEnd(TRACE_SLEEP);
+}
+
 void I_FinishUpdate(void)
 {
+    if (framehash_file)
+    {
+        UpdateFrameHash();
+    }
+
     if (noblit)
     {
         return;
@@ -862,43 +1145,54 @@ void I_FinishUpdate(void)
 
     I_DrawDiskIcon();
 
-    UpdateRender();
-
-    if (frametime_start)
+    if (async_present && use_limiter)
     {
-        frametime_withoutpresent = I_GetTimeUS() - frametime_start;
-    }
+        // The previous present followed the limiter and isn't rendering.
+        if (frametime_start)
+        {
+            frametime_withoutpresent =
+                I_GetTimeUS() - frametime_start - frametime_present;
+        }
 
-    SDL_RenderPresent(renderer);
+        StartUpload();
+        LimitFrameRate();
+
+        M_TraceBegin(TRACE_PRESENT);
+        FinishUpload();
+        SDL_RenderPresent(renderer);
+        M_TraceEnd(TRACE_PRESENT);
 
-    I_RestoreDiskBackground();
+        frametime_present = I_GetTimeUS() - frametime_start;
 
-    if (use_limiter)
+        I_RestoreDiskBackground();
+    }
+    else
     {
-        uint64_t target_time = (uint64_t)(1000000.0f / targetrefresh);
+        M_TraceBegin(TRACE_PRESENT);
+
+        UpdateRender();
 
-        while (true)
+        if (frametime_start)
         {
-            uint64_t current_time = I_GetTimeUS();
-            int64_t elapsed_time = current_time - frametime_start;
+            frametime_withoutpresent = I_GetTimeUS() - frametime_start;
+        }
 
-            if (elapsed_time >= target_time)
-            {
-                frametime_start = current_time;
-                break;
-            }
+        SDL_RenderPresent(renderer);
 
-            int64_t remaining_time = target_time - elapsed_time;
+        M_TraceEnd(TRACE_PRESENT);
 
-            if (remaining_time > 1000ull)
-            {
-                I_SleepUS(500ull);
-            }
+        I_RestoreDiskBackground();
+
+        if (use_limiter)
+        {
+            LimitFrameRate();
         }
-    }
-    else
-    {
-        frametime_start = I_GetTimeUS();
+        else
+        {
+            frametime_start = I_GetTimeUS();
+        }
+
+        frametime_present = 0;
     }
 
     if (setrefreshneeded)
@@ -1695,6 +1989,7 @@ void I_InitGraphics(void)
     I_UpdateHudAnchoring();
     CreateVideoBuffer();
     ResetLogicalSize();
+    InitFrameHash();
 
     // Mouse motion is based on SDL_GetRelativeMouseState() values only.
     SDL_SetEventEnabled(SDL_EVENT_MOUSE_MOTION, false);
@@ -1720,6 +2015,8 @@ void I_BindVideoVariables(void)
     BIND_BOOL(fullscreen, true, "Fullscreen");
     BIND_BOOL_GENERAL(use_vsync, true,
         "Vertical sync to prevent display tearing");
+    BIND_BOOL(async_present, false,
+        "Upload frames during the framerate limiter wait (experimental)");
     M_BindBool("uncapped", &default_uncapped, &uncapped, true, ss_gen, wad_no,
         "Uncapped rendering frame rate");
     BIND_NUM_GENERAL(fpslimit, 0, 0, 500,
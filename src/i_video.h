@@ -59,6 +59,15 @@ void I_ToggleVsync(void); // [JN] Calls native SDL vsync toggle
 void I_DynamicResolution(void);
 void I_ResetDRS(void);
 
+typedef struct
+{
+    double scale;     // video height relative to current_video_height
+    double predicted; // predicted time of the next frame in milliseconds
+    double budget;    // frame time budget in milliseconds
+} drs_stats_t;
+
+drs_stats_t I_GetDRSStats(void);
+
 extern int current_video_height;
 #define DRS_MIN_HEIGHT 400
 extern boolean dynamic_resolution;
@@ -71,6 +80,7 @@ extern boolean toggle_fullscreen;
 extern boolean toggle_exclusive_fullscreen;
 extern boolean correct_aspect_ratio;
 extern boolean screenvisible;
+extern boolean screenwiping; // [Woof!] left out of -framehash
 
 extern int gamma2;
 byte I_GetNearestColor(byte *palette, int r, int g, int b);
@@ -187,4 +187,5 @@ stream_module_t stream_xmp_module =
     I_XMP_DeviceList,
     I_XMP_BindVariables,
     I_XMP_MusicFormat,
+    NULL,
 };
@@ -1427,6 +1427,8 @@ static void UnArchiveWorld(void)
             }
         }
     }
+
+    P_InvalidateSightCache();
 }
 
 //
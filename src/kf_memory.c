@@ -22,6 +22,7 @@
 #include "i_system.h"
 #include "m_arena.h"
 #include "m_array.h"
+#include "m_delta.h"
 #include "m_random.h"
 #include "p_dirty.h"
 #include "p_map.h"
@@ -41,9 +42,42 @@
 
 #define KEYFRAME_BUFFER_SIZE (256 * 1024)
 
+// The sector fields a keyframe restores, packed by P_FinishKeyframe().
+typedef struct
+{
+    fixed_t floorheight, ceilingheight;
+    fixed_t floor_xoffs, floor_yoffs;
+    fixed_t ceiling_xoffs, ceiling_yoffs;
+    angle_t floor_rotation, ceiling_rotation;
+    int tint;
+
+    short floorpic, ceilingpic;
+    short lightlevel;
+    short special;
+    short tag;
+
+    struct mobj_s *soundtarget;
+    void *floordata, *ceilingdata;
+    struct mobj_s *thinglist;
+    struct msecnode_s *touching_thinglist;
+} sector_state_t;
+
 typedef struct keyframe_data_s
 {
     char *buffer;
+    size_t size;
+
+    // the packed sectors follow the rest of the buffer
+    size_t world_offset;
+    int numsectors;
+
+    // raw copy of the sectors until the keyframe is finished
+    const sector_t *snapshot;
+
+    // buffer and arenas are deltas against base
+    const keyframe_t *base;
+    size_t delta_size;
+
     arena_copy_t *thinkers;
     arena_copy_t *msecnodes;
     arena_copy_t *activeceilings;
@@ -53,6 +87,10 @@ typedef struct keyframe_data_s
 static char *buffer, *curr_p;
 static size_t buffer_size;
 
+// Shared by all keyframes, see P_FinishKeyframe().
+static sector_t *sector_snapshot;
+static int snapshot_numsectors;
+
 inline static void check_buffer(size_t size)
 {
     ptrdiff_t offset = curr_p - buffer;
@@ -189,38 +227,58 @@ static void UnArchivePlayers(void)
     }
 }
 
-static void ArchiveWorld(void)
+static void SnapshotSectors(keyframe_data_t *data)
 {
-    int i;
-    const sector_t *sector;
+    if (numsectors > snapshot_numsectors)
+    {
+        snapshot_numsectors = numsectors;
+        sector_snapshot = I_Realloc(sector_snapshot,
+                                    numsectors * sizeof(*sector_snapshot));
+    }
 
-    // do sectors
-    for (i = 0, sector = sectors; i < numsectors; i++, sector++)
+    memcpy(sector_snapshot, sectors, numsectors * sizeof(*sector_snapshot));
+
+    data->snapshot = sector_snapshot;
+    data->numsectors = numsectors;
+}
+
+static void PackSectors(sector_state_t *state, const sector_t *sector,
+                        int count)
+{
+    for (int i = 0; i < count; i++, state++, sector++)
     {
         // killough 10/98: save full floor & ceiling heights, including fraction
-        write32(sector->floorheight,
-                sector->ceilingheight,
-                sector->floor_xoffs,
-                sector->floor_yoffs,
-                sector->ceiling_xoffs,
-                sector->ceiling_yoffs,
-                sector->floor_rotation,
-                sector->ceiling_rotation,
-                sector->tint);
-
-        write16(sector->floorpic,
-                sector->ceilingpic,
-                sector->lightlevel,
-                sector->special, // needed?   yes -- transfer types
-                sector->tag);    // needed?   need them -- killough 
+        state->floorheight = sector->floorheight;
+        state->ceilingheight = sector->ceilingheight;
+        state->floor_xoffs = sector->floor_xoffs;
+        state->floor_yoffs = sector->floor_yoffs;
+        state->ceiling_xoffs = sector->ceiling_xoffs;
+        state->ceiling_yoffs = sector->ceiling_yoffs;
+        state->floor_rotation = sector->floor_rotation;
+        state->ceiling_rotation = sector->ceiling_rotation;
+        state->tint = sector->tint;
+
+        state->floorpic = sector->floorpic;
+        state->ceilingpic = sector->ceilingpic;
+        state->lightlevel = sector->lightlevel;
+        state->special = sector->special; // needed?   yes -- transfer types
+        state->tag = sector->tag;         // needed?   need them -- killough
 
         // Woof!
-        writep(sector->soundtarget,
-               sector->floordata,
-               sector->ceilingdata,
-               sector->thinglist,
-               sector->touching_thinglist);
+        state->soundtarget = sector->soundtarget;
+        state->floordata = sector->floordata;
+        state->ceilingdata = sector->ceilingdata;
+        state->thinglist = sector->thinglist;
+        state->touching_thinglist = sector->touching_thinglist;
     }
+}
+
+static void ArchiveWorld(keyframe_data_t *data)
+{
+    int i;
+
+    // do sectors
+    SnapshotSectors(data);
 
     const line_t *line;
 
@@ -249,38 +307,40 @@ static void ArchiveWorld(void)
     }
 }
 
-static void UnArchiveWorld(void)
+static void UnArchiveWorld(const sector_state_t *state)
 {
     int i;
     sector_t *sector;
 
     // do sectors
-    for (i = 0, sector = sectors; i < numsectors; i++, sector++)
+    for (i = 0, sector = sectors; i < numsectors; i++, sector++, state++)
     {
-        sector->floorheight = read32();
-        sector->ceilingheight = read32();
-        sector->floor_xoffs = read32();
-        sector->floor_yoffs = read32();
-        sector->ceiling_xoffs = read32();
-        sector->ceiling_yoffs = read32();
-        sector->floor_rotation = read32();
-        sector->ceiling_rotation = read32();
-        sector->tint = read32();
-
-        sector->floorpic = read16();
-        sector->ceilingpic = read16();
-        sector->lightlevel = read16();
-        sector->special = read16();
-        sector->tag = read16();
+        sector->floorheight = state->floorheight;
+        sector->ceilingheight = state->ceilingheight;
+        sector->floor_xoffs = state->floor_xoffs;
+        sector->floor_yoffs = state->floor_yoffs;
+        sector->ceiling_xoffs = state->ceiling_xoffs;
+        sector->ceiling_yoffs = state->ceiling_yoffs;
+        sector->floor_rotation = state->floor_rotation;
+        sector->ceiling_rotation = state->ceiling_rotation;
+        sector->tint = state->tint;
+
+        sector->floorpic = state->floorpic;
+        sector->ceilingpic = state->ceilingpic;
+        sector->lightlevel = state->lightlevel;
+        sector->special = state->special;
+        sector->tag = state->tag;
 
         // Woof!
-        sector->soundtarget = readp();
-        sector->floordata = readp();
-        sector->ceilingdata = readp();
-        sector->thinglist = readp();
-        sector->touching_thinglist = readp();
+        sector->soundtarget = state->soundtarget;
+        sector->floordata = state->floordata;
+        sector->ceilingdata = state->ceilingdata;
+        sector->thinglist = state->thinglist;
+        sector->touching_thinglist = state->touching_thinglist;
     }
 
+    P_InvalidateSightCache();
+
     line_t *line;
 
     int oldsize = read32();
@@ -459,7 +519,7 @@ keyframe_t *P_SaveKeyframe(int tic)
             playback_totaltics);
 
     ArchivePlayers();
-    ArchiveWorld();
+    ArchiveWorld(keyframe->data);
     ArchivePlayState(keyframe);
     ArchiveRNG();
     ArchiveAutomap();
@@ -467,6 +527,7 @@ keyframe_t *P_SaveKeyframe(int tic)
     writep(demo_p);
 
     keyframe->data->buffer = buffer;
+    keyframe->data->size = curr_p - buffer;
     keyframe->tic = tic;
     keyframe->episode = gameepisode;
     keyframe->map = gamemap;
@@ -474,9 +535,69 @@ keyframe_t *P_SaveKeyframe(int tic)
     return keyframe;
 }
 
+static void DeltaKeyframe(keyframe_data_t *data, const keyframe_t *base)
+{
+    const keyframe_data_t *base_data = base->data;
+
+    if (data->base || base_data->base)
+    {
+        I_Error("Delta keyframes can't be based on each other");
+    }
+
+    char *delta = M_DeltaEncode(data->buffer, data->size, base_data->buffer,
+                                base_data->size, &data->delta_size);
+    free(data->buffer);
+    data->buffer = delta;
+    data->base = base;
+
+    // the small lists of active ceilings and platforms are kept whole
+    M_ArenaDeltaCopy(data->thinkers, base_data->thinkers);
+    M_ArenaDeltaCopy(data->msecnodes, base_data->msecnodes);
+}
+
+void P_FinishKeyframe(keyframe_t *keyframe, const keyframe_t *base)
+{
+    keyframe_data_t *data = keyframe->data;
+    const size_t size = data->size;
+
+    // keep the packed sectors aligned, and zero the padding so that it
+    // doesn't show up in deltas
+    data->world_offset = (size + 7) & ~(size_t)7;
+    data->size = data->world_offset + data->numsectors * sizeof(sector_state_t);
+    data->buffer = I_Realloc(data->buffer, data->size);
+    memset(data->buffer + size, 0, data->size - size);
+
+    PackSectors((sector_state_t *)(data->buffer + data->world_offset),
+                data->snapshot, data->numsectors);
+    data->snapshot = NULL;
+
+    if (base)
+    {
+        DeltaKeyframe(data, base);
+    }
+}
+
 void P_LoadKeyframe(const keyframe_t *keyframe)
 {
-    curr_p = keyframe->data->buffer;
+    const keyframe_data_t *data = keyframe->data;
+    char *decoded = NULL;
+    char *start;
+
+    if (data->base)
+    {
+        const keyframe_data_t *base_data = data->base->data;
+
+        decoded = malloc(data->size);
+        M_DeltaDecode(data->buffer, data->delta_size, base_data->buffer,
+                      base_data->size, decoded, data->size);
+        start = decoded;
+    }
+    else
+    {
+        start = data->buffer;
+    }
+
+    curr_p = start;
 
     boom_basetic = gametic - read8();
 
@@ -487,13 +608,15 @@ void P_LoadKeyframe(const keyframe_t *keyframe)
 
     P_MapStart();
     UnArchivePlayers();
-    UnArchiveWorld();
+    UnArchiveWorld((const sector_state_t *)(start + data->world_offset));
     UnArchivePlayState(keyframe);
     UnArchiveRNG();
     UnArchiveAutomap();
     P_MapEnd();
 
     demo_p = readp();
+
+    free(decoded);
 }
 
 void P_FreeKeyframe(keyframe_t *keyframe)
@@ -22,6 +22,7 @@
 
 #include "i_region.h"
 #include "i_system.h"
+#include "m_delta.h"
 
 #define M_HASHMAP_KEY_T uintptr_t
 typedef struct
@@ -53,8 +54,26 @@ struct arena_s
 
     block_t *deleted;
     hashmap_t *hashmap;
+
+    // Allocations of a frame arena that didn't fit in its reserve, freed by
+    // M_ArenaClear().
+    void **overflow;
 };
 
+static void *AllocOverflow(arena_t *arena, int size, int align)
+{
+    char *block = malloc(size + align - 1);
+
+    if (!block)
+    {
+        I_Error("Out of memory");
+    }
+
+    array_push(arena->overflow, block);
+
+    return block + (-(uintptr_t)block & (align - 1));
+}
+
 void *M_ArenaAlloc(arena_t *arena, int size, int align)
 {
     array_foreach_type(block, arena->deleted, block_t)
@@ -81,6 +100,10 @@ void *M_ArenaAlloc(arena_t *arena, int size, int align)
         ptrdiff_t new_buffer_size = buffer_size * 2;
         if (new_buffer_size > arena->reserve)
         {
+            if (!arena->hashmap)
+            {
+                return AllocOverflow(arena, size, align);
+            }
             I_Error("Out of memory");
         }
 
@@ -104,12 +127,15 @@ void *M_ArenaAlloc(arena_t *arena, int size, int align)
     void *ptr = arena->beg + padding;
     arena->beg += padding + size;
 
-    hashmap_value_t value = {
-        .size = size,
-        .align = align,
-        .index = arena->hashmap->size
-    };
-    hashmap_put(arena->hashmap, (uintptr_t)ptr, &value);
+    if (arena->hashmap)
+    {
+        hashmap_value_t value = {
+            .size = size,
+            .align = align,
+            .index = arena->hashmap->size
+        };
+        hashmap_put(arena->hashmap, (uintptr_t)ptr, &value);
+    }
 
     return ptr;
 }
@@ -124,7 +150,7 @@ void *M_ArenaCalloc(arena_t *arena, int size, int align)
 void arena_free(arena_t *arena, void *ptr)
 {
     hashmap_value_t value;
-    if (!hashmap_get(arena->hashmap, (uintptr_t)ptr, &value))
+    if (!arena->hashmap || !hashmap_get(arena->hashmap, (uintptr_t)ptr, &value))
     {
         I_Error("Freed a pointer not from arena");
     }
@@ -143,7 +169,7 @@ void arena_free(arena_t *arena, void *ptr)
     array_push(arena->deleted, block);
 }
 
-arena_t *M_ArenaInit(int reserve, int commit)
+static arena_t *InitArena(int reserve, int commit)
 {
     arena_t *arena = calloc(1, sizeof(*arena));
 
@@ -160,11 +186,21 @@ arena_t *M_ArenaInit(int reserve, int commit)
     arena->beg = arena->buffer;
     arena->end = arena->beg + commit;
 
-    arena->hashmap = hashmap_init(1024);
+    return arena;
+}
 
+arena_t *M_ArenaInit(int reserve, int commit)
+{
+    arena_t *arena = InitArena(reserve, commit);
+    arena->hashmap = hashmap_init(1024);
     return arena;
 }
 
+arena_t *M_ArenaInitFrame(int reserve, int commit)
+{
+    return InitArena(reserve, commit);
+}
+
 static void FreeBlocks(block_t *blocks)
 {
     array_foreach_type(block, blocks, block_t)
@@ -178,11 +214,20 @@ void M_ArenaClear(arena_t *arena)
 {
     arena->beg = arena->buffer;
 
+    array_foreach_type(block, arena->overflow, void *)
+    {
+        free(*block);
+    }
+    array_clear(arena->overflow);
+
     FreeBlocks(arena->deleted);
     arena->deleted = NULL;
 
-    hashmap_free(arena->hashmap);
-    arena->hashmap = hashmap_init(1024);
+    if (arena->hashmap)
+    {
+        hashmap_free(arena->hashmap);
+        arena->hashmap = hashmap_init(1024);
+    }
 }
 
 struct arena_copy_s
@@ -190,6 +235,10 @@ struct arena_copy_s
     char *buffer;
     size_t size;
 
+    // the buffer is a delta against the buffer of base
+    const arena_copy_t *base;
+    size_t delta_size;
+
     block_t *deleted;
     hashmap_t *hashmap;
 };
@@ -232,10 +281,30 @@ arena_copy_t *M_ArenaCopy(const arena_t *arena)
     return copy;
 }
 
+void M_ArenaDeltaCopy(arena_copy_t *copy, const arena_copy_t *base)
+{
+    size_t delta_size;
+    char *delta = M_DeltaEncode(copy->buffer, copy->size, base->buffer,
+                                base->size, &delta_size);
+
+    free(copy->buffer);
+    copy->buffer = delta;
+    copy->delta_size = delta_size;
+    copy->base = base;
+}
+
 void M_ArenaRestore(arena_t *arena, const arena_copy_t *copy)
 {
     arena->beg = arena->buffer + copy->size;
-    memcpy(arena->buffer, copy->buffer, copy->size);
+    if (copy->base)
+    {
+        M_DeltaDecode(copy->buffer, copy->delta_size, copy->base->buffer,
+                      copy->base->size, arena->buffer, copy->size);
+    }
+    else
+    {
+        memcpy(arena->buffer, copy->buffer, copy->size);
+    }
 
     FreeBlocks(arena->deleted);
     arena->deleted = CopyBlocks(copy->deleted);
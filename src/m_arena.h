@@ -37,11 +37,18 @@ void *M_ArenaCalloc(arena_t *arena, int size, int align);
 void arena_free(arena_t *arena, void *ptr);
 
 arena_t *M_ArenaInit(int reserve, int commit);
+// An arena without bookkeeping per allocation, for scratch memory that is
+// only ever freed all at once by M_ArenaClear(). It can't be copied and
+// doesn't support arena_free(). Once the reserve is used up, allocations
+// fall back to the heap instead of failing.
+arena_t *M_ArenaInitFrame(int reserve, int commit);
 void M_ArenaClear(arena_t *arena);
 
 typedef struct arena_copy_s arena_copy_t;
 
 arena_copy_t *M_ArenaCopy(const arena_t *arena);
+// Stores the copy as a delta against base, which must outlive it.
+void M_ArenaDeltaCopy(arena_copy_t *copy, const arena_copy_t *base);
 void M_ArenaRestore(arena_t *arena, const arena_copy_t *copy);
 void M_ArenaFreeCopy(arena_copy_t *copy);
 
@@ -21,7 +21,7 @@ void M_ArrayDelete(void *v, size_t esize, int i, int n)
     {
         m_array_buffer_t *p = array_ptr(v);
 
-        memmove((char *)v + i * esize, (char *)v + n * esize,
+        memmove((char *)v + i * esize, (char *)v + (i + n) * esize,
                 (p->size - n - i) * esize);
         p->size -= n;
     }
@@ -0,0 +1,380 @@
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 2
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      -benchmark: per-phase frame timings of a demo.
+//
+//      Every frame records how long the game tics run before it and each
+//      rendering phase took, along with the renderer counters and the
+//      sight checks of its tics. At exit the frames are written to
+//      <report>.csv, and their percentiles and the worst of them to
+//      <report>.json.
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "doomstat.h"
+#include "i_exit.h"
+#include "i_printf.h"
+#include "i_timer.h"
+#include "m_argv.h"
+#include "m_array.h"
+#include "m_bench.h"
+#include "m_io.h"
+#include "m_misc.h"
+#include "m_trace.h"
+#include "p_map.h"
+#include "r_draw.h"
+#include "r_main.h"
+#include "v_video.h"
+
+#include "yyjson.h"
+
+#define NUMWORSTFRAMES 10
+
+typedef struct
+{
+    int gametic;
+    uint64_t time; // whole frame
+    uint64_t phases[NUMBENCHPHASES];
+    int segs, visplanes, vissprites, voxels;
+    int tics, sightchecks, sightcachehits;
+} benchframe_t;
+
+static const char *phase_names[NUMBENCHPHASES] = {
+    "tic", "bsp", "walls", "planes", "masked", "hud", "blit"
+};
+
+boolean benchmark;
+
+static const char *report;
+static const char *demo;
+
+static benchframe_t *frames;
+static benchframe_t current;
+
+// the phases are recorded in the frame trace as well, walls are too many
+static const int trace_events[NUMBENCHPHASES] = {
+    TRACE_TIC, TRACE_BSP, -1, TRACE_PLANES, TRACE_MASKED, TRACE_HUD, TRACE_BLIT
+};
+
+static uint64_t phase_start[NUMBENCHPHASES];
+static uint64_t frame_start, bench_start;
+static int frame_gametic, frame_sightchecks, frame_sightcachehits;
+
+void M_BenchStart(benchphase_t phase)
+{
+    if (trace_events[phase] >= 0)
+    {
+        M_TraceBegin(trace_events[phase]);
+    }
+
+    if (benchmark)
+    {
+        phase_start[phase] = I_GetTimeNS();
+    }
+}
+
+void M_BenchStop(benchphase_t phase)
+{
+    if (trace_events[phase] >= 0)
+    {
+        M_TraceEnd(trace_events[phase]);
+    }
+
+    if (benchmark)
+    {
+        current.phases[phase] += I_GetTimeNS() - phase_start[phase];
+    }
+}
+
+void M_BenchFrame(void)
+{
+    const uint64_t now = I_GetTimeNS();
+
+    if (!benchmark)
+    {
+        return;
+    }
+
+    // the first frame starts with the demo
+    if (!frame_start)
+    {
+        bench_start = frame_start = now;
+        memset(&current, 0, sizeof(current));
+        frame_gametic = gametic;
+        frame_sightchecks = sight_checks;
+        frame_sightcachehits = sight_cache_hits;
+        return;
+    }
+
+    current.gametic = gametic;
+    current.time = now - frame_start;
+
+    // walls are drawn while traversing the BSP
+    if (current.phases[BENCH_BSP] > current.phases[BENCH_WALLS])
+    {
+        current.phases[BENCH_BSP] -= current.phases[BENCH_WALLS];
+    }
+    else
+    {
+        current.phases[BENCH_BSP] = 0;
+    }
+
+    current.segs = rendered_segs;
+    current.visplanes = rendered_visplanes;
+    current.vissprites = rendered_vissprites;
+    current.voxels = rendered_voxels;
+
+    current.tics = gametic - frame_gametic;
+    current.sightchecks = sight_checks - frame_sightchecks;
+    current.sightcachehits = sight_cache_hits - frame_sightcachehits;
+    frame_gametic = gametic;
+    frame_sightchecks = sight_checks;
+    frame_sightcachehits = sight_cache_hits;
+
+    array_push(frames, current);
+
+    memset(&current, 0, sizeof(current));
+    frame_start = now;
+}
+
+static double ToMS(uint64_t ns)
+{
+    return ns / 1000000.0;
+}
+
+static int CompareTimes(const void *a, const void *b)
+{
+    const uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int CompareFrames(const void *a, const void *b)
+{
+    const benchframe_t *x = *(benchframe_t *const *)a;
+    const benchframe_t *y = *(benchframe_t *const *)b;
+    return (x->time < y->time) - (x->time > y->time);
+}
+
+// Nearest-rank percentile of sorted times.
+
+static uint64_t Percentile(const uint64_t *sorted, int count, int p)
+{
+    int rank = (int)ceil(p / 100.0 * count);
+    return sorted[CLAMP(rank, 1, count) - 1];
+}
+
+static void AddStats(yyjson_mut_doc *doc, yyjson_mut_val *phases,
+                     const char *name, uint64_t *times, int count)
+{
+    yyjson_mut_val *stats = yyjson_mut_obj_add_obj(doc, phases, name);
+    uint64_t sum = 0;
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        sum += times[i];
+    }
+
+    qsort(times, count, sizeof(*times), CompareTimes);
+
+    yyjson_mut_obj_add_real(doc, stats, "mean", ToMS(sum) / count);
+    yyjson_mut_obj_add_real(doc, stats, "p50",
+                            ToMS(Percentile(times, count, 50)));
+    yyjson_mut_obj_add_real(doc, stats, "p90",
+                            ToMS(Percentile(times, count, 90)));
+    yyjson_mut_obj_add_real(doc, stats, "p99",
+                            ToMS(Percentile(times, count, 99)));
+    yyjson_mut_obj_add_real(doc, stats, "max", ToMS(times[count - 1]));
+}
+
+static yyjson_mut_doc *CreateReport(uint64_t seconds_ns)
+{
+    const int count = array_size(frames);
+    uint64_t *times = malloc(count * sizeof(*times));
+    benchframe_t **worst = malloc(count * sizeof(*worst));
+    yyjson_mut_doc *doc = yyjson_mut_doc_new(NULL);
+    yyjson_mut_val *root, *phases, *worstframes;
+    int tics = 0, sightchecks = 0, sightcachehits = 0;
+    int i, p;
+
+    root = yyjson_mut_obj(doc);
+    yyjson_mut_doc_set_root(doc, root);
+    yyjson_mut_obj_add_str(doc, root, "demo", demo);
+    yyjson_mut_obj_add_int(doc, root, "frames", count);
+    yyjson_mut_obj_add_int(doc, root, "gametics", gametic);
+    yyjson_mut_obj_add_real(doc, root, "seconds", seconds_ns / 1000000000.0);
+    yyjson_mut_obj_add_real(doc, root, "fps",
+                            count * 1000000000.0 / MAX(seconds_ns, 1));
+    yyjson_mut_obj_add_int(doc, root, "width", video.width);
+    yyjson_mut_obj_add_int(doc, root, "height", video.height);
+    yyjson_mut_obj_add_str(doc, root, "light_tables",
+                           merged_lighttables ? "merged" : "split");
+
+    for (i = 0; i < count; i++)
+    {
+        tics += frames[i].tics;
+        sightchecks += frames[i].sightchecks;
+        sightcachehits += frames[i].sightcachehits;
+    }
+    yyjson_mut_obj_add_real(doc, root, "sight_checks_per_tic",
+                            (double)sightchecks / MAX(tics, 1));
+    yyjson_mut_obj_add_real(doc, root, "sight_cache_hit_rate",
+                            (double)sightcachehits / MAX(sightchecks, 1));
+
+    phases = yyjson_mut_obj_add_obj(doc, root, "phases");
+    for (p = 0; p < NUMBENCHPHASES; p++)
+    {
+        for (i = 0; i < count; i++)
+        {
+            times[i] = frames[i].phases[p];
+        }
+        AddStats(doc, phases, phase_names[p], times, count);
+    }
+    for (i = 0; i < count; i++)
+    {
+        times[i] = frames[i].time;
+    }
+    AddStats(doc, phases, "frame", times, count);
+
+    for (i = 0; i < count; i++)
+    {
+        worst[i] = &frames[i];
+    }
+    qsort(worst, count, sizeof(*worst), CompareFrames);
+
+    worstframes = yyjson_mut_obj_add_arr(doc, root, "worst_frames");
+    for (i = 0; i < MIN(count, NUMWORSTFRAMES); i++)
+    {
+        const benchframe_t *frame = worst[i];
+        yyjson_mut_val *entry = yyjson_mut_arr_add_obj(doc, worstframes);
+
+        yyjson_mut_obj_add_int(doc, entry, "frame", (int)(frame - frames));
+        yyjson_mut_obj_add_int(doc, entry, "gametic", frame->gametic);
+        yyjson_mut_obj_add_real(doc, entry, "frame_ms", ToMS(frame->time));
+        for (p = 0; p < NUMBENCHPHASES; p++)
+        {
+            yyjson_mut_obj_add_real(doc, entry, phase_names[p],
+                                    ToMS(frame->phases[p]));
+        }
+        yyjson_mut_obj_add_int(doc, entry, "segs", frame->segs);
+        yyjson_mut_obj_add_int(doc, entry, "visplanes", frame->visplanes);
+        yyjson_mut_obj_add_int(doc, entry, "vissprites", frame->vissprites);
+        yyjson_mut_obj_add_int(doc, entry, "voxels", frame->voxels);
+    }
+
+    free(worst);
+    free(times);
+
+    return doc;
+}
+
+static void WriteCSV(FILE *file)
+{
+    int i, p;
+
+    fprintf(file, "frame,gametic,frame_ms");
+    for (p = 0; p < NUMBENCHPHASES; p++)
+    {
+        fprintf(file, ",%s_ms", phase_names[p]);
+    }
+    fprintf(file, ",segs,visplanes,vissprites,voxels,tics,sight_checks,"
+                  "sight_cache_hits\n");
+
+    for (i = 0; i < array_size(frames); i++)
+    {
+        const benchframe_t *frame = &frames[i];
+
+        fprintf(file, "%d,%d,%.3f", i, frame->gametic, ToMS(frame->time));
+        for (p = 0; p < NUMBENCHPHASES; p++)
+        {
+            fprintf(file, ",%.3f", ToMS(frame->phases[p]));
+        }
+        fprintf(file, ",%d,%d,%d,%d,%d,%d,%d\n", frame->segs,
+                frame->visplanes, frame->vissprites, frame->voxels,
+                frame->tics, frame->sightchecks, frame->sightcachehits);
+    }
+}
+
+static void WriteReport(void)
+{
+    const uint64_t seconds_ns = frame_start - bench_start;
+    char *filename;
+    boolean success = false;
+    FILE *file;
+
+    if (!array_size(frames))
+    {
+        I_Printf(VB_WARNING, "Benchmark: no frames were rendered");
+        return;
+    }
+
+    filename = M_StringJoin(report, ".json");
+    if ((file = M_fopen(filename, "w")))
+    {
+        yyjson_mut_doc *doc = CreateReport(seconds_ns);
+
+        success = yyjson_mut_write_fp(file, doc, YYJSON_WRITE_PRETTY, NULL,
+                                      NULL);
+        yyjson_mut_doc_free(doc);
+        success &= fclose(file) == 0;
+    }
+
+    if (success)
+    {
+        I_Printf(VB_ALWAYS, "Benchmark: wrote %s", filename);
+    }
+    else
+    {
+        I_Printf(VB_ERROR, "Benchmark: could not write %s", filename);
+    }
+    free(filename);
+
+    filename = M_StringJoin(report, ".csv");
+    if ((file = M_fopen(filename, "w")))
+    {
+        WriteCSV(file);
+        fclose(file);
+        I_Printf(VB_ALWAYS, "Benchmark: wrote %s", filename);
+    }
+    else
+    {
+        I_Printf(VB_ERROR, "Benchmark: could not write %s", filename);
+    }
+    free(filename);
+
+    array_free(frames);
+}
+
+void M_InitBenchmark(const char *demoname)
+{
+    int p;
+
+    benchmark = true;
+    demo = demoname;
+
+    //!
+    // @arg <name>
+    // @category demo
+    //
+    // Base name of the -benchmark report files, <name>.json and <name>.csv.
+    // The default is "benchmark".
+    //
+
+    p = M_CheckParmWithArgs("-benchreport", 1);
+    report = p ? myargv[p + 1] : "benchmark";
+
+    I_AtExit(WriteReport, false);
+}
@@ -0,0 +1,43 @@
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 2
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      -benchmark: per-phase frame timings of a demo.
+//
+
+#ifndef __M_BENCH__
+#define __M_BENCH__
+
+#include "doomtype.h"
+
+typedef enum
+{
+    BENCH_TIC,      // game tics run before the frame
+    BENCH_BSP,      // BSP traversal, without walls
+    BENCH_WALLS,
+    BENCH_PLANES,
+    BENCH_MASKED,   // sprites and masked midtextures
+    BENCH_HUD,
+    BENCH_BLIT,
+    NUMBENCHPHASES
+} benchphase_t;
+
+extern boolean benchmark;
+
+void M_InitBenchmark(const char *demoname);
+
+void M_BenchStart(benchphase_t phase);
+void M_BenchStop(benchphase_t phase);
+
+// Ends the current frame.
+void M_BenchFrame(void);
+
+#endif
@@ -206,6 +206,13 @@ default_t *M_LookupDefault(const char *name)
     return dp;
 }
 
+// Used by processes that must not overwrite the config of their parent.
+
+void M_DisableSaveDefaults(void)
+{
+    defaults_loaded = false;
+}
+
 //
 // M_SaveDefaults
 //
@@ -25,6 +25,7 @@
 
 void M_LoadDefaults(void);
 void M_SaveDefaults(void);
+void M_DisableSaveDefaults(void);
 struct default_s *M_LookupDefault(const char *name);     // killough 11/98
 boolean M_ParseOption(const char *name, boolean wad);    // killough 11/98
 void M_LoadOptions(void);                                // killough 11/98
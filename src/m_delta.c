@@ -0,0 +1,195 @@
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// XOR/RLE deltas of memory snapshots.
+//
+// A delta is a sequence of runs, each a varint count of unchanged bytes,
+// a varint count of changed bytes and the changed bytes XORed with the
+// base. Unchanged stretches shorter than MIN_SKIP are kept in the changed
+// bytes, so that scattered changes don't cost more than they save.
+
+#include "m_delta.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "i_system.h"
+
+#define MIN_SKIP 8
+
+typedef struct
+{
+    char *buffer;
+    size_t size, capacity;
+} output_t;
+
+static void Reserve(output_t *out, size_t size)
+{
+    if (out->size + size > out->capacity)
+    {
+        while (out->size + size > out->capacity)
+        {
+            out->capacity *= 2;
+        }
+        out->buffer = I_Realloc(out->buffer, out->capacity);
+    }
+}
+
+static void PutVarint(output_t *out, size_t value)
+{
+    Reserve(out, 10);
+
+    while (value >= 0x80)
+    {
+        out->buffer[out->size++] = (char)(value | 0x80);
+        value >>= 7;
+    }
+    out->buffer[out->size++] = (char)value;
+}
+
+static size_t GetVarint(const char **p)
+{
+    size_t value = 0;
+    int shift = 0;
+    unsigned char c;
+
+    do
+    {
+        c = *(*p)++;
+        value |= (size_t)(c & 0x7f) << shift;
+        shift += 7;
+    } while (c & 0x80);
+
+    return value;
+}
+
+inline static char BaseByte(const char *base, size_t base_size, size_t i)
+{
+    return i < base_size ? base[i] : 0;
+}
+
+static void CopyBase(char *data, const char *base, size_t base_size,
+                     size_t i, size_t count)
+{
+    size_t from_base = 0;
+
+    if (i < base_size)
+    {
+        from_base = base_size - i < count ? base_size - i : count;
+        memcpy(data + i, base + i, from_base);
+    }
+    memset(data + i + from_base, 0, count - from_base);
+}
+
+// Length of the unchanged stretch at i.
+
+static size_t SkipLength(const char *data, size_t size, const char *base,
+                         size_t base_size, size_t i)
+{
+    const size_t start = i;
+    const size_t common = size < base_size ? size : base_size;
+
+    while (i + sizeof(uint64_t) <= common)
+    {
+        uint64_t a, b;
+        memcpy(&a, data + i, sizeof(a));
+        memcpy(&b, base + i, sizeof(b));
+        if (a != b)
+        {
+            break;
+        }
+        i += sizeof(uint64_t);
+    }
+
+    while (i < size && data[i] == BaseByte(base, base_size, i))
+    {
+        i++;
+    }
+
+    return i - start;
+}
+
+char *M_DeltaEncode(const char *data, size_t size, const char *base,
+                    size_t base_size, size_t *delta_size)
+{
+    output_t out = {0};
+    size_t i = 0;
+
+    out.capacity = 1024;
+    out.buffer = I_Realloc(NULL, out.capacity);
+
+    while (i < size)
+    {
+        size_t skip = SkipLength(data, size, base, base_size, i);
+        size_t start = i + skip, end = start;
+
+        // trailing unchanged bytes are not encoded
+        if (start == size)
+        {
+            break;
+        }
+
+        // changed bytes, up to the next stretch worth skipping
+        while (end < size)
+        {
+            size_t next = SkipLength(data, size, base, base_size, end);
+
+            if (next >= MIN_SKIP || end + next == size)
+            {
+                break;
+            }
+            end += next ? next : 1;
+        }
+
+        PutVarint(&out, skip);
+        PutVarint(&out, end - start);
+
+        Reserve(&out, end - start);
+        for (size_t j = start; j < end; j++)
+        {
+            out.buffer[out.size++] = data[j] ^ BaseByte(base, base_size, j);
+        }
+
+        i = end;
+    }
+
+    *delta_size = out.size;
+    return out.buffer;
+}
+
+void M_DeltaDecode(const char *delta, size_t delta_size, const char *base,
+                   size_t base_size, char *data, size_t size)
+{
+    const char *p = delta, *end = delta + delta_size;
+    size_t i = 0;
+
+    while (p < end)
+    {
+        size_t skip = GetVarint(&p);
+        size_t length = GetVarint(&p);
+
+        if (i + skip + length > size)
+        {
+            I_Error("Corrupted delta");
+        }
+
+        CopyBase(data, base, base_size, i, skip);
+        i += skip;
+
+        for (; length > 0; length--, i++)
+        {
+            data[i] = *p++ ^ BaseByte(base, base_size, i);
+        }
+    }
+
+    CopyBase(data, base, base_size, i, size - i);
+}
@@ -0,0 +1,28 @@
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// XOR/RLE deltas of memory snapshots.
+
+#ifndef M_DELTA_H
+#define M_DELTA_H
+
+#include <stddef.h>
+
+// Returns a new buffer with the delta of data against base, which is
+// treated as zero-padded or truncated to the size of data.
+char *M_DeltaEncode(const char *data, size_t size, const char *base,
+                    size_t base_size, size_t *delta_size);
+
+// Restores size bytes of the data the delta was encoded from.
+void M_DeltaDecode(const char *delta, size_t delta_size, const char *base,
+                   size_t base_size, char *data, size_t size);
+
+#endif
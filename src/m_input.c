@@ -776,6 +776,7 @@ void M_BindInputVariables(void)
     BIND_INPUT(input_zoomout, "Reduce display");
     BIND_INPUT(input_screenshot, "Take a screenshot");
     BIND_INPUT(input_clean_screenshot, "Take a clean screenshot");
+    BIND_INPUT(input_frame_trace, "Save the timings of the last frames");
     BIND_INPUT(input_pause, "Pause the game");
 
     BIND_INPUT(input_demo_quit, "Finish recording demo");
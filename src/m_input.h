@@ -88,6 +88,7 @@ enum
     input_zoomout,
     input_screenshot,
     input_clean_screenshot,
+    input_frame_trace,
     input_pause,
     input_spy,
 
@@ -26,6 +26,7 @@
 #  include <windows.h>
 #else
 #  include <fcntl.h>
+#  include <sys/mman.h>
 #  include <unistd.h>
 #endif
 
@@ -328,6 +329,95 @@ void M_MakeDirectory(const char *path)
 #endif
 }
 
+// Maps a whole file into memory. Pages are shared with the page cache until
+// written to, and writes never reach the file.
+
+void *M_MapFile(const char *filename, size_t *length)
+{
+#ifdef _WIN32
+    wchar_t *wname = NULL;
+    HANDLE file, mapping;
+    LARGE_INTEGER size;
+    void *data = NULL;
+
+    wname = ConvertUtf8ToWide(filename);
+
+    if (!wname)
+    {
+        return NULL;
+    }
+
+    file = CreateFileW(wname, GENERIC_READ, FILE_SHARE_READ, NULL,
+                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    free(wname);
+
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return NULL;
+    }
+
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+    {
+        mapping = CreateFileMappingW(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+
+        if (mapping)
+        {
+            data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+            CloseHandle(mapping);
+        }
+    }
+
+    CloseHandle(file);
+
+    if (data)
+    {
+        *length = (size_t)size.QuadPart;
+    }
+
+    return data;
+#else
+    struct stat st;
+    void *data = NULL;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd,
+                    0);
+
+        if (data == MAP_FAILED)
+        {
+            data = NULL;
+        }
+        else
+        {
+            *length = st.st_size;
+        }
+    }
+
+    close(fd);
+
+    return data;
+#endif
+}
+
+void M_UnmapFile(void *data, size_t length)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+#else
+    munmap(data, length);
+#endif
+}
+
 #ifdef _WIN32
 typedef struct
 {
@@ -46,6 +46,8 @@ int M_open(const char *filename, int oflag);
 int M_access(const char *path, int mode);
 void M_MakeDirectory(const char *dir);
 char *M_getenv(const char *name);
+void *M_MapFile(const char *filename, size_t *length);
+void M_UnmapFile(void *data, size_t length);
 
 #ifdef _WIN32
 char *M_ConvertWideToUtf8(const wchar_t *wstr);
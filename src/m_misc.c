@@ -23,8 +23,10 @@
 #include <string.h>
 #include <ctype.h>
 
+#include "i_glob.h"
 #include "i_printf.h"
 #include "i_system.h"
+#include "m_array.h"
 #include "m_io.h"
 #include "m_misc.h"
 #include "z_zone.h"
@@ -719,6 +721,68 @@ void M_DigestToString(const byte *digest, char *string, int size)
     }
 }
 
+typedef struct
+{
+    char *path;
+    time_t mtime;
+    int64_t size;
+} cachefile_t;
+
+static int CompareCacheFiles(const void *a, const void *b)
+{
+    const cachefile_t *x = a, *y = b;
+    return (x->mtime > y->mtime) - (x->mtime < y->mtime);
+}
+
+void M_TrimCacheDir(const char *dir, const char *pattern, int64_t max_size)
+{
+    cachefile_t *files = NULL;
+    int64_t total = 0;
+    const char *path;
+    glob_t *glob;
+
+    if (!M_DirExists(dir))
+    {
+        return;
+    }
+
+    glob = I_StartGlob(dir, pattern, GLOB_FLAG_NOCASE);
+
+    while ((path = I_NextGlob(glob)))
+    {
+        struct stat st;
+
+        if (M_stat(path, &st) == 0)
+        {
+            cachefile_t file = {M_StringDuplicate(path), st.st_mtime,
+                                st.st_size};
+            array_push(files, file);
+            total += file.size;
+        }
+    }
+
+    I_EndGlob(glob);
+
+    if (total > max_size)
+    {
+        qsort(files, array_size(files), sizeof(*files), CompareCacheFiles);
+
+        for (int i = 0; i < array_size(files) && total > max_size; i++)
+        {
+            if (M_remove(files[i].path) == 0)
+            {
+                total -= files[i].size;
+            }
+        }
+    }
+
+    array_foreach_type(file, files, cachefile_t)
+    {
+        free(file->path);
+    }
+    array_free(files);
+}
+
 // Really complex printing shit...
 void M_ProgressBarStart(const int item_count, const char *msg)
 {
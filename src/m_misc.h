@@ -73,6 +73,10 @@ int M_ReadFile(const char *name, byte **buffer);
 boolean M_StringToDigest(const char *string, byte *digest, int size);
 void M_DigestToString(const byte *digest, char *string, int size);
 
+// Removes the oldest files matching the pattern from a cache directory until
+// the rest take up at most max_size bytes.
+void M_TrimCacheDir(const char *dir, const char *pattern, int64_t max_size);
+
 // Really complex printing shit...
 void M_ProgressBarStart(const int item_count, const char *msg);
 void M_ProgressBarMove(const int item_current);
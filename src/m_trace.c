@@ -0,0 +1,182 @@
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 2
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Ring buffer of the timed phases of the last frames, written as
+//      Chrome trace events.
+//
+//      The phases are always recorded, which only costs two clock reads
+//      each, so that a stutter can still be written after it happened.
+//      Every event is a complete ("X") event on a single track, phases
+//      nested in time are shown nested.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "d_main.h"
+#include "doomstat.h"
+#include "doomtype.h"
+#include "i_printf.h"
+#include "i_timer.h"
+#include "m_io.h"
+#include "m_misc.h"
+#include "m_trace.h"
+
+#include "yyjson.h"
+
+// About ten seconds of frames at 200 fps.
+#define NUMTRACEENTRIES 32768
+
+typedef struct
+{
+    uint64_t start, duration;
+    int frame;
+    traceevent_t event;
+} traceentry_t;
+
+static const char *event_names[NUMTRACEEVENTS] = {
+    "frame", "input", "tics", "tic", "bsp", "planes",
+    "masked", "hud", "blit", "sound", "present", "sleep"
+};
+
+static traceentry_t entries[NUMTRACEENTRIES];
+static unsigned int numentries; // total, the ring holds the last ones
+
+static uint64_t begin_time[NUMTRACEEVENTS];
+static int frame;
+
+static void AddEntry(traceevent_t event, uint64_t start, uint64_t end)
+{
+    traceentry_t *entry = &entries[numentries++ % NUMTRACEENTRIES];
+
+    entry->start = start;
+    entry->duration = end - start;
+    entry->frame = frame;
+    entry->event = event;
+}
+
+void M_TraceBegin(traceevent_t event)
+{
+    begin_time[event] = I_GetTimeNS();
+}
+
+void M_TraceEnd(traceevent_t event)
+{
+    if (begin_time[event])
+    {
+        AddEntry(event, begin_time[event], I_GetTimeNS());
+    }
+}
+
+void M_TraceFrame(void)
+{
+    const uint64_t now = I_GetTimeNS();
+
+    if (begin_time[TRACE_FRAME])
+    {
+        AddEntry(TRACE_FRAME, begin_time[TRACE_FRAME], now);
+    }
+
+    begin_time[TRACE_FRAME] = now;
+    frame++;
+}
+
+static yyjson_mut_doc *CreateTrace(void)
+{
+    const unsigned int count = MIN(numentries, NUMTRACEENTRIES);
+    const unsigned int first = numentries - count;
+    yyjson_mut_doc *doc = yyjson_mut_doc_new(NULL);
+    yyjson_mut_val *root, *events;
+    uint64_t origin = UINT64_MAX;
+
+    root = yyjson_mut_obj(doc);
+    yyjson_mut_doc_set_root(doc, root);
+    yyjson_mut_obj_add_str(doc, root, "displayTimeUnit", "ms");
+    events = yyjson_mut_obj_add_arr(doc, root, "traceEvents");
+
+    // timestamps are in microseconds from the first event
+    for (unsigned int i = first; i < numentries; i++)
+    {
+        origin = MIN(origin, entries[i % NUMTRACEENTRIES].start);
+    }
+
+    for (unsigned int i = first; i < numentries; i++)
+    {
+        const traceentry_t *entry = &entries[i % NUMTRACEENTRIES];
+        yyjson_mut_val *event = yyjson_mut_arr_add_obj(doc, events);
+        yyjson_mut_val *args;
+
+        yyjson_mut_obj_add_str(doc, event, "name", event_names[entry->event]);
+        yyjson_mut_obj_add_str(doc, event, "ph", "X");
+        yyjson_mut_obj_add_real(doc, event, "ts",
+                                (entry->start - origin) / 1000.0);
+        yyjson_mut_obj_add_real(doc, event, "dur", entry->duration / 1000.0);
+        yyjson_mut_obj_add_int(doc, event, "pid", 1);
+        yyjson_mut_obj_add_int(doc, event, "tid", 1);
+
+        args = yyjson_mut_obj_add_obj(doc, event, "args");
+        yyjson_mut_obj_add_int(doc, args, "frame", entry->frame);
+    }
+
+    return doc;
+}
+
+void M_WriteFrameTrace(void)
+{
+    static int trace;
+    char *filename = NULL;
+    char name[16];
+    int tries = 10000;
+    boolean success = false;
+    yyjson_mut_doc *doc;
+    FILE *file;
+
+    if (!numentries)
+    {
+        displaymsg("No frames to trace");
+        return;
+    }
+
+    do
+    {
+        M_snprintf(name, sizeof(name), "%.4s%04d.json", D_DoomExeName(),
+                   trace++);
+        free(filename);
+        filename = M_StringJoin(screenshotdir, DIR_SEPARATOR_S, name);
+    } while (!M_access(filename, 0) && --tries);
+
+    if (tries && (file = M_fopen(filename, "wb")))
+    {
+        doc = CreateTrace();
+        success = yyjson_mut_write_fp(file, doc, YYJSON_WRITE_NOFLAG, NULL,
+                                      NULL);
+        yyjson_mut_doc_free(doc);
+        success &= fclose(file) == 0;
+
+        if (!success)
+        {
+            M_remove(filename);
+        }
+    }
+
+    if (success)
+    {
+        I_Printf(VB_INFO, "M_WriteFrameTrace: %s", filename);
+        displaymsg("Frame trace saved as %s", name);
+    }
+    else
+    {
+        displaymsg("Could not write frame trace");
+    }
+
+    free(filename);
+}
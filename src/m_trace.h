@@ -0,0 +1,48 @@
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 2
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Ring buffer of the timed phases of the last frames, written as
+//      Chrome trace events.
+//
+
+#ifndef __M_TRACE__
+#define __M_TRACE__
+
+typedef enum
+{
+    TRACE_FRAME,
+    TRACE_INPUT,    // events read for a new tic
+    TRACE_TICS,     // TryRunTics()
+    TRACE_TIC,      // G_Ticker()
+    TRACE_BSP,
+    TRACE_PLANES,
+    TRACE_MASKED,
+    TRACE_HUD,
+    TRACE_BLIT,     // I_FinishUpdate()
+    TRACE_SOUND,    // S_UpdateSounds()
+    TRACE_PRESENT,
+    TRACE_SLEEP,    // frame limiter
+    NUMTRACEEVENTS
+} traceevent_t;
+
+// Must be called from the main thread.
+void M_TraceBegin(traceevent_t event);
+void M_TraceEnd(traceevent_t event);
+
+// Ends the current frame.
+void M_TraceFrame(void);
+
+// Writes the recorded events to a new file in the screenshot directory,
+// which can be opened in Perfetto or chrome://tracing.
+void M_WriteFrameTrace(void);
+
+#endif
@@ -47,6 +47,7 @@
 #include "m_io.h"
 #include "m_misc.h"
 #include "m_swap.h"
+#include "m_trace.h"
 #include "mn_font.h"
 #include "mn_internal.h"
 #include "mn_menu.h"
@@ -3188,6 +3189,11 @@ boolean M_Responder(event_t *ev)
         G_ScreenShot();
     }
 
+    if (M_InputActivated(input_frame_trace))
+    {
+        M_WriteFrameTrace();
+    }
+
     // Pop-up Main menu?
 
     if (!menuactive)
@@ -44,6 +44,7 @@
 #include "p_map.h"
 #include "p_maputl.h"
 #include "p_mobj.h"
+#include "p_profile.h"
 #include "p_pspr.h"
 #include "p_setup.h"
 #include "p_spec.h"
@@ -137,8 +138,10 @@ void P_NoiseAlert(mobj_t *target, mobj_t *emitter)
   if (target && target->player && (target->player->cheats & CF_NOTARGET))
     return;
 
+  PROFILE_START(PROF_NOISEALERT);
   validcount++;
   P_RecursiveSound(emitter->subsector->sector, 0, target);
+  PROFILE_STOP(PROF_NOISEALERT);
 }
 
 //
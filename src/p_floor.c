@@ -72,6 +72,8 @@ result_e T_MovePlane
   fixed_t       destheight; //jff 02/04/98 used to keep floors/ceilings
                             // from moving thru each other
 
+  P_InvalidateSightCache();
+
   switch(floorOrCeiling)
   {
     case 0:
@@ -22,7 +22,14 @@ typedef struct
     int map;
 } keyframe_t;
 
+// Only copies the game state, which is cheap. The keyframe can't be loaded
+// until P_FinishKeyframe() has returned, and that must happen before the
+// next P_SaveKeyframe(), which reuses the copy of the sectors.
 keyframe_t *P_SaveKeyframe(int tic);
+// Packs the copied state, and stores it as a delta against base, a finished
+// full keyframe that must outlive it, unless base is NULL. Doesn't touch the
+// game state, so it can run on another thread.
+void P_FinishKeyframe(keyframe_t *keyframe, const keyframe_t *base);
 void P_LoadKeyframe(const keyframe_t *keyframe);
 void P_FreeKeyframe(keyframe_t *keyframe);
 
@@ -39,6 +39,7 @@
 #include "p_map.h"
 #include "p_maputl.h"
 #include "p_mobj.h"
+#include "p_profile.h"
 #include "p_setup.h"
 #include "p_spec.h"
 #include "p_user.h"
@@ -764,7 +765,7 @@ boolean Check_Sides(mobj_t *actor, int x, int y)
 //  numspeciallines
 //
 
-boolean P_CheckPosition(mobj_t *thing, fixed_t x, fixed_t y) 
+static boolean CheckPosition(mobj_t *thing, fixed_t x, fixed_t y)
 {
   int xl, xh, yl, yh, bx, by;
   subsector_t *newsubsec;
@@ -841,6 +842,15 @@ boolean P_CheckPosition(mobj_t *thing, fixed_t x, fixed_t y)
   return true;
 }
 
+boolean P_CheckPosition(mobj_t *thing, fixed_t x, fixed_t y)
+{
+  boolean result;
+  PROFILE_START(PROF_CHECKPOSITION);
+  result = CheckPosition(thing, x, y);
+  PROFILE_STOP(PROF_CHECKPOSITION);
+  return result;
+}
+
 //
 // P_TryMove
 // Attempt to move to a new position,
@@ -848,7 +858,7 @@ boolean P_CheckPosition(mobj_t *thing, fixed_t x, fixed_t y)
 //
 // killough 3/15/98: allow dropoff as option
 
-boolean P_TryMove(mobj_t *thing, fixed_t x, fixed_t y, int dropoff)
+static boolean TryMove(mobj_t *thing, fixed_t x, fixed_t y, int dropoff)
 {
   fixed_t oldx, oldy;
 
@@ -953,6 +963,15 @@ boolean P_TryMove(mobj_t *thing, fixed_t x, fixed_t y, int dropoff)
   return true;
 }
 
+boolean P_TryMove(mobj_t *thing, fixed_t x, fixed_t y, int dropoff)
+{
+  boolean result;
+  PROFILE_START(PROF_TRYMOVE);
+  result = TryMove(thing, x, y, dropoff);
+  PROFILE_STOP(PROF_TRYMOVE);
+  return result;
+}
+
 //
 // killough 9/12/98:
 //
@@ -2117,6 +2136,8 @@ boolean P_ChangeSector(sector_t *sector,boolean crunch)
 {
   int x, y;
 
+  PROFILE_START(PROF_CHANGESECTOR);
+
   nofit = false;
   crushchange = crunch;
 
@@ -2130,6 +2151,8 @@ boolean P_ChangeSector(sector_t *sector,boolean crunch)
     for (y=sector->blockbox[BOXBOTTOM];y<= sector->blockbox[BOXTOP] ; y++)
       P_BlockThingsIterator (x, y, PIT_ChangeSector, false);
 
+  PROFILE_STOP(PROF_CHANGESECTOR);
+
   return nofit;
 }
 
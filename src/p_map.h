@@ -50,6 +50,10 @@ boolean P_TryMove(struct mobj_s *thing, fixed_t x, fixed_t y, int dropoff);
 boolean P_TeleportMove(struct mobj_s *thing, fixed_t x, fixed_t y, boolean boss);
 void    P_SlideMove(struct mobj_s *mo);
 extern boolean (*P_CheckSight)(struct mobj_s *t1, struct mobj_s *t2);
+extern boolean sight_cache;
+extern int sight_checks, sight_cache_hits; // counted for -benchmark
+// Must be called whenever sector heights change.
+void    P_InvalidateSightCache(void);
 boolean P_CheckFov(struct mobj_s *t1, struct mobj_s *t2, angle_t fov);
 void    P_UseLines(struct player_s *player);
 
@@ -30,6 +30,7 @@
 #include "p_map.h"
 #include "p_maputl.h"
 #include "p_mobj.h"
+#include "p_profile.h"
 #include "p_setup.h"
 #include "r_defs.h"
 #include "r_main.h"
@@ -854,8 +855,8 @@ static void InterceptsOverrun(int num_intercepts, intercept_t *intercept)
 //
 // killough 5/3/98: reformatted, cleaned up
 
-boolean P_PathTraverse(fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2,
-                       int flags, boolean trav(intercept_t *))
+static boolean PathTraverse(fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2,
+                            int flags, boolean trav(intercept_t *))
 {
   fixed_t xt1, yt1;
   fixed_t xt2, yt2;
@@ -971,6 +972,16 @@ boolean P_PathTraverse(fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2,
   return P_TraverseIntercepts(trav, FRACUNIT);
 }
 
+boolean P_PathTraverse(fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2,
+                       int flags, boolean trav(intercept_t *))
+{
+  boolean result;
+  PROFILE_START(PROF_PATHTRAVERSE);
+  result = PathTraverse(x1, y1, x2, y2, flags, trav);
+  PROFILE_STOP(PROF_PATHTRAVERSE);
+  return result;
+}
+
 //
 // mbf21: RoughBlockCheck
 // [XA] adapted from Hexen -- used by P_RoughTargetSearch
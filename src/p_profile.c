@@ -0,0 +1,196 @@
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 2
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Playsim profiler, built with -DWOOF_PROFILER=ON.
+//
+//      The thinkers and the most expensive playsim functions time
+//      themselves and count their calls. The render stats widget shows
+//      the averages per tic of the last second, and every tic of a level
+//      is written to <prefdir>/profile/<map>.csv when the level ends.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "d_iwad.h"
+#include "d_think.h"
+#include "doomdef.h"
+#include "doomstat.h"
+#include "i_exit.h"
+#include "i_printf.h"
+#include "i_timer.h"
+#include "info.h"
+#include "m_array.h"
+#include "m_io.h"
+#include "m_misc.h"
+#include "p_mobj.h"
+#include "p_profile.h"
+
+typedef struct
+{
+    uint64_t time;
+    int calls;
+} profdata_t;
+
+typedef struct
+{
+    int leveltime;
+    profdata_t data[NUMPROFILES];
+} proftic_t;
+
+static const char *profile_names[NUMPROFILES] = {
+    "players",       "monsters", "mobjs",        "specials",
+    "checksight",    "pathtraverse",
+    "checkposition", "trymove",  "changesector", "noisealert"
+};
+
+static proftic_t current;
+
+// every tic of the current level
+static proftic_t *level_tics;
+static char level_name[9];
+
+// the last full second, for the widget
+static proftic_t second, last_second;
+
+uint64_t P_ProfileTime(void)
+{
+    return I_GetTimeNS();
+}
+
+void P_ProfileAdd(profile_t profile, uint64_t start)
+{
+    current.data[profile].time += I_GetTimeNS() - start;
+    current.data[profile].calls++;
+}
+
+profile_t P_ThinkerProfile(const thinker_t *thinker)
+{
+    const mobj_t *mobj = (const mobj_t *)thinker;
+
+    if (thinker->function.p1 != P_MobjThinker)
+    {
+        return PROF_SPECIALS;
+    }
+
+    if (mobj->flags & MF_COUNTKILL || mobj->type == MT_SKULL)
+    {
+        return PROF_MONSTERS;
+    }
+
+    return PROF_MOBJS;
+}
+
+void P_ProfileTic(void)
+{
+    current.leveltime = leveltime;
+    array_push(level_tics, current);
+
+    for (int i = 0; i < NUMPROFILES; i++)
+    {
+        second.data[i].time += current.data[i].time;
+        second.data[i].calls += current.data[i].calls;
+    }
+
+    // leveltime counts the tics of the second
+    if (++second.leveltime == TICRATE)
+    {
+        last_second = second;
+        memset(&second, 0, sizeof(second));
+    }
+
+    memset(&current, 0, sizeof(current));
+}
+
+boolean P_ProfileStats(profile_t profile, double *ms, double *calls)
+{
+    const profdata_t *data = &last_second.data[profile];
+
+    if (!last_second.leveltime)
+    {
+        return false;
+    }
+
+    *ms = data->time / 1000000.0 / last_second.leveltime;
+    *calls = (double)data->calls / last_second.leveltime;
+
+    return true;
+}
+
+static void WriteLevelCSV(void)
+{
+    char *dir, *filename;
+    FILE *file;
+
+    if (!array_size(level_tics))
+    {
+        return;
+    }
+
+    dir = M_StringJoin(D_DoomPrefDir(), DIR_SEPARATOR_S, "profile");
+    M_MakeDirectory(dir);
+    filename = M_StringJoin(dir, DIR_SEPARATOR_S, level_name, ".csv");
+    free(dir);
+
+    if ((file = M_fopen(filename, "w")))
+    {
+        fprintf(file, "leveltime");
+        for (int i = 0; i < NUMPROFILES; i++)
+        {
+            fprintf(file, ",%s_ms,%s_calls", profile_names[i],
+                    profile_names[i]);
+        }
+        fprintf(file, "\n");
+
+        for (int tic = 0; tic < array_size(level_tics); tic++)
+        {
+            const proftic_t *data = &level_tics[tic];
+
+            fprintf(file, "%d", data->leveltime);
+            for (int i = 0; i < NUMPROFILES; i++)
+            {
+                fprintf(file, ",%.3f,%d", data->data[i].time / 1000000.0,
+                        data->data[i].calls);
+            }
+            fprintf(file, "\n");
+        }
+
+        fclose(file);
+        I_Printf(VB_INFO, "Profiler: wrote %s", filename);
+    }
+    else
+    {
+        I_Printf(VB_ERROR, "Profiler: could not write %s", filename);
+    }
+
+    free(filename);
+    array_free(level_tics);
+}
+
+void P_ProfileLevel(const char *mapname)
+{
+    static boolean registered;
+
+    if (!registered)
+    {
+        I_AtExit(WriteLevelCSV, false);
+        registered = true;
+    }
+
+    WriteLevelCSV();
+
+    M_CopyLumpName(level_name, mapname);
+    memset(&current, 0, sizeof(current));
+    memset(&second, 0, sizeof(second));
+    memset(&last_second, 0, sizeof(last_second));
+}
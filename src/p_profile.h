@@ -0,0 +1,71 @@
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 2
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Playsim profiler, built with -DWOOF_PROFILER=ON.
+//
+
+#ifndef P_PROFILE_H
+#define P_PROFILE_H
+
+#ifdef PLAYSIM_PROFILER
+
+#include <stdint.h>
+
+#include "doomtype.h"
+
+struct thinker_s;
+
+typedef enum
+{
+    // thinkers
+    PROF_PLAYERS,
+    PROF_MONSTERS,
+    PROF_MOBJS,
+    PROF_SPECIALS,
+
+    // the times of these are included in those of the thinkers
+    PROF_CHECKSIGHT,
+    PROF_PATHTRAVERSE,
+    PROF_CHECKPOSITION,
+    PROF_TRYMOVE,
+    PROF_CHANGESECTOR,
+    PROF_NOISEALERT,
+
+    NUMPROFILES
+} profile_t;
+
+uint64_t P_ProfileTime(void);
+void P_ProfileAdd(profile_t profile, uint64_t start);
+
+profile_t P_ThinkerProfile(const struct thinker_s *thinker);
+
+// Ends the current tic.
+void P_ProfileTic(void);
+
+// Writes the CSV file of the previous level.
+void P_ProfileLevel(const char *mapname);
+
+// Averages per tic over the last second, for the render stats widget.
+// Returns false until a second has passed.
+boolean P_ProfileStats(profile_t profile, double *ms, double *calls);
+
+#define PROFILE_START(id) const uint64_t profile_start_##id = P_ProfileTime()
+#define PROFILE_STOP(id)  P_ProfileAdd((id), profile_start_##id)
+
+#else
+
+#define PROFILE_START(id)
+#define PROFILE_STOP(id)
+
+#endif
+
+#endif
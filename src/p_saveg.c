@@ -31,6 +31,7 @@
 #include "m_array.h"
 #include "m_random.h"
 #include "p_enemy.h"
+#include "p_map.h"
 #include "p_maputl.h"
 #include "p_mobj.h"
 #include "p_pspr.h"
@@ -1125,6 +1126,8 @@ void P_UnArchiveWorld(void)
             }
         }
     }
+
+    P_InvalidateSightCache();
 }
 
 //
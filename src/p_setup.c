@@ -45,6 +45,7 @@
 #include "p_map.h"
 #include "p_maputl.h"
 #include "p_mobj.h"
+#include "p_profile.h"
 #include "p_setup.h"
 #include "p_spec.h"
 #include "p_tick.h"
@@ -1826,6 +1827,10 @@ void P_SetupLevel(int episode, int map, int playermask, skill_t skill)
   // find map name
   M_CopyLumpName(lumpname, MapName(episode, map));
 
+#ifdef PLAYSIM_PROFILER
+  P_ProfileLevel(lumpname);
+#endif
+
   lumpnum = W_GetNumForName(lumpname);
 
   mapformat = P_CheckMapFormat(lumpnum);
@@ -1869,6 +1874,8 @@ void P_SetupLevel(int episode, int map, int playermask, skill_t skill)
   // [crispy] fix long wall wobble
   P_SegLengths();
 
+  P_InvalidateSightCache();
+
   // Note: you don't need to clear player queue slots --
   // a much simpler fix is in g_game.c -- killough 10/98
 
@@ -1918,6 +1925,9 @@ void P_SetupLevel(int episode, int map, int playermask, skill_t skill)
   if (precache)
     R_PrecacheLevel();
 
+  // [Woof!] wait for the sounds decoded in the background
+  S_PreloadLevelSounds();
+
   // [FG] log level setup
   I_Printf(VB_DEMO, "P_SetupLevel: %.8s (%s), Skill %d, %s%s%s, %s",
     lumpname, W_WadNameForLump(lumpnum),
@@ -17,6 +17,10 @@
 //
 //-----------------------------------------------------------------------------
 
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
 #include "doomdata.h"
 #include "doomstat.h"
 #include "doomtype.h"
@@ -25,6 +29,7 @@
 #include "m_fixed.h"
 #include "p_maputl.h"
 #include "p_mobj.h"
+#include "p_profile.h"
 #include "p_setup.h"
 #include "r_defs.h"
 #include "r_main.h"
@@ -220,6 +225,67 @@ static boolean P_CrossBSPNode(int bspnum, register los_t *los)
   return P_CrossSubsector(bspnum == -1 ? 0 : bspnum & ~NF_SUBSECTOR, los);
 }
 
+//
+// Sight cache
+//
+// The BSP walk only depends on the eye and target positions and on the
+// sector heights, so its results are kept until a plane moves or the world
+// is reloaded. Monsters check the same target more than once a tic, and
+// idle monsters keep checking a player who isn't moving, so this saves a
+// lot of walks without changing any result.
+//
+
+#define SIGHTCACHE_BITS 12
+#define SIGHTCACHE_SIZE (1 << SIGHTCACHE_BITS)
+
+typedef struct {
+  fixed_t x1, y1, z1;              // eye of looker
+  fixed_t x2, y2, z2, height2;     // target
+  int generation;
+  boolean result;
+} sightcache_t;
+
+static sightcache_t sightcache[SIGHTCACHE_SIZE];
+static int sightcache_generation = 1;
+
+boolean sight_cache;
+
+int sight_checks, sight_cache_hits;
+
+void P_InvalidateSightCache(void)
+{
+  if (++sightcache_generation == INT_MAX)
+    {
+      memset(sightcache, 0, sizeof(sightcache));
+      sightcache_generation = 1;
+    }
+}
+
+static sightcache_t *P_SightCacheEntry(const sightcache_t *key)
+{
+  uint32_t hash = key->x1;
+
+  hash = hash * 0x9e3779b1u ^ key->y1;
+  hash = hash * 0x9e3779b1u ^ key->z1;
+  hash = hash * 0x9e3779b1u ^ key->x2;
+  hash = hash * 0x9e3779b1u ^ key->y2;
+  hash = hash * 0x9e3779b1u ^ key->z2;
+  hash = hash * 0x9e3779b1u ^ key->height2;
+  hash *= 0x9e3779b1u;
+
+  return &sightcache[hash >> (32 - SIGHTCACHE_BITS)];
+}
+
+static boolean P_SightCacheMatch(const sightcache_t *entry,
+                                 const sightcache_t *key)
+{
+  return entry->generation == sightcache_generation &&
+         entry->x1 == key->x1 && entry->y1 == key->y1 &&
+         entry->z1 == key->z1 && entry->x2 == key->x2 &&
+         entry->y2 == key->y2 && entry->z2 == key->z2 &&
+         entry->height2 == key->height2;
+}
+
 //
 // P_CheckSight
 // Returns true
@@ -234,6 +300,9 @@ static boolean P_CheckSight_MBF(mobj_t *t1, mobj_t *t2)
   const sector_t *s2 = t2->subsector->sector;
   int pnum = (s1-sectors)*numsectors + (s2-sectors);
   los_t los;
+  sightcache_t key, *entry = NULL;
+
+  sight_checks++;
 
   // First check for trivial rejection.
   // Determine subsector entries in REJECT table.
@@ -268,6 +337,25 @@ static boolean P_CheckSight_MBF(mobj_t *t1, mobj_t *t2)
 
   validcount++;
 
+  if (sight_cache)
+    {
+      key.x1 = t1->x;
+      key.y1 = t1->y;
+      key.z1 = t1->z + t1->height - (t1->height>>2);
+      key.x2 = t2->x;
+      key.y2 = t2->y;
+      key.z2 = t2->z;
+      key.height2 = t2->height;
+
+      entry = P_SightCacheEntry(&key);
+
+      if (P_SightCacheMatch(entry, &key))
+        {
+          sight_cache_hits++;
+          return entry->result;
+        }
+    }
+
   los.topslope = (los.bottomslope = t2->z - (los.sightzstart =
                                              t1->z + t1->height -
                                              (t1->height>>2))) + t2->height;
@@ -285,10 +373,40 @@ static boolean P_CheckSight_MBF(mobj_t *t1, mobj_t *t2)
     los.bbox[BOXTOP] = t2->y, los.bbox[BOXBOTTOM] = t1->y;
 
   // the head node is the last node output
-  return P_CrossBSPNode(numnodes-1, &los);
+  if (!entry)
+    return P_CrossBSPNode(numnodes-1, &los);
+
+  key.result = P_CrossBSPNode(numnodes-1, &los);
+  key.generation = sightcache_generation;
+  *entry = key;
+
+  return key.result;
 }
 
 boolean checksight12;
+
+#ifdef PLAYSIM_PROFILER
+
+static boolean (*P_CheckSight_Engine)(mobj_t *t1, mobj_t *t2) = P_CheckSight_MBF;
+
+static boolean P_CheckSight_Profile(mobj_t *t1, mobj_t *t2)
+{
+  boolean result;
+  PROFILE_START(PROF_CHECKSIGHT);
+  result = P_CheckSight_Engine(t1, t2);
+  PROFILE_STOP(PROF_CHECKSIGHT);
+  return result;
+}
+
+boolean (*P_CheckSight)(mobj_t *t1, mobj_t *t2) = P_CheckSight_Profile;
+
+void P_UpdateCheckSight(void)
+{
+  P_CheckSight_Engine = CRITICAL(checksight12) ? P_CheckSight_12 : P_CheckSight_MBF;
+}
+
+#else
+
 boolean (*P_CheckSight)(mobj_t *t1, mobj_t *t2) = P_CheckSight_MBF;
 
 void P_UpdateCheckSight(void)
@@ -296,6 +414,8 @@ void P_UpdateCheckSight(void)
   P_CheckSight = CRITICAL(checksight12) ? P_CheckSight_12 : P_CheckSight_MBF;
 }
 
+#endif
+
 //
 // mbf21: P_CheckFov
 // Returns true if t2 is within t1's field of view.
@@ -25,6 +25,7 @@
 #include "p_ambient.h"
 #include "p_map.h"
 #include "p_mobj.h"
+#include "p_profile.h"
 #include "p_tick.h"
 #include "p_spec.h"
 #include "p_user.h"
@@ -316,13 +317,38 @@ void P_SetTarget(mobj_t **mop, mobj_t *targ)
 // external and using P_RemoveThinkerDelayed() implicitly.
 //
 
+int awake_thinkers;
+
+// Idle mobjs are items, decorations and monsters that haven't woken up.
+
+inline static boolean IsAwake(const thinker_t *thinker)
+{
+  const mobj_t *mo = (const mobj_t *)thinker;
+
+  return thinker->function.p1 != P_MobjThinker
+         || mo->target || mo->momx || mo->momy || mo->momz;
+}
+
 static void P_RunThinkers (void)
 {
+  awake_thinkers = 0;
+
   for (currentthinker = thinkercap.next;
        currentthinker != &thinkercap;
        currentthinker = currentthinker->next)
     if (currentthinker->function.p1)
+    {
+      awake_thinkers += IsAwake(currentthinker);
+
+#ifdef PLAYSIM_PROFILER
+      const profile_t profile = P_ThinkerProfile(currentthinker);
+      const uint64_t start = P_ProfileTime();
       currentthinker->function.p1((mobj_t *)currentthinker);
+      P_ProfileAdd(profile, start);
+#else
+      currentthinker->function.p1((mobj_t *)currentthinker);
+#endif
+    }
 
   // [crispy] support MUSINFO lump (dynamic music changing)
   T_MusInfo();
@@ -391,15 +417,21 @@ void P_Ticker (void)
   P_MapStart();
   if (gamestate == GS_LEVEL)
   {
+  PROFILE_START(PROF_PLAYERS);
   for (i=0; i<MAXPLAYERS; i++)
     if (playeringame[i])
       P_PlayerThink(&players[i]);
+  PROFILE_STOP(PROF_PLAYERS);
   }
 
   P_RunThinkers();
   P_UpdateSpecials();
   P_RespawnSpecials();
   P_MapEnd();
+
+#ifdef PLAYSIM_PROFILER
+  P_ProfileTic();
+#endif
   }
 
   leveltime++;                       // for par times
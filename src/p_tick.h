@@ -72,6 +72,9 @@ extern thinker_t thinkerclasscap[];
 
 extern int init_thinkers_count;
 
+// Thinkers other than idle mobjs that ran in the last tic.
+extern int awake_thinkers;
+
 extern arena_t *thinkers_arena;
 
 #endif
@@ -89,6 +89,11 @@ static const char *params_with_args[] = {
 "-recordfromto",
 "-skipsec",
 "-timedemo",
+"-benchmark",
+"-benchreport",
+"-demobatch",
+"-demobatchjobs",
+"-demobatchreport",
 "-cl",
 "-complevel",
 "-gameversion",
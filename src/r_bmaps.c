@@ -19,6 +19,7 @@
 //	Adapted from doomretro/src/r_data.c:97-209
 //
 
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -28,7 +29,11 @@
 #include "info.h"
 #include "m_array.h"
 #include "m_misc.h"
+#include "r_bmaps.h"
 #include "r_data.h"
+#include "r_draw.h"
+#include "r_main.h"
+#include "r_state.h"
 #include "m_scanner.h"
 #include "w_wad.h"
 #include "z_zone.h"
@@ -41,7 +46,7 @@ boolean force_brightmaps;
 
 const byte nobrightmap[COLORMASK_SIZE] = {0};
 
-const byte *dc_brightmap = nobrightmap;
+THREAD_LOCAL const byte *dc_brightmap = nobrightmap;
 
 typedef struct
 {
@@ -337,3 +342,109 @@ void R_ParseBrightmaps(int lumpnum)
 
     brightmaps_found = (array_size(brightmaps_array) > 1);
 }
+
+// [Woof!] Merged light tables. Every row of every colormap with each
+// brightmap applied to it, so that the drawers look up a brightmapped pixel
+// in one table instead of through the brightmap and two colormap rows.
+
+// The light levels and the invulnerability colormap.
+#define BRIGHT_ROWS       (NUMCOLORMAPS + 1)
+#define BRIGHT_TABLE_SIZE (BRIGHT_ROWS * 256)
+
+static lighttable_t *bright_lighttables; // [colormap][brightmap][row][color]
+
+static void BuildBrightRow(int colormap, int brightmap, int row)
+{
+    const lighttable_t *source = colormaps[colormap];
+    const byte *colormask = brightmaps_array[brightmap].colormask;
+    lighttable_t *dest = bright_lighttables
+        + ((size_t)colormap * array_size(brightmaps_array) + brightmap)
+              * BRIGHT_TABLE_SIZE
+        + row * 256;
+
+    for (int i = 0; i < 256; ++i)
+    {
+        dest[i] = colormask[i] ? source[i] : source[row * 256 + i];
+    }
+}
+
+void R_InitBrightLightTables(void)
+{
+    const int numbrightmaps = array_size(brightmaps_array);
+
+    if (!merged_lighttables || !numbrightmaps)
+    {
+        return;
+    }
+
+    bright_lighttables = Z_Malloc((size_t)numcolormaps * numbrightmaps
+                                      * BRIGHT_TABLE_SIZE,
+                                  PU_STATIC, NULL);
+
+    for (int c = 0; c < numcolormaps; ++c)
+    {
+        for (int b = 0; b < numbrightmaps; ++b)
+        {
+            for (int row = 0; row < BRIGHT_ROWS; ++row)
+            {
+                BuildBrightRow(c, b, row);
+            }
+        }
+    }
+}
+
+void R_UpdateInvulLightTables(void)
+{
+    if (bright_lighttables)
+    {
+        for (int b = 0; b < array_size(brightmaps_array); ++b)
+        {
+            BuildBrightRow(0, b, NUMCOLORMAPS);
+        }
+    }
+}
+
+// Index of the colormap of the last lookup. Consecutive columns and spans
+// are almost always in the same one.
+static THREAD_LOCAL int last_colormap;
+
+const lighttable_t *R_BrightLightTable(lighttable_t *const *colormap,
+                                       const byte *brightmap)
+{
+    const brightmap_t *bm;
+    ptrdiff_t offset;
+    int c = last_colormap;
+
+    if (!bright_lighttables)
+    {
+        return NULL;
+    }
+
+    // the brightmapped pixels are looked up in the first row of the colormap
+    if (c >= numcolormaps || colormaps[c] != colormap[1])
+    {
+        for (c = 0; c < numcolormaps && colormaps[c] != colormap[1]; ++c)
+            ;
+
+        if (c == numcolormaps)
+        {
+            return NULL;
+        }
+
+        last_colormap = c;
+    }
+
+    offset = colormap[0] - colormap[1];
+
+    if (offset < 0 || offset >= BRIGHT_TABLE_SIZE)
+    {
+        return NULL;
+    }
+
+    bm = (const brightmap_t *)(brightmap - offsetof(brightmap_t, colormask));
+
+    return bright_lighttables
+           + ((size_t)c * array_size(brightmaps_array) + (bm - brightmaps_array))
+                 * BRIGHT_TABLE_SIZE
+           + offset;
+}
@@ -39,4 +39,12 @@ const byte *R_BrightmapForState(const int state);
 
 extern const byte **texturebrightmap;
 
+void R_InitBrightLightTables(void);
+void R_UpdateInvulLightTables(void);
+
+// Returns the merged light table for a colormap row and its brightmap, or
+// NULL if there is none.
+const lighttable_t *R_BrightLightTable(lighttable_t *const *colormap,
+                                       const byte *brightmap);
+
 #endif
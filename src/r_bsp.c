@@ -26,6 +26,7 @@
 #include "i_system.h"
 #include "i_video.h" // [FG] uncapped
 #include "m_bbox.h"
+#include "m_bench.h"
 #include "m_fixed.h"
 #include "p_mobj.h"
 #include "r_defs.h"
@@ -33,25 +34,31 @@
 #include "r_plane.h"
 #include "r_segs.h"
 #include "r_state.h"
+#include "r_strip.h"
 #include "r_things.h"
 #include "tables.h"
 #include "v_video.h"
+#include "z_zone.h"
 
-seg_t     *curline;
-side_t    *sidedef;
-line_t    *linedef;
-sector_t  *frontsector;
-sector_t  *backsector;
-drawseg_t *ds_p;
+THREAD_LOCAL seg_t     *curline;
+THREAD_LOCAL side_t    *sidedef;
+THREAD_LOCAL line_t    *linedef;
+THREAD_LOCAL sector_t  *frontsector;
+THREAD_LOCAL sector_t  *backsector;
+THREAD_LOCAL drawseg_t *ds_p;
 
 // killough 4/7/98: indicates doors closed wrt automap bugfix:
-int      doorclosed;
+THREAD_LOCAL int      doorclosed;
 
 // killough: New code which removes 2s linedef limit
-drawseg_t *drawsegs;
-unsigned  maxdrawsegs;
+THREAD_LOCAL drawseg_t *drawsegs;
+THREAD_LOCAL unsigned  maxdrawsegs;
 // drawseg_t drawsegs[MAXDRAWSEGS];       // old code -- killough
 
+THREAD_LOCAL int leafrank;
+
+static int LeafCount(int bspnum);
+
 //
 // R_ClearDrawSegs
 //
@@ -96,7 +103,7 @@ typedef struct {
 // Replaces the old R_Clip*WallSegment functions. It draws bits of walls in those
 // columns which aren't solid, and updates the solidcol[] array appropriately
 
-byte *solidcol = NULL;
+THREAD_LOCAL byte *solidcol = NULL;
 
 static void R_ClipWallSegment(int first, int last, boolean solid)
 {
@@ -119,7 +126,15 @@ static void R_ClipWallSegment(int first, int last, boolean solid)
       else
         to = p - solidcol;
 
-      R_StoreWallRange(first, to-1);
+      // strips run on several threads, their walls are timed with the BSP
+      if (curstrip)
+        R_StoreWallRange(first, to-1);
+      else
+      {
+        M_BenchStart(BENCH_WALLS);
+        R_StoreWallRange(first, to-1);
+        M_BenchStop(BENCH_WALLS);
+      }
 
       if (solid)
         memset(solidcol+first, 1, to-first);
@@ -372,6 +387,24 @@ static void R_MaybeInterpolateTextureOffsets(side_t *side)
     }
 }
 
+// Strips share sectors and sides, so they are all interpolated up front
+// instead of while traversing the BSP.
+
+void R_InterpolateSectors(void)
+{
+    int i;
+
+    for (i = 0; i < numsectors; i++)
+    {
+        R_MaybeInterpolateSector(&sectors[i]);
+    }
+
+    for (i = 0; i < numsides; i++)
+    {
+        R_MaybeInterpolateTextureOffsets(&sides[i]);
+    }
+}
+
 //
 // R_AddLine
 // Clips the given segment
@@ -386,7 +419,7 @@ static void R_AddLine (seg_t *line)
   angle_t  angle2;
   angle_t  span;
   angle_t  tspan;
-  static sector_t tempsec;     // killough 3/8/98: ceiling/water hack
+  static THREAD_LOCAL sector_t tempsec; // killough 3/8/98: ceiling/water hack
 
   curline = line;
 
@@ -442,7 +475,8 @@ static void R_AddLine (seg_t *line)
   if (x1 >= x2)       // killough 1/31/98 -- change == to >= for robustness
     return;
 
-  R_MaybeInterpolateTextureOffsets(line->sidedef);
+  if (!curstrip)
+    R_MaybeInterpolateTextureOffsets(line->sidedef);
 
   backsector = line->backsector;
 
@@ -453,11 +487,14 @@ static void R_AddLine (seg_t *line)
   // [AM] Interpolate sector movement before
   //      running clipping tests.  Frontsector
   //      should already be interpolated.
-  R_MaybeInterpolateSector(backsector);
-
-  if (backsector->heightsec != -1)
+  if (!curstrip)
   {
-    R_MaybeInterpolateSector(&sectors[backsector->heightsec]);
+    R_MaybeInterpolateSector(backsector);
+
+    if (backsector->heightsec != -1)
+    {
+      R_MaybeInterpolateSector(&sectors[backsector->heightsec]);
+    }
   }
 
   // killough 3/8/98, 4/4/98: hack for invisible ceilings / deep water
@@ -509,10 +546,14 @@ static void R_AddLine (seg_t *line)
     return;
 
 clippass:
+  rw_segx1 = x1;
+  rw_segx2 = x2 - 1;
   R_ClipWallSegment(x1, x2, false);
   return;
 
 clipsolid:
+  rw_segx1 = x1;
+  rw_segx2 = x2 - 1;
   R_ClipWallSegment(x1, x2, true);
 }
 
@@ -642,11 +683,14 @@ static void R_Subsector(int num)
 
   // [AM] Interpolate sector movement.  Usually only needed
   //      when you're standing inside the sector.
-  R_MaybeInterpolateSector(frontsector);
-
-  if (frontsector->heightsec != -1)
+  if (!curstrip)
   {
-    R_MaybeInterpolateSector(&sectors[frontsector->heightsec]);
+    R_MaybeInterpolateSector(frontsector);
+
+    if (frontsector->heightsec != -1)
+    {
+      R_MaybeInterpolateSector(&sectors[frontsector->heightsec]);
+    }
   }
 
   // killough 3/8/98, 4/4/98: Deep water / fake ceiling effect
@@ -717,7 +761,10 @@ static void R_Subsector(int num)
   // real sector, or you must account for the lighting in some other way, 
   // like passing it as an argument.
 
-  R_AddSprites(sub->sector, (floorlightlevel+ceilinglightlevel)/2);
+  if (curstrip)
+    R_AddStripLeaf(sub->sector, (floorlightlevel+ceilinglightlevel)/2);
+  else
+    R_AddSprites(sub->sector, (floorlightlevel+ceilinglightlevel)/2);
 
   while (count--)
   {
@@ -750,13 +797,70 @@ void R_RenderBSPNode(int bspnum)
       // Possibly divide back space.
 
       if (!R_CheckBBox(bsp->bbox[side^=1]))
-        return;
+        {
+          if (curstrip)
+            leafrank += LeafCount(bsp->children[side]);
+          return;
+        }
 
       bspnum = bsp->children[side];
     }
   R_Subsector(bspnum == -1 ? 0 : bspnum & ~NF_SUBSECTOR);
+  if (curstrip)
+    leafrank++;
 }
 
+//
+// R_InitLeafCounts
+// Counts the subsectors below each node, so that strips culling a subtree
+// can keep the BSP order of the subsectors they do visit in step.
+//
+
+static int *leafcounts;
+
+static int LeafCount(int bspnum)
+{
+  return bspnum & NF_SUBSECTOR ? 1 : leafcounts[bspnum];
+}
+
+static int CountLeafs(int bspnum)
+{
+  node_t *bsp;
+
+  if (bspnum & NF_SUBSECTOR)
+    return 1;
+
+  bsp = &nodes[bspnum];
+  return leafcounts[bspnum] = CountLeafs(bsp->children[0]) +
+                              CountLeafs(bsp->children[1]);
+}
+
+void R_InitLeafCounts(void)
+{
+  if (leafcounts || numnodes <= 0)
+    return;
+
+  Z_Malloc(numnodes * sizeof(*leafcounts), PU_LEVEL, (void **)&leafcounts);
+  CountLeafs(numnodes - 1);
+}
+
+//
+// R_SwapStripBSP
+// Exchanges the BSP state of the calling thread with that of the strip.
+//
+
+#define SWAP(type, a, b) do { type t_ = (a); (a) = (b); (b) = t_; } while (0)
+
+void R_SwapStripBSP(rstrip_t *strip)
+{
+  SWAP(drawseg_t *, drawsegs, strip->drawsegs);
+  SWAP(unsigned, maxdrawsegs, strip->maxdrawsegs);
+  SWAP(drawseg_t *, ds_p, strip->ds_p);
+  SWAP(byte *, solidcol, strip->solidcol);
+}
+
+#undef SWAP
+
 //----------------------------------------------------------------------------
 //
 // $Log: r_bsp.c,v $
@@ -20,31 +20,36 @@
 #ifndef __R_BSP__
 #define __R_BSP__
 
+#include "doomtype.h"
 #include "r_defs.h"
 
-extern seg_t    *curline;
-extern side_t   *sidedef;
-extern line_t   *linedef;
-extern sector_t *frontsector;
-extern sector_t *backsector;
-extern int      rw_x;
-extern int      rw_stopx;
-extern boolean  segtextured;
-extern boolean  markfloor;      // false if the back side is the same plane
-extern boolean  markceiling;
+extern THREAD_LOCAL seg_t    *curline;
+extern THREAD_LOCAL side_t   *sidedef;
+extern THREAD_LOCAL line_t   *linedef;
+extern THREAD_LOCAL sector_t *frontsector;
+extern THREAD_LOCAL sector_t *backsector;
+extern THREAD_LOCAL int      rw_x;
+extern THREAD_LOCAL int      rw_stopx;
+extern THREAD_LOCAL boolean  segtextured;
+extern THREAD_LOCAL boolean  markfloor;      // false if the back side is the same plane
+extern THREAD_LOCAL boolean  markceiling;
 
 // old code -- killough:
 // extern drawseg_t drawsegs[MAXDRAWSEGS];
 // new code -- killough:
-extern drawseg_t *drawsegs;
-extern unsigned maxdrawsegs;
+extern THREAD_LOCAL drawseg_t *drawsegs;
+extern THREAD_LOCAL unsigned maxdrawsegs;
 
-extern drawseg_t *ds_p;
+extern THREAD_LOCAL drawseg_t *ds_p;
 
-extern byte *solidcol;
+extern THREAD_LOCAL byte *solidcol;
 
 // killough 4/7/98: indicates doors closed wrt automap bugfix:
-extern int doorclosed;
+extern THREAD_LOCAL int doorclosed;
+
+// BSP traversal order of the current subsector, only kept up to date while
+// rendering in strips
+extern THREAD_LOCAL int leafrank;
 
 void R_ClearClipSegs(void);
 void R_ClearDrawSegs(void);
@@ -54,6 +59,12 @@ int R_DoorClosed(void);   // killough 1/17/98
 // killough 4/13/98: fake floors/ceilings for deep water / fake ceilings:
 sector_t *R_FakeFlat(sector_t *, sector_t *, int *, int *, boolean);
 
+void R_InterpolateSectors(void);
+void R_InitLeafCounts(void);
+
+struct rstrip_s;
+void R_SwapStripBSP(struct rstrip_s *strip);
+
 #endif
 
 //----------------------------------------------------------------------------
@@ -30,6 +30,7 @@
 #include "doomtype.h"
 #include "i_printf.h"
 #include "i_system.h"
+#include "i_thread.h"
 #include "info.h"
 #include "m_array.h"
 #include "m_fixed.h"
@@ -43,6 +44,8 @@
 #include "r_sky.h"
 #include "r_skydefs.h"
 #include "r_state.h"
+#include "r_strip.h"
+#include "r_texcache.h"
 #include "r_tranmap.h"
 #include "v_patch.h"
 #include "v_video.h" // cr_dark, cr_shaded
@@ -190,17 +193,19 @@ static void R_DrawColumnInCache(const column_t *patch, byte *cache,
 }
 
 //
-// R_GenerateComposite
+// R_BuildComposite
 // Using the texture definition,
 //  the composite texture is created from the patches,
 //  and each column is cached.
 //
 // Rewritten by Lee Killough for performance and to fix Medusa bug
+//
+// Does not allocate from the zone if the patches are given, so that the
+// composites of a level can be built on several threads.
 
-static void R_GenerateComposite(int texnum)
+static void R_BuildComposite(int texnum, byte *block, byte *block2,
+                             patch_t **patches, byte *marks, byte *source)
 {
-  byte *block = texturecomposite[texnum],
-       *block2 = texturecomposite2[texnum];
   texture_t *texture = textures[texnum];
   // Composite the columns together.
   texpatch_t *patch = texture->patches;
@@ -208,26 +213,14 @@ static void R_GenerateComposite(int texnum)
   unsigned *colofs = texturecolumnofs[texnum]; // killough 4/9/98: make 32-bit
   unsigned *colofs2 = texturecolumnofs2[texnum];
   int i = texture->patchcount;
-  // killough 4/9/98: marks to identify transparent regions in merged textures
-  byte *marks = Z_Calloc(texture->width, texture->height, PU_STATIC, 0), *source;
 
-  if (!block)
-  {
-    block = Z_Malloc(texturecompositesize[texnum], PU_LEVEL,
-                     (void **) &texturecomposite[texnum]);
-  }
-  // [FG] memory block for opaque textures
-  if (!block2)
-  {
-    block2 = Z_Malloc(texture->width * texture->height, PU_LEVEL,
-                      (void **) &texturecomposite2[texnum]);
-  }
   // [FG] initialize composite background to palette index 0 (usually black)
   memset(block, 0, texturecompositesize[texnum]);
 
   for (; --i >=0; patch++)
     {
-      patch_t *realpatch = V_CachePatchNum(patch->patch, PU_CACHE);
+      patch_t *realpatch = patches ? patches[patch - texture->patches]
+                                   : V_CachePatchNum(patch->patch, PU_CACHE);
       int x, x1 = patch->originx, x2 = x1 + SHORT(realpatch->width);
       const int *cofs = realpatch->columnofs - x1;
 
@@ -249,7 +242,6 @@ static void R_GenerateComposite(int texnum)
   // killough 4/9/98: Next, convert multipatched columns into true columns,
   // to fix Medusa bug while still allowing for transparent regions.
 
-  source = Z_Malloc(texture->height, PU_STATIC, 0);       // temporary column
   for (i=0; i < texture->width; i++)
     // [FG] generate composites for all columns
 //  if (collump[i] == -1)                 // process only multipatched columns
@@ -302,8 +294,57 @@ static void R_GenerateComposite(int texnum)
             col = (column_t *)((byte *) col + len + 4); // next post
           }
       }
+}
+
+//
+// R_GenerateComposite
+//
+
+void R_GenerateComposite(int texnum)
+{
+  byte *block, *block2;
+  texture_t *texture = textures[texnum];
+  byte *marks, *source;
+
+  R_LockStrips();
+
+  block = texturecomposite[texnum];
+  block2 = texturecomposite2[texnum];
+
+  // another strip may have generated it while this one was waiting
+  if (block && block2)
+  {
+    R_UnlockStrips();
+    return;
+  }
+
+  // killough 4/9/98: marks to identify transparent regions in merged textures
+  marks = Z_Calloc(texture->width, texture->height, PU_STATIC, 0);
+
+  // new blocks are published only once they are complete, as strips read
+  // texturecomposite[] without locking
+  if (!block)
+  {
+    block = Z_Malloc(texturecompositesize[texnum], PU_LEVEL, NULL);
+  }
+  // [FG] memory block for opaque textures
+  if (!block2)
+  {
+    block2 = Z_Malloc(texture->width * texture->height, PU_LEVEL, NULL);
+  }
+
+  source = Z_Malloc(texture->height, PU_STATIC, 0);       // temporary column
+
+  R_BuildComposite(texnum, block, block2, NULL, marks, source);
+
   Z_Free(source);         // free temporary column
   Z_Free(marks);          // free transparency marks
+
+  I_MemoryBarrier();
+  Z_ChangeUser(block, (void **) &texturecomposite[texnum]);
+  Z_ChangeUser(block2, (void **) &texturecomposite2[texnum]);
+
+  R_UnlockStrips();
 }
 
 //
@@ -318,9 +359,15 @@ static void R_GenerateLookup(int texnum, int *const errors)
 
   // Composited texture not created yet.
 
-  short *collump = texturecolumnlump[texnum];
-  unsigned *colofs = texturecolumnofs[texnum]; // killough 4/9/98: make 32-bit
-  unsigned *colofs2 = texturecolumnofs2[texnum];
+  // killough 4/9/98: make column offsets 32-bit;
+  // clean up malloc-ing to use sizeof
+  // killough 12/98: fix sizeofs
+  short *collump = texturecolumnlump[texnum] =
+    Z_Malloc(texture->width * sizeof(**texturecolumnlump), PU_STATIC, 0);
+  unsigned *colofs = texturecolumnofs[texnum] =
+    Z_Malloc(texture->width * sizeof(**texturecolumnofs), PU_STATIC, 0);
+  unsigned *colofs2 = texturecolumnofs2[texnum] =
+    Z_Malloc(texture->width * sizeof(**texturecolumnofs2), PU_STATIC, 0);
 
   // killough 4/9/98: keep count of posts in addition to patches.
   // Part of fix for medusa bug for multipatched 2s normals.
@@ -536,16 +583,6 @@ static inline void RegisterTexture(texture_t *texture, int i)
     // [crispy] initialize brightmaps
     texturebrightmap[i] = R_BrightmapForTexName(texture->name);
 
-    // killough 4/9/98: make column offsets 32-bit;
-    // clean up malloc-ing to use sizeof
-    // killough 12/98: fix sizeofs
-    texturecolumnlump[i] =
-        Z_Malloc(texture->width * sizeof(**texturecolumnlump), PU_STATIC, 0);
-    texturecolumnofs[i] =
-        Z_Malloc(texture->width * sizeof(**texturecolumnofs), PU_STATIC, 0);
-    texturecolumnofs2[i] =
-        Z_Malloc(texture->width * sizeof(**texturecolumnofs2), PU_STATIC, 0);
-
     int j;
     for (j = 1; j * 2 <= texture->width; j <<= 1)
         ;
@@ -789,11 +826,16 @@ void R_InitTextures (void)
     I_Error("\n\n%d errors.", errors);
     
   // Precalculate whatever possible.
-  for (i=0 ; i<numtextures ; i++)
-    R_GenerateLookup(i, &errors);
+  // The lookups are read from the cache if it is valid, and the composites
+  // it has are mapped. It is written when levels are precached.
+  if (!R_LoadTextureCache())
+  {
+    for (i=0 ; i<numtextures ; i++)
+      R_GenerateLookup(i, &errors);
 
-  if (errors)
-    I_Error("\n\n%d errors.", errors);
+    if (errors)
+      I_Error("\n\n%d errors.", errors);
+  }
 
   // Create translation table for global animation.
   // killough 4/9/98: make column offsets 32-bit;
@@ -914,6 +956,8 @@ void R_InvulMode(void)
       memcpy(&colormaps[0][256*32], invul_gray, 256);
       break;
   }
+
+  R_UpdateInvulLightTables();
 }
 
 void R_InitColormaps(void)
@@ -935,6 +979,8 @@ void R_InitColormaps(void)
 
   memcpy(invul_orig, &colormaps[0][256*32], 256);
   R_InvulMode();
+
+  R_InitBrightLightTables();
 }
 
 // killough 4/4/98: get colormap number from name
@@ -1052,6 +1098,182 @@ int R_TextureNumForName(const char *name)  // const added -- killough
   return i;
 }
 
+// Marks the wall textures of the level.
+
+static void R_MarkLevelTextures(byte *hitlist)
+{
+  int i;
+
+  memset(hitlist, 0, numtextures);
+
+  for (i = numsides; --i >= 0;)
+    hitlist[sides[i].bottomtexture] =
+      hitlist[sides[i].toptexture] =
+      hitlist[sides[i].midtexture] = 1;
+
+  // Sky texture is always present.
+  // Note that F_SKY1 is the name used to
+  //  indicate a sky floor/ceiling as a flat,
+  //  while the sky texture is stored like
+  //  a wall texture, with an episode dependend
+  //  name.
+
+  sky_t *sky;
+  array_foreach(sky, levelskies)
+  {
+    hitlist[sky->background.texture] = 1;
+  }
+}
+
+//
+// R_PrecacheComposites
+//
+// [Woof!] Builds the composites of all wall textures of the level up front,
+// so that R_GetColumn() does not generate them in the middle of a frame
+// when they are first seen. They share one block, each of them aligned to
+// cache lines, which is freed when the next level is precached, after they
+// have been written to the texture cache. With the threaded renderer, they
+// are built on all threads.
+//
+
+#define COMPOSITE_ALIGN 64
+
+typedef struct
+{
+  int texnum;
+  byte *block, *block2;
+  patch_t **patches;
+} composite_job_t;
+
+static byte *composite_arena;
+static int *composite_textures; // built into composite_arena
+
+static size_t AlignComposite(size_t size)
+{
+  return (size + COMPOSITE_ALIGN - 1) & ~(size_t)(COMPOSITE_ALIGN - 1);
+}
+
+static void BuildCompositeTask(void *data, int index)
+{
+  const composite_job_t *job = (const composite_job_t *)data + index;
+  const texture_t *texture = textures[job->texnum];
+  byte *marks = calloc(texture->width, texture->height);
+  byte *source = malloc(texture->height);
+
+  if (!marks || !source)
+    I_Error("Failed to allocate composite of %.8s", texture->name);
+
+  R_BuildComposite(job->texnum, job->block, job->block2, job->patches,
+                   marks, source);
+
+  free(source);
+  free(marks);
+}
+
+static void R_PrecacheComposites(void)
+{
+  byte *hitlist = Z_Malloc(numtextures, PU_STATIC, 0);
+  composite_job_t *jobs;
+  patch_t **patches;
+  int numjobs = 0, numpatches = 0;
+  size_t size = 0;
+  byte *block;
+  int i, j;
+
+  // the composites of the previous level go to the texture cache first
+  R_SaveTextureCache();
+
+  for (i = 0; i < array_size(composite_textures); i++)
+  {
+    texturecomposite[composite_textures[i]] = NULL;
+    texturecomposite2[composite_textures[i]] = NULL;
+  }
+  array_clear(composite_textures);
+
+  if (composite_arena)
+  {
+    Z_Free(composite_arena);
+    composite_arena = NULL;
+  }
+
+  R_MapCachedComposites();
+
+  R_MarkLevelTextures(hitlist);
+
+  // composites mapped from the texture cache or generated before
+  for (i = 0; i < numtextures; i++)
+    if (hitlist[i] && !texturecomposite[i] && !texturecomposite2[i])
+    {
+      const texture_t *texture = textures[i];
+
+      array_push(composite_textures, i);
+      size += AlignComposite(texturecompositesize[i]);
+      size += AlignComposite(texture->width * texture->height);
+      numpatches += texture->patchcount;
+    }
+
+  Z_Free(hitlist);
+
+  numjobs = array_size(composite_textures);
+
+  if (!numjobs)
+    return;
+
+  composite_arena = Z_Malloc(size + COMPOSITE_ALIGN - 1, PU_STATIC, 0);
+  jobs = Z_Malloc(numjobs * sizeof(*jobs), PU_STATIC, 0);
+  patches = Z_Malloc(numpatches * sizeof(*patches), PU_STATIC, 0);
+
+  block = (byte *)(((uintptr_t)composite_arena + COMPOSITE_ALIGN - 1)
+                   & ~(uintptr_t)(COMPOSITE_ALIGN - 1));
+  numpatches = 0;
+
+  // the patches are locked in the zone, which the threads must not touch
+  for (i = 0; i < numjobs; i++)
+  {
+    const int texnum = composite_textures[i];
+    const texture_t *texture = textures[texnum];
+    composite_job_t *job = &jobs[i];
+
+    job->texnum = texnum;
+    job->block = block;
+    block += AlignComposite(texturecompositesize[texnum]);
+    job->block2 = block;
+    block += AlignComposite(texture->width * texture->height);
+
+    job->patches = &patches[numpatches];
+    for (j = 0; j < texture->patchcount; j++)
+      patches[numpatches++] = V_CachePatchNum(texture->patches[j].patch,
+                                              PU_STATIC);
+  }
+
+  if (threaded_renderer)
+  {
+    I_RunTasks(BuildCompositeTask, jobs, numjobs);
+  }
+  else
+  {
+    for (i = 0; i < numjobs; i++)
+      BuildCompositeTask(jobs, i);
+  }
+
+  for (i = 0; i < numjobs; i++)
+  {
+    const texture_t *texture = textures[jobs[i].texnum];
+
+    texturecomposite[jobs[i].texnum] = jobs[i].block;
+    texturecomposite2[jobs[i].texnum] = jobs[i].block2;
+
+    for (j = 0; j < texture->patchcount; j++)
+      V_CachePatchNum(texture->patches[j].patch, PU_CACHE);
+  }
+
+  Z_Free(patches);
+  Z_Free(jobs);
+
+  I_Printf(VB_DEBUG, "R_PrecacheComposites: %d textures, %zu bytes",
+           numjobs, size);
+}
+
 //
 // R_PrecacheLevel
 // Preloads all relevant graphics for the level.
@@ -1064,6 +1286,9 @@ void R_PrecacheLevel(void)
   register int i;
   register byte *hitlist;
 
+  // not needed for the texture cache
+  R_PrecacheComposites();
+
   if (demoplayback)
     return;
 
@@ -1090,25 +1315,7 @@ void R_PrecacheLevel(void)
 
   // Precache textures.
 
-  memset(hitlist, 0, numtextures);
-
-  for (i = numsides; --i >= 0;)
-    hitlist[sides[i].bottomtexture] =
-      hitlist[sides[i].toptexture] =
-      hitlist[sides[i].midtexture] = 1;
-
-  // Sky texture is always present.
-  // Note that F_SKY1 is the name used to
-  //  indicate a sky floor/ceiling as a flat,
-  //  while the sky texture is stored like
-  //  a wall texture, with an episode dependend
-  //  name.
-
-  sky_t *sky;
-  array_foreach(sky, levelskies)
-  {
-    hitlist[sky->background.texture] = 1;
-  }
+  R_MarkLevelTextures(hitlist);
 
   for (i = numtextures; --i >= 0; )
     if (hitlist[i])
@@ -44,6 +44,15 @@ typedef struct
 } texture_t;
 
 extern texture_t **textures;
+extern int numtextures;
+
+// Column lookups and composites of the textures.
+extern int *texturecompositesize;
+extern short **texturecolumnlump;
+extern unsigned **texturecolumnofs, **texturecolumnofs2;
+extern byte **texturecomposite, **texturecomposite2;
+
+void R_GenerateComposite(int texnum);
 
 // Retrieve column data for span blitting.
 byte *R_GetColumn(int tex, int col);
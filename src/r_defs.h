@@ -136,10 +136,6 @@ typedef struct sector_s
   int linecount;
   struct line_s **lines;
 
-  // WiggleFix: [kb] For R_FixWiggle()
-  int cachedheight;
-  int scaleindex;
-
   // [AM] Previous position of floor and ceiling before
   //      think.  Used to interpolate between positions.
   fixed_t	oldfloorheight;
@@ -381,6 +377,10 @@ typedef struct drawseg_s
   // all three adjusted so [x1] is first value.
 
   int *sprtopclip, *sprbottomclip, *maskedtexturecol; // [FG] 32-bit integer math
+
+  // Used to merge the pieces of a seg rendered by different strips.
+  int leafrank;                         // BSP order of the subsector
+  boolean didsolidcol;                  // marked at least one column solid
 } drawseg_t;
 
 //
@@ -493,10 +493,11 @@ typedef struct visplane_s
   fixed_t height;
   fixed_t xoffs, yoffs;         // killough 2/28/98: Support scrolling flats
   angle_t rotation;
-  unsigned short *bottom;
   int tint; // ID24 per-sector colormap
-  unsigned short pad1;          // leave pads for [minx-1]/[maxx+1]
-  unsigned short top[3];
+  // top and bottom are only allocated for columns lo to hi, which cover
+  // [minx-1]/[maxx+1], and indexed by column
+  int lo, hi;
+  unsigned short *top, *bottom;
 } visplane_t;
 
 #endif
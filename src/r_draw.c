@@ -21,12 +21,24 @@
 
 #include <string.h>
 
+#include "config.h"
+
+#if defined(HAVE_SSE41) || defined(HAVE_AVX2)
+  #include <immintrin.h>
+#endif
+#if defined(HAVE_NEON)
+  #include <arm_neon.h>
+#endif
+
 #include "doomdef.h"
 #include "doomstat.h"
 #include "doomtype.h"
+#include "i_printf.h"
 #include "i_system.h"
 #include "i_video.h"
+#include "m_argv.h"
 #include "m_fixed.h"
+#include "r_bmaps.h"
 #include "r_bsp.h"
 #include "r_defs.h"
 #include "r_draw.h"
@@ -68,15 +80,15 @@ static pixel_t *background_buffer = NULL;
 // Source is the top of the column to scale.
 //
 
-lighttable_t *dc_colormap[2]; // [crispy] brightmaps
-int dc_x;
-int dc_yl;
-int dc_yh;
-fixed_t dc_iscale;
-fixed_t dc_texturemid;
-int dc_texheight; // killough
-byte *dc_source;  // first pixel in a column (possibly virtual)
-byte dc_skycolor;
+THREAD_LOCAL lighttable_t *dc_colormap[2]; // [crispy] brightmaps
+THREAD_LOCAL int dc_x;
+THREAD_LOCAL int dc_yl;
+THREAD_LOCAL int dc_yh;
+THREAD_LOCAL fixed_t dc_iscale;
+THREAD_LOCAL fixed_t dc_texturemid;
+THREAD_LOCAL int dc_texheight; // killough
+THREAD_LOCAL byte *dc_source;  // first pixel in a column (possibly virtual)
+THREAD_LOCAL byte dc_skycolor;
 
 //
 // A column is a vertical slice/span from a wall texture that,
@@ -94,7 +106,7 @@ byte dc_skycolor;
 
 // heightmask is the Tutti-Frutti fix -- killough
 
-void R_DrawColumn(void)
+static void DrawColumnScalar(void)
 {
     int count = dc_yh - dc_yl + 1;
     if (count <= 0)
@@ -185,7 +197,7 @@ void R_DrawColumn(void)
 // opaque' decision is made outside this routine, not down where the
 // actual code differences are.
 
-void R_DrawTLColumn(void)
+static void DrawTLColumnScalar(void)
 {
     int count = dc_yh - dc_yl + 1;
     if (count <= 0)
@@ -784,7 +796,8 @@ void R_SetFuzzColumnMode(void)
 //  identical sprites, kinda brightened up.
 //
 
-byte *dc_translation, *translationtables;
+THREAD_LOCAL byte *dc_translation;
+byte *translationtables;
 
 void R_DrawTranslatedColumn(void)
 {
@@ -913,22 +926,22 @@ void R_InitTranslationTables(void)
 //  and the inner loop has to step in texture space u and v.
 //
 
-int ds_y;
-int ds_x1;
-int ds_x2;
+THREAD_LOCAL int ds_y;
+THREAD_LOCAL int ds_x1;
+THREAD_LOCAL int ds_x2;
 
-lighttable_t *ds_colormap[2];
-const byte *ds_brightmap;
+THREAD_LOCAL lighttable_t *ds_colormap[2];
+THREAD_LOCAL const byte *ds_brightmap;
 
-uint32_t ds_xfrac;
-uint32_t ds_yfrac;
-uint32_t ds_xstep;
-uint32_t ds_ystep;
+THREAD_LOCAL uint32_t ds_xfrac;
+THREAD_LOCAL uint32_t ds_yfrac;
+THREAD_LOCAL uint32_t ds_xstep;
+THREAD_LOCAL uint32_t ds_ystep;
 
 // start of a 64*64 tile image
-byte *ds_source;
+THREAD_LOCAL byte *ds_source;
 
-void R_DrawSpan(void)
+static void DrawSpanScalar(void)
 {
     int count = ds_x2 - ds_x1 + 1;
     pixel_t *dest = ylookup[ds_y] + columnofs[ds_x1];
@@ -989,6 +1002,862 @@ void R_DrawSpan(void)
     #undef XSHIFT
 }
 
+//
+// Drawers for merged light tables
+//
+// A brightmapped column or span is looked up in a colormap row with the
+// brightmap already applied (see R_BrightLightTable()), so that each pixel
+// takes one lookup instead of three. Without a brightmap, it is looked up
+// in colormap[0] alone.
+//
+
+boolean merged_lighttables;
+
+// Only colormap[0] is ever used without a brightmap.
+inline static boolean UseBrightmap(lighttable_t *const *colormap,
+                                   const byte *brightmap)
+{
+    return brightmap != nobrightmap && colormap[0] != colormap[1];
+}
+
+// Returns the table the pixels are looked up in, or NULL if they have to be
+// looked up through the brightmap.
+inline static const lighttable_t *LightTable(lighttable_t *const *colormap,
+                                             const byte *brightmap)
+{
+    if (!UseBrightmap(colormap, brightmap))
+    {
+        return colormap[0];
+    }
+    return merged_lighttables ? R_BrightLightTable(colormap, brightmap) : NULL;
+}
+
+static void DrawColumnMerged(void)
+{
+    const lighttable_t *map = LightTable(dc_colormap, dc_brightmap);
+    if (!map)
+    {
+        DrawColumnScalar();
+        return;
+    }
+
+    int count = dc_yh - dc_yl + 1;
+    if (count <= 0)
+    {
+        return;
+    }
+
+#ifdef RANGECHECK
+    if ((unsigned)dc_x >= video.width || dc_yl < 0 || dc_yh >= video.height)
+    {
+        I_Error("%i to %i at %i", dc_yl, dc_yh, dc_x);
+    }
+#endif
+
+    pixel_t *dest = ylookup[dc_yl] + columnofs[dc_x];
+    const fixed_t fracstep = dc_iscale;
+    fixed_t frac = dc_texturemid + (dc_yl - centery) * fracstep;
+
+    const byte *source = dc_source;
+    int heightmask = dc_texheight - 1;
+
+    if (dc_texheight & heightmask)
+    {
+        heightmask++;
+        heightmask <<= 16;
+        if (frac < 0)
+        {
+            while ((frac += heightmask) < 0)
+                ;
+        }
+        else
+        {
+            while (frac >= heightmask)
+            {
+                frac -= heightmask;
+            }
+        }
+
+        do
+        {
+            *dest = map[source[frac >> 16]];
+            dest += linesize;
+            if ((frac += fracstep) >= heightmask)
+            {
+                frac -= heightmask;
+            }
+            if (frac < 0)
+            {
+                frac += heightmask;
+            }
+        } while (--count);
+    }
+    else
+    {
+        while ((count -= 2) >= 0)
+        {
+            *dest = map[source[(frac >> FRACBITS) & heightmask]];
+            dest += linesize;
+            frac += fracstep;
+            *dest = map[source[(frac >> FRACBITS) & heightmask]];
+            dest += linesize;
+            frac += fracstep;
+        }
+        if (count & 1)
+        {
+            *dest = map[source[(frac >> FRACBITS) & heightmask]];
+        }
+    }
+}
+
+static void DrawTLColumnMerged(void)
+{
+    const lighttable_t *map = LightTable(dc_colormap, dc_brightmap);
+    if (!map)
+    {
+        DrawTLColumnScalar();
+        return;
+    }
+
+    int count = dc_yh - dc_yl + 1;
+    if (count <= 0)
+    {
+        return;
+    }
+
+#ifdef RANGECHECK
+    if ((unsigned)dc_x >= video.width || dc_yl < 0 || dc_yh >= video.height)
+    {
+        I_Error("%i to %i at %i", dc_yl, dc_yh, dc_x);
+    }
+#endif
+
+    pixel_t *dest = ylookup[dc_yl] + columnofs[dc_x];
+    const fixed_t fracstep = dc_iscale;
+    fixed_t frac = dc_texturemid + (dc_yl - centery) * fracstep;
+
+    const byte *source = dc_source;
+    int heightmask = dc_texheight - 1;
+
+    if (dc_texheight & heightmask)
+    {
+        heightmask++;
+        heightmask <<= 16;
+        if (frac < 0)
+        {
+            while ((frac += heightmask) < 0)
+                ;
+        }
+        else
+        {
+            while (frac >= heightmask)
+            {
+                frac -= heightmask;
+            }
+        }
+
+        do
+        {
+            *dest = tranmap[(*dest << 8) + map[source[frac >> 16]]];
+            dest += linesize;
+            if ((frac += fracstep) >= heightmask)
+            {
+                frac -= heightmask;
+            }
+            if (frac < 0)
+            {
+                frac += heightmask;
+            }
+        } while (--count);
+    }
+    else
+    {
+        while ((count -= 2) >= 0)
+        {
+            *dest = tranmap[(*dest << 8)
+                            + map[source[(frac >> FRACBITS) & heightmask]]];
+            dest += linesize;
+            frac += fracstep;
+            *dest = tranmap[(*dest << 8)
+                            + map[source[(frac >> FRACBITS) & heightmask]]];
+            dest += linesize;
+            frac += fracstep;
+        }
+        if (count & 1)
+        {
+            *dest = tranmap[(*dest << 8)
+                            + map[source[(frac >> FRACBITS) & heightmask]]];
+        }
+    }
+}
+
+static void DrawSpanMerged(void)
+{
+    const lighttable_t *map = LightTable(ds_colormap, ds_brightmap);
+    if (!map)
+    {
+        DrawSpanScalar();
+        return;
+    }
+
+    int count = ds_x2 - ds_x1 + 1;
+    pixel_t *dest = ylookup[ds_y] + columnofs[ds_x1];
+    const byte *source = ds_source;
+
+    unsigned int       xf = ds_xfrac << 10, yf = ds_yfrac << 10;
+    const unsigned int xs = ds_xstep << 10, ys = ds_ystep << 10;
+
+    #define XSHIFT (32 - 6)
+    #define YSHIFT (32 - 6 - 6)
+    #define YMASK  (63 * 64) // 0x0FC0
+
+    while (count >= 4)
+    {
+        dest[0] = map[source[((yf >> YSHIFT) & YMASK) | (xf >> XSHIFT)]];
+        xf += xs;
+        yf += ys;
+
+        dest[1] = map[source[((yf >> YSHIFT) & YMASK) | (xf >> XSHIFT)]];
+        xf += xs;
+        yf += ys;
+
+        dest[2] = map[source[((yf >> YSHIFT) & YMASK) | (xf >> XSHIFT)]];
+        xf += xs;
+        yf += ys;
+
+        dest[3] = map[source[((yf >> YSHIFT) & YMASK) | (xf >> XSHIFT)]];
+        xf += xs;
+        yf += ys;
+
+        dest += 4;
+        count -= 4;
+    }
+    while (count--)
+    {
+        *dest++ = map[source[((yf >> YSHIFT) & YMASK) | (xf >> XSHIFT)]];
+        xf += xs;
+        yf += ys;
+    }
+
+    #undef YSHIFT
+    #undef YMASK
+    #undef XSHIFT
+}
+
+// The scalar drawers the SIMD drawers fall back to.
+static void (*DrawColumnFallback)(void) = DrawColumnScalar;
+static void (*DrawTLColumnFallback)(void) = DrawTLColumnScalar;
+
+//
+// SIMD drawers
+//
+// The texel offsets of a batch of pixels are computed in vector registers,
+// with exactly the same 32-bit arithmetic as the scalar drawers above, and
+// the texels and colormaps are then looked up one by one. The output is
+// identical to that of the scalar drawers, and only textures whose height
+// is a power of two take this path.
+//
+
+#define SPAN_SHIFT(xf, yf) \
+    ((((yf) >> (32 - 6 - 6)) & (63 * 64)) | ((xf) >> (32 - 6)))
+
+// The pixels are looked up in map, see LightTable(), or through the
+// brightmap if it is NULL.
+
+inline static void SpanPixels(pixel_t *dest, const uint32_t *index, int count,
+                              const byte *source, lighttable_t *const *colormap,
+                              const byte *brightmap, const lighttable_t *map)
+{
+    if (map)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            dest[i] = map[source[index[i]]];
+        }
+    }
+    else
+    {
+        for (int i = 0; i < count; i++)
+        {
+            const byte src = source[index[i]];
+            dest[i] = colormap[brightmap[src]][src];
+        }
+    }
+}
+
+inline static pixel_t *ColumnPixels(pixel_t *dest, const int32_t *index,
+                                    int count, const byte *source,
+                                    lighttable_t *const *colormap,
+                                    const byte *brightmap,
+                                    const lighttable_t *map)
+{
+    for (int i = 0; i < count; i++)
+    {
+        const byte src = source[index[i]];
+        *dest = map ? map[src] : colormap[brightmap[src]][src];
+        dest += linesize;
+    }
+    return dest;
+}
+
+inline static pixel_t *TLColumnPixels(pixel_t *dest, const int32_t *index,
+                                      int count, const byte *source,
+                                      lighttable_t *const *colormap,
+                                      const byte *brightmap,
+                                      const lighttable_t *map)
+{
+    for (int i = 0; i < count; i++)
+    {
+        const byte src = source[index[i]];
+        const byte color = map ? map[src] : colormap[brightmap[src]][src];
+        *dest = tranmap[(*dest << 8) + color];
+        dest += linesize;
+    }
+    return dest;
+}
+
+inline static void SpanTail(pixel_t *dest, int count, uint32_t xf, uint32_t yf,
+                            uint32_t xs, uint32_t ys, const byte *source,
+                            lighttable_t *const *colormap,
+                            const byte *brightmap, const lighttable_t *map)
+{
+    while (count--)
+    {
+        const byte src = source[SPAN_SHIFT(xf, yf)];
+        *dest++ = map ? map[src] : colormap[brightmap[src]][src];
+        xf += xs;
+        yf += ys;
+    }
+}
+
+inline static pixel_t *ColumnTail(pixel_t *dest, int count, uint32_t frac,
+                                  uint32_t fracstep, int heightmask,
+                                  const byte *source,
+                                  lighttable_t *const *colormap,
+                                  const byte *brightmap,
+                                  const lighttable_t *map, boolean translucent)
+{
+    while (count--)
+    {
+        const byte src = source[((int32_t)frac >> FRACBITS) & heightmask];
+        const byte color = map ? map[src] : colormap[brightmap[src]][src];
+        *dest = translucent ? tranmap[(*dest << 8) + color] : color;
+        dest += linesize;
+        frac += fracstep;
+    }
+    return dest;
+}
+
+// Common setup of the column drawers. Returns false if there is nothing to
+// draw or the texture height isn't a power of two.
+
+inline static boolean SetupColumn(int *count, pixel_t **dest, uint32_t *frac,
+                                  int *heightmask)
+{
+    *count = dc_yh - dc_yl + 1;
+    if (*count <= 0)
+    {
+        return false;
+    }
+
+#ifdef RANGECHECK
+    if ((unsigned)dc_x >= video.width || dc_yl < 0 || dc_yh >= video.height)
+    {
+        I_Error("%i to %i at %i", dc_yl, dc_yh, dc_x);
+    }
+#endif
+
+    *heightmask = dc_texheight - 1;
+    if (dc_texheight & *heightmask)
+    {
+        return false;
+    }
+
+    *dest = ylookup[dc_yl] + columnofs[dc_x];
+    *frac = dc_texturemid + (dc_yl - centery) * dc_iscale;
+    return true;
+}
+
+#if defined(HAVE_SSE41)
+
+__attribute__((target("sse4.1")))
+static void DrawSpanSSE41(void)
+{
+    int count = ds_x2 - ds_x1 + 1;
+    pixel_t *dest = ylookup[ds_y] + columnofs[ds_x1];
+    const byte *source = ds_source;
+    lighttable_t *const *colormap = ds_colormap;
+    const byte *brightmap = ds_brightmap;
+    const lighttable_t *map = LightTable(colormap, brightmap);
+
+    uint32_t xf = ds_xfrac << 10, yf = ds_yfrac << 10;
+    const uint32_t xs = ds_xstep << 10, ys = ds_ystep << 10;
+
+    const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128i lane_xs = _mm_mullo_epi32(lanes, _mm_set1_epi32(xs));
+    const __m128i lane_ys = _mm_mullo_epi32(lanes, _mm_set1_epi32(ys));
+    const __m128i ymask = _mm_set1_epi32(63 * 64);
+    uint32_t index[8];
+
+    while (count >= 8)
+    {
+        for (int i = 0; i < 8; i += 4)
+        {
+            const __m128i x = _mm_add_epi32(_mm_set1_epi32(xf), lane_xs);
+            const __m128i y = _mm_add_epi32(_mm_set1_epi32(yf), lane_ys);
+            const __m128i spot =
+                _mm_or_si128(_mm_and_si128(_mm_srli_epi32(y, 32 - 6 - 6), ymask),
+                             _mm_srli_epi32(x, 32 - 6));
+            _mm_storeu_si128((__m128i *)&index[i], spot);
+            xf += 4 * xs;
+            yf += 4 * ys;
+        }
+        SpanPixels(dest, index, 8, source, colormap, brightmap, map);
+        dest += 8;
+        count -= 8;
+    }
+
+    SpanTail(dest, count, xf, yf, xs, ys, source, colormap, brightmap,
+             map);
+}
+
+__attribute__((target("sse4.1")))
+inline static void ColumnIndexSSE41(int32_t *index, uint32_t frac,
+                                    __m128i lane_steps, __m128i mask)
+{
+    const __m128i f = _mm_add_epi32(_mm_set1_epi32(frac), lane_steps);
+    _mm_storeu_si128((__m128i *)index,
+                     _mm_and_si128(_mm_srai_epi32(f, FRACBITS), mask));
+}
+
+__attribute__((target("sse4.1")))
+static void DrawColumnSSE41(void)
+{
+    int count, heightmask;
+    pixel_t *dest;
+    uint32_t frac;
+
+    if (!SetupColumn(&count, &dest, &frac, &heightmask))
+    {
+        if (count > 0)
+        {
+            DrawColumnFallback();
+        }
+        return;
+    }
+
+    const uint32_t fracstep = dc_iscale;
+    const byte *source = dc_source;
+    lighttable_t *const *colormap = dc_colormap;
+    const byte *brightmap = dc_brightmap;
+    const lighttable_t *map = LightTable(colormap, brightmap);
+
+    const __m128i lane_steps =
+        _mm_mullo_epi32(_mm_setr_epi32(0, 1, 2, 3), _mm_set1_epi32(fracstep));
+    const __m128i mask = _mm_set1_epi32(heightmask);
+    int32_t index[4];
+
+    while (count >= 4)
+    {
+        ColumnIndexSSE41(index, frac, lane_steps, mask);
+        dest = ColumnPixels(dest, index, 4, source, colormap, brightmap,
+                            map);
+        frac += 4 * fracstep;
+        count -= 4;
+    }
+
+    ColumnTail(dest, count, frac, fracstep, heightmask, source, colormap,
+               brightmap, map, false);
+}
+
+__attribute__((target("sse4.1")))
+static void DrawTLColumnSSE41(void)
+{
+    int count, heightmask;
+    pixel_t *dest;
+    uint32_t frac;
+
+    if (!SetupColumn(&count, &dest, &frac, &heightmask))
+    {
+        if (count > 0)
+        {
+            DrawTLColumnFallback();
+        }
+        return;
+    }
+
+    const uint32_t fracstep = dc_iscale;
+    const byte *source = dc_source;
+    lighttable_t *const *colormap = dc_colormap;
+    const byte *brightmap = dc_brightmap;
+    const lighttable_t *map = LightTable(colormap, brightmap);
+
+    const __m128i lane_steps =
+        _mm_mullo_epi32(_mm_setr_epi32(0, 1, 2, 3), _mm_set1_epi32(fracstep));
+    const __m128i mask = _mm_set1_epi32(heightmask);
+    int32_t index[4];
+
+    while (count >= 4)
+    {
+        ColumnIndexSSE41(index, frac, lane_steps, mask);
+        dest = TLColumnPixels(dest, index, 4, source, colormap, brightmap,
+                              map);
+        frac += 4 * fracstep;
+        count -= 4;
+    }
+
+    ColumnTail(dest, count, frac, fracstep, heightmask, source, colormap,
+               brightmap, map, true);
+}
+
+#endif
+
+#if defined(HAVE_AVX2)
+
+__attribute__((target("avx2")))
+static void DrawSpanAVX2(void)
+{
+    int count = ds_x2 - ds_x1 + 1;
+    pixel_t *dest = ylookup[ds_y] + columnofs[ds_x1];
+    const byte *source = ds_source;
+    lighttable_t *const *colormap = ds_colormap;
+    const byte *brightmap = ds_brightmap;
+    const lighttable_t *map = LightTable(colormap, brightmap);
+
+    uint32_t xf = ds_xfrac << 10, yf = ds_yfrac << 10;
+    const uint32_t xs = ds_xstep << 10, ys = ds_ystep << 10;
+
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i lane_xs = _mm256_mullo_epi32(lanes, _mm256_set1_epi32(xs));
+    const __m256i lane_ys = _mm256_mullo_epi32(lanes, _mm256_set1_epi32(ys));
+    const __m256i ymask = _mm256_set1_epi32(63 * 64);
+    uint32_t index[8];
+
+    while (count >= 8)
+    {
+        const __m256i x = _mm256_add_epi32(_mm256_set1_epi32(xf), lane_xs);
+        const __m256i y = _mm256_add_epi32(_mm256_set1_epi32(yf), lane_ys);
+        const __m256i spot = _mm256_or_si256(
+            _mm256_and_si256(_mm256_srli_epi32(y, 32 - 6 - 6), ymask),
+            _mm256_srli_epi32(x, 32 - 6));
+        _mm256_storeu_si256((__m256i *)index, spot);
+
+        SpanPixels(dest, index, 8, source, colormap, brightmap, map);
+        xf += 8 * xs;
+        yf += 8 * ys;
+        dest += 8;
+        count -= 8;
+    }
+
+    SpanTail(dest, count, xf, yf, xs, ys, source, colormap, brightmap,
+             map);
+}
+
+__attribute__((target("avx2")))
+inline static void ColumnIndexAVX2(int32_t *index, uint32_t frac,
+                                   __m256i lane_steps, __m256i mask)
+{
+    const __m256i f = _mm256_add_epi32(_mm256_set1_epi32(frac), lane_steps);
+    _mm256_storeu_si256((__m256i *)index,
+                        _mm256_and_si256(_mm256_srai_epi32(f, FRACBITS), mask));
+}
+
+__attribute__((target("avx2")))
+static void DrawColumnAVX2(void)
+{
+    int count, heightmask;
+    pixel_t *dest;
+    uint32_t frac;
+
+    if (!SetupColumn(&count, &dest, &frac, &heightmask))
+    {
+        if (count > 0)
+        {
+            DrawColumnFallback();
+        }
+        return;
+    }
+
+    const uint32_t fracstep = dc_iscale;
+    const byte *source = dc_source;
+    lighttable_t *const *colormap = dc_colormap;
+    const byte *brightmap = dc_brightmap;
+    const lighttable_t *map = LightTable(colormap, brightmap);
+
+    const __m256i lane_steps = _mm256_mullo_epi32(
+        _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(fracstep));
+    const __m256i mask = _mm256_set1_epi32(heightmask);
+    int32_t index[8];
+
+    while (count >= 8)
+    {
+        ColumnIndexAVX2(index, frac, lane_steps, mask);
+        dest = ColumnPixels(dest, index, 8, source, colormap, brightmap,
+                            map);
+        frac += 8 * fracstep;
+        count -= 8;
+    }
+
+    ColumnTail(dest, count, frac, fracstep, heightmask, source, colormap,
+               brightmap, map, false);
+}
+
+__attribute__((target("avx2")))
+static void DrawTLColumnAVX2(void)
+{
+    int count, heightmask;
+    pixel_t *dest;
+    uint32_t frac;
+
+    if (!SetupColumn(&count, &dest, &frac, &heightmask))
+    {
+        if (count > 0)
+        {
+            DrawTLColumnFallback();
+        }
+        return;
+    }
+
+    const uint32_t fracstep = dc_iscale;
+    const byte *source = dc_source;
+    lighttable_t *const *colormap = dc_colormap;
+    const byte *brightmap = dc_brightmap;
+    const lighttable_t *map = LightTable(colormap, brightmap);
+
+    const __m256i lane_steps = _mm256_mullo_epi32(
+        _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(fracstep));
+    const __m256i mask = _mm256_set1_epi32(heightmask);
+    int32_t index[8];
+
+    while (count >= 8)
+    {
+        ColumnIndexAVX2(index, frac, lane_steps, mask);
+        dest = TLColumnPixels(dest, index, 8, source, colormap, brightmap,
+                              map);
+        frac += 8 * fracstep;
+        count -= 8;
+    }
+
+    ColumnTail(dest, count, frac, fracstep, heightmask, source, colormap,
+               brightmap, map, true);
+}
+
+#endif
+
+#if defined(HAVE_NEON)
+
+static void DrawSpanNEON(void)
+{
+    int count = ds_x2 - ds_x1 + 1;
+    pixel_t *dest = ylookup[ds_y] + columnofs[ds_x1];
+    const byte *source = ds_source;
+    lighttable_t *const *colormap = ds_colormap;
+    const byte *brightmap = ds_brightmap;
+    const lighttable_t *map = LightTable(colormap, brightmap);
+
+    uint32_t xf = ds_xfrac << 10, yf = ds_yfrac << 10;
+    const uint32_t xs = ds_xstep << 10, ys = ds_ystep << 10;
+
+    static const uint32_t lane_init[4] = {0, 1, 2, 3};
+    const uint32x4_t lanes = vld1q_u32(lane_init);
+    const uint32x4_t lane_xs = vmulq_n_u32(lanes, xs);
+    const uint32x4_t lane_ys = vmulq_n_u32(lanes, ys);
+    const uint32x4_t ymask = vdupq_n_u32(63 * 64);
+    uint32_t index[8];
+
+    while (count >= 8)
+    {
+        for (int i = 0; i < 8; i += 4)
+        {
+            const uint32x4_t x = vaddq_u32(vdupq_n_u32(xf), lane_xs);
+            const uint32x4_t y = vaddq_u32(vdupq_n_u32(yf), lane_ys);
+            const uint32x4_t spot =
+                vorrq_u32(vandq_u32(vshrq_n_u32(y, 32 - 6 - 6), ymask),
+                          vshrq_n_u32(x, 32 - 6));
+            vst1q_u32(&index[i], spot);
+            xf += 4 * xs;
+            yf += 4 * ys;
+        }
+        SpanPixels(dest, index, 8, source, colormap, brightmap, map);
+        dest += 8;
+        count -= 8;
+    }
+
+    SpanTail(dest, count, xf, yf, xs, ys, source, colormap, brightmap,
+             map);
+}
+
+inline static void ColumnIndexNEON(int32_t *index, uint32_t frac,
+                                   int32x4_t lane_steps, int32x4_t mask)
+{
+    const int32x4_t f = vaddq_s32(vdupq_n_s32(frac), lane_steps);
+    vst1q_s32(index, vandq_s32(vshrq_n_s32(f, FRACBITS), mask));
+}
+
+static void DrawColumnNEON(void)
+{
+    int count, heightmask;
+    pixel_t *dest;
+    uint32_t frac;
+
+    if (!SetupColumn(&count, &dest, &frac, &heightmask))
+    {
+        if (count > 0)
+        {
+            DrawColumnFallback();
+        }
+        return;
+    }
+
+    const uint32_t fracstep = dc_iscale;
+    const byte *source = dc_source;
+    lighttable_t *const *colormap = dc_colormap;
+    const byte *brightmap = dc_brightmap;
+    const lighttable_t *map = LightTable(colormap, brightmap);
+
+    static const int32_t lane_init[4] = {0, 1, 2, 3};
+    const int32x4_t lane_steps = vmulq_n_s32(vld1q_s32(lane_init), fracstep);
+    const int32x4_t mask = vdupq_n_s32(heightmask);
+    int32_t index[4];
+
+    while (count >= 4)
+    {
+        ColumnIndexNEON(index, frac, lane_steps, mask);
+        dest = ColumnPixels(dest, index, 4, source, colormap, brightmap,
+                            map);
+        frac += 4 * fracstep;
+        count -= 4;
+    }
+
+    ColumnTail(dest, count, frac, fracstep, heightmask, source, colormap,
+               brightmap, map, false);
+}
+
+static void DrawTLColumnNEON(void)
+{
+    int count, heightmask;
+    pixel_t *dest;
+    uint32_t frac;
+
+    if (!SetupColumn(&count, &dest, &frac, &heightmask))
+    {
+        if (count > 0)
+        {
+            DrawTLColumnFallback();
+        }
+        return;
+    }
+
+    const uint32_t fracstep = dc_iscale;
+    const byte *source = dc_source;
+    lighttable_t *const *colormap = dc_colormap;
+    const byte *brightmap = dc_brightmap;
+    const lighttable_t *map = LightTable(colormap, brightmap);
+
+    static const int32_t lane_init[4] = {0, 1, 2, 3};
+    const int32x4_t lane_steps = vmulq_n_s32(vld1q_s32(lane_init), fracstep);
+    const int32x4_t mask = vdupq_n_s32(heightmask);
+    int32_t index[4];
+
+    while (count >= 4)
+    {
+        ColumnIndexNEON(index, frac, lane_steps, mask);
+        dest = TLColumnPixels(dest, index, 4, source, colormap, brightmap,
+                              map);
+        frac += 4 * fracstep;
+        count -= 4;
+    }
+
+    ColumnTail(dest, count, frac, fracstep, heightmask, source, colormap,
+               brightmap, map, true);
+}
+
+#endif
+
+
+void (*R_DrawColumn)(void) = DrawColumnScalar;
+void (*R_DrawTLColumn)(void) = DrawTLColumnScalar;
+void (*R_DrawSpan)(void) = DrawSpanScalar;
+
+void R_InitDrawers(void)
+{
+    const char *name = "single lookup";
+    int features = I_GetCPUFeatures();
+
+    //!
+    // @category video
+    //
+    // Use the plain C column and span drawers instead of the SIMD ones.
+    //
+
+    if (M_CheckParm("-nosimd"))
+    {
+        features = 0;
+    }
+
+    //!
+    // @category video
+    //
+    // Look up every pixel through the brightmap and the colormap, like the
+    // original drawers. The output must be the same, see -framehash.
+    //
+
+    if (M_CheckParm("-plaindrawers"))
+    {
+        R_DrawColumn = DrawColumnScalar;
+        R_DrawTLColumn = DrawTLColumnScalar;
+        R_DrawSpan = DrawSpanScalar;
+
+        I_Printf(VB_DEBUG, "R_InitDrawers: plain drawers, %s light tables",
+                 merged_lighttables ? "merged" : "split");
+        return;
+    }
+
+    R_DrawColumn = DrawColumnMerged;
+    R_DrawTLColumn = DrawTLColumnMerged;
+    R_DrawSpan = DrawSpanMerged;
+
+    DrawColumnFallback = R_DrawColumn;
+    DrawTLColumnFallback = R_DrawTLColumn;
+
+#if defined(HAVE_AVX2)
+    if (features & CPU_AVX2)
+    {
+        R_DrawColumn = DrawColumnAVX2;
+        R_DrawTLColumn = DrawTLColumnAVX2;
+        R_DrawSpan = DrawSpanAVX2;
+        name = "AVX2";
+    }
+    else
+#endif
+#if defined(HAVE_SSE41)
+    if (features & CPU_SSE41)
+    {
+        R_DrawColumn = DrawColumnSSE41;
+        R_DrawTLColumn = DrawTLColumnSSE41;
+        R_DrawSpan = DrawSpanSSE41;
+        name = "SSE4.1";
+    }
+    else
+#endif
+#if defined(HAVE_NEON)
+    if (features & CPU_NEON)
+    {
+        R_DrawColumn = DrawColumnNEON;
+        R_DrawTLColumn = DrawTLColumnNEON;
+        R_DrawSpan = DrawSpanNEON;
+        name = "NEON";
+    }
+    else
+#endif
+    {
+        (void)features;
+    }
+
+    I_Printf(VB_DEBUG, "R_InitDrawers: %s drawers, %s light tables", name,
+             merged_lighttables ? "merged" : "split");
+}
+
 void R_InitBufferRes(void)
 {
     columnofs = Z_Malloc(video.width * sizeof(*columnofs), PU_RENDERER, NULL);
@@ -23,24 +23,26 @@
 #include "doomtype.h"
 #include "m_fixed.h"
 
-extern lighttable_t *dc_colormap[2];
-extern int      dc_x;
-extern int      dc_yl;
-extern int      dc_yh;
-extern fixed_t  dc_iscale;
-extern fixed_t  dc_texturemid;
-extern int      dc_texheight;    // killough
-extern byte     dc_skycolor;
+extern THREAD_LOCAL lighttable_t *dc_colormap[2];
+extern THREAD_LOCAL int      dc_x;
+extern THREAD_LOCAL int      dc_yl;
+extern THREAD_LOCAL int      dc_yh;
+extern THREAD_LOCAL fixed_t  dc_iscale;
+extern THREAD_LOCAL fixed_t  dc_texturemid;
+extern THREAD_LOCAL int      dc_texheight;    // killough
+extern THREAD_LOCAL byte     dc_skycolor;
 
 // first pixel in a column
-extern byte     *dc_source;         
-extern const byte *dc_brightmap;
+extern THREAD_LOCAL byte     *dc_source;         
+extern THREAD_LOCAL const byte *dc_brightmap;
 
 // The span blitting interface.
 // Hook in assembler or system specific BLT here.
 
-void R_DrawColumn(void);
-void R_DrawTLColumn(void);      // drawing translucent textures // phares
+extern boolean merged_lighttables;
+
+extern void (*R_DrawColumn)(void);
+extern void (*R_DrawTLColumn)(void); // drawing translucent textures // phares
 extern void (*R_DrawFuzzColumn)(void);    // The Spectre/Invisibility effect.
 
 // [crispy] draw fuzz effect independent of rendering frame rate
@@ -67,24 +69,28 @@ void R_DrawSkyColumnMasked(void);
 
 void R_DrawTranslatedColumn(void);
 
-extern lighttable_t *ds_colormap[2];
+extern THREAD_LOCAL lighttable_t *ds_colormap[2];
 
-extern int     ds_y;
-extern int     ds_x1;
-extern int     ds_x2;
-extern uint32_t ds_xfrac;
-extern uint32_t ds_yfrac;
-extern uint32_t ds_xstep;
-extern uint32_t ds_ystep;
+extern THREAD_LOCAL int     ds_y;
+extern THREAD_LOCAL int     ds_x1;
+extern THREAD_LOCAL int     ds_x2;
+extern THREAD_LOCAL uint32_t ds_xfrac;
+extern THREAD_LOCAL uint32_t ds_yfrac;
+extern THREAD_LOCAL uint32_t ds_xstep;
+extern THREAD_LOCAL uint32_t ds_ystep;
 
 // start of a 64*64 tile image
-extern byte *ds_source;              
+extern THREAD_LOCAL byte *ds_source;              
 extern byte *translationtables;
-extern byte *dc_translation;
-extern const byte *ds_brightmap;
+extern THREAD_LOCAL byte *dc_translation;
+extern THREAD_LOCAL const byte *ds_brightmap;
 
 // Span blitting for rows, floor/ceiling. No Spectre effect needed.
-void R_DrawSpan(void);
+extern void (*R_DrawSpan)(void);
+
+// Picks the column and span drawers for the CPU, see -nosimd and
+// -plaindrawers.
+void R_InitDrawers(void);
 
 void R_InitBuffer(void);
 
@@ -44,9 +44,12 @@
 #include "r_segs.h"
 #include "r_sky.h"
 #include "r_state.h"
+#include "r_strip.h"
 #include "r_swirl.h"
+#include "r_texcache.h"
 #include "r_things.h"
 #include "r_voxel.h"
+#include "m_bench.h"
 #include "m_config.h"
 #include "st_stuff.h"
 #include "v_flextran.h"
@@ -122,10 +125,10 @@ int* scalelightoffset;
 int* scalelightindex;
 int* zlightoffset;
 int* zlightindex;
-int* planezlightoffset;
-int  planezlightindex;
-int* walllightoffset;
-int  walllightindex;
+THREAD_LOCAL int* planezlightoffset;
+THREAD_LOCAL int  planezlightindex;
+THREAD_LOCAL int* walllightoffset;
+THREAD_LOCAL int  walllightindex;
 
 // killough 3/20/98, 4/4/98: end dynamic colormaps
 
@@ -133,7 +136,7 @@ int extralight;                           // bumped light from gun blasts
 
 int extra_level_brightness;               // level brightness feature
 
-void (*colfunc)(void);                    // current column draw function
+THREAD_LOCAL void (*colfunc)(void);       // current column draw function
 
 //
 // R_PointOnSide
@@ -695,10 +698,12 @@ void R_Init (void)
   R_InitPlanes();
   R_InitLightTables();
   R_InitTranslationTables();
+  R_InitStrips();
   V_InitFlexTranTable();
 
   // [FG] spectre drawing mode
   R_SetFuzzColumnMode();
+  R_InitDrawers();
 
   colfunc = R_DrawColumn;
 }
@@ -883,7 +888,8 @@ void R_SetupFrame (player_t *player)
 // R_ShowStats
 //
 
-int rendered_visplanes, rendered_segs, rendered_vissprites, rendered_voxels;
+THREAD_LOCAL int rendered_visplanes, rendered_segs;
+int rendered_vissprites, rendered_voxels;
 
 static void R_ClearStats(void)
 {
@@ -985,26 +991,42 @@ void R_RenderPlayerView (player_t* player)
   // check for new console commands.
   NetUpdate ();
 
-  // The head node is the last node output.
-  R_RenderBSPNode (numnodes-1);
+  // walls and planes of strips are timed as part of the BSP
+  if (R_UseStrips())
+  {
+    M_BenchStart(BENCH_BSP);
+    R_RenderStrips ();
+    M_BenchStop(BENCH_BSP);
+  }
+  else
+  {
+    // The head node is the last node output.
+    M_BenchStart(BENCH_BSP);
+    R_RenderBSPNode (numnodes-1);
 
-  R_NearbySprites ();
+    R_NearbySprites ();
+    M_BenchStop(BENCH_BSP);
 
-  // [FG] update automap while playing
-  if (automap_on)
-    return;
+    // [FG] update automap while playing
+    if (automap_on)
+      return;
 
-  // Check for new console commands.
-  NetUpdate ();
-    
-  R_DrawPlanes ();
+    // Check for new console commands.
+    NetUpdate ();
+
+    M_BenchStart(BENCH_PLANES);
+    R_DrawPlanes ();
+    M_BenchStop(BENCH_PLANES);
+  }
     
   // Check for new console commands.
   NetUpdate ();
     
   // [crispy] draw fuzz effect independent of rendering frame rate
   R_SetFuzzPosDraw();
+  M_BenchStart(BENCH_MASKED);
   R_DrawMasked ();
+  M_BenchStop(BENCH_MASKED);
 
   // Check for new console commands.
   NetUpdate ();
@@ -1015,6 +1037,7 @@ void R_InitAnyRes(void)
   R_InitSpritesRes();
   R_InitBufferRes();
   R_InitPlanesRes();
+  R_InitStripsRes();
 }
 
 void R_BindRenderVariables(void)
@@ -1045,6 +1068,20 @@ void R_BindRenderVariables(void)
 
   BIND_BOOL(draw_nearby_sprites, true,
     "Draw sprites overlapping into visible sectors");
+
+  BIND_BOOL(threaded_renderer, false,
+    "Render the view in vertical strips on several threads");
+  BIND_NUM(renderer_threads, 0, 0, 32,
+    "Number of strips for the threaded renderer (0 = Number of CPU cores)");
+
+  BIND_BOOL(merged_lighttables, true,
+    "Look up brightmapped pixels in merged light tables");
+
+  BIND_BOOL(texture_cache, true,
+    "Cache composited wall textures on disk");
+
+  BIND_BOOL(voxel_cache, true,
+    "Cache decoded voxel models on disk");
 }
 
 //----------------------------------------------------------------------------
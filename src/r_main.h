@@ -52,7 +52,8 @@ extern int      max_project_slope;
 // Rendering stats
 //
 
-extern int rendered_visplanes, rendered_segs, rendered_vissprites, rendered_voxels;
+extern THREAD_LOCAL int rendered_visplanes, rendered_segs;
+extern int rendered_vissprites, rendered_voxels;
 
 void R_BindRenderVariables(void);
 
@@ -80,10 +81,10 @@ extern int* scalelightoffset;
 extern int* scalelightindex;
 extern int* zlightoffset;
 extern int* zlightindex;
-extern int* planezlightoffset;
-extern int  planezlightindex;
-extern int* walllightoffset;
-extern int  walllightindex;
+extern THREAD_LOCAL int* planezlightoffset;
+extern THREAD_LOCAL int  planezlightindex;
+extern THREAD_LOCAL int* walllightoffset;
+extern THREAD_LOCAL int  walllightindex;
 
 // killough 3/20/98, 4/4/98: end dynamic colormaps
 
@@ -103,7 +104,7 @@ extern int           fixedcolormapindex;
 // Function pointer to switch refresh/drawing functions.
 //
 
-extern void (*colfunc)(void);
+extern THREAD_LOCAL void (*colfunc)(void);
 
 //
 // Utility functions.
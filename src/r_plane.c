@@ -45,6 +45,8 @@
 #include "doomtype.h"
 #include "i_system.h"
 #include "i_video.h"
+#include "m_arena.h"
+#include "m_array.h"
 #include "m_fixed.h"
 #include "r_bmaps.h" // [crispy] R_BrightmapForTexName()
 #include "r_data.h"
@@ -55,6 +57,7 @@
 #include "r_sky.h"
 #include "r_skydefs.h"
 #include "r_state.h"
+#include "r_strip.h"
 #include "r_tranmap.h"
 #include "r_swirl.h" // [crispy] R_DistortedFlat()
 #include "tables.h"
@@ -63,12 +66,17 @@
 #include "w_wad.h"
 #include "z_zone.h"
 
-#define MAXVISPLANES 128    /* must be a power of 2 */
+static THREAD_LOCAL visplane_t *visplanes[MAXVISPLANES];   // killough
+THREAD_LOCAL visplane_t *floorplane, *ceilingplane;
 
-static visplane_t *visplanes[MAXVISPLANES];   // killough
-static visplane_t *freetail;                  // killough
-static visplane_t **freehead = &freetail;     // killough
-visplane_t *floorplane, *ceilingplane;
+// Visplanes and their columns only live until the end of the frame, so they
+// are allocated from an arena that is cleared by R_ClearPlanes(). Every strip
+// has its own.
+
+static THREAD_LOCAL arena_t *plane_arena;
+
+// visplanes sorted by flat for drawing
+static THREAD_LOCAL visplane_t **sorted_planes;
 
 // killough -- hash function for visplanes
 // Empirically verified to be fairly uniform:
@@ -79,37 +87,37 @@ visplane_t *floorplane, *ceilingplane;
 
 // killough 8/1/98: set static number of openings to be large enough
 // (a static limit is okay in this case and avoids difficulties in r_segs.c)
-int maxopenings;
-int *openings, *lastopening; // [FG] 32-bit integer math
+THREAD_LOCAL int maxopenings;
+THREAD_LOCAL int *openings, *lastopening; // [FG] 32-bit integer math
 
 // Clip values are the solid pixel bounding the range.
 //  floorclip starts out SCREENHEIGHT
 //  ceilingclip starts out -1
 
-int *floorclip = NULL, *ceilingclip = NULL; // [FG] 32-bit integer math
+THREAD_LOCAL int *floorclip = NULL, *ceilingclip = NULL; // [FG] 32-bit integer math
 
 // spanstart holds the start of a plane span; initialized to 0 at start
 
-static int *spanstart = NULL;                // killough 2/8/98
+static THREAD_LOCAL int *spanstart = NULL;                // killough 2/8/98
 
 //
 // texture mapping
 //
 
-static fixed_t planeheight;
+static THREAD_LOCAL fixed_t planeheight;
 
 // killough 2/8/98: make variables static
 
-static fixed_t *cachedheight = NULL;
-static fixed_t *cacheddistance = NULL;
-static fixed_t *cachedxstep = NULL;
-static fixed_t *cachedystep = NULL;
-static fixed_t *cachedrotation = NULL;
-static fixed_t xoffs,yoffs;    // killough 2/28/98: flat offsets
-static angle_t rotation;
+static THREAD_LOCAL fixed_t *cachedheight = NULL;
+static THREAD_LOCAL fixed_t *cacheddistance = NULL;
+static THREAD_LOCAL fixed_t *cachedxstep = NULL;
+static THREAD_LOCAL fixed_t *cachedystep = NULL;
+static THREAD_LOCAL fixed_t *cachedrotation = NULL;
+static THREAD_LOCAL fixed_t xoffs,yoffs;    // killough 2/28/98: flat offsets
+static THREAD_LOCAL angle_t rotation;
 
-static fixed_t angle_sin, angle_cos;
-static fixed_t viewx_trans, viewy_trans;
+static THREAD_LOCAL fixed_t angle_sin, angle_cos;
+static THREAD_LOCAL fixed_t viewx_trans, viewy_trans;
 
 fixed_t *yslope = NULL;
 
@@ -155,15 +163,17 @@ void R_InitVisplanesRes(void)
 {
   int i;
 
-  freetail = NULL;
-  freehead = &freetail;
-
   for (i = 0; i < MAXVISPLANES; i++)
   {
     visplanes[i] = 0;
   }
 }
 
+arena_t *R_InitPlaneArena(void)
+{
+  return M_ArenaInitFrame(32 * 1024 * 1024, 1024 * 1024);
+}
+
 //
 // R_MapPlane
 //
@@ -266,8 +276,11 @@ void R_ClearPlanes(void)
     floorclip[i] = viewheight, ceilingclip[i] = -1;
 
   for (i=0;i<MAXVISPLANES;i++)    // new code -- killough
-    for (*freehead = visplanes[i], visplanes[i] = NULL; *freehead; )
-      freehead = &(*freehead)->next;
+    visplanes[i] = NULL;
+
+  if (!plane_arena)
+    plane_arena = R_InitPlaneArena();
+  M_ArenaClear(plane_arena);
 
   lastopening = openings;
 
@@ -279,21 +292,71 @@ void R_ClearPlanes(void)
 
 static visplane_t *new_visplane(unsigned hash)
 {
-  visplane_t *check = freetail;
-  if (!check)
-  {
-    const int size = sizeof(*check) + (video.width * 2) * sizeof(*check->top);
-    check = Z_Calloc(1, size, PU_VALLOC, NULL);
-    check->bottom = &check->top[video.width + 2];
-  }
-  else
-    if (!(freetail = freetail->next))
-      freehead = &freetail;
+  visplane_t *check = arena_alloc(plane_arena, visplane_t);
+  check->lo = 0;
+  check->hi = -1;
+  check->top = check->bottom = NULL;
   check->next = visplanes[hash];
   visplanes[hash] = check;
   return check;
 }
 
+// Makes top and bottom cover columns start-1 to stop+1. Planes mostly grow
+// a seg at a time, so they are given room to grow by half again.
+
+static void GrowPlaneColumns(visplane_t *pl, int start, int stop)
+{
+  unsigned short *top;
+  int lo, hi, count;
+
+  start--, stop++;
+
+  if (start >= pl->lo && stop <= pl->hi)
+    return;
+
+  if (pl->lo > pl->hi)
+  {
+    lo = start;
+    hi = stop;
+  }
+  else
+  {
+    lo = MIN(start, pl->lo);
+    hi = MAX(stop, pl->hi);
+
+    const int slack = (hi - lo + 1) / 2;
+
+    if (lo < pl->lo)
+      lo -= slack;
+    if (hi > pl->hi)
+      hi += slack;
+  }
+
+  lo = MAX(lo, -1);
+  hi = MIN(hi, viewwidth);
+  count = hi - lo + 1;
+
+  // bottom must not be left at USHRT_MAX, see R_MakeSpans()
+  top = arena_alloc_num(plane_arena, unsigned short, count * 2);
+  memset(top, UCHAR_MAX, count * sizeof(*top));
+  memset(top + count, 0, count * sizeof(*top));
+
+  // the columns are indexed directly, even though only lo to hi exist
+  top -= lo;
+
+  if (pl->lo <= pl->hi)
+  {
+    const int size = (pl->hi - pl->lo + 1) * sizeof(*top);
+    memcpy(&top[pl->lo], &pl->top[pl->lo], size);
+    memcpy(&top[pl->lo] + count, &pl->bottom[pl->lo], size);
+  }
+
+  pl->top = top;
+  pl->bottom = top + count;
+  pl->lo = lo;
+  pl->hi = hi;
+}
+
 // cph 2003/04/18 - create duplicate of existing visplane and set initial range
 
 visplane_t *R_DupPlane(const visplane_t *pl, int start, int stop)
@@ -310,7 +373,7 @@ visplane_t *R_DupPlane(const visplane_t *pl, int start, int stop)
     new_pl->minx = start;
     new_pl->maxx = stop;
     new_pl->tint = pl->tint;
-    memset(new_pl->top, UCHAR_MAX, video.width * sizeof(*new_pl->top));
+    GrowPlaneColumns(new_pl, start, stop);
 
     return new_pl;
 }
@@ -369,8 +432,6 @@ visplane_t *R_FindPlane(fixed_t height, int picnum, int lightlevel,
   check->rotation = rotation;
   check->tint = tint;
 
-  memset(check->top, UCHAR_MAX, video.width * sizeof(*check->top));
-
   return check;
 }
 
@@ -395,7 +456,10 @@ visplane_t *R_CheckPlane(visplane_t *pl, int start, int stop)
     ;
 
   if (x > intrh)
+  {
+    GrowPlaneColumns(pl, unionl, unionh);
     pl->minx = unionl, pl->maxx = unionh;
+  }
   else
     pl = R_DupPlane(pl, start, stop);
 
@@ -568,8 +632,10 @@ static void do_draw_plane(visplane_t *pl)
         }
         else
         {
+            R_LockStrips();
             ds_source = V_CacheFlatNum(firstflat + flattranslation[pl->picnum],
                                        PU_STATIC);
+            R_UnlockStrips();
             ds_brightmap = R_BrightmapForFlatNum(flattranslation[pl->picnum]);
         }
     }
@@ -627,7 +693,13 @@ static void do_draw_plane(visplane_t *pl)
                     pl->bottom[x], thiscolormap);
     }
 
-    if (!swirling)
+    // another strip may still be drawing the flat, it is released once
+    // they are all done, see R_RenderStrips()
+    if (!swirling && curstrip)
+    {
+        array_push(curstrip->flats, ds_source);
+    }
+    else if (!swirling)
     {
         Z_ChangeTag(ds_source, PU_CACHE);
     }
@@ -638,18 +710,94 @@ static void do_draw_plane(visplane_t *pl)
 // At the end of each frame.
 //
 
-void R_DrawPlanes (void)
+// Visplanes never overlap, so the order they are drawn in does not matter.
+// They are drawn sorted by flat and colormap, so that every flat is only
+// streamed through the cache once per frame.
+
+static int ComparePlanes(const void *a, const void *b)
+{
+  const visplane_t *pa = *(const visplane_t **)a;
+  const visplane_t *pb = *(const visplane_t **)b;
+
+  if (pa->picnum != pb->picnum)
+    return pa->picnum < pb->picnum ? -1 : 1;
+  if (pa->tint != pb->tint)
+    return pa->tint < pb->tint ? -1 : 1;
+  return pa->lightlevel - pb->lightlevel;
+}
+
+// Skies, swirling and missing flats keep state shared by all strips,
+// so they are left for the main thread.
+
+static boolean SharedPlane(const visplane_t *pl)
+{
+  return pl->picnum == NO_TEXTURE
+         || pl->picnum == skyflatnum
+         || pl->picnum & PL_SKYFLAT
+         || flattranslation[pl->picnum] == -1;
+}
+
+static void DrawSortedPlanes(boolean all, boolean shared)
 {
   visplane_t *pl;
   int i;
+
+  array_clear(sorted_planes);
+
   for (i=0;i<MAXVISPLANES;i++)
     for (pl=visplanes[i]; pl; pl=pl->next)
-    {
-      do_draw_plane(pl);
-      rendered_visplanes++;
-    }
+      if (all || SharedPlane(pl) == shared)
+        array_push(sorted_planes, pl);
+
+  qsort(sorted_planes, array_size(sorted_planes), sizeof(*sorted_planes),
+        ComparePlanes);
+
+  for (i = 0; i < array_size(sorted_planes); i++)
+  {
+    do_draw_plane(sorted_planes[i]);
+    rendered_visplanes++;
+  }
+}
+
+void R_DrawPlanes (void)
+{
+  DrawSortedPlanes(true, false);
 }
 
+void R_DrawStripPlanes(boolean shared)
+{
+  DrawSortedPlanes(false, shared);
+}
+
+// Exchanges the plane state of the calling thread with that of the strip.
+// Calling it a second time restores both.
+
+#define SWAP(type, a, b) do { type t_ = (a); (a) = (b); (b) = t_; } while (0)
+
+void R_SwapStripPlanes(rstrip_t *strip)
+{
+  int i;
+
+  for (i = 0; i < MAXVISPLANES; i++)
+    SWAP(visplane_t *, visplanes[i], strip->visplanes[i]);
+
+  SWAP(arena_t *, plane_arena, strip->plane_arena);
+
+  SWAP(int, maxopenings, strip->maxopenings);
+  SWAP(int *, openings, strip->openings);
+  SWAP(int *, lastopening, strip->lastopening);
+  SWAP(int *, floorclip, strip->floorclip);
+  SWAP(int *, ceilingclip, strip->ceilingclip);
+  SWAP(int *, spanstart, strip->spanstart);
+  SWAP(fixed_t *, cachedheight, strip->cachedheight);
+  SWAP(fixed_t *, cacheddistance, strip->cacheddistance);
+  SWAP(fixed_t *, cachedxstep, strip->cachedxstep);
+  SWAP(fixed_t *, cachedystep, strip->cachedystep);
+  SWAP(fixed_t *, cachedrotation, strip->cachedrotation);
+}
+
+#undef SWAP
+
 //----------------------------------------------------------------------------
 //
 // $Log: r_plane.c,v $
@@ -20,6 +20,7 @@
 #ifndef __R_PLANE__
 #define __R_PLANE__
 
+#include "doomtype.h"
 #include "m_fixed.h"
 #include "r_defs.h"
 #include "tables.h"
@@ -29,16 +30,19 @@ struct visplane_s;
 // killough 10/98: special mask indicates sky flat comes from sidedef
 #define PL_SKYFLAT (0x80000000)
 
+#define MAXVISPLANES 128    /* must be a power of 2 */
+
 // Visplane related.
-extern int maxopenings;
-extern int *openings, *lastopening; // [FG] 32-bit integer math
+extern THREAD_LOCAL int maxopenings;
+extern THREAD_LOCAL int *openings, *lastopening; // [FG] 32-bit integer math
 
-extern int *floorclip, *ceilingclip; // [FG] 32-bit integer math
+extern THREAD_LOCAL int *floorclip, *ceilingclip; // [FG] 32-bit integer math
 extern fixed_t *yslope;
 
 void R_InitPlanes(void);
 void R_ClearPlanes(void);
 void R_DrawPlanes (void);
+void R_DrawStripPlanes(boolean shared);
 
 // killough 2/28/98: add x-y offsets
 struct visplane_s *R_FindPlane(fixed_t height, int picnum, int lightlevel,
@@ -54,6 +58,12 @@ void R_InitPlanesRes(void);
 
 void R_InitVisplanesRes(void);
 
+// Arena for the visplanes of one thread, see R_ClearPlanes().
+struct arena_s *R_InitPlaneArena(void);
+
+struct rstrip_s;
+void R_SwapStripPlanes(struct rstrip_s *strip);
+
 #endif
 
 //----------------------------------------------------------------------------
@@ -35,6 +35,7 @@
 #include "r_main.h"
 #include "r_plane.h"
 #include "r_state.h"
+#include "r_strip.h"
 #include "r_tranmap.h"
 #include "r_things.h"
 #include "tables.h"
@@ -47,44 +48,50 @@
 // killough 1/6/98: replaced globals with statics where appropriate
 
 // True if any of the segs textures might be visible.
-boolean  segtextured;
-boolean  markfloor;      // False if the back side is the same plane.
-boolean  markceiling;
-static boolean  maskedtexture;
-static int      toptexture;
-static int      bottomtexture;
-static int      midtexture;
-
-angle_t         rw_normalangle; // angle to line origin
-int             rw_angle1;
-fixed_t         rw_distance;
+THREAD_LOCAL boolean  segtextured;
+THREAD_LOCAL boolean  markfloor;      // False if the back side is the same plane.
+THREAD_LOCAL boolean  markceiling;
+static THREAD_LOCAL boolean  maskedtexture;
+static THREAD_LOCAL int      toptexture;
+static THREAD_LOCAL int      bottomtexture;
+static THREAD_LOCAL int      midtexture;
+
+THREAD_LOCAL angle_t    rw_normalangle; // angle to line origin
+THREAD_LOCAL int        rw_angle1;
+THREAD_LOCAL fixed_t    rw_distance;
+
+// Visible column range of the whole seg, set by R_AddLine. Walls are
+// stepped from its left end, so that they look the same however
+// R_ClipWallSegment splits them.
+THREAD_LOCAL int        rw_segx1;
+THREAD_LOCAL int        rw_segx2;
 
 //
 // regular wall
 //
-int      rw_x;
-int      rw_stopx;
-static angle_t  rw_centerangle;
-static int32_t  rw_lightlevel;
-static fixed_t  rw_offset;
-static fixed_t  rw_scale;
-static fixed_t  rw_scalestep;
-static fixed_t  rw_midtexturemid;
-static fixed_t  rw_toptexturemid;
-static fixed_t  rw_bottomtexturemid;
-static int      worldtop;
-static int      worldbottom;
-static int      worldhigh;
-static int      worldlow;
-static int64_t  pixhigh; // [FG] 64-bit integer math
-static int64_t  pixlow; // [FG] 64-bit integer math
-static fixed_t  pixhighstep;
-static fixed_t  pixlowstep;
-static int64_t  topfrac; // [FG] 64-bit integer math
-static fixed_t  topstep;
-static int64_t  bottomfrac; // [FG] 64-bit integer math
-static fixed_t  bottomstep;
-static int    *maskedtexturecol; // [FG] 32-bit integer math
+THREAD_LOCAL int        rw_x;
+THREAD_LOCAL int        rw_stopx;
+static THREAD_LOCAL angle_t  rw_centerangle;
+static THREAD_LOCAL int32_t  rw_lightlevel;
+static THREAD_LOCAL fixed_t  rw_offset;
+static THREAD_LOCAL fixed_t  rw_scale;
+static THREAD_LOCAL fixed_t  rw_scalestep;
+static THREAD_LOCAL fixed_t  rw_midtexturemid;
+static THREAD_LOCAL fixed_t  rw_toptexturemid;
+static THREAD_LOCAL fixed_t  rw_bottomtexturemid;
+static THREAD_LOCAL int      worldtop;
+static THREAD_LOCAL int      worldbottom;
+static THREAD_LOCAL int      worldhigh;
+static THREAD_LOCAL int      worldlow;
+static THREAD_LOCAL int64_t  pixhigh; // [FG] 64-bit integer math
+static THREAD_LOCAL int64_t  pixlow; // [FG] 64-bit integer math
+static THREAD_LOCAL fixed_t  pixhighstep;
+static THREAD_LOCAL fixed_t  pixlowstep;
+static THREAD_LOCAL int64_t  topfrac; // [FG] 64-bit integer math
+static THREAD_LOCAL fixed_t  topstep;
+static THREAD_LOCAL int64_t  bottomfrac; // [FG] 64-bit integer math
+static THREAD_LOCAL fixed_t  bottomstep;
+static THREAD_LOCAL int    *maskedtexturecol; // [FG] 32-bit integer math
 
 //
 // UDMF extensions, adapted from DSDA
@@ -315,10 +322,10 @@ void R_RenderMaskedSegRange(drawseg_t *ds, int x1, int x2)
 //   possibly, creating a noticable performance penalty.
 //
 
-static int max_rwscale = 64 * FRACUNIT;
-static int heightbits  = HEIGHTBITS;
-static int heightunit  = HEIGHTUNIT;
-static int invhgtbits  = 4;
+static THREAD_LOCAL int max_rwscale = 64 * FRACUNIT;
+static THREAD_LOCAL int heightbits  = HEIGHTBITS;
+static THREAD_LOCAL int heightunit  = HEIGHTUNIT;
+static THREAD_LOCAL int invhgtbits  = 4;
 
 static const struct
 {
@@ -337,7 +344,7 @@ static const struct
 
 void R_FixWiggle (sector_t *sector)
 {
-    static int lastheight = 0;
+    static THREAD_LOCAL int lastheight = 0;
     int height = (sector->interpceilingheight - sector->interpfloorheight) >> FRACBITS;
 
     // disallow negative heights. using 1 forces cache initialization
@@ -347,29 +354,26 @@ void R_FixWiggle (sector_t *sector)
     // early out?
     if (height != lastheight)
     {
-        lastheight = height;
+        // the adjustment is not cached in the sector, which is shared by
+        // all strip threads
+        int scaleindex = 0;
 
-        // initialize, or handle moving sector
-        if (height != sector->cachedheight)
-        {
-            sector->cachedheight = height;
-            sector->scaleindex = 0;
-            height >>= 7;
+        lastheight = height;
+        height >>= 7;
 
-            // calculate adjustment
-            while (height >>= 1)
-                sector->scaleindex++;
-        }
+        // calculate adjustment
+        while (height >>= 1)
+            scaleindex++;
 
         // fine-tune renderer for this wall
-        max_rwscale = scale_values[sector->scaleindex].clamp;
-        heightbits  = scale_values[sector->scaleindex].heightbits;
+        max_rwscale = scale_values[scaleindex].clamp;
+        heightbits  = scale_values[scaleindex].heightbits;
         heightunit  = (1 << heightbits);
         invhgtbits  = FRACBITS - heightbits;
     }
 }
 
-static boolean didsolidcol; // True if at least one column was marked solid
+static THREAD_LOCAL boolean didsolidcol; // True if at least one column was marked solid
 
 static void R_RenderSegLoop(lighttable_t * thiscolormap)
 {
@@ -571,7 +575,10 @@ void R_StoreWallRange(const int start, const int stop)
   if (!drawsegs || ds_p == drawsegs+maxdrawsegs) // killough 1/98 -- fix 2s line HOM
     {
       unsigned newmax = maxdrawsegs ? maxdrawsegs*2 : 128; // killough
-      drawsegs = Z_Realloc(drawsegs,newmax*sizeof(*drawsegs),PU_STATIC,0);
+      R_LockStrips();
+      drawsegs = Z_Realloc(drawsegs,newmax*sizeof(*drawsegs),
+                           curstrip ? PU_RENDERER : PU_STATIC,0);
+      R_UnlockStrips();
       ds_p = drawsegs+maxdrawsegs;
       maxdrawsegs = newmax;
     }
@@ -609,6 +616,7 @@ void R_StoreWallRange(const int start, const int stop)
   ds_p->x1 = rw_x = start;
   ds_p->x2 = stop;
   ds_p->curline = curline;
+  ds_p->leafrank = leafrank;
   rw_stopx = stop+1;
 
   ptrdiff_t pos = lastopening - openings;
@@ -626,17 +634,25 @@ void R_StoreWallRange(const int start, const int stop)
   // killough 8/1/98: Replaced code with a static limit 
   // guaranteed to be big enough
 
-  // calculate scale at both ends and step
-  ds_p->scale1 = rw_scale =
-    R_ScaleFromGlobalAngle (viewangle + xtoviewangle[start]);
+  // calculate scale at both ends of the seg and step
+  {
+    const fixed_t segscale1 =
+      R_ScaleFromGlobalAngle (viewangle + xtoviewangle[rw_segx1]);
+    fixed_t segscale2 = segscale1;
 
-  if (stop > start)
-    {
-      ds_p->scale2 = R_ScaleFromGlobalAngle (viewangle + xtoviewangle[stop]);
-      ds_p->scalestep = rw_scalestep = (ds_p->scale2-rw_scale) / (stop-start);
-    }
-  else
-    ds_p->scale2 = ds_p->scale1;
+    if (rw_segx2 > rw_segx1)
+      {
+        segscale2 = R_ScaleFromGlobalAngle (viewangle + xtoviewangle[rw_segx2]);
+        rw_scalestep = (segscale2-segscale1) / (rw_segx2-rw_segx1);
+      }
+    else
+      rw_scalestep = 0;
+
+    ds_p->scalestep = rw_scalestep;
+    ds_p->scale1 = rw_scale = segscale1 + (start-rw_segx1)*rw_scalestep;
+    ds_p->scale2 = stop == rw_segx2 ? segscale2 :
+      segscale1 + (stop-rw_segx1)*rw_scalestep;
+  }
 
   // calculate texture boundaries
   //  and decide if floor / ceiling marks are needed
@@ -864,28 +880,34 @@ void R_StoreWallRange(const int start, const int stop)
   worldtop >>= invhgtbits;
   worldbottom >>= invhgtbits;
 
-  topstep = -FixedMul (rw_scalestep, worldtop);
-  topfrac = ((int64_t)centeryfrac>>invhgtbits) - (((int64_t)worldtop*rw_scale)>>FRACBITS); // [FG] 64-bit integer math
+  // texture edges are stepped from the left end of the seg as well
+  {
+    const fixed_t segscale1 = rw_scale - (start-rw_segx1)*rw_scalestep;
+    const int64_t segdx = start - rw_segx1;
 
-  bottomstep = -FixedMul (rw_scalestep,worldbottom);
-  bottomfrac = ((int64_t)centeryfrac>>invhgtbits) - (((int64_t)worldbottom*rw_scale)>>FRACBITS); // [FG] 64-bit integer math
+    topstep = -FixedMul (rw_scalestep, worldtop);
+    topfrac = ((int64_t)centeryfrac>>invhgtbits) - (((int64_t)worldtop*segscale1)>>FRACBITS) + segdx*topstep; // [FG] 64-bit integer math
 
-  if (backsector)
-    {
-      worldhigh >>= invhgtbits;
-      worldlow >>= invhgtbits;
+    bottomstep = -FixedMul (rw_scalestep,worldbottom);
+    bottomfrac = ((int64_t)centeryfrac>>invhgtbits) - (((int64_t)worldbottom*segscale1)>>FRACBITS) + segdx*bottomstep; // [FG] 64-bit integer math
 
-      if (worldhigh < worldtop)
-        {
-          pixhigh = ((int64_t)centeryfrac>>invhgtbits) - (((int64_t)worldhigh*rw_scale)>>FRACBITS); // [FG] 64-bit integer math
-          pixhighstep = -FixedMul (rw_scalestep,worldhigh);
-        }
-      if (worldlow > worldbottom)
-        {
-          pixlow = ((int64_t)centeryfrac>>invhgtbits) - (((int64_t)worldlow*rw_scale)>>FRACBITS); // [FG] 64-bit integer math
-          pixlowstep = -FixedMul (rw_scalestep,worldlow);
-        }
-    }
+    if (backsector)
+      {
+        worldhigh >>= invhgtbits;
+        worldlow >>= invhgtbits;
+
+        if (worldhigh < worldtop)
+          {
+            pixhighstep = -FixedMul (rw_scalestep,worldhigh);
+            pixhigh = ((int64_t)centeryfrac>>invhgtbits) - (((int64_t)worldhigh*segscale1)>>FRACBITS) + segdx*pixhighstep; // [FG] 64-bit integer math
+          }
+        if (worldlow > worldbottom)
+          {
+            pixlowstep = -FixedMul (rw_scalestep,worldlow);
+            pixlow = ((int64_t)centeryfrac>>invhgtbits) - (((int64_t)worldlow*segscale1)>>FRACBITS) + segdx*pixlowstep; // [FG] 64-bit integer math
+          }
+      }
+  }
 
   // render it
   if (markceiling)
@@ -910,6 +932,7 @@ void R_StoreWallRange(const int start, const int stop)
 
   didsolidcol = false;
   R_RenderSegLoop(thiscolormap);
+  ds_p->didsolidcol = didsolidcol;
 
   // cph - if a column was made solid by this wall, we _must_ save full clipping
   // info
@@ -928,13 +951,15 @@ void R_StoreWallRange(const int start, const int stop)
   }
 
   // save sprite clipping info
-  if ((ds_p->silhouette & SIL_TOP || maskedtexture) && !ds_p->sprtopclip)
+  // strips always save it, as the fragments of a seg they render may end up
+  // with a silhouette when they are merged
+  if ((ds_p->silhouette & SIL_TOP || maskedtexture || curstrip) && !ds_p->sprtopclip)
     {
       memcpy (lastopening, ceilingclip+start, sizeof(*lastopening)*(rw_stopx-start)); // [FG] 32-bit integer math
       ds_p->sprtopclip = lastopening - start;
       lastopening += rw_stopx - start;
     }
-  if ((ds_p->silhouette & SIL_BOTTOM || maskedtexture) && !ds_p->sprbottomclip)
+  if ((ds_p->silhouette & SIL_BOTTOM || maskedtexture || curstrip) && !ds_p->sprbottomclip)
     {
       memcpy (lastopening, floorclip+start, sizeof(*lastopening)*(rw_stopx-start)); // [FG] 32-bit integer math
       ds_p->sprbottomclip = lastopening - start;
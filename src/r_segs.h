@@ -27,6 +27,8 @@ struct drawseg_s;
 void R_RenderMaskedSegRange(struct drawseg_s *ds, int x1, int x2);
 void R_StoreWallRange(int start, int stop);
 
+extern THREAD_LOCAL int rw_segx1, rw_segx2;
+
 
 #endif
 
@@ -115,20 +115,20 @@ extern angle_t          clipangle;
 extern angle_t          vx_clipangle;
 extern int              viewangletox[FINEANGLES/2];
 extern angle_t          *xtoviewangle;  // killough 2/8/98
-extern fixed_t          rw_distance;
-extern angle_t          rw_normalangle;
+extern THREAD_LOCAL fixed_t rw_distance;
+extern THREAD_LOCAL angle_t rw_normalangle;
 
 // [FG] linear horizontal sky scrolling
 extern angle_t          *linearskyangle;
 
 // angle to line origin
-extern int              rw_angle1;
+extern THREAD_LOCAL int rw_angle1;
 
 // Segs count?
 extern int              sscount;
 
-extern visplane_t       *floorplane;
-extern visplane_t       *ceilingplane;
+extern THREAD_LOCAL visplane_t *floorplane;
+extern THREAD_LOCAL visplane_t *ceilingplane;
 
 #endif
 
@@ -0,0 +1,537 @@
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 2
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Threaded rendering of the view in vertical strips.
+//
+//      Every strip traverses the whole BSP tree with the columns outside
+//      of it marked solid, so it only stores the walls and visplanes it
+//      covers. The strips draw their walls and flats on the worker pool,
+//      then the main thread stitches their drawsegs back together, adds
+//      sprites in BSP order and draws the planes that use shared state.
+//
+
+#include <string.h>
+
+#include "doomstat.h"
+#include "i_thread.h"
+#include "m_arena.h"
+#include "m_array.h"
+#include "r_bsp.h"
+#include "r_defs.h"
+#include "r_draw.h"
+#include "r_main.h"
+#include "r_plane.h"
+#include "r_state.h"
+#include "r_strip.h"
+#include "r_things.h"
+#include "v_video.h"
+#include "z_zone.h"
+
+#define MAXSTRIPS 32
+
+// Strips start on multiples of this many columns, so that neighbours
+// don't write to the same cache lines.
+#define STRIPALIGN 64
+
+boolean threaded_renderer;
+int renderer_threads;
+
+THREAD_LOCAL rstrip_t *curstrip;
+
+static rstrip_t strips[MAXSTRIPS];
+
+// The strips are reallocated with the resolution, their arenas are not.
+static arena_t *plane_arenas[MAXSTRIPS];
+static int numstrips;
+
+static thread_mutex_t *strip_lock;
+
+void R_LockStrips(void)
+{
+    if (curstrip && strip_lock)
+    {
+        I_LockMutex(strip_lock);
+    }
+}
+
+void R_UnlockStrips(void)
+{
+    if (curstrip && strip_lock)
+    {
+        I_UnlockMutex(strip_lock);
+    }
+}
+
+void R_InitStrips(void)
+{
+    strip_lock = I_CreateMutex();
+}
+
+// Everything allocated by the strips is PU_RENDERER, which has just been
+// freed.
+
+void R_InitStripsRes(void)
+{
+    int i;
+
+    for (i = 0; i < MAXSTRIPS; i++)
+    {
+        array_free(strips[i].flats);
+    }
+
+    memset(strips, 0, sizeof(strips));
+    numstrips = 0;
+}
+
+static int NumStrips(void)
+{
+    const int count = renderer_threads ? renderer_threads : I_GetNumThreads();
+    return CLAMP(count, 1, MAXSTRIPS);
+}
+
+boolean R_UseStrips(void)
+{
+    // the automap needs the single-threaded traversal to mark lines
+    return threaded_renderer && !automap_on && NumStrips() > 1;
+}
+
+static void FreeStrip(rstrip_t *strip)
+{
+    Z_Free(strip->solidcol);
+    Z_Free(strip->openings);
+    Z_Free(strip->floorclip);
+    Z_Free(strip->ceilingclip);
+    Z_Free(strip->spanstart);
+    Z_Free(strip->cachedheight);
+    Z_Free(strip->cacheddistance);
+    Z_Free(strip->cachedxstep);
+    Z_Free(strip->cachedystep);
+    Z_Free(strip->cachedrotation);
+
+    if (strip->drawsegs)
+    {
+        Z_Free(strip->drawsegs);
+    }
+    if (strip->leaves)
+    {
+        Z_Free(strip->leaves);
+    }
+
+    array_free(strip->flats);
+
+    memset(strip, 0, sizeof(*strip));
+}
+
+static void AllocStrip(rstrip_t *strip, int count)
+{
+    const int width = video.width, height = video.height;
+    const int index = strip - strips;
+
+    if (!plane_arenas[index])
+    {
+        plane_arenas[index] = R_InitPlaneArena();
+    }
+    strip->plane_arena = plane_arenas[index];
+
+    strip->solidcol = Z_Calloc(1, width * sizeof(*strip->solidcol),
+                               PU_RENDERER, NULL);
+
+    strip->maxopenings = (width / count + STRIPALIGN + 1) * height;
+    strip->openings = Z_Calloc(1, strip->maxopenings * sizeof(*strip->openings),
+                               PU_RENDERER, NULL);
+
+    strip->floorclip = Z_Calloc(1, width * sizeof(*strip->floorclip),
+                                PU_RENDERER, NULL);
+    strip->ceilingclip = Z_Calloc(1, width * sizeof(*strip->ceilingclip),
+                                  PU_RENDERER, NULL);
+    strip->spanstart = Z_Calloc(1, height * sizeof(*strip->spanstart),
+                                PU_RENDERER, NULL);
+
+    strip->cachedheight = Z_Calloc(1, height * sizeof(*strip->cachedheight),
+                                   PU_RENDERER, NULL);
+    strip->cacheddistance = Z_Calloc(1, height * sizeof(*strip->cacheddistance),
+                                     PU_RENDERER, NULL);
+    strip->cachedxstep = Z_Calloc(1, height * sizeof(*strip->cachedxstep),
+                                  PU_RENDERER, NULL);
+    strip->cachedystep = Z_Calloc(1, height * sizeof(*strip->cachedystep),
+                                  PU_RENDERER, NULL);
+    strip->cachedrotation = Z_Calloc(1, height * sizeof(*strip->cachedrotation),
+                                     PU_RENDERER, NULL);
+}
+
+static void SetupStrips(void)
+{
+    const int count = NumStrips();
+    int i;
+
+    if (count != numstrips)
+    {
+        for (i = 0; i < numstrips; i++)
+        {
+            FreeStrip(&strips[i]);
+        }
+
+        for (i = 0; i < count; i++)
+        {
+            AllocStrip(&strips[i], count);
+        }
+
+        numstrips = count;
+    }
+
+    // the view size can change from frame to frame
+    for (i = 0; i < numstrips; i++)
+    {
+        strips[i].x1 = i ? (viewwidth * i / numstrips) & ~(STRIPALIGN - 1) : 0;
+        strips[i].x2 = (i + 1 < numstrips ?
+                        (viewwidth * (i + 1) / numstrips) & ~(STRIPALIGN - 1) :
+                        viewwidth) - 1;
+    }
+}
+
+// Exchanges the renderer state of the calling thread with the strip.
+
+static void BindStrip(rstrip_t *strip)
+{
+    R_SwapStripBSP(strip);
+    R_SwapStripPlanes(strip);
+}
+
+static boolean EmptyStrip(const rstrip_t *strip)
+{
+    return strip->x1 > strip->x2;
+}
+
+void R_AddStripLeaf(sector_t *sector, int lightlevel)
+{
+    stripleaf_t *leaf;
+
+    if (curstrip->numleaves == curstrip->maxleaves)
+    {
+        curstrip->maxleaves = curstrip->maxleaves ? curstrip->maxleaves * 2 : 128;
+        R_LockStrips();
+        curstrip->leaves =
+            Z_Realloc(curstrip->leaves,
+                      curstrip->maxleaves * sizeof(*curstrip->leaves),
+                      PU_RENDERER, NULL);
+        R_UnlockStrips();
+    }
+
+    leaf = &curstrip->leaves[curstrip->numleaves++];
+    leaf->leafrank = leafrank;
+    leaf->sector = sector;
+    leaf->lightlevel = lightlevel;
+}
+
+static void RenderStrip(void *data, int index)
+{
+    rstrip_t *strip = (rstrip_t *)data + index;
+    void (*oldcolfunc)(void) = colfunc;
+    const int oldsegs = rendered_segs, oldvisplanes = rendered_visplanes;
+
+    if (EmptyStrip(strip))
+    {
+        return;
+    }
+
+    BindStrip(strip);
+    curstrip = strip;
+
+    colfunc = R_DrawColumn;
+    rendered_segs = 0;
+    rendered_visplanes = 0;
+
+    R_ClearClipSegs();
+    memset(solidcol, 1, strip->x1);
+    memset(solidcol + strip->x2 + 1, 1, video.width - strip->x2 - 1);
+
+    R_ClearDrawSegs();
+    R_ClearPlanes();
+    strip->numleaves = 0;
+    leafrank = 0;
+
+    R_RenderBSPNode(numnodes - 1);
+    R_DrawStripPlanes(false);
+
+    strip->rendered_segs = rendered_segs;
+    strip->rendered_visplanes = rendered_visplanes;
+
+    curstrip = NULL;
+    BindStrip(strip);
+
+    colfunc = oldcolfunc;
+    rendered_segs = oldsegs;
+    rendered_visplanes = oldvisplanes;
+}
+
+//
+// Drawseg merging
+//
+
+static int CompareDrawSegs(const drawseg_t *a, const drawseg_t *b)
+{
+    if (a->leafrank != b->leafrank)
+    {
+        return a->leafrank < b->leafrank ? -1 : 1;
+    }
+    if (a->curline != b->curline)
+    {
+        return a->curline < b->curline ? -1 : 1;
+    }
+    return a->x1 < b->x1 ? -1 : a->x1 > b->x1;
+}
+
+static drawseg_t *NewDrawSeg(void)
+{
+    if (ds_p == drawsegs + maxdrawsegs)
+    {
+        unsigned pos = ds_p - drawsegs;
+        unsigned newmax = maxdrawsegs ? maxdrawsegs * 2 : 128;
+        drawsegs = Z_Realloc(drawsegs, newmax * sizeof(*drawsegs), PU_STATIC, 0);
+        ds_p = drawsegs + pos;
+        maxdrawsegs = newmax;
+    }
+
+    return ds_p++;
+}
+
+// Copies the per-piece values of a clipping array into the openings of the
+// main thread. Returns NULL if the pieces don't need one.
+
+static int *JoinClip(drawseg_t **pieces, int count, size_t offset,
+                     boolean needed)
+{
+    int *first = *(int **)((byte *)pieces[0] + offset);
+    boolean same = true;
+    int *join;
+    int i;
+
+    if (!needed)
+    {
+        return NULL;
+    }
+
+    for (i = 1; i < count; i++)
+    {
+        if (*(int **)((byte *)pieces[i] + offset) != first)
+        {
+            same = false;
+            break;
+        }
+    }
+
+    // screenheightarray and negonearray are shared
+    if (same)
+    {
+        return first;
+    }
+
+    join = lastopening - pieces[0]->x1;
+
+    for (i = 0; i < count; i++)
+    {
+        const drawseg_t *ds = pieces[i];
+        const int *src = *(int **)((byte *)ds + offset);
+        const int len = ds->x2 - ds->x1 + 1;
+
+        memcpy(lastopening, src + ds->x1, len * sizeof(*lastopening));
+        lastopening += len;
+    }
+
+    return join;
+}
+
+// Pieces of one seg split by strip boundaries become a single drawseg, the
+// same one that a single-threaded frame would have stored.
+
+static void JoinDrawSegs(drawseg_t **pieces, int count)
+{
+    drawseg_t *ds = NewDrawSeg();
+    const drawseg_t *last = pieces[count - 1];
+    int i;
+
+    *ds = *pieces[0];
+    ds->x2 = last->x2;
+    ds->scale2 = last->scale2;
+
+    for (i = 0; i < count; i++)
+    {
+        if (pieces[i]->didsolidcol)
+        {
+            ds->didsolidcol = true;
+            ds->silhouette = pieces[i]->silhouette;
+            ds->bsilheight = pieces[i]->bsilheight;
+            ds->tsilheight = pieces[i]->tsilheight;
+            break;
+        }
+    }
+
+    ds->maskedtexturecol =
+        JoinClip(pieces, count, offsetof(drawseg_t, maskedtexturecol),
+                 ds->maskedtexturecol != NULL);
+    ds->sprtopclip =
+        JoinClip(pieces, count, offsetof(drawseg_t, sprtopclip),
+                 ds->silhouette & SIL_TOP || ds->maskedtexturecol);
+    ds->sprbottomclip =
+        JoinClip(pieces, count, offsetof(drawseg_t, sprbottomclip),
+                 ds->silhouette & SIL_BOTTOM || ds->maskedtexturecol);
+}
+
+static void MergeDrawSegs(void)
+{
+    drawseg_t *next[MAXSTRIPS];
+    drawseg_t *pieces[MAXSTRIPS];
+    int count = 0;
+    int i;
+
+    for (i = 0; i < numstrips; i++)
+    {
+        next[i] = EmptyStrip(&strips[i]) ? strips[i].ds_p : strips[i].drawsegs;
+    }
+
+    ds_p = drawsegs;
+    lastopening = openings;
+
+    while (true)
+    {
+        drawseg_t *ds = NULL;
+        int best = -1;
+
+        for (i = 0; i < numstrips; i++)
+        {
+            if (next[i] != strips[i].ds_p
+                && (!ds || CompareDrawSegs(next[i], ds) < 0))
+            {
+                ds = next[i];
+                best = i;
+            }
+        }
+
+        if (count && (!ds || ds->curline != pieces[0]->curline
+                      || ds->x1 != pieces[count - 1]->x2 + 1))
+        {
+            JoinDrawSegs(pieces, count);
+            count = 0;
+        }
+
+        if (!ds)
+        {
+            break;
+        }
+
+        pieces[count++] = ds;
+        next[best]++;
+    }
+}
+
+// Sprites are added in the order the BSP tree was traversed in, which is
+// the one they are sorted by when their scales are equal.
+
+static void MergeLeaves(void)
+{
+    int next[MAXSTRIPS] = {0};
+    int lastrank = -1;
+
+    while (true)
+    {
+        stripleaf_t *leaf = NULL;
+        int best = -1;
+        int i;
+
+        for (i = 0; i < numstrips; i++)
+        {
+            rstrip_t *strip = &strips[i];
+
+            if (!EmptyStrip(strip) && next[i] < strip->numleaves
+                && (!leaf || strip->leaves[next[i]].leafrank < leaf->leafrank))
+            {
+                leaf = &strip->leaves[next[i]];
+                best = i;
+            }
+        }
+
+        if (!leaf)
+        {
+            break;
+        }
+
+        next[best]++;
+
+        // several strips may have visited the same subsector
+        if (leaf->leafrank != lastrank)
+        {
+            R_AddSprites(leaf->sector, leaf->lightlevel);
+            lastrank = leaf->leafrank;
+        }
+    }
+}
+
+// The strips keep the flats they drew cached until none of them draws any
+// more, then the main thread releases them.
+
+static void ReleaseFlats(void)
+{
+    int i, j;
+
+    for (i = 0; i < numstrips; i++)
+    {
+        rstrip_t *strip = &strips[i];
+
+        for (j = 0; j < array_size(strip->flats); j++)
+        {
+            Z_ChangeTag(strip->flats[j], PU_CACHE);
+        }
+
+        array_clear(strip->flats);
+    }
+}
+
+//
+// R_RenderStrips
+// Renders the view in strips on the worker pool. Takes the place of
+// R_RenderBSPNode(), R_NearbySprites() and R_DrawPlanes().
+//
+
+void R_RenderStrips(void)
+{
+    int i;
+
+    SetupStrips();
+
+    R_InitLeafCounts();
+    R_InterpolateSectors();
+
+    I_RunTasks(RenderStrip, strips, numstrips);
+
+    ReleaseFlats();
+
+    MergeDrawSegs();
+    MergeLeaves();
+    R_NearbySprites();
+
+    for (i = 0; i < numstrips; i++)
+    {
+        rstrip_t *strip = &strips[i];
+
+        if (EmptyStrip(strip))
+        {
+            continue;
+        }
+
+        rendered_segs += strip->rendered_segs;
+        rendered_visplanes += strip->rendered_visplanes;
+
+        BindStrip(strip);
+        R_DrawStripPlanes(true);
+        BindStrip(strip);
+    }
+}
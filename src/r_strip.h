@@ -0,0 +1,86 @@
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 2
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Threaded rendering of the view in vertical strips.
+//
+
+#ifndef __R_STRIP__
+#define __R_STRIP__
+
+#include "doomtype.h"
+#include "m_fixed.h"
+#include "r_defs.h"
+#include "r_plane.h"
+
+// A subsector visited by a strip. Sprites are added on the main thread
+// afterwards, in BSP order.
+
+typedef struct
+{
+    int leafrank;
+    sector_t *sector;
+    int lightlevel;
+} stripleaf_t;
+
+// Everything a strip needs to run BSP traversal, walls and planes on its
+// own. Swapped with the thread-local renderer state while the strip runs.
+
+typedef struct rstrip_s
+{
+    int x1, x2; // inclusive column range
+
+    // r_bsp.c
+    drawseg_t *drawsegs;
+    unsigned maxdrawsegs;
+    drawseg_t *ds_p;
+    byte *solidcol;
+    stripleaf_t *leaves;
+    int numleaves, maxleaves;
+
+    // r_plane.c
+    visplane_t *visplanes[MAXVISPLANES];
+    struct arena_s *plane_arena;
+    int maxopenings;
+    int *openings, *lastopening;
+    int *floorclip, *ceilingclip;
+    int *spanstart;
+    fixed_t *cachedheight;
+    fixed_t *cacheddistance;
+    fixed_t *cachedxstep;
+    fixed_t *cachedystep;
+    fixed_t *cachedrotation;
+    byte **flats; // PU_STATIC until all strips are done
+
+    int rendered_segs, rendered_visplanes;
+} rstrip_t;
+
+// The strip being rendered by the calling thread, NULL on the main thread
+// outside of R_RenderStrips().
+extern THREAD_LOCAL rstrip_t *curstrip;
+
+extern boolean threaded_renderer;
+extern int renderer_threads;
+
+void R_InitStrips(void);
+void R_InitStripsRes(void);
+
+boolean R_UseStrips(void);
+void R_RenderStrips(void);
+
+// Records a subsector visited by the current strip.
+void R_AddStripLeaf(sector_t *sector, int lightlevel);
+
+// Serializes zone memory and WAD cache access from strip threads.
+void R_LockStrips(void);
+void R_UnlockStrips(void);
+
+#endif
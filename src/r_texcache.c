@@ -0,0 +1,466 @@
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 2
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Persistent cache of composited wall textures.
+//
+//      The cache files live in <prefdir>/textures and are named after the
+//      MD5 checksum of the texture definitions, the names and sizes of the
+//      patch lumps they use and the sizes and modification times of the
+//      files the lumps are read from. A file holds the column lookups of
+//      every texture and the composites of those built so far. It is
+//      rewritten whenever new composites have been built, when a level is
+//      precached and at exit, and the composites are mapped from it, so
+//      that their pages are only read when a texture is first drawn.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "d_iwad.h"
+#include "doomtype.h"
+#include "i_exit.h"
+#include "i_printf.h"
+#include "i_system.h"
+#include "m_array.h"
+#include "m_io.h"
+#include "m_misc.h"
+#include "md5.h"
+#include "r_data.h"
+#include "r_texcache.h"
+#include "w_wad.h"
+#include "z_zone.h"
+
+// Bump whenever the composites or the file layout change.
+#define TEXCACHE_VERSION 2
+
+// The oldest cache files are removed beyond this size.
+#define TEXCACHE_SIZE (256 * 1024 * 1024)
+
+static const char texcache_magic[8] = "WOOFTEX";
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t numtextures;
+    byte digest[16];
+} texcacheheader_t;
+
+// Followed by colofs[width], colofs2[width], collump[width] and, if the
+// texture is composited, the composite and the opaque composite, padded to
+// four bytes.
+
+typedef struct
+{
+    uint64_t offset;
+    int32_t width, height;
+    int32_t compositesize;
+    int32_t composited;
+} texcacheentry_t;
+
+boolean texture_cache;
+
+static byte texcache_digest[16];
+static char *texcache_file;
+
+static byte *texcache_data;
+static size_t texcache_length;
+static const texcacheentry_t *texcache_entries;
+
+static size_t LookupSize(int width)
+{
+    return width * (2 * sizeof(unsigned) + sizeof(short));
+}
+
+static size_t EntrySize(int width, int height, int compositesize,
+                        boolean composited)
+{
+    size_t size = LookupSize(width);
+
+    if (composited)
+    {
+        size += compositesize + width * height;
+    }
+
+    return (size + 3) & ~3;
+}
+
+static void CalculateTexturesChecksum(void)
+{
+    const uint32_t version = TEXCACHE_VERSION;
+    struct MD5Context md5;
+
+    MD5Init(&md5);
+    MD5Update(&md5, (const byte *)&version, sizeof(version));
+
+    for (int i = 0; i < numtextures; i++)
+    {
+        const texture_t *texture = textures[i];
+        const int32_t size[3] = {texture->width, texture->height,
+                                 texture->patchcount};
+
+        MD5Update(&md5, (const byte *)texture->name, sizeof(texture->name));
+        MD5Update(&md5, (const byte *)size, sizeof(size));
+
+        for (int j = 0; j < texture->patchcount; j++)
+        {
+            const texpatch_t *patch = &texture->patches[j];
+            const int32_t origin[3] = {patch->originx, patch->originy,
+                                       patch->patch};
+
+            MD5Update(&md5, (const byte *)origin, sizeof(origin));
+
+            if (patch->patch >= 0)
+            {
+                const int32_t length = lumpinfo[patch->patch].size;
+
+                MD5Update(&md5, (const byte *)lumpinfo[patch->patch].name,
+                          sizeof(lumpinfo[patch->patch].name));
+                MD5Update(&md5, (const byte *)&length, sizeof(length));
+            }
+        }
+    }
+
+    // the patches themselves are not read, the files they come from are
+    // identified by their size and modification time instead
+    for (int i = 0; i < array_size(resourcefiles); i++)
+    {
+        struct stat st;
+        int64_t identity[2] = {0};
+
+        if (M_stat(resourcefiles[i], &st) == 0)
+        {
+            identity[0] = st.st_size;
+            identity[1] = st.st_mtime;
+        }
+
+        MD5Update(&md5, (const byte *)resourcefiles[i],
+                  strlen(resourcefiles[i]) + 1);
+        MD5Update(&md5, (const byte *)identity, sizeof(identity));
+    }
+
+    MD5Final(texcache_digest, &md5);
+}
+
+static void CreateCacheFileName(void)
+{
+    char digest_string[33];
+    char *dir;
+
+    M_DigestToString(texcache_digest, digest_string, sizeof(texcache_digest));
+
+    dir = M_StringJoin(D_DoomPrefDir(), DIR_SEPARATOR_S, "textures");
+    M_MakeDirectory(dir);
+    M_TrimCacheDir(dir, "*.dat", TEXCACHE_SIZE);
+
+    texcache_file = M_StringJoin(dir, DIR_SEPARATOR_S, digest_string, ".dat");
+    free(dir);
+}
+
+// Maps the cache file and checks it against the loaded textures.
+
+static boolean MapCacheFile(void)
+{
+    const texcacheheader_t *header;
+    const texcacheentry_t *entries;
+    size_t length;
+    byte *data;
+
+    data = M_MapFile(texcache_file, &length);
+
+    if (!data)
+    {
+        return false;
+    }
+
+    header = (const texcacheheader_t *)data;
+    entries = (const texcacheentry_t *)(header + 1);
+
+    if (length < sizeof(*header) + numtextures * sizeof(*entries)
+        || memcmp(header->magic, texcache_magic, sizeof(header->magic))
+        || header->version != TEXCACHE_VERSION
+        || header->numtextures != numtextures
+        || memcmp(header->digest, texcache_digest, sizeof(header->digest)))
+    {
+        M_UnmapFile(data, length);
+        return false;
+    }
+
+    for (int i = 0; i < numtextures; i++)
+    {
+        const texcacheentry_t *entry = &entries[i];
+
+        if (entry->width != textures[i]->width
+            || entry->height != textures[i]->height
+            || entry->compositesize < 0 || entry->offset > length
+            || length - entry->offset < EntrySize(entry->width, entry->height,
+                                                   entry->compositesize,
+                                                   entry->composited))
+        {
+            M_UnmapFile(data, length);
+            return false;
+        }
+    }
+
+    texcache_data = data;
+    texcache_length = length;
+    texcache_entries = entries;
+
+    return true;
+}
+
+static boolean IsMapped(const byte *composite)
+{
+    return texcache_data && composite >= texcache_data
+           && composite < texcache_data + texcache_length;
+}
+
+// The composites mapped from the file are generated again when drawn,
+// unless they are mapped from another one.
+
+static void UnmapCacheFile(void)
+{
+    for (int i = 0; i < numtextures; i++)
+    {
+        if (IsMapped(texturecomposite[i]))
+        {
+            texturecomposite[i] = NULL;
+            texturecomposite2[i] = NULL;
+        }
+    }
+
+    M_UnmapFile(texcache_data, texcache_length);
+    texcache_data = NULL;
+    texcache_length = 0;
+    texcache_entries = NULL;
+}
+
+void R_MapCachedComposites(void)
+{
+    if (!texcache_data)
+    {
+        return;
+    }
+
+    for (int i = 0; i < numtextures; i++)
+    {
+        const texcacheentry_t *entry = &texcache_entries[i];
+
+        if (entry->composited && !texturecomposite[i] && !texturecomposite2[i])
+        {
+            byte *data = texcache_data + entry->offset
+                         + LookupSize(entry->width);
+
+            texturecomposite[i] = data;
+            texturecomposite2[i] = data + entry->compositesize;
+        }
+    }
+}
+
+boolean R_LoadTextureCache(void)
+{
+    if (!texture_cache)
+    {
+        return false;
+    }
+
+    CalculateTexturesChecksum();
+    CreateCacheFileName();
+
+    I_AtExit(R_SaveTextureCache, false);
+
+    if (!MapCacheFile())
+    {
+        return false;
+    }
+
+    // the lookups are small, and copying them keeps them valid when the
+    // file is replaced
+    for (int i = 0; i < numtextures; i++)
+    {
+        const texcacheentry_t *entry = &texcache_entries[i];
+        const byte *data = texcache_data + entry->offset;
+        const int width = entry->width;
+
+        texturecolumnofs[i] = Z_Malloc(width * sizeof(unsigned), PU_STATIC, 0);
+        memcpy(texturecolumnofs[i], data, width * sizeof(unsigned));
+        data += width * sizeof(unsigned);
+        texturecolumnofs2[i] = Z_Malloc(width * sizeof(unsigned), PU_STATIC, 0);
+        memcpy(texturecolumnofs2[i], data, width * sizeof(unsigned));
+        data += width * sizeof(unsigned);
+        texturecolumnlump[i] = Z_Malloc(width * sizeof(short), PU_STATIC, 0);
+        memcpy(texturecolumnlump[i], data, width * sizeof(short));
+
+        texturecompositesize[i] = entry->compositesize;
+    }
+
+    R_MapCachedComposites();
+
+    I_Printf(VB_DEBUG, "R_LoadTextureCache: %s", texcache_file);
+
+    return true;
+}
+
+static boolean IsComposited(int texnum)
+{
+    return texturecomposite[texnum] && texturecomposite2[texnum];
+}
+
+static boolean WriteCacheFile(const char *filename)
+{
+    texcacheheader_t header = {0};
+    texcacheentry_t *entries;
+    uint64_t offset;
+    boolean ok = true;
+    FILE *file;
+
+    file = M_fopen(filename, "wb");
+
+    if (!file)
+    {
+        return false;
+    }
+
+    memcpy(header.magic, texcache_magic, sizeof(header.magic));
+    header.version = TEXCACHE_VERSION;
+    header.numtextures = numtextures;
+    memcpy(header.digest, texcache_digest, sizeof(header.digest));
+
+    entries = Z_Calloc(numtextures, sizeof(*entries), PU_STATIC, 0);
+    offset = sizeof(header) + numtextures * sizeof(*entries);
+
+    for (int i = 0; i < numtextures; i++)
+    {
+        const texture_t *texture = textures[i];
+
+        entries[i].offset = offset;
+        entries[i].width = texture->width;
+        entries[i].height = texture->height;
+        entries[i].compositesize = texturecompositesize[i];
+        entries[i].composited = IsComposited(i);
+        offset += EntrySize(texture->width, texture->height,
+                            texturecompositesize[i], entries[i].composited);
+    }
+
+    ok &= fwrite(&header, sizeof(header), 1, file) == 1;
+    ok &= fwrite(entries, sizeof(*entries), numtextures, file) == numtextures;
+
+    for (int i = 0; i < numtextures && ok; i++)
+    {
+        const texture_t *texture = textures[i];
+        const int width = texture->width;
+        const int size = width * texture->height;
+        const byte pad[4] = {0};
+        size_t padding;
+
+        ok &= fwrite(texturecolumnofs[i], sizeof(unsigned), width, file)
+              == width;
+        ok &= fwrite(texturecolumnofs2[i], sizeof(unsigned), width, file)
+              == width;
+        ok &= fwrite(texturecolumnlump[i], sizeof(short), width, file) == width;
+
+        if (entries[i].composited)
+        {
+            ok &= fwrite(texturecomposite[i], 1, texturecompositesize[i], file)
+                  == texturecompositesize[i];
+            ok &= fwrite(texturecomposite2[i], 1, size, file) == size;
+        }
+
+        padding = EntrySize(width, texture->height, texturecompositesize[i],
+                            entries[i].composited)
+                  - LookupSize(width);
+        if (entries[i].composited)
+        {
+            padding -= texturecompositesize[i] + size;
+        }
+        if (padding)
+        {
+            ok &= fwrite(pad, 1, padding, file) == padding;
+        }
+    }
+
+    Z_Free(entries);
+
+    ok &= fclose(file) == 0;
+
+    return ok;
+}
+
+void R_SaveTextureCache(void)
+{
+    boolean ok = false;
+    char *tempfile;
+    int missing = 0;
+
+    if (!texture_cache || !texcache_file)
+    {
+        return;
+    }
+
+    for (int i = 0; i < numtextures; i++)
+    {
+        if (IsComposited(i)
+            && !(texcache_entries && texcache_entries[i].composited))
+        {
+            missing++;
+        }
+    }
+
+    // a file without composites still spares generating the lookups
+    if (texcache_data && !missing)
+    {
+        return;
+    }
+
+    // write to a temporary file first, so that other instances never map
+    // a partially written cache
+    tempfile = M_StringJoin(texcache_file, ".tmp");
+
+    if (WriteCacheFile(tempfile))
+    {
+        // the old file can't be replaced while it is mapped on Windows
+        if (texcache_data)
+        {
+            UnmapCacheFile();
+        }
+        M_remove(texcache_file);
+        ok = !M_rename(tempfile, texcache_file);
+    }
+
+    if (ok)
+    {
+        I_Printf(VB_DEBUG, "R_SaveTextureCache: %d new composites", missing);
+    }
+    else
+    {
+        I_Printf(VB_WARNING, "R_SaveTextureCache: Could not write %s",
+                 texcache_file);
+        M_remove(tempfile);
+    }
+
+    free(tempfile);
+
+    // if the file could not be replaced, the one another instance left
+    // there may still be mapped
+    if (!texcache_data && MapCacheFile())
+    {
+        R_MapCachedComposites();
+    }
+
+    // don't try again for every level
+    if (!ok)
+    {
+        free(texcache_file);
+        texcache_file = NULL;
+    }
+}
@@ -0,0 +1,36 @@
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 2
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Persistent cache of composited wall textures.
+//
+
+#ifndef __R_TEXCACHE__
+#define __R_TEXCACHE__
+
+#include "doomtype.h"
+
+extern boolean texture_cache;
+
+// Reads the column lookups of all textures from the cache file of the
+// loaded texture definitions and patches, and maps the composites it has.
+// Returns false if there is no valid one.
+boolean R_LoadTextureCache(void);
+
+// Writes the column lookups and the composites built so far to a new cache
+// file, if the current one lacks any of them, and maps the composites from
+// it. Called when a level is precached and at exit.
+void R_SaveTextureCache(void);
+
+// Maps the composites that have not been built from the cache file.
+void R_MapCachedComposites(void);
+
+#endif
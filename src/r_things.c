@@ -81,17 +81,32 @@ typedef struct drawseg_xrange_item_s
   drawseg_t *user;
 } drawseg_xrange_item_t;
 
-typedef struct drawsegs_xrange_s
+// The drawsegs that can clip sprites are indexed by screen columns in
+// buckets of levels of power of two widths. Level 0 is a single bucket for
+// the whole view, every further level halves the bucket width down to
+// DS_MIN_BUCKET_SHIFT. A sprite only checks the drawsegs of the smallest
+// bucket that contains it, which are in the same order as in drawsegs.
+
+#define DS_MIN_BUCKET_SHIFT 5
+#define DS_MAX_LEVELS       12
+
+typedef struct
 {
-  drawseg_xrange_item_t *items;
-  int count;
-} drawsegs_xrange_t;
+  int shift;  // bucket width is 1 << shift
+  int first;  // first bucket of the level in drawsegs_buckets
+} drawsegs_level_t;
+
+static drawsegs_level_t drawsegs_levels[DS_MAX_LEVELS];
+static int drawsegs_numlevels;
 
-#define DS_RANGES_COUNT 3
-static drawsegs_xrange_t drawsegs_xranges[DS_RANGES_COUNT];
+// start and end of each bucket in drawsegs_items
+static int *drawsegs_buckets;
+static int drawsegs_buckets_size;
+
+static drawseg_xrange_item_t *drawsegs_items;
+static int drawsegs_items_size;
 
 static drawseg_xrange_item_t *drawsegs_xrange;
-static unsigned int drawsegs_xrange_size = 0;
 static int drawsegs_xrange_count = 0;
 
 // [FG] 32-bit integer math
@@ -1071,6 +1086,75 @@ static void msort(vissprite_t **s, vissprite_t **t, int n)
     }
 }
 
+// Stable LSD radix sort by descending scale, for the counts of vissprites
+// where the merge sort falls behind. Produces the same order as msort().
+
+#define RADIX_MIN_SPRITES 256
+
+typedef struct
+{
+  uint32_t key;
+  vissprite_t *spr;
+} sortitem_t;
+
+static sortitem_t *sortitems;
+static int num_sortitems;
+
+static void radix_sort(vissprite_t **s, int n)
+{
+  sortitem_t *src, *dst;
+  int i, shift;
+
+  if (num_sortitems < n * 2)
+  {
+    num_sortitems = n * 2;
+    sortitems = Z_Realloc(sortitems, num_sortitems * sizeof(*sortitems),
+                          PU_STATIC, 0);
+  }
+
+  src = sortitems;
+  dst = sortitems + n;
+
+  // scales are positive, so descending scale is ascending complement
+  for (i = 0; i < n; i++)
+  {
+    src[i].key = ~(uint32_t)s[i]->scale;
+    src[i].spr = s[i];
+  }
+
+  for (shift = 0; shift < 32; shift += 8)
+  {
+    int count[256] = {0};
+    int sum = 0;
+
+    for (i = 0; i < n; i++)
+      count[(src[i].key >> shift) & 0xff]++;
+
+    // skip the digits all keys have in common, usually the high ones
+    if (count[(src[0].key >> shift) & 0xff] == n)
+      continue;
+
+    for (i = 0; i < 256; i++)
+    {
+      const int c = count[i];
+      count[i] = sum;
+      sum += c;
+    }
+
+    for (i = 0; i < n; i++)
+      dst[count[(src[i].key >> shift) & 0xff]++] = src[i];
+
+    {
+      sortitem_t *temp = src;
+      src = dst;
+      dst = temp;
+    }
+  }
+
+  for (i = 0; i < n; i++)
+    s[i] = src[i].spr;
+}
+
 void R_SortVisSprites (void)
 {
   if (num_vissprite)
@@ -1098,7 +1182,10 @@ void R_SortVisSprites (void)
       // killough 9/22/98: replace qsort with merge sort, since the keys
       // are roughly in order to begin with, due to BSP rendering.
 
-      msort(vissprite_ptrs, vissprite_ptrs + num_vissprite, num_vissprite);
+      if (num_vissprite < RADIX_MIN_SPRITES)
+        msort(vissprite_ptrs, vissprite_ptrs + num_vissprite, num_vissprite);
+      else
+        radix_sort(vissprite_ptrs, num_vissprite);
     }
 }
 
@@ -1128,7 +1215,7 @@ void R_DrawSprite (vissprite_t* spr)
   //    for (ds=ds_p-1 ; ds >= drawsegs ; ds--)    old buggy code
 
   // [Woof!] Andrey Budko: optimization
-  if (drawsegs_xrange_size)
+  if (drawsegs_xrange_count)
   {
     const drawseg_xrange_item_t *last = &drawsegs_xrange[drawsegs_xrange_count - 1];
     drawseg_xrange_item_t *curr = &drawsegs_xrange[-1];
@@ -1249,62 +1336,128 @@ void R_DrawSprite (vissprite_t* spr)
 }
 
 //
-// R_DrawMasked
+// R_BuildDrawsegBuckets
+//
+// [Woof!] Andrey Budko: reducing of cache misses in the following
+// R_DrawSprite(). Makes sense for scenes with huge amount of drawsegs.
 //
 
-void R_DrawMasked(void)
+static void R_BuildDrawsegBuckets(void)
 {
-  int i;
   drawseg_t *ds;
+  int numbuckets = 0, numitems = 0;
+  int i, level, b;
 
-  R_SortVisSprites();
+  drawsegs_numlevels = 0;
+
+  if (!num_vissprite || ds_p == drawsegs)
+    return;
 
-  // [Woof!] Andrey Budko
-  // Reducing of cache misses in the following R_DrawSprite()
-  // Makes sense for scenes with huge amount of drawsegs.
-  // ~12% of speed improvement on epic.wad map05
-  for(i = 0; i < DS_RANGES_COUNT; i++)
-    drawsegs_xranges[i].count = 0;
+  // level 0 covers the whole view with one bucket
+  for (i = 0; (viewwidth - 1) >> i; i++)
+    ;
 
-  if (num_vissprite > 0)
+  for (level = 0; level < DS_MAX_LEVELS; level++, i--)
   {
-    if (drawsegs_xrange_size < maxdrawsegs)
-    {
-      drawsegs_xrange_size = 2 * maxdrawsegs;
-      for(i = 0; i < DS_RANGES_COUNT; i++)
+    drawsegs_levels[level].shift = i;
+    drawsegs_levels[level].first = numbuckets;
+    numbuckets += ((viewwidth - 1) >> i) + 1;
+    drawsegs_numlevels++;
+
+    if (i <= DS_MIN_BUCKET_SHIFT)
+      break;
+  }
+
+  if (drawsegs_buckets_size < numbuckets + 1)
+  {
+    drawsegs_buckets_size = numbuckets + 1;
+    drawsegs_buckets = Z_Realloc(drawsegs_buckets,
+                                 drawsegs_buckets_size * sizeof(*drawsegs_buckets),
+                                 PU_STATIC, 0);
+  }
+
+  memset(drawsegs_buckets, 0, (numbuckets + 1) * sizeof(*drawsegs_buckets));
+
+  // count the drawsegs of each bucket
+  for (ds = ds_p; ds-- > drawsegs;)
+    if (ds->silhouette || ds->maskedtexturecol)
+      for (level = 0; level < drawsegs_numlevels; level++)
       {
-        drawsegs_xranges[i].items = Z_Realloc(
-          drawsegs_xranges[i].items,
-          drawsegs_xrange_size * sizeof(drawsegs_xranges[i].items[0]),
-          PU_STATIC, 0);
+        const drawsegs_level_t *l = &drawsegs_levels[level];
+
+        for (b = ds->x1 >> l->shift; b <= ds->x2 >> l->shift; b++)
+          drawsegs_buckets[l->first + b + 1]++;
       }
-    }
-    for (ds = ds_p; ds-- > drawsegs;)
+
+  for (b = 0; b < numbuckets; b++)
+    drawsegs_buckets[b + 1] += drawsegs_buckets[b];
+
+  numitems = drawsegs_buckets[numbuckets];
+
+  if (drawsegs_items_size < numitems)
+  {
+    drawsegs_items_size = numitems * 2;
+    drawsegs_items = Z_Realloc(drawsegs_items,
+                               drawsegs_items_size * sizeof(*drawsegs_items),
+                               PU_STATIC, 0);
+  }
+
+  // fill them back to front, moving the bucket starts to their ends
+  for (ds = ds_p; ds-- > drawsegs;)
+    if (ds->silhouette || ds->maskedtexturecol)
     {
-      if (ds->silhouette || ds->maskedtexturecol)
+      const drawseg_xrange_item_t item = {ds->x1, ds->x2, ds};
+
+      for (level = 0; level < drawsegs_numlevels; level++)
       {
-        drawsegs_xranges[0].items[drawsegs_xranges[0].count].x1 = ds->x1;
-        drawsegs_xranges[0].items[drawsegs_xranges[0].count].x2 = ds->x2;
-        drawsegs_xranges[0].items[drawsegs_xranges[0].count].user = ds;
-        
-        // Andrey Budko: ~13% of speed improvement on sunder.wad map10
-        if (ds->x1 < centerx)
-        {
-          drawsegs_xranges[1].items[drawsegs_xranges[1].count] = 
-            drawsegs_xranges[0].items[drawsegs_xranges[0].count];
-          drawsegs_xranges[1].count++;
-        }
-        if (ds->x2 >= centerx)
-        {
-          drawsegs_xranges[2].items[drawsegs_xranges[2].count] = 
-            drawsegs_xranges[0].items[drawsegs_xranges[0].count];
-          drawsegs_xranges[2].count++;
-        }
+        const drawsegs_level_t *l = &drawsegs_levels[level];
 
-        drawsegs_xranges[0].count++;
+        for (b = ds->x1 >> l->shift; b <= ds->x2 >> l->shift; b++)
+          drawsegs_items[drawsegs_buckets[l->first + b]++] = item;
       }
     }
-  }
+
+  // and back to their starts
+  for (b = numbuckets; b > 0; b--)
+    drawsegs_buckets[b] = drawsegs_buckets[b - 1];
+  drawsegs_buckets[0] = 0;
+}
+
+// Selects the smallest bucket containing columns x1 to x2 for R_DrawSprite().
+
+static void R_FindDrawsegBucket(int x1, int x2)
+{
+  int level, b;
+
+  drawsegs_xrange_count = 0;
+
+  if (!drawsegs_numlevels)
+    return;
+
+  x1 = MAX(x1, 0);
+  x2 = MIN(x2, viewwidth - 1);
+
+  for (level = drawsegs_numlevels - 1; level > 0; level--)
+    if (x1 >> drawsegs_levels[level].shift == x2 >> drawsegs_levels[level].shift)
+      break;
+
+  b = drawsegs_levels[level].first + (x1 >> drawsegs_levels[level].shift);
+  drawsegs_xrange = &drawsegs_items[drawsegs_buckets[b]];
+  drawsegs_xrange_count = drawsegs_buckets[b + 1] - drawsegs_buckets[b];
+}
+
+//
+// R_DrawMasked
+//
+
+void R_DrawMasked(void)
+{
+  int i;
+  drawseg_t *ds;
+
+  R_SortVisSprites();
+
+  R_BuildDrawsegBuckets();
 
   // draw all vissprites back to front
 
@@ -1312,23 +1465,8 @@ void R_DrawMasked(void)
   {
     vissprite_t* spr = vissprite_ptrs[i];
 
-    if (spr->x2 < centerx)
-    {
-      drawsegs_xrange = drawsegs_xranges[1].items;
-      drawsegs_xrange_count = drawsegs_xranges[1].count;
-    }
-    else if (spr->x1 >= centerx)
-    {
-      drawsegs_xrange = drawsegs_xranges[2].items;
-      drawsegs_xrange_count = drawsegs_xranges[2].count;
-    }
-    else
-    {
-      drawsegs_xrange = drawsegs_xranges[0].items;
-      drawsegs_xrange_count = drawsegs_xranges[0].count;
-    }
-
-    R_DrawSprite(vissprite_ptrs[i]);         // killough
+    R_FindDrawsegBucket(spr->x1, spr->x2);
+    R_DrawSprite(spr);         // killough
   }
 
   // render any remaining masked mid textures
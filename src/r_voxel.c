@@ -15,14 +15,18 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "d_iwad.h"
 #include "doomstat.h"
 #include "doomtype.h"
 #include "hu_crosshair.h"
 #include "i_printf.h"
+#include "i_thread.h"
 #include "i_video.h"
 #include "info.h"
 #include "m_fixed.h"
+#include "m_io.h"
 #include "m_misc.h"
+#include "md5.h"
 #include "mn_menu.h"
 #include "p_mobj.h"
 #include "r_bmaps.h"
@@ -31,6 +35,7 @@
 #include "r_draw.h"
 #include "r_main.h"
 #include "r_state.h"
+#include "r_strip.h"
 #include "r_things.h"
 #include "tables.h"
 #include "v_video.h"
@@ -58,6 +63,9 @@ struct Voxel
 
 static struct Voxel *** all_voxels;
 
+// lump of each model not loaded yet, -1 otherwise
+static int * voxel_lumps;
+
 #define VX_ITEM_ROTATION_ANGLE (4 * ANG1)
 
 static int vx_rotate_items = 1;
@@ -145,7 +153,7 @@ static void VX_RemapSlabColors (struct Voxel * v, int x, int y, byte * table)
 }
 
 
-static struct Voxel * VX_Decode (byte * p, int length)
+static struct Voxel * VX_Decode (byte * p, int length, int * data_size_out)
 {
 	// too short?
 	if (length < 40 + 768)
@@ -207,6 +215,8 @@ static struct Voxel * VX_Decode (byte * p, int length)
 	if (data_size <= 0)
 		return NULL;
 
+	*data_size_out = data_size;
+
 	for (x = 0 ; x < num_offsets ; x++)
 		v->offsets[x] -= min_offset;
 
@@ -236,7 +246,244 @@ static struct Voxel * VX_Decode (byte * p, int length)
 }
 
 
-static boolean VX_Load (int spr, int frame)
+//
+// Decoded and remapped models are cached in <prefdir>/voxels, in files
+// named after the MD5 checksum of the KVX lump and the palette.
+//
+
+// Bump whenever the decoding or the file layout change.
+#define VX_CACHE_VERSION 1
+
+// The oldest files are removed beyond this.
+#define VX_CACHE_SIZE (64 * 1024 * 1024)
+
+static const char vx_cache_magic[8] = "WOOFVOX";
+
+// Followed by offsets[x_size * (y_size + 1)] and data[data_size].
+
+typedef struct
+{
+	char    magic[8];
+	uint32_t version;
+	int32_t x_size, y_size, z_size;
+	int32_t x_pivot, y_pivot, z_pivot;
+	int32_t data_size;
+} vxcacheheader_t;
+
+boolean voxel_cache;
+
+static char * vx_cache_dir;
+
+
+static char * VX_CacheFileName (byte * buf, int length)
+{
+	const uint32_t version = VX_CACHE_VERSION;
+	byte * pal = W_CacheLumpName ("PLAYPAL", PU_CACHE);
+
+	struct MD5Context md5;
+	byte digest[16];
+	char digest_string[33];
+
+	MD5Init (&md5);
+	MD5Update (&md5, (const byte *) &version, sizeof(version));
+	MD5Update (&md5, pal, 768);
+	MD5Update (&md5, buf, length);
+	MD5Final (digest, &md5);
+
+	M_DigestToString (digest, digest_string, sizeof(digest));
+
+	if (vx_cache_dir == NULL)
+	{
+		vx_cache_dir = M_StringJoin (D_DoomPrefDir (), DIR_SEPARATOR_S, "voxels");
+		M_MakeDirectory (vx_cache_dir);
+		M_TrimCacheDir (vx_cache_dir, "*.dat", VX_CACHE_SIZE);
+	}
+
+	return M_StringJoin (vx_cache_dir, DIR_SEPARATOR_S, digest_string, ".dat");
+}
+
+
+// The slabs of every column of a cached model must lie in its data, the
+// file may be truncated or corrupt.
+
+static boolean VX_ValidModel (const struct Voxel * v, int data_size)
+{
+	int x, y;
+
+	for (x = 0 ; x < v->x_size ; x++)
+	{
+		for (y = 0 ; y < v->y_size ; y++)
+		{
+			int A = v->offsets[y     * v->x_size + x];
+			int B = v->offsets[(y+1) * v->x_size + x];
+
+			if (A < 0 || A > data_size || B < 0 || B > data_size)
+				return false;
+
+			// top, len, face, then len colors
+			while (A < B)
+			{
+				if (A + 3 > data_size || A + 3 + v->data[A+1] > data_size)
+					return false;
+
+				A += 3 + v->data[A+1];
+			}
+		}
+	}
+
+	return true;
+}
+
+
+// Maps a cache file, whose data is then used in place.
+
+static struct Voxel * VX_MapCacheFile (const char * filename)
+{
+	size_t length;
+	byte * data = M_MapFile (filename, &length);
+
+	if (data == NULL)
+		return NULL;
+
+	const vxcacheheader_t * header = (const vxcacheheader_t *) data;
+
+	if (length < sizeof(*header)
+	    || memcmp (header->magic, vx_cache_magic, sizeof(header->magic))
+	    || header->version != VX_CACHE_VERSION
+	    || header->x_size <= 0 || header->x_size > 256
+	    || header->y_size <= 0 || header->y_size > 256
+	    || header->z_size <= 0 || header->z_size > 256
+	    || header->data_size <= 0
+	    || length - sizeof(*header) < header->x_size * (header->y_size + 1)
+	       * sizeof(int) + header->data_size)
+	{
+		M_UnmapFile (data, length);
+		return NULL;
+	}
+
+	struct Voxel * v = Z_Malloc (sizeof(struct Voxel), PU_STATIC, NULL);
+
+	v->x_size  = header->x_size;
+	v->y_size  = header->y_size;
+	v->z_size  = header->z_size;
+	v->x_pivot = header->x_pivot;
+	v->y_pivot = header->y_pivot;
+	v->z_pivot = header->z_pivot;
+
+	v->offsets = (int *) (header + 1);
+	v->data    = (byte *) (v->offsets + v->x_size * (v->y_size + 1));
+
+	if (! VX_ValidModel (v, header->data_size))
+	{
+		I_Printf (VB_WARNING, "VX_MapCacheFile: %s is corrupt, rebuilding", filename);
+		Z_Free (v);
+		M_UnmapFile (data, length);
+		return NULL;
+	}
+
+	return v;
+}
+
+
+static void VX_SaveCacheFile (const char * filename, struct Voxel * v, int data_size)
+{
+	vxcacheheader_t header = {0};
+	int num_offsets = v->x_size * (v->y_size + 1);
+	boolean ok = false;
+
+	memcpy (header.magic, vx_cache_magic, sizeof(header.magic));
+	header.version   = VX_CACHE_VERSION;
+	header.x_size    = v->x_size;
+	header.y_size    = v->y_size;
+	header.z_size    = v->z_size;
+	header.x_pivot   = v->x_pivot;
+	header.y_pivot   = v->y_pivot;
+	header.z_pivot   = v->z_pivot;
+	header.data_size = data_size;
+
+	// write to a temporary file first, so that other instances never map
+	// a partially written cache
+	char * tempfile = M_StringJoin (filename, ".tmp");
+	FILE * file = M_fopen (tempfile, "wb");
+
+	if (file != NULL)
+	{
+		ok = fwrite (&header, sizeof(header), 1, file) == 1
+		     && fwrite (v->offsets, sizeof(int), num_offsets, file) == num_offsets
+		     && fwrite (v->data, 1, data_size, file) == data_size;
+
+		ok &= fclose (file) == 0;
+	}
+
+	if (ok)
+	{
+		M_remove (filename);
+		ok = !M_rename (tempfile, filename);
+	}
+
+	if (!ok)
+	{
+		I_Printf (VB_WARNING, "VX_SaveCacheFile: Could not write %s", filename);
+		M_remove (tempfile);
+	}
+
+	free (tempfile);
+}
+
+
+static struct Voxel * VX_Load (int lumpnum)
+{
+	byte *buf = W_CacheLumpNum(lumpnum, PU_STATIC);
+	int len   = W_LumpLength(lumpnum);
+
+	char * filename = NULL;
+	struct Voxel * v = NULL;
+
+	if (voxel_cache)
+	{
+		filename = VX_CacheFileName (buf, len);
+		v = VX_MapCacheFile (filename);
+	}
+
+	if (v == NULL)
+	{
+		int data_size;
+
+		// Note: this may return NULL
+		v = VX_Decode (buf, len, &data_size);
+
+		if (v != NULL && filename != NULL)
+			VX_SaveCacheFile (filename, v, data_size);
+	}
+
+	free (filename);
+	Z_Free (buf);
+
+	return v;
+}
+
+
+// Models are only decoded when first seen, big voxel packs would
+// otherwise add seconds to the startup.
+
+static struct Voxel * VX_GetModel (int spr, int frame)
+{
+	if (frame >= MAX_FRAMES)
+		return NULL;
+
+	int * lump = &voxel_lumps[spr * MAX_FRAMES + frame];
+
+	if (*lump >= 0)
+	{
+		all_voxels[spr][frame] = VX_Load (*lump);
+		*lump = -1;
+	}
+
+	return all_voxels[spr][frame];
+}
+
+
+static boolean VX_FindLump (int spr, int frame)
 {
 	char frame_ch = 'A' + frame;
 
@@ -254,18 +501,9 @@ static boolean VX_Load (int spr, int frame)
 		return false;
 	}
 
-	byte *buf = W_CacheLumpNum(lumpnum, PU_STATIC);
-	int len   = W_LumpLength(lumpnum);
+	voxels_found = true;
 
-	// Note: this may return NULL
-	struct Voxel * v = VX_Decode (buf, len);
-
-	if (v != NULL)
-		voxels_found = true;
-
-	all_voxels[spr][frame] = v;
-
-	Z_Free (buf);
+	voxel_lumps[spr * MAX_FRAMES + frame] = lumpnum;
 
 	return true;
 }
@@ -276,6 +514,8 @@ void VX_Init (void)
 	int spr, frame;
 
 	all_voxels = Z_Malloc(num_sprites * sizeof(*all_voxels), PU_STATIC, NULL);
+	voxel_lumps = Z_Malloc(num_sprites * MAX_FRAMES * sizeof(*voxel_lumps),
+			       PU_STATIC, NULL);
 	for (spr = 0 ; spr < num_sprites ; spr++)
 	{
 		all_voxels[spr] = Z_Malloc (MAX_FRAMES * sizeof(**all_voxels),
@@ -283,6 +523,7 @@ void VX_Init (void)
 		for (frame = 0 ; frame < MAX_FRAMES ; frame++)
 		{
 			all_voxels[spr][frame] = NULL;
+			voxel_lumps[spr * MAX_FRAMES + frame] = -1;
 		}
 	}
 
@@ -292,7 +533,7 @@ void VX_Init (void)
 	{
 		for (frame = 0 ; frame < MAX_FRAMES ; frame++)
 		{
-			if (! VX_Load (spr, frame))
+			if (! VX_FindLump (spr, frame))
 				break;
 		}
 	}
@@ -509,7 +750,7 @@ boolean VX_ProjectVoxel(mobj_t *thing, int lightlevel_override)
 	int spr   = thing->sprite;
 	int frame = thing->frame & FF_FRAMEMASK;
 
-	struct Voxel * v = all_voxels[spr][frame];
+	struct Voxel * v = VX_GetModel (spr, frame);
 	if (v == NULL)
 		return false;
 
@@ -748,10 +989,26 @@ boolean VX_ProjectVoxel(mobj_t *thing, int lightlevel_override)
 static fixed_t  vx_eye_x;
 static fixed_t  vx_eye_y;
 
+// Wide voxels are split into ranges of screen columns, which are drawn
+// on the worker threads. Clipping against the drawsegs has already been
+// done by R_DrawSprite() in mfloorclip and mceilingclip.
 
-static void VX_DrawColumn (vissprite_t * spr, int x, int y)
+#define VX_MAX_TILES       32
+#define VX_MIN_TILE_WIDTH  32
+
+typedef struct
 {
-	struct VisVoxel * vv = &visvoxels[spr->voxel_index];
+	vissprite_t * spr;
+	int x1, x2;  // inclusive column range
+} vxtile_t;
+
+static vxtile_t vx_tiles[VX_MAX_TILES];
+
+
+static void VX_DrawColumn (const vxtile_t * tile, int x, int y)
+{
+	vissprite_t     * spr = tile->spr;
+	struct VisVoxel * vv  = &visvoxels[spr->voxel_index];
 	struct Voxel    * v  = vv->model;
 
 	int ofs1 = v->offsets[y     * v->x_size + x];
@@ -839,6 +1096,10 @@ static void VX_DrawColumn (vissprite_t * spr, int x, int y)
 	Cx = centerxfrac + FixedMul (Cx, C_xscale);
 	Dx = centerxfrac + FixedMul (Dx, D_xscale);
 
+	// outside of the columns drawn by this tile?
+	if (Ax >= ((tile->x2 + 1) << FRACBITS) || ((Cx > Bx) ? Cx : Bx) <= (tile->x1 << FRACBITS))
+		return;
+
 	static const byte A_faces[9] = { F_BACK, F_BACK, F_RIGHT, F_LEFT, 0, F_RIGHT, F_LEFT, F_FRONT, F_FRONT };
 	static const byte B_faces[9] = { F_LEFT, 0, F_BACK, 0, 0, 0, F_FRONT, 0, F_RIGHT };
 
@@ -856,8 +1117,8 @@ static void VX_DrawColumn (vissprite_t * spr, int x, int y)
 	for (; ux < ((Cx > Bx) ? Cx : Bx) ; ux += FRACUNIT)
 	{
 		// clip horizontally
-		if (ux >= ((spr->x2 + 1) << FRACBITS)) break;
-		if (ux <  ((spr->x1    ) << FRACBITS)) continue;
+		if (ux >= ((tile->x2 + 1) << FRACBITS)) break;
+		if (ux <  ((tile->x1    ) << FRACBITS)) continue;
 
 		fixed_t clip_y1 =  ((int)mceilingclip[ux >> FRACBITS] + 1) << FRACBITS;
 		fixed_t clip_y2 = (((int)mfloorclip  [ux >> FRACBITS]    ) << FRACBITS) - 1;
@@ -985,13 +1246,13 @@ static void VX_DrawColumn (vissprite_t * spr, int x, int y)
 }
 
 
-static void VX_RecursiveDraw (vissprite_t * spr, int x, int y, int w, int h)
+static void VX_RecursiveDraw (const vxtile_t * tile, int x, int y, int w, int h)
 {
 loop:
 	// reached a single column?
 	if (w == 1 && h == 1)
 	{
-		VX_DrawColumn (spr, x, y);
+		VX_DrawColumn (tile, x, y);
 		return;
 	}
 
@@ -1003,12 +1264,12 @@ loop:
 	{
 		if (vx_eye_x < ((x * 2 + w) << (FRACBITS-1)))
 		{
-			VX_RecursiveDraw (spr, x + w / 2, y, (w+1) / 2, h);
+			VX_RecursiveDraw (tile, x + w / 2, y, (w+1) / 2, h);
 			w = w / 2;
 		}
 		else
 		{
-			VX_RecursiveDraw (spr, x, y, w / 2, h);
+			VX_RecursiveDraw (tile, x, y, w / 2, h);
 			x += w / 2;
 			w = (w+1) / 2;
 		}
@@ -1017,12 +1278,12 @@ loop:
 	{
 		if (vx_eye_y < ((y * 2 + h) << (FRACBITS-1)))
 		{
-			VX_RecursiveDraw (spr, x, y + h / 2, w, (h+1) / 2);
+			VX_RecursiveDraw (tile, x, y + h / 2, w, (h+1) / 2);
 			h = h / 2;
 		}
 		else
 		{
-			VX_RecursiveDraw (spr, x, y, w, h / 2);
+			VX_RecursiveDraw (tile, x, y, w, h / 2);
 			y += h / 2;
 			h = (h+1) / 2;
 		}
@@ -1032,6 +1293,15 @@ loop:
 }
 
 
+static void VX_DrawTile (void * data, int index)
+{
+	const vxtile_t * tile = (const vxtile_t *) data + index;
+	struct Voxel   * v    = visvoxels[tile->spr->voxel_index].model;
+
+	VX_RecursiveDraw (tile, 0, 0, v->x_size, v->y_size);
+}
+
+
 void VX_DrawVoxel (vissprite_t * spr)
 {
 	struct VisVoxel * vv = &visvoxels[spr->voxel_index];
@@ -1097,5 +1367,23 @@ void VX_DrawVoxel (vissprite_t * spr)
 	vx_eye_x = v->x_pivot + FixedMul (delta_x, c) + FixedMul (delta_y, s);
 	vx_eye_y = v->y_pivot + FixedMul (delta_x, s) - FixedMul (delta_y, c);
 
-	VX_RecursiveDraw (spr, 0, 0, v->x_size, v->y_size);
+	int width = spr->x2 - spr->x1 + 1;
+	int num_tiles = 1;
+
+	// the fuzz effect is not thread-safe
+	if (threaded_renderer && !(spr->mobjflags & MF_SHADOW))
+	{
+		num_tiles = MIN (I_GetNumThreads (), width / VX_MIN_TILE_WIDTH);
+		num_tiles = CLAMP (num_tiles, 1, VX_MAX_TILES);
+	}
+
+	int i;
+	for (i = 0 ; i < num_tiles ; i++)
+	{
+		vx_tiles[i].spr = spr;
+		vx_tiles[i].x1  = spr->x1 + width * i / num_tiles;
+		vx_tiles[i].x2  = spr->x1 + width * (i + 1) / num_tiles - 1;
+	}
+
+	I_RunTasks (VX_DrawTile, vx_tiles, num_tiles);
 }
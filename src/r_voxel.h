@@ -29,6 +29,8 @@ void VX_DrawVoxel (struct vissprite_s * vis);
 
 extern boolean voxels_rendering, default_voxels_rendering;
 
+extern boolean voxel_cache;
+
 void VX_IncreaseMaxDist (int step_multipler);
 
 void VX_DecreaseMaxDist (int step_multipler);
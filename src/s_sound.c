@@ -20,8 +20,10 @@
 // killough 3/7/98: modified to allow arbitrary listeners in spy mode
 // killough 5/2/98: reindented, removed useless code, beautified
 
+#include <stdlib.h>
 #include <string.h>
 
+#include "d_items.h"
 #include "deh_strings.h"
 #include "doomdef.h"
 #include "doomstat.h"
@@ -30,11 +32,15 @@
 #include "i_rumble.h"
 #include "i_sound.h"
 #include "i_system.h"
+#include "info.h"
+#include "m_array.h"
 #include "m_config.h"
 #include "m_misc.h"
 #include "m_random.h"
+#include "p_action.h"
 #include "p_ambient.h"
 #include "p_mobj.h"
+#include "p_tick.h"
 #include "s_musinfo.h" // [crispy] struct musinfo
 #include "s_sound.h"
 #include "s_trakinfo.h"
@@ -93,6 +99,248 @@ int idmusnum;
 static int max_channels_per_sfx;
 static int max_volume_per_sfx;
 
+// [Woof!] The playing channels are kept in a binary heap with the channel
+// to evict first at its root: the one with the highest priority number,
+// which the sound modules raise with distance, then the quietest one. The
+// free channels are kept on a stack, and the loops over the channels only
+// visit the playing ones.
+
+static int chanheap[MAX_CHANNELS];
+static int heappos[MAX_CHANNELS]; // of each playing channel in chanheap
+static int numplaying;
+
+static int freechans[MAX_CHANNELS];
+static int numfree;
+
+// snd_channels, or fewer if the sound module can't play as many at once
+static int numchannels;
+
+// The playing channels are also listed by origin, in a small hash table,
+// and by sound, starting at sfxinfo->active.channel. The sounds of the
+// same origin and the channels of the same sound are found without a scan.
+
+#define ORIGIN_HASH_SIZE 64
+
+typedef struct
+{
+    int prev, next;
+} chanlink_t;
+
+static int originhash[ORIGIN_HASH_SIZE];
+static chanlink_t originlinks[MAX_CHANNELS];
+static chanlink_t sfxlinks[MAX_CHANNELS];
+
+static int *OriginChain(const mobj_t *origin)
+{
+    return &originhash[((uintptr_t)origin >> 4) % ORIGIN_HASH_SIZE];
+}
+
+static void LinkChannel(chanlink_t *links, int *head, int cnum)
+{
+    links[cnum].prev = -1;
+    links[cnum].next = *head;
+    if (*head >= 0)
+    {
+        links[*head].prev = cnum;
+    }
+    *head = cnum;
+}
+
+static void UnlinkChannel(chanlink_t *links, int *head, int cnum)
+{
+    if (links[cnum].prev >= 0)
+    {
+        links[links[cnum].prev].next = links[cnum].next;
+    }
+    else
+    {
+        *head = links[cnum].next;
+    }
+
+    if (links[cnum].next >= 0)
+    {
+        links[links[cnum].next].prev = links[cnum].prev;
+    }
+}
+
+// Called before active.count is raised, which tells whether the list of
+// the sound is valid.
+
+static void IndexChannel(int cnum)
+{
+    sfxinfo_t *sfx = channels[cnum].sfxinfo;
+
+    if (!sfx->active.count)
+    {
+        sfx->active.channel = -1;
+    }
+
+    LinkChannel(sfxlinks, &sfx->active.channel, cnum);
+    LinkChannel(originlinks, OriginChain(channels[cnum].origin), cnum);
+}
+
+static void UnindexChannel(int cnum)
+{
+    UnlinkChannel(sfxlinks, &channels[cnum].sfxinfo->active.channel, cnum);
+    UnlinkChannel(originlinks, OriginChain(channels[cnum].origin), cnum);
+}
+
+// Of the playing channels of origin, the one with the lowest number, as
+// the channels used to be searched in order.
+
+static int FindOriginChannel(const mobj_t *origin)
+{
+    int found = -1;
+
+    for (int cnum = *OriginChain(origin); cnum >= 0;
+         cnum = originlinks[cnum].next)
+    {
+        if (channels[cnum].origin == origin && (found < 0 || cnum < found))
+        {
+            found = cnum;
+        }
+    }
+
+    return found;
+}
+
+static boolean EvictsBefore(int a, int b)
+{
+    const channel_t *ca = &channels[a], *cb = &channels[b];
+
+    if (ca->priority != cb->priority)
+    {
+        return ca->priority > cb->priority;
+    }
+
+    return ca->volume < cb->volume;
+}
+
+static void HeapSet(int pos, int cnum)
+{
+    chanheap[pos] = cnum;
+    heappos[cnum] = pos;
+}
+
+static void SiftUp(int pos)
+{
+    const int cnum = chanheap[pos];
+
+    while (pos > 0)
+    {
+        const int parent = (pos - 1) / 2;
+
+        if (!EvictsBefore(cnum, chanheap[parent]))
+        {
+            break;
+        }
+
+        HeapSet(pos, chanheap[parent]);
+        pos = parent;
+    }
+
+    HeapSet(pos, cnum);
+}
+
+static void SiftDown(int pos)
+{
+    const int cnum = chanheap[pos];
+
+    while (true)
+    {
+        int child = 2 * pos + 1;
+
+        if (child >= numplaying)
+        {
+            break;
+        }
+
+        if (child + 1 < numplaying
+            && EvictsBefore(chanheap[child + 1], chanheap[child]))
+        {
+            child++;
+        }
+
+        if (!EvictsBefore(chanheap[child], cnum))
+        {
+            break;
+        }
+
+        HeapSet(pos, chanheap[child]);
+        pos = child;
+    }
+
+    HeapSet(pos, cnum);
+}
+
+static void HeapInsert(int cnum)
+{
+    HeapSet(numplaying++, cnum);
+    SiftUp(numplaying - 1);
+}
+
+static void HeapRemove(int cnum)
+{
+    const int pos = heappos[cnum];
+
+    if (pos < --numplaying)
+    {
+        const int moved = chanheap[numplaying];
+
+        HeapSet(pos, moved);
+        SiftUp(pos);
+        SiftDown(heappos[moved]);
+    }
+}
+
+// After the priorities have changed.
+
+static void HeapRebuild(void)
+{
+    for (int pos = numplaying / 2 - 1; pos >= 0; pos--)
+    {
+        SiftDown(pos);
+    }
+}
+
+static void ResetChannels(void)
+{
+    numplaying = 0;
+    numchannels = MIN(snd_channels, I_SoundChannels());
+
+    for (int i = 0; i < ORIGIN_HASH_SIZE; i++)
+    {
+        originhash[i] = -1;
+    }
+
+    // the first channels are used first
+    numfree = 0;
+    for (int cnum = numchannels - 1; cnum >= 0; cnum--)
+    {
+        freechans[numfree++] = cnum;
+    }
+}
+
+// Coarse check ahead of the sound modules. Their distances are never
+// shorter than the longer of the axis distances.
+
+static boolean OutOfRange(const mobj_t *listener, const mobj_t *source,
+                          int stop_dist)
+{
+    int adx, ady;
+
+    if (!source || !listener || !listener->player
+        || source == players[displayplayer].mo)
+    {
+        return false;
+    }
+
+    adx = abs((listener->x >> FRACBITS) - (source->x >> FRACBITS));
+    ady = abs((listener->y >> FRACBITS) - (source->y >> FRACBITS));
+
+    return MAX(adx, ady) > MAX(stop_dist, S_CLIPPING_DIST);
+}
+
 static void ResetActive(void)
 {
     for (int cnum = 0; cnum < MAX_CHANNELS; cnum++)
@@ -130,10 +378,14 @@ static void StopChannel(int cnum)
     if (channels[cnum].sfxinfo)
     {
         I_StopSound(channels[cnum].handle); // stop the sound playing
+        UnindexChannel(cnum);
         channels[cnum].sfxinfo->active.count--;
 
         // haleyjd 09/27/06: clear the entire channel
         memset(&channels[cnum], 0, sizeof(channel_t));
+
+        HeapRemove(cnum);
+        freechans[numfree++] = cnum;
     }
 }
 
@@ -145,7 +397,7 @@ static void StopChannel(int cnum)
 static void S_EvictChannel(int cnum)
 {
 #ifdef RANGECHECK
-    if (cnum >= snd_channels)
+    if (cnum >= numchannels)
     {
         I_Error("handle %d out of range", cnum);
     }
@@ -167,7 +419,7 @@ static void S_EvictChannel(int cnum)
 static void S_StopChannel(int cnum)
 {
 #ifdef RANGECHECK
-    if (cnum < 0 || cnum >= snd_channels)
+    if (cnum < 0 || cnum >= numchannels)
     {
         I_Error("handle %d out of range\n", cnum);
     }
@@ -196,6 +448,7 @@ void S_EvictChannels(void)
     ResetActive();
     memset(channels, 0, sizeof(channels));
     memset(sobjs, 0, sizeof(sobjs));
+    ResetChannels();
 }
 
 //
@@ -213,30 +466,31 @@ static int S_AdjustSoundParams(const mobj_t *listener, const mobj_t *source,
     return I_AdjustSoundParams(listener, source, params);
 }
 
-static void LimitChannelsPerSfx(const mobj_t *origin, const sfxinfo_t *sfxinfo,
-                                int priority, int *cnum)
+// Returns false if the sound may not take a channel.
+
+static boolean LimitChannelsPerSfx(const mobj_t *origin,
+                                   const sfxinfo_t *sfxinfo, int priority)
 {
-    if (max_channels_per_sfx < 1 || *cnum != snd_channels || !origin)
+    if (max_channels_per_sfx < 1 || !origin
+        || sfxinfo->active.count < max_channels_per_sfx)
     {
-        return;
+        return true;
     }
 
-    int lowestpriority = -1;
     int lpcnum = -1;
     int num_channels = 0;
 
-    for (int i = 0; i < snd_channels; i++)
+    for (int cnum = sfxinfo->active.channel; cnum >= 0;
+         cnum = sfxlinks[cnum].next)
     {
-        const channel_t *c = &channels[i];
-        const sfxinfo_t *sfx = c->sfxinfo;
+        const channel_t *c = &channels[cnum];
 
-        if (sfx && sfxinfo == sfx && c->origin)
+        if (c->origin)
         {
             // Find the lowest priority channel using the target sound.
-            if (c->priority > lowestpriority)
+            if (lpcnum < 0 || EvictsBefore(cnum, lpcnum))
             {
-                lowestpriority = c->priority;
-                lpcnum = i;
+                lpcnum = cnum;
             }
 
             // Find the number of channels using the target sound.
@@ -246,18 +500,17 @@ static void LimitChannelsPerSfx(const mobj_t *origin, const sfxinfo_t *sfxinfo,
 
     if (num_channels >= max_channels_per_sfx)
     {
-        if (priority > lowestpriority)
+        if (priority > channels[lpcnum].priority)
         {
             // The other channels have higher priority.
-            *cnum = -1;
-        }
-        else
-        {
-            // Stop the lowest priority channel.
-            S_EvictChannel(lpcnum);
-            *cnum = lpcnum;
+            return false;
         }
+
+        // Stop the lowest priority channel.
+        S_EvictChannel(lpcnum);
     }
+
+    return true;
 }
 
 //
@@ -270,11 +523,6 @@ static void LimitChannelsPerSfx(const mobj_t *origin, const sfxinfo_t *sfxinfo,
 static int S_getChannel(const mobj_t *origin, const sfxinfo_t *sfxinfo,
                         int priority, int singularity)
 {
-    // channel number to use
-    int cnum;
-    int lowestpriority = -1; // haleyjd
-    int lpcnum = -1;
-
     // haleyjd 09/28/06: moved this here. If we kill a sound already
     // being played, we can use that channel. There is no need to
     // search for a free one again because we already know of one.
@@ -282,60 +530,37 @@ static int S_getChannel(const mobj_t *origin, const sfxinfo_t *sfxinfo,
     // kill old sound
     // killough 12/98: replace is_pickup hack with singularity flag
     // haleyjd 06/12/08: only if subchannel matches
-    for (cnum = 0; cnum < snd_channels; cnum++)
+    for (int cnum = *OriginChain(origin); cnum >= 0;
+         cnum = originlinks[cnum].next)
     {
-        if (channels[cnum].sfxinfo && channels[cnum].singularity == singularity
+        if (channels[cnum].singularity == singularity
             && channels[cnum].origin == origin)
         {
             S_StopChannel(cnum);
-            break;
+            return freechans[--numfree];
         }
     }
 
-    LimitChannelsPerSfx(origin, sfxinfo, priority, &cnum);
-
-    // Find an open channel
-    if (cnum == snd_channels)
+    if (!LimitChannelsPerSfx(origin, sfxinfo, priority))
     {
-        // haleyjd 09/28/06: it isn't necessary to look for playing sounds in
-        // the same singularity class again, as we just did that above. Here
-        // we are looking for an open channel. We will also keep track of the
-        // channel found with the lowest sound priority while doing this.
-        for (cnum = 0; cnum < snd_channels && channels[cnum].sfxinfo; cnum++)
-        {
-            if (channels[cnum].priority > lowestpriority)
-            {
-                lowestpriority = channels[cnum].priority;
-                lpcnum = cnum;
-            }
-        }
+        return -1;
     }
 
     // None available?
-    if (cnum == snd_channels)
+    if (!numfree)
     {
         // Look for lower priority
-        // haleyjd: we have stored the channel found with the lowest priority
-        // in the loop above
-        if (priority > lowestpriority)
+        // [Woof!] the channel with the lowest priority is the root of the heap
+        if (!numplaying || priority > channels[chanheap[0]].priority)
         {
             return -1; // No lower priority.  Sorry, Charlie.
         }
-        else
-        {
-            S_EvictChannel(lpcnum); // Otherwise, kick out lowest priority.
-            cnum = lpcnum;
-        }
-    }
 
-#ifdef RANGECHECK
-    if (cnum >= snd_channels)
-    {
-        I_Error("handle %d out of range\n", cnum);
+        S_EvictChannel(chanheap[0]); // Otherwise, kick out lowest priority.
     }
-#endif
 
-    return cnum;
+    // The evicted or stopped channel is the next free one
+    return freechans[--numfree];
 }
 
 static void LimitVolumePerSfx(void)
@@ -345,9 +570,9 @@ static void LimitVolumePerSfx(void)
         return;
     }
 
-    for (int cnum = 0; cnum < snd_channels; cnum++)
+    for (int i = 0; i < numplaying; i++)
     {
-        channel_t *c = &channels[cnum];
+        channel_t *c = &channels[chanheap[i]];
         sfxinfo_t *sfx = c->sfxinfo;
 
         if (sfx)
@@ -357,9 +582,9 @@ static void LimitVolumePerSfx(void)
     }
 
     // Find channels using the same sound and add up the total volume.
-    for (int cnum = 0; cnum < snd_channels; cnum++)
+    for (int i = 0; i < numplaying; i++)
     {
-        channel_t *c = &channels[cnum];
+        channel_t *c = &channels[chanheap[i]];
         sfxinfo_t *sfx = c->sfxinfo;
 
         if (sfx && sfx->active.count > 1 && c->origin)
@@ -370,9 +595,9 @@ static void LimitVolumePerSfx(void)
 
     // If the total volume of a sound is too loud, reduce the volume of each
     // channel playing that sound.
-    for (int cnum = 0; cnum < snd_channels; cnum++)
+    for (int i = 0; i < numplaying; i++)
     {
-        channel_t *c = &channels[cnum];
+        channel_t *c = &channels[chanheap[i]];
         sfxinfo_t *sfx = c->sfxinfo;
 
         if (sfx && sfx->active.volume > max_volume_per_sfx)
@@ -388,9 +613,9 @@ static void LimitVolumePerSfx(void)
 static float GetAmbientSoundOffset(sfxinfo_t *sfxinfo, ambient_t *ambient)
 {
     // If another source is playing the same sound, then sync the offsets.
-    for (int cnum = 0; cnum < snd_channels; cnum++)
+    for (int i = 0; i < numplaying; i++)
     {
-        channel_t *c = &channels[cnum];
+        channel_t *c = &channels[chanheap[i]];
         sfxinfo_t *sfx = c->sfxinfo;
 
         if (c->ambient && c->ambient != ambient && sfx == sfxinfo)
@@ -483,7 +708,8 @@ static boolean StartSoundEx(const mobj_t *origin, int sfx_id,
     // Check to see if it is audible, modify the params
     // killough 3/7/98, 4/25/98: code rearranged slightly
 
-    if (!S_AdjustSoundParams(players[displayplayer].mo, origin, &params))
+    if (OutOfRange(players[displayplayer].mo, origin, params.stop_dist)
+        || !S_AdjustSoundParams(players[displayplayer].mo, origin, &params))
     {
         return false;
     }
@@ -495,7 +721,7 @@ static boolean StartSoundEx(const mobj_t *origin, int sfx_id,
     }
 
 #ifdef RANGECHECK
-    if (cnum < 0 || cnum >= snd_channels)
+    if (cnum < 0 || cnum >= numchannels)
     {
         I_Error("handle %d out of range\n", cnum);
     }
@@ -530,7 +756,9 @@ static boolean StartSoundEx(const mobj_t *origin, int sfx_id,
         channels[cnum].priority = params.priority; // scaled priority
         channels[cnum].singularity = singularity;
         channels[cnum].volume = params.volume;
+        IndexChannel(cnum);
         channels[cnum].sfxinfo->active.count++;
+        HeapInsert(cnum);
         LimitVolumePerSfx();
 
         if (rumble_type != RUMBLE_NONE)
@@ -542,6 +770,7 @@ static boolean StartSoundEx(const mobj_t *origin, int sfx_id,
     else // haleyjd: the sound didn't start, so clear the channel info
     {
         memset(&channels[cnum], 0, sizeof(channel_t));
+        freechans[numfree++] = cnum;
         return false;
     }
 
@@ -690,13 +919,11 @@ void S_StopSound(const mobj_t *origin)
         return;
     }
 
-    for (cnum = 0; cnum < snd_channels; ++cnum)
+    cnum = FindOriginChannel(origin);
+
+    if (cnum >= 0)
     {
-        if (channels[cnum].sfxinfo && channels[cnum].origin == origin)
-        {
-            S_StopChannel(cnum);
-            break;
-        }
+        S_StopChannel(cnum);
     }
 }
 
@@ -707,7 +934,7 @@ void S_StopAmbientSounds(void)
         return;
     }
 
-    for (int cnum = 0; cnum < snd_channels; cnum++)
+    for (int cnum = 0; cnum < numchannels; cnum++)
     {
         if (channels[cnum].ambient)
         {
@@ -723,8 +950,10 @@ void S_MarkSounds(void)
         return;
     }
 
-    for (int cnum = 0; cnum < snd_channels; cnum++)
+    for (int i = 0; i < numplaying; i++)
     {
+        const int cnum = chanheap[i];
+
         if (channels[cnum].ambient)
         {
             P_MarkAmbientSound(channels[cnum].ambient, channels[cnum].handle);
@@ -747,18 +976,19 @@ void S_UnlinkSound(mobj_t *origin)
 
     if (origin)
     {
-        for (cnum = 0; cnum < snd_channels; cnum++)
+        cnum = FindOriginChannel(origin);
+
+        if (cnum >= 0)
         {
-            if (channels[cnum].sfxinfo && channels[cnum].origin == origin)
-            {
-                mobj_t *const sobj = &sobjs[cnum];
-                sobj->x = origin->x;
-                sobj->y = origin->y;
-                sobj->z = origin->z;
-                sobj->info = origin->info;
-                channels[cnum].origin = sobj;
-                break;
-            }
+            mobj_t *const sobj = &sobjs[cnum];
+            sobj->x = origin->x;
+            sobj->y = origin->y;
+            sobj->z = origin->z;
+            sobj->info = origin->info;
+
+            UnlinkChannel(originlinks, OriginChain(origin), cnum);
+            channels[cnum].origin = sobj;
+            LinkChannel(originlinks, OriginChain(sobj), cnum);
         }
     }
 }
@@ -772,12 +1002,9 @@ void S_PauseSound(void)
 
     I_DeferSoundUpdates();
 
-    for (int cnum = 0; cnum < snd_channels; cnum++)
+    for (int i = 0; i < numplaying; i++)
     {
-        if (channels[cnum].sfxinfo)
-        {
-            I_PauseSound(channels[cnum].handle);
-        }
+        I_PauseSound(channels[chanheap[i]].handle);
     }
 
     I_ProcessSoundUpdates();
@@ -792,12 +1019,9 @@ void S_ResumeSound(void)
 
     I_DeferSoundUpdates();
 
-    for (int cnum = 0; cnum < snd_channels; cnum++)
+    for (int i = 0; i < numplaying; i++)
     {
-        if (channels[cnum].sfxinfo)
-        {
-            I_ResumeSound(channels[cnum].handle);
-        }
+        I_ResumeSound(channels[chanheap[i]].handle);
     }
 
     I_ProcessSoundUpdates();
@@ -843,7 +1067,8 @@ void S_InitListener(const mobj_t *listener)
 
 void S_UpdateSounds(const mobj_t *listener)
 {
-    int cnum;
+    int playing[MAX_CHANNELS];
+    int numchecked;
 
     // jff 1/22/98 return if sound is not enabled
     if (nosfxparm)
@@ -854,8 +1079,13 @@ void S_UpdateSounds(const mobj_t *listener)
     I_DeferSoundUpdates();
     I_UpdateListenerParams(listener);
 
-    for (cnum = 0; cnum < snd_channels; ++cnum)
+    // the channels that stop are removed from the heap
+    numchecked = numplaying;
+    memcpy(playing, chanheap, numchecked * sizeof(*playing));
+
+    for (int i = 0; i < numchecked; i++)
     {
+        const int cnum = playing[i];
         channel_t *c = &channels[cnum];
         sfxinfo_t *sfx = c->sfxinfo;
 
@@ -876,7 +1106,8 @@ void S_UpdateSounds(const mobj_t *listener)
                     params.volume_scale = c->volume_scale;
                     params.priority = c->o_priority; // haleyjd 09/27/06: priority
 
-                    if (S_AdjustSoundParams(listener, c->origin, &params))
+                    if (!OutOfRange(listener, c->origin, params.stop_dist)
+                        && S_AdjustSoundParams(listener, c->origin, &params))
                     {
                         I_UpdateSoundParams(c->handle, &params);
                         c->priority = params.priority; // haleyjd
@@ -898,6 +1129,9 @@ void S_UpdateSounds(const mobj_t *listener)
         }
     }
 
+    // the priorities have changed with the distances
+    HeapRebuild();
+
     LimitVolumePerSfx();
     I_ProcessSoundUpdates();
     I_UpdateRumble();
@@ -1135,7 +1369,7 @@ void S_Start(void)
     // jff 1/22/98 skip sound init if sound not enabled
     if (!nosfxparm)
     {
-        for (cnum = 0; cnum < snd_channels; ++cnum)
+        for (cnum = 0; cnum < numchannels; ++cnum)
         {
             if (channels[cnum].sfxinfo)
             {
@@ -1184,6 +1418,197 @@ void S_Start(void)
     S_ChangeMusic(mnum, true);
 }
 
+//
+// S_PreloadLevelSounds
+//
+// [Woof!] Caches the sounds of the things in the level, of the weapons, of
+// the projectiles they fire and of the states they can enter, so that none
+// of them is still being decoded in the background when it is first played.
+//
+
+typedef struct
+{
+    byte *mobj_hit;
+    byte *state_hit;
+    byte *sfx_hit;
+} preload_t;
+
+// Sounds and projectiles of the weapon codepointers that hardcode them.
+
+static const struct
+{
+    actionf_p2 action;
+    int sfx_id;
+    mobjtype_t type;
+} weapon_sounds[] =
+{
+    {A_Punch,         sfx_punch,  MT_NULL   },
+    {A_Saw,           sfx_sawup,  MT_NULL   },
+    {A_Saw,           sfx_sawidl, MT_NULL   },
+    {A_Saw,           sfx_sawful, MT_NULL   },
+    {A_Saw,           sfx_sawhit, MT_NULL   },
+    {A_FirePistol,    sfx_pistol, MT_NULL   },
+    {A_FireShotgun,   sfx_shotgn, MT_NULL   },
+    {A_FireShotgun2,  sfx_dshtgn, MT_NULL   },
+    {A_OpenShotgun2,  sfx_dbopn,  MT_NULL   },
+    {A_LoadShotgun2,  sfx_dbload, MT_NULL   },
+    {A_CloseShotgun2, sfx_dbcls,  MT_NULL   },
+    {A_FireCGun,      sfx_pistol, MT_NULL   },
+    {A_FireMissile,   sfx_None,   MT_ROCKET },
+    {A_FirePlasma,    sfx_None,   MT_PLASMA },
+    {A_FireBFG,       sfx_None,   MT_BFG    },
+    {A_FireOldBFG,    sfx_None,   MT_PLASMA1},
+    {A_FireOldBFG,    sfx_None,   MT_PLASMA2},
+    {A_BFGsound,      sfx_bfg,    MT_NULL   },
+};
+
+static void MarkSound(preload_t *preload, int sfx_id)
+{
+    if (sfx_id > 0 && sfx_id < num_sfx)
+    {
+        preload->sfx_hit[sfx_id] = 1;
+    }
+}
+
+static void MarkMobjSounds(preload_t *preload, int type);
+
+static void MarkStateSounds(preload_t *preload, int state)
+{
+    while (state > 0 && state < num_states && !preload->state_hit[state])
+    {
+        const state_t *st = &states[state];
+
+        preload->state_hit[state] = 1;
+
+        if (st->action.p1 == A_PlaySound)
+        {
+            MarkSound(preload, st->misc1);
+        }
+        else if (st->action.p2 == A_WeaponSound)
+        {
+            MarkSound(preload, st->args[0]);
+        }
+        else if (st->action.p2 == A_WeaponMeleeAttack)
+        {
+            MarkSound(preload, st->args[3]);
+        }
+        else if (st->action.p2 == A_WeaponProjectile)
+        {
+            MarkMobjSounds(preload, st->args[0] - 1);
+        }
+        else if (st->action.p2 == A_WeaponJump
+                 || st->action.p2 == A_GunFlashTo
+                 || st->action.p2 == A_CheckAmmo
+                 || st->action.p2 == A_RefireTo)
+        {
+            MarkStateSounds(preload, st->args[0]);
+        }
+        else
+        {
+            for (int i = 0; i < arrlen(weapon_sounds); ++i)
+            {
+                if (st->action.p2 == weapon_sounds[i].action)
+                {
+                    MarkSound(preload, weapon_sounds[i].sfx_id);
+                    MarkMobjSounds(preload, weapon_sounds[i].type);
+                }
+            }
+        }
+
+        state = st->nextstate;
+    }
+}
+
+static void MarkMobjSounds(preload_t *preload, int type)
+{
+    const mobjinfo_t *info;
+
+    if (type < 0 || type >= num_mobj_types || preload->mobj_hit[type])
+    {
+        return;
+    }
+
+    preload->mobj_hit[type] = 1;
+    info = &mobjinfo[type];
+
+    MarkSound(preload, info->seesound);
+    MarkSound(preload, info->attacksound);
+    MarkSound(preload, info->painsound);
+    MarkSound(preload, info->deathsound);
+    MarkSound(preload, info->activesound);
+    MarkSound(preload, info->ripsound);
+
+    MarkStateSounds(preload, info->spawnstate);
+    MarkStateSounds(preload, info->seestate);
+    MarkStateSounds(preload, info->painstate);
+    MarkStateSounds(preload, info->meleestate);
+    MarkStateSounds(preload, info->missilestate);
+    MarkStateSounds(preload, info->deathstate);
+    MarkStateSounds(preload, info->xdeathstate);
+    MarkStateSounds(preload, info->raisestate);
+}
+
+void S_PreloadLevelSounds(void)
+{
+    preload_t preload;
+    sfxinfo_t **sounds = NULL;
+    thinker_t *th;
+    int i;
+
+    if (nosfxparm)
+    {
+        return;
+    }
+
+    preload.mobj_hit = Z_Calloc(num_mobj_types, 1, PU_STATIC, NULL);
+    preload.state_hit = Z_Calloc(num_states, 1, PU_STATIC, NULL);
+    preload.sfx_hit = Z_Calloc(num_sfx, 1, PU_STATIC, NULL);
+
+    for (th = thinkercap.next; th != &thinkercap; th = th->next)
+    {
+        if (th->function.p1 == P_MobjThinker)
+        {
+            MarkMobjSounds(&preload, ((mobj_t *)th)->type);
+        }
+    }
+
+    for (i = 0; i < NUMWEAPONS; ++i)
+    {
+        const weaponinfo_t *weapon = &weaponinfo[i];
+
+        MarkStateSounds(&preload, weapon->upstate);
+        MarkStateSounds(&preload, weapon->downstate);
+        MarkStateSounds(&preload, weapon->readystate);
+        MarkStateSounds(&preload, weapon->atkstate);
+        MarkStateSounds(&preload, weapon->flashstate);
+    }
+
+    for (i = 1; i < num_sfx; ++i)
+    {
+        sfxinfo_t *sfx = &S_sfx[i];
+
+        // DEHEXTRA has turned S_sfx into a sparse array
+        if (!preload.sfx_hit[i] || !sfx->name)
+        {
+            continue;
+        }
+
+        while (sfx->link)
+        {
+            sfx = sfx->link;
+        }
+
+        array_push(sounds, sfx);
+    }
+
+    I_PreloadSounds(sounds, array_size(sounds));
+
+    array_free(sounds);
+    Z_Free(preload.sfx_hit);
+    Z_Free(preload.state_hit);
+    Z_Free(preload.mobj_hit);
+}
+
 //
 // Initializes sound stuff, including volume
 // Sets channels, SFX and music volume,
@@ -1374,6 +1799,7 @@ void S_Init(int sfxVolume, int musicVolume)
         // Reset channel memory
         memset(channels, 0, sizeof(channels));
         memset(sobjs, 0, sizeof(sobjs));
+        ResetChannels();
     }
 
     S_SetMusicVolume(musicVolume);
@@ -45,6 +45,9 @@ void S_Init(int sfxVolume, int musicVolume);
 //
 void S_Start(void);
 
+// Caches the sounds the level will likely play.
+void S_PreloadLevelSounds(void);
+
 void S_EvictChannels(void);
 
 //
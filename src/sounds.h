@@ -51,6 +51,7 @@ typedef struct sfxactive_s
 {
   int count;      // Number of active channels using this sound.
   int volume;     // Volume of active channels using this sound.
+  int channel;    // [Woof!] First of them while count > 0, see s_sound.c.
 } sfxactive_t;
 
 typedef struct sfxinfo_s
@@ -93,6 +94,9 @@ typedef struct sfxinfo_s
 
   boolean cached;
 
+  // [Woof!] Is it being decoded in the background?
+  boolean decoding;
+
   sfxrumble_t rumble;
 
   sfxactive_t active;
@@ -36,6 +36,7 @@
 #include "m_misc.h"
 #include "mn_menu.h"
 #include "p_mobj.h"
+#include "p_profile.h"
 #include "p_spec.h"
 #include "r_main.h"
 #include "r_voxel.h"
@@ -935,6 +936,33 @@ static void UpdateFPS(sbe_widget_t *widget, player_t *player)
     ST_AddLine(widget, string);
 }
 
+#ifdef PLAYSIM_PROFILER
+static void UpdateProfile(sbe_widget_t *widget)
+{
+    static const char *names[NUMPROFILES] = {
+        "Players", "Monsters", "Mobjs",   "Specials",     "Sight",
+        "Paths",   "Position", "TryMove", "ChangeSector", "Sound"
+    };
+    static char lines[NUMPROFILES][60];
+
+    for (int i = 0; i < NUMPROFILES; i++)
+    {
+        double ms, calls;
+
+        if (!P_ProfileStats(i, &ms, &calls))
+        {
+            return;
+        }
+
+        // for the thinkers, the calls are how many of them there are
+        M_snprintf(lines[i], sizeof(lines[i]),
+                   GRAY_S "%12s " GREEN_S "%6.3f ms " GRAY_S "%7.0f", names[i],
+                   ms, calls);
+        ST_AddLine(widget, lines[i]);
+    }
+}
+#endif
+
 static void UpdateRate(sbe_widget_t *widget, player_t *player)
 {
     ST_ClearLines(widget);
@@ -959,6 +987,20 @@ static void UpdateRate(sbe_widget_t *widget, player_t *player)
                    rendered_voxels);
         ST_AddLine(widget, line2);
     }
+
+    if (dynamic_resolution)
+    {
+        const drs_stats_t drs = I_GetDRSStats();
+        static char line3[60];
+        M_snprintf(line3, sizeof(line3),
+                   GRAY_S "    DRS %3d%% %5.2f / %5.2f ms",
+                   (int)(drs.scale * 100.0 + 0.5), drs.predicted, drs.budget);
+        ST_AddLine(widget, line3);
+    }
+
+#ifdef PLAYSIM_PROFILER
+    UpdateProfile(widget);
+#endif
 }
 
 int speedometer;
@@ -24,6 +24,7 @@
 #include "m_swap.h"
 #include "w_internal.h"
 #include "w_wad.h"
+#include "z_zone.h"
 
 static int FileLength(int descriptor)
 {
@@ -86,6 +87,7 @@ static boolean W_FILE_AddDir(w_handle_t handle, const char *path,
         }
 
         I_Printf(VB_INFO, " adding %s", filename);
+        array_push(resourcefiles, M_StringDuplicate(filename));
 
         lumpinfo_t item = {0};
         W_ExtractFileBase(filename, item.name);
@@ -112,6 +114,48 @@ static boolean W_FILE_AddDir(w_handle_t handle, const char *path,
 
 static int *descriptors = NULL;
 
+typedef struct
+{
+    byte *data;
+    size_t length;
+} mapping_t;
+
+static mapping_t *mappings = NULL;
+
+// Lumps of memory-mapped WADs are read by copying from the mapping, and
+// W_CacheLumpNum() returns their data in place if it is aligned well enough
+// for the structures they contain.
+
+static void MapLumps(const char *path, lumpinfo_t *lumps, int count)
+{
+    mapping_t mapping;
+
+    mapping.data = M_MapFile(path, &mapping.length);
+
+    if (!mapping.data)
+    {
+        return;
+    }
+
+    array_push(mappings, mapping);
+    Z_AddExternal(mapping.data, mapping.length);
+
+    for (int i = 0; i < count; i++)
+    {
+        lumpinfo_t *lump = &lumps[i];
+        const int position = lump->handle.p2.position;
+
+        if (position < 0 || lump->size < 0
+            || (size_t)position + lump->size > mapping.length)
+        {
+            continue;
+        }
+
+        lump->data = mapping.data + position;
+        lump->mapped = lump->size > 0 && !(position & 3);
+    }
+}
+
 static w_type_t W_FILE_Open(const char *path, w_handle_t *handle)
 {
     if (M_DirExists(path))
@@ -127,6 +171,7 @@ static w_type_t W_FILE_Open(const char *path, w_handle_t *handle)
     }
 
     I_Printf(VB_INFO, " adding %s", path); // killough 8/8/98
+    array_push(resourcefiles, M_StringDuplicate(path));
 
     w_handle_t local_handle = {.p1.descriptor = descriptor,
                                .priority = handle->priority};
@@ -222,6 +267,9 @@ static w_type_t W_FILE_Open(const char *path, w_handle_t *handle)
         array_push(lumpinfo, item);
     }
 
+    MapLumps(path, &lumpinfo[array_size(lumpinfo) - header.numlumps],
+             header.numlumps);
+
     free(fileinfo);
     return W_FILE;
 }
@@ -242,6 +290,12 @@ static void W_FILE_Close(void)
     {
         close(descriptors[i]);
     }
+
+    for (int i = 0; i < array_size(mappings); ++i)
+    {
+        Z_RemoveExternal(mappings[i].data);
+        M_UnmapFile(mappings[i].data, mappings[i].length);
+    }
 }
 
 w_module_t w_file_module =
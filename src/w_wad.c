@@ -43,6 +43,10 @@ void        **lumpcache;      // killough
 
 const char  **wadfiles;
 
+// [Woof!] every file lumps are read from, so that caches built from them
+// can tell whether they changed
+const char  **resourcefiles;
+
 void W_ExtractFileBase(const char *path, char *dest)
 {
   const char *src;
@@ -511,7 +515,8 @@ void W_ReadLumpSize(int lump, void *dest, int size)
 
     if (info->data) // killough 1/31/98: predefined lump data
     {
-        memcpy(dest, info->data, size);
+        // [Woof!] don't read past a short lump, the callers pad the rest
+        memcpy(dest, info->data, MIN(size, info->size));
         return;
     }
 
@@ -539,10 +544,14 @@ void *W_CacheLumpNum(int lump, pu_tag tag)
     I_Error ("%i >= numlumps",lump);
 #endif
 
-  if (!lumpcache[lump])      // read the lump in
-    W_ReadLump(lump, Z_Malloc(W_LumpLength(lump), tag, &lumpcache[lump]));
-  else
+  if (lumpcache[lump])
     Z_ChangeTag(lumpcache[lump],tag);
+  else if (lumpinfo[lump].mapped)
+    // The pages of memory-mapped lumps are shared and can be dropped by the
+    // system like purgable blocks, so they are not copied
+    return (void *) lumpinfo[lump].data;
+  else                       // read the lump in
+    W_ReadLump(lump, Z_Malloc(W_LumpLength(lump), tag, &lumpcache[lump]));
 
   return lumpcache[lump];
 }
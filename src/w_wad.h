@@ -106,6 +106,9 @@ typedef struct
 
   // [FG] WAD file that contains the lump
   const char *wad_file;
+
+  // data points into a memory-mapped WAD and is used in place
+  boolean mapped;
 } lumpinfo_t;
 
 extern lumpinfo_t *lumpinfo;
@@ -113,6 +116,7 @@ extern int        numlumps;
 extern void       **lumpcache;
 
 extern const char **wadfiles;
+extern const char **resourcefiles;
 
 boolean W_InitBaseFile(const char *path);
 void W_AddBaseDir(const char *path);
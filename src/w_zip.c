@@ -16,26 +16,49 @@
 #include "doomtype.h"
 #include "i_printf.h"
 #include "m_array.h"
+#include "m_io.h"
 #include "m_misc.h"
 #include "m_swap.h"
 #include "w_wad.h"
 #include "w_internal.h"
+#include "z_zone.h"
 
 #include "miniz.h"
 
+#define LOCAL_HEADER_SIZE 30
+#define LOCAL_HEADER_SIG  0x04034b50
+
 typedef struct
 {
     int index;
     const char *filename;
 } record_t;
 
+// A deflated file read through the module.
+typedef struct
+{
+    int index; // of the file in the archive
+    int size;
+} entry_t;
+
 struct archive_s
 {
     mz_zip_archive *zip;
     record_t *directory;
+
+    // memory-mapped archive, stored files are used in place
+    byte *data;
+    size_t size;
+
+    entry_t *entries;
+
+    // Deflated WADs are decompressed in full when the archive is opened,
+    // their directory is usually at the end anyway, and their lumps are used
+    // in place.
+    byte **wads;
 };
 
-static archive_t *archives;
+static archive_t **archives;
 
 static void ConvertSlashes(char *path)
 {
@@ -48,18 +71,73 @@ static void ConvertSlashes(char *path)
     }
 }
 
-static void AddWadInMem(w_handle_t handle, const char *name, int index,
-                        size_t data_size)
+static void Extract(const archive_t *archive, int index, void *dest,
+                    size_t size)
 {
-    I_Printf(VB_INFO, " - adding %s", name);
+    if (!mz_zip_reader_extract_to_mem(archive->zip, index, dest, size, 0))
+    {
+        I_Error("mz_zip_reader_extract_to_mem failed");
+    }
+}
 
-    mz_zip_archive *zip = handle.p1.archive->zip;
+// Returns the data of a stored file in the mapping of its archive.
 
-    byte *data = malloc(data_size);
+static const byte *StoredData(const archive_t *archive,
+                              const mz_zip_archive_file_stat *stat)
+{
+    const byte *header;
+    size_t offset;
 
-    if (!mz_zip_reader_extract_to_mem(zip, index, data, data_size, 0))
+    if (!archive->data || stat->m_method || stat->m_is_encrypted
+        || stat->m_comp_size != stat->m_uncomp_size
+        || stat->m_local_header_ofs + LOCAL_HEADER_SIZE > archive->size)
     {
-        I_Error("mz_zip_reader_extract_to_mem failed");
+        return NULL;
+    }
+
+    header = archive->data + stat->m_local_header_ofs;
+
+    if ((header[0] | header[1] << 8 | header[2] << 16
+         | (uint32_t)header[3] << 24) != LOCAL_HEADER_SIG)
+    {
+        return NULL;
+    }
+
+    // file name and extra field lengths
+    offset = stat->m_local_header_ofs + LOCAL_HEADER_SIZE
+             + (header[26] | header[27] << 8) + (header[28] | header[29] << 8);
+
+    if (offset + stat->m_uncomp_size > archive->size)
+    {
+        return NULL;
+    }
+
+    return archive->data + offset;
+}
+
+static int AddEntry(archive_t *archive, int index, int size)
+{
+    entry_t entry = {index, size};
+    array_push(archive->entries, entry);
+    return array_size(archive->entries) - 1;
+}
+
+static void AddWad(w_handle_t handle, const char *name,
+                   const mz_zip_archive_file_stat *stat)
+{
+    I_Printf(VB_INFO, " - adding %s", name);
+
+    archive_t *archive = handle.p1.archive;
+    const byte *data = StoredData(archive, stat);
+    const size_t data_size = stat->m_uncomp_size;
+
+    if (!data)
+    {
+        byte *wad = malloc(data_size);
+        Extract(archive, stat->m_file_index, wad, data_size);
+        Z_AddExternal(wad, data_size);
+        array_push(archive->wads, wad);
+        data = wad;
     }
 
     wadinfo_t header;
@@ -81,19 +159,20 @@ static void AddWadInMem(w_handle_t handle, const char *name, int index,
     if (header.numlumps == 0)
     {
         I_Printf(VB_WARNING, "Wad file %s is empty", name);
-        free(data);
         return;
     }
 
     header.infotableofs = LONG(header.infotableofs);
-    if (header.infotableofs + header.numlumps * sizeof(filelump_t) > data_size)
+    const size_t length = header.numlumps * sizeof(filelump_t);
+    if (header.numlumps < 0 || header.infotableofs < 0
+        || header.infotableofs + length > data_size)
     {
         I_Printf(VB_WARNING, "Error seeking offset from %s", name);
-        free(data);
         return;
     }
 
-    filelump_t *fileinfo = (filelump_t *)(data + header.infotableofs);
+    filelump_t *fileinfo = malloc(length);
+    memcpy(fileinfo, data + header.infotableofs, length);
 
     const char *wadname = M_StringDuplicate(name);
     array_push(wadfiles, wadname);
@@ -106,19 +185,21 @@ static void AddWadInMem(w_handle_t handle, const char *name, int index,
         M_CopyLumpName(item.name, fileinfo[i].name);
         int size = LONG(fileinfo[i].size);
         int position = LONG(fileinfo[i].filepos);
-        if (position + size > data_size)
+        if (position < 0 || size < 0 || (size_t)position + size > data_size)
         {
             I_Error("Error reading lump %d from %s", i, wadname);
         }
         item.size = size;
         item.data = data + position;
-
+        item.mapped = size > 0 && !((uintptr_t)item.data & 3);
         item.handle = handle;
- 
+
         // [FG] WAD file that contains the lump
         item.wad_file = wadname;
         array_push(lumpinfo, item);
     }
+
+    free(fileinfo);
 }
 
 static boolean W_ZIP_AddDir(w_handle_t handle, const char *path,
@@ -157,8 +238,7 @@ static boolean W_ZIP_AddDir(w_handle_t handle, const char *path,
 
         if (is_root && M_StringCaseEndsWith(record.filename, ".wad"))
         {
-            AddWadInMem(handle, M_BaseName(record.filename), record.index,
-                        stat.m_uncomp_size);
+            AddWad(handle, M_BaseName(record.filename), &stat);
             continue;
         }
 
@@ -179,10 +259,18 @@ static boolean W_ZIP_AddDir(w_handle_t handle, const char *path,
 
         item.module = &w_zip_module;
         w_handle_t local_handle = {.p1.archive = archive,
-                                   .p2.index = record.index,
+                                   .p2.index = AddEntry(archive, record.index,
+                                                        item.size),
                                    .priority = handle.priority};
         item.handle = local_handle;
 
+        const byte *data = StoredData(archive, &stat);
+        if (data)
+        {
+            item.data = data;
+            item.mapped = item.size > 0 && !((uintptr_t)data & 3);
+        }
+
         array_push(lumpinfo, item);
         numlumps++;
     }
@@ -207,8 +295,20 @@ static int compare_records(const void *a, const void *b)
 static w_type_t W_ZIP_Open(const char *path, w_handle_t *handle)
 {
     mz_zip_archive *zip = calloc(1, sizeof(*zip));
+    size_t size = 0;
+    byte *data = M_MapFile(path, &size);
 
-    if (!mz_zip_reader_init_file(zip, path, MZ_ZIP_FLAG_DO_NOT_SORT_CENTRAL_DIRECTORY))
+    if (data)
+    {
+        if (!mz_zip_reader_init_mem(zip, data, size,
+                                    MZ_ZIP_FLAG_DO_NOT_SORT_CENTRAL_DIRECTORY))
+        {
+            M_UnmapFile(data, size);
+            free(zip);
+            return W_NONE;
+        }
+    }
+    else if (!mz_zip_reader_init_file(zip, path, MZ_ZIP_FLAG_DO_NOT_SORT_CENTRAL_DIRECTORY))
     {
         free(zip);
         return W_NONE;
@@ -227,22 +327,40 @@ static w_type_t W_ZIP_Open(const char *path, w_handle_t *handle)
     qsort(directory, num_files, sizeof(*directory), compare_records);
 
     I_Printf(VB_INFO, " adding %s", path);
+    array_push(resourcefiles, M_StringDuplicate(path));
+
+    if (data)
+    {
+        Z_AddExternal(data, size);
+    }
 
-    archive_t archive = {zip, directory};
+    archive_t *archive = calloc(1, sizeof(*archive));
+    archive->zip = zip;
+    archive->directory = directory;
+    archive->data = data;
+    archive->size = size;
     array_push(archives, archive);
-    handle->p1.archive = array_end(archives) - 1;
+    handle->p1.archive = archive;
 
     return W_DIR;
 }
 
 static void W_ZIP_Read(w_handle_t handle, void *dest, int size)
 {
-    boolean result = mz_zip_reader_extract_to_mem(
-        handle.p1.archive->zip, handle.p2.index, dest, size, 0);
+    const archive_t *archive = handle.p1.archive;
+    const entry_t *entry = &archive->entries[handle.p2.index];
 
-    if (!result)
+    // callers pad a short lump, e.g. REJECT, themselves
+    if (size >= entry->size)
     {
-        I_Error("mz_zip_reader_extract_to_mem failed");
+        Extract(archive, entry->index, dest, entry->size);
+    }
+    else
+    {
+        byte *buffer = malloc(entry->size);
+        Extract(archive, entry->index, buffer, entry->size);
+        memcpy(dest, buffer, size);
+        free(buffer);
     }
 }
 
@@ -250,7 +368,21 @@ static void W_ZIP_Close(void)
 {
     for (int i = 0; i < array_size(archives); ++i)
     {
-        mz_zip_reader_end(archives[i].zip);
+        archive_t *archive = archives[i];
+
+        mz_zip_reader_end(archive->zip);
+
+        for (int j = 0; j < array_size(archive->wads); ++j)
+        {
+            Z_RemoveExternal(archive->wads[j]);
+            free(archive->wads[j]);
+        }
+
+        if (archive->data)
+        {
+            Z_RemoveExternal(archive->data);
+            M_UnmapFile(archive->data, archive->size);
+        }
     }
 }
 
@@ -50,6 +50,51 @@ static const size_t HEADER_SIZE = (sizeof(memblock_t)+CHUNK_SIZE-1) & ~(CHUNK_SI
 
 static memblock_t *blockbytag[PU_MAX];
 
+// Memory owned by others, such as memory-mapped WAD lumps, which may be
+// passed to the zone functions in place of blocks and is left alone.
+
+typedef struct
+{
+  const char *start, *end;
+} external_t;
+
+static external_t *externals;
+static int numexternals;
+
+void Z_AddExternal(const void *start, size_t size)
+{
+  externals = I_Realloc(externals, (numexternals + 1) * sizeof(*externals));
+  externals[numexternals].start = start;
+  externals[numexternals].end = (const char *) start + size;
+  numexternals++;
+}
+
+void Z_RemoveExternal(const void *start)
+{
+  int i;
+
+  for (i = 0; i < numexternals; i++)
+    if (externals[i].start == start)
+    {
+      externals[i] = externals[--numexternals];
+      break;
+    }
+}
+
+static const external_t *FindExternal(const void *ptr)
+{
+  int i;
+
+  for (i = 0; i < numexternals; i++)
+    if ((const char *) ptr >= externals[i].start
+        && (const char *) ptr < externals[i].end)
+      return &externals[i];
+
+  return NULL;
+}
+
+#define IsExternal(ptr) (numexternals && FindExternal(ptr))
+
 // Z_Malloc
 // You can pass a NULL user if the tag is < PU_CACHE.
 
@@ -98,7 +143,7 @@ void Z_Free(void *p)
 {
   memblock_t *block;
 
-  if (!p)
+  if (!p || IsExternal(p))
     return;
 
   block = (memblock_t *)((char *) p - HEADER_SIZE);
@@ -147,7 +192,7 @@ void Z_ChangeTag(void *ptr, pu_tag tag)
   memblock_t *block = (memblock_t *)((char *) ptr - HEADER_SIZE);
 
   // proff - added sanity check, this can happen when an empty lump is locked
-  if (!ptr)
+  if (!ptr || IsExternal(ptr))
     return;
 
   // proff - do nothing if tag doesn't differ
@@ -184,10 +229,33 @@ void Z_ChangeTag(void *ptr, pu_tag tag)
   block->tag = tag;
 }
 
+// Sets the owner of a block, which is nullified when the block is freed.
+
+void Z_ChangeUser(void *ptr, void **user)
+{
+  memblock_t *block = (memblock_t *)((char *) ptr - HEADER_SIZE);
+
+  if (IsExternal(ptr))
+    return;
+
+  if (block->id != ZONEID)
+    I_Error ("changed the user of a pointer without ZONEID");
+
+  block->user = user;
+  if (user)
+    *user = ptr;
+}
+
 void *Z_Realloc(void *ptr, size_t n, pu_tag tag, void **user)
 {
   void *p = Z_Malloc(n, tag, user);
-  if (ptr)
+  const external_t *external = ptr ? FindExternal(ptr) : NULL;
+  if (external)
+    {
+      size_t size = external->end - (const char *) ptr;
+      memcpy(p, ptr, n <= size ? n : size);
+    }
+  else if (ptr)
     {
       memblock_t *block = (memblock_t *)((char *) ptr - HEADER_SIZE);
       memcpy(p, ptr, n <= block->size ? n : block->size);
@@ -46,11 +46,15 @@ void *Z_Malloc(size_t size, pu_tag tag, void **ptr);
 void Z_Free(void *ptr);
 void Z_FreeTag(pu_tag tag);
 void Z_ChangeTag(void *ptr, pu_tag tag);
+void Z_ChangeUser(void *ptr, void **user);
 void *Z_Calloc(size_t n, size_t n2, pu_tag tag, void **user);
 void *Z_Realloc(void *p, size_t n, pu_tag tag, void **user);
 
 char *Z_StrDup(const char *orig, pu_tag tag);
 
+void Z_AddExternal(const void *start, size_t size);
+void Z_RemoveExternal(const void *start);
+
 #endif
 
 //----------------------------------------------------------------------------